@@ -0,0 +1,243 @@
+// Cooks a Wavefront OBJ model into a .vkmesh (see vke_mesh_format.h).
+//
+// Usage: VKE.Cooker -o <mesh> <model.obj>
+//   -o  output mesh
+//   Faces are triangulated as fans and every group is merged into one mesh. Corners without a normal get
+//   the smooth normal of their position; texture coordinates are flipped to Vulkan's top-left origin.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshCooker.h"
+
+namespace fs = std::filesystem;
+using namespace VKE;
+
+// One face corner: OBJ position, texture coordinate and normal indices, -1 when absent
+struct ObjCorner
+{
+	int32_t Position;
+	int32_t TexCoord;
+	int32_t Normal;
+
+	bool operator==(const ObjCorner& other) const
+	{
+		return Position == other.Position && TexCoord == other.TexCoord && Normal == other.Normal;
+	}
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& corner) const
+	{
+		uint64_t hash = (uint64_t)(uint32_t)corner.Position * 0x9E3779B97F4A7C15ull;
+		hash ^= (uint64_t)(uint32_t)corner.TexCoord * 0xC2B2AE3D27D4EB4Full + (hash << 6) + (hash >> 2);
+		hash ^= (uint64_t)(uint32_t)corner.Normal * 0x165667B19E3779F9ull + (hash << 6) + (hash >> 2);
+		return (size_t)hash;
+	}
+};
+
+// OBJ indices are 1-based, or negative to count back from the latest element
+static int32_t ResolveIndex(const char* text, size_t count)
+{
+	const long index = strtol(text, nullptr, 10);
+	if (index > 0 && (size_t)index <= count) {
+		return (int32_t)index - 1;
+	}
+	if (index < 0 && (size_t)-index <= count) {
+		return (int32_t)(count + index);
+	}
+	return -1;
+}
+
+static bool ParseCorner(const char* token, size_t positionCount, size_t texCoordCount, size_t normalCount, ObjCorner* corner)
+{
+	corner->Position = ResolveIndex(token, positionCount);
+	corner->TexCoord = -1;
+	corner->Normal = -1;
+	const char* slash = strchr(token, '/');
+	if (slash) {
+		if (slash[1] != '/') {
+			corner->TexCoord = ResolveIndex(slash + 1, texCoordCount);
+		}
+		const char* second = strchr(slash + 1, '/');
+		if (second) {
+			corner->Normal = ResolveIndex(second + 1, normalCount);
+		}
+	}
+	return corner->Position >= 0;
+}
+
+static bool LoadObj(const fs::path& path, std::vector<MeshCookerVertex>* vertices, std::vector<uint32_t>* indices)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		printf("Unable to read %s\n", path.string().c_str());
+		return false;
+	}
+
+	std::vector<float> positions;
+	std::vector<float> texCoords;
+	std::vector<float> normals;
+	std::vector<ObjCorner> corners;
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		const char* text = line.c_str();
+		if (strncmp(text, "v ", 2) == 0) {
+			float x = 0.0f, y = 0.0f, z = 0.0f;
+			sscanf(text + 2, "%f %f %f", &x, &y, &z);
+			positions.insert(positions.end(), { x, y, z });
+		}
+		else if (strncmp(text, "vt ", 3) == 0) {
+			float u = 0.0f, v = 0.0f;
+			sscanf(text + 3, "%f %f", &u, &v);
+			texCoords.insert(texCoords.end(), { u, 1.0f - v });
+		}
+		else if (strncmp(text, "vn ", 3) == 0) {
+			float x = 0.0f, y = 0.0f, z = 0.0f;
+			sscanf(text + 3, "%f %f %f", &x, &y, &z);
+			normals.insert(normals.end(), { x, y, z });
+		}
+		else if (strncmp(text, "f ", 2) == 0) {
+			// Fan triangulation
+			std::vector<ObjCorner> face;
+			std::istringstream tokens(line.substr(2));
+			std::string token;
+			while (tokens >> token) {
+				ObjCorner corner;
+				if (!ParseCorner(token.c_str(), positions.size() / 3, texCoords.size() / 2, normals.size() / 3, &corner)) {
+					printf("%s(%u): invalid face corner '%s'\n", path.string().c_str(), lineNumber, token.c_str());
+					return false;
+				}
+				face.push_back(corner);
+			}
+			for (size_t i = 2; i < face.size(); ++i) {
+				corners.insert(corners.end(), { face[0], face[i - 1], face[i] });
+			}
+		}
+	}
+
+	if (corners.empty()) {
+		printf("%s has no faces\n", path.string().c_str());
+		return false;
+	}
+
+	// Smooth normals per position for corners that have none, weighted by face area
+	std::vector<float> smoothNormals(positions.size(), 0.0f);
+	for (size_t i = 0; i < corners.size(); i += 3) {
+		const float* a = &positions[corners[i].Position * 3];
+		const float* b = &positions[corners[i + 1].Position * 3];
+		const float* c = &positions[corners[i + 2].Position * 3];
+		const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		const float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+		for (size_t corner = i; corner < i + 3; ++corner) {
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				smoothNormals[corners[corner].Position * 3 + axis] += normal[axis];
+			}
+		}
+	}
+
+	// One vertex per unique corner
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> lookup;
+	for (const ObjCorner& corner : corners) {
+		auto found = lookup.find(corner);
+		if (found != lookup.end()) {
+			indices->push_back(found->second);
+			continue;
+		}
+
+		MeshCookerVertex vertex = {};
+		memcpy(vertex.Position, &positions[corner.Position * 3], sizeof(vertex.Position));
+		const float* normal = corner.Normal >= 0 ? &normals[corner.Normal * 3] : &smoothNormals[corner.Position * 3];
+		const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (uint32_t axis = 0; axis < 3; ++axis) {
+			vertex.Normal[axis] = length > 0.0f ? normal[axis] / length : (axis == 2 ? 1.0f : 0.0f);
+		}
+		if (corner.TexCoord >= 0) {
+			memcpy(vertex.TexCoord, &texCoords[corner.TexCoord * 2], sizeof(vertex.TexCoord));
+		}
+
+		const uint32_t index = (uint32_t)vertices->size();
+		vertices->push_back(vertex);
+		lookup.emplace(corner, index);
+		indices->push_back(index);
+	}
+	return true;
+}
+
+static void PrintUsage()
+{
+	printf("Usage: VKE.Cooker -o <mesh> <model.obj>\n");
+}
+
+int main(int argc, const char** argv)
+{
+	const char* output = nullptr;
+	const char* input = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (argv[i][0] == '-' || input) {
+			PrintUsage();
+			return 1;
+		}
+		else {
+			input = argv[i];
+		}
+	}
+
+	if (!output || !input) {
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<MeshCookerVertex> vertices;
+	std::vector<uint32_t> indices;
+	if (!LoadObj(input, &vertices, &indices)) {
+		return 1;
+	}
+
+	std::vector<uint8_t> cooked;
+	MeshCookerStats stats = {};
+	if (!MeshCooker::Cook(vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size(), &cooked, &stats)) {
+		printf("Unable to cook %s\n", input);
+		return 1;
+	}
+
+	const fs::path tempOutput = std::string(output) + ".tmp";
+	std::ofstream file(tempOutput, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		printf("Unable to write %s\n", tempOutput.string().c_str());
+		return 1;
+	}
+	file.write(reinterpret_cast<const char*>(cooked.data()), cooked.size());
+	file.close();
+	if (file.fail()) {
+		printf("Failed writing %s\n", tempOutput.string().c_str());
+		return 1;
+	}
+
+	std::error_code error;
+	fs::rename(tempOutput, output, error);
+	if (error) {
+		printf("Unable to replace %s: %s\n", output, error.message().c_str());
+		return 1;
+	}
+
+	printf("Cooked %s into %s: %u triangles, %u vertices, ACMR %.3f -> %.3f, %u overdraw clusters, %llu bytes (%llu as floats)\n",
+		input, output, stats.TriangleCount, stats.VertexCount, stats.AcmrBefore, stats.AcmrAfter, stats.Clusters,
+		(unsigned long long)stats.CookedBytes, (unsigned long long)stats.SourceBytes);
+	return 0;
+}
@@ -0,0 +1,300 @@
+#include "Allocators.h"
+#include "Logger.h"
+#include "vke_memory.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Heap counter
+
+namespace VKE
+{
+	static std::atomic<uint64_t> g_heapAllocations(0);
+	static std::atomic<uint64_t> g_heapFrees(0);
+	static thread_local uint64_t t_heapAllocations = 0;
+
+	uint64_t HeapCounter::GetAllocations()
+	{
+		return g_heapAllocations.load(std::memory_order_relaxed);
+	}
+
+	uint64_t HeapCounter::GetFrees()
+	{
+		return g_heapFrees.load(std::memory_order_relaxed);
+	}
+
+	uint64_t HeapCounter::GetThreadAllocations()
+	{
+		return t_heapAllocations;
+	}
+
+	// With memory tracking, every allocation goes through the tracker and is charged to the thread's tag
+	static void* CountedMalloc(size_t size)
+	{
+		g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+		t_heapAllocations++;
+#ifdef ENABLE_MEMORY_TRACKING
+		return MemoryTracker::Allocate(size, alignof(std::max_align_t), MemoryTracker::GetThreadTag());
+#else
+		return std::malloc(size > 0 ? size : 1);
+#endif
+	}
+
+	static void* CountedAlignedMalloc(size_t size, size_t alignment)
+	{
+		g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+		t_heapAllocations++;
+#ifdef ENABLE_MEMORY_TRACKING
+		return MemoryTracker::Allocate(size, alignment, MemoryTracker::GetThreadTag());
+#else
+		size = size > 0 ? size : 1;
+#ifdef _MSC_VER
+		return _aligned_malloc(size, alignment);
+#else
+		void* pointer = nullptr;
+		return posix_memalign(&pointer, alignment, size) == 0 ? pointer : nullptr;
+#endif
+#endif
+	}
+
+	static void CountedFree(void* pointer)
+	{
+		if (pointer != nullptr) {
+			g_heapFrees.fetch_add(1, std::memory_order_relaxed);
+#ifdef ENABLE_MEMORY_TRACKING
+			MemoryTracker::Free(pointer);
+#else
+			std::free(pointer);
+#endif
+		}
+	}
+
+	static void CountedAlignedFree(void* pointer)
+	{
+		if (pointer != nullptr) {
+			g_heapFrees.fetch_add(1, std::memory_order_relaxed);
+#if defined(ENABLE_MEMORY_TRACKING)
+			MemoryTracker::Free(pointer);
+#elif defined(_MSC_VER)
+			_aligned_free(pointer);
+#else
+			std::free(pointer);
+#endif
+		}
+	}
+}
+
+// Every operator new in the program goes through the counter
+void* operator new(size_t size)
+{
+	void* pointer = VKE::CountedMalloc(size);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return VKE::CountedMalloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return VKE::CountedMalloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* pointer = VKE::CountedAlignedMalloc(size, (size_t)alignment);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return VKE::CountedAlignedMalloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return VKE::CountedAlignedMalloc(size, (size_t)alignment);
+}
+
+void operator delete(void* pointer) noexcept { VKE::CountedFree(pointer); }
+void operator delete[](void* pointer) noexcept { VKE::CountedFree(pointer); }
+void operator delete(void* pointer, size_t) noexcept { VKE::CountedFree(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { VKE::CountedFree(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { VKE::CountedFree(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { VKE::CountedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { VKE::CountedAlignedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { VKE::CountedAlignedFree(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { VKE::CountedAlignedFree(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { VKE::CountedAlignedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { VKE::CountedAlignedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { VKE::CountedAlignedFree(pointer); }
+
+namespace VKE
+{
+	static uintptr_t AlignUp(uintptr_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	}
+
+	// Linear arena
+
+	LinearArena::LinearArena(size_t capacity, const char* name)
+		: _name(name), _memory(nullptr), _capacity(capacity), _offset(0), _peak(0), _overflows(0)
+	{
+		ASSERT_MSG(capacity > 0, "Empty arena");
+		_memory = (uint8_t*)::operator new(capacity);
+		_overflowBlocks.reserve(16);
+	}
+
+	LinearArena::~LinearArena()
+	{
+		Reset();
+		::operator delete(_memory);
+	}
+
+	void* LinearArena::Allocate(size_t size, size_t alignment)
+	{
+		ASSERT_MSG(alignment > 0 && (alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+		const uintptr_t base = (uintptr_t)_memory;
+		size_t offset = _offset.load(std::memory_order_relaxed);
+		for (;;) {
+			const size_t aligned = (size_t)(AlignUp(base + offset, alignment) - base);
+			if (aligned + size > _capacity) {
+				return AllocateOverflow(size, alignment);
+			}
+			if (_offset.compare_exchange_weak(offset, aligned + size, std::memory_order_relaxed)) {
+				return _memory + aligned;
+			}
+		}
+	}
+
+	void* LinearArena::AllocateOverflow(size_t size, size_t alignment)
+	{
+		std::lock_guard<std::mutex> lock(_overflowMutex);
+		if (_overflows++ == 0) {
+			Logger::Warn("%s arena is full (%llu bytes), overflowing to the heap", _name, (unsigned long long)_capacity);
+		}
+
+		// The block keeps its own start so it can be freed after the returned pointer was aligned
+		void* block = ::operator new(size + alignment);
+		_overflowBlocks.push_back(block);
+		return (void*)AlignUp((uintptr_t)block, alignment);
+	}
+
+	LinearArenaMarker LinearArena::GetMarker() const
+	{
+		std::lock_guard<std::mutex> lock(_overflowMutex);
+		return { _offset.load(std::memory_order_relaxed), _overflowBlocks.size() };
+	}
+
+	void LinearArena::Rewind(const LinearArenaMarker& marker)
+	{
+		const size_t offset = _offset.load(std::memory_order_relaxed);
+		ASSERT_MSG(marker.Offset <= offset, "Arena rewound past its current offset");
+		_peak = std::max(_peak, offset);
+		_offset.store(marker.Offset, std::memory_order_relaxed);
+
+		// Blocks are appended in order, so the ones allocated since the marker are at the end
+		std::lock_guard<std::mutex> lock(_overflowMutex);
+		ASSERT_MSG(marker.OverflowBlocks <= _overflowBlocks.size(), "Arena rewound past its current overflow blocks");
+		for (size_t i = marker.OverflowBlocks; i < _overflowBlocks.size(); i++) {
+			::operator delete(_overflowBlocks[i]);
+		}
+		_overflowBlocks.resize(marker.OverflowBlocks);
+	}
+
+	void LinearArena::Reset()
+	{
+		Rewind({ 0, 0 });
+	}
+
+	// Scratch scope
+
+	static LinearArena& GetScratchArena()
+	{
+		// Created on the thread's first use and freed when it exits
+		static thread_local LinearArena arena(VKE_SCRATCH_ARENA_SIZE, "Scratch");
+		return arena;
+	}
+
+	ScratchScope::ScratchScope()
+		: _arena(&GetScratchArena()), _marker(_arena->GetMarker())
+	{
+	}
+
+	ScratchScope::~ScratchScope()
+	{
+		_arena->Rewind(_marker);
+	}
+
+	// Block pool
+
+	BlockPool::BlockPool(size_t blockSize, size_t alignment, uint32_t blocksPerPage)
+		: _blockSize(AlignUp(std::max(blockSize, sizeof(void*)), alignment)), _alignment(alignment), _blocksPerPage(blocksPerPage),
+		_freeList(nullptr), _used(0)
+	{
+		ASSERT_MSG(alignment > 0 && (alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+		ASSERT_MSG(blocksPerPage > 0, "Empty pool page");
+	}
+
+	BlockPool::~BlockPool()
+	{
+		ASSERT_MSG(_used == 0, "Block pool destroyed with blocks still in use");
+		for (void* page : _pages) {
+			::operator delete(page, std::align_val_t(_alignment));
+		}
+	}
+
+	void BlockPool::AddPage()
+	{
+		uint8_t* page = (uint8_t*)::operator new(_blockSize * _blocksPerPage, std::align_val_t(_alignment));
+		_pages.push_back(page);
+
+		// Thread the new blocks onto the free list in address order
+		for (uint32_t i = _blocksPerPage; i > 0; i--) {
+			void* block = page + (size_t)(i - 1) * _blockSize;
+			*(void**)block = _freeList;
+			_freeList = block;
+		}
+	}
+
+	void* BlockPool::Allocate()
+	{
+		if (_freeList == nullptr) {
+			AddPage();
+		}
+		void* block = _freeList;
+		_freeList = *(void**)block;
+		_used++;
+		return block;
+	}
+
+	void BlockPool::Free(void* block)
+	{
+		ASSERT(block != nullptr && _used > 0);
+		*(void**)block = _freeList;
+		_freeList = block;
+		_used--;
+	}
+}
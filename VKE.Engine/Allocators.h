@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "vke_assert.h"
+
+// Per thread, created on the thread's first ScratchScope
+#ifndef VKE_SCRATCH_ARENA_SIZE
+#define VKE_SCRATCH_ARENA_SIZE (1024 * 1024)
+#endif
+
+namespace VKE
+{
+	// Counts every operator new. Lets a frame prove it made no general heap allocations.
+	class HeapCounter
+	{
+	public:
+		// Across all threads
+		static uint64_t GetAllocations();
+		static uint64_t GetFrees();
+		// On the calling thread only
+		static uint64_t GetThreadAllocations();
+	};
+
+	// Bump allocator over one block reserved up front. Allocate is lock-free and safe from any thread;
+	// Rewind and Reset are for the owner only, when nobody else is allocating. Requests that don't fit go to
+	// the heap (and show up in HeapCounter) until the next Rewind or Reset, so an undersized arena is slow, not fatal.
+	// Where a LinearArena stood: its offset and how many heap blocks it had overflowed into
+	struct LinearArenaMarker
+	{
+		size_t Offset;
+		size_t OverflowBlocks;
+	};
+
+	class LinearArena
+	{
+	public:
+		explicit LinearArena(size_t capacity, const char* name = "Linear");
+		~LinearArena();
+
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+		template<typename T>
+		T* Allocate(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))); }
+
+		LinearArenaMarker GetMarker() const;
+		// Frees everything allocated after the marker was taken, heap blocks included
+		void Rewind(const LinearArenaMarker& marker);
+		void Reset();
+
+		size_t GetUsed() const { return _offset.load(std::memory_order_relaxed); }
+		size_t GetCapacity() const { return _capacity; }
+		size_t GetPeak() const { return _peak; }
+		uint64_t GetOverflows() const { return _overflows; }
+
+		LinearArena(const LinearArena&) = delete;
+		LinearArena& operator=(const LinearArena&) = delete;
+
+	private:
+		void* AllocateOverflow(size_t size, size_t alignment);
+
+		const char* _name;
+		uint8_t* _memory;
+		size_t _capacity;
+		std::atomic<size_t> _offset;
+		size_t _peak;
+
+		mutable std::mutex _overflowMutex;
+		std::vector<void*> _overflowBlocks;
+		uint64_t _overflows;
+	};
+
+	// Temporary memory on the calling thread's scratch stack, released when the scope closes. Scopes nest,
+	// and whatever is allocated from them must not outlive them.
+	class ScratchScope
+	{
+	public:
+		ScratchScope();
+		~ScratchScope();
+
+		LinearArena& GetArena() { return *_arena; }
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) { return _arena->Allocate(size, alignment); }
+		template<typename T>
+		T* Allocate(size_t count) { return _arena->Allocate<T>(count); }
+
+		ScratchScope(const ScratchScope&) = delete;
+		ScratchScope& operator=(const ScratchScope&) = delete;
+
+	private:
+		LinearArena* _arena;
+		LinearArenaMarker _marker;
+	};
+
+	// Fixed-size blocks carved from pages that are kept until the pool is destroyed. Not thread safe.
+	class BlockPool
+	{
+	public:
+		BlockPool(size_t blockSize, size_t alignment = alignof(std::max_align_t), uint32_t blocksPerPage = 256);
+		~BlockPool();
+
+		void* Allocate();
+		void Free(void* block);
+
+		size_t GetBlockSize() const { return _blockSize; }
+		uint32_t GetUsed() const { return _used; }
+		uint32_t GetCapacity() const { return (uint32_t)_pages.size() * _blocksPerPage; }
+
+		BlockPool(const BlockPool&) = delete;
+		BlockPool& operator=(const BlockPool&) = delete;
+
+	private:
+		void AddPage();
+
+		size_t _blockSize;
+		size_t _alignment;
+		uint32_t _blocksPerPage;
+		std::vector<void*> _pages;
+		void* _freeList;
+		uint32_t _used;
+	};
+
+	// Typed front end of a BlockPool
+	template<typename T>
+	class ObjectPool
+	{
+	public:
+		explicit ObjectPool(uint32_t objectsPerPage = 256)
+			: _pool(sizeof(T) < sizeof(void*) ? sizeof(void*) : sizeof(T), alignof(T), objectsPerPage)
+		{
+		}
+
+		template<typename... Args>
+		T* New(Args&&... args) { return new (_pool.Allocate()) T(std::forward<Args>(args)...); }
+
+		void Delete(T* object)
+		{
+			object->~T();
+			_pool.Free(object);
+		}
+
+		uint32_t GetUsed() const { return _pool.GetUsed(); }
+
+	private:
+		BlockPool _pool;
+	};
+
+	// STL allocator over a LinearArena, e.g. a ScratchScope's. Deallocation is a no-op; the
+	// memory comes back when the arena is reset or rewound.
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		typedef T value_type;
+
+		explicit ArenaAllocator(LinearArena& arena) : _arena(&arena) {}
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.GetArena()) {}
+
+		T* allocate(size_t count) { return _arena->Allocate<T>(count); }
+		void deallocate(T*, size_t) {}
+
+		LinearArena* GetArena() const { return _arena; }
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const { return _arena == other.GetArena(); }
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const { return _arena != other.GetArena(); }
+
+	private:
+		LinearArena* _arena;
+	};
+
+	// STL allocator for node containers (list, map, set) over a BlockPool whose blocks fit one node. Larger
+	// requests, such as hash table buckets, go to the heap.
+	template<typename T>
+	class PoolAllocator
+	{
+	public:
+		typedef T value_type;
+
+		explicit PoolAllocator(BlockPool& pool) : _pool(&pool) {}
+		template<typename U>
+		PoolAllocator(const PoolAllocator<U>& other) : _pool(other.GetPool()) {}
+
+		T* allocate(size_t count)
+		{
+			if (count == 1 && sizeof(T) <= _pool->GetBlockSize()) {
+				return static_cast<T*>(_pool->Allocate());
+			}
+			return static_cast<T*>(::operator new(sizeof(T) * count));
+		}
+
+		void deallocate(T* pointer, size_t count)
+		{
+			if (count == 1 && sizeof(T) <= _pool->GetBlockSize()) {
+				_pool->Free(pointer);
+				return;
+			}
+			::operator delete(pointer);
+		}
+
+		BlockPool* GetPool() const { return _pool; }
+
+		template<typename U>
+		bool operator==(const PoolAllocator<U>& other) const { return _pool == other.GetPool(); }
+		template<typename U>
+		bool operator!=(const PoolAllocator<U>& other) const { return _pool != other.GetPool(); }
+
+	private:
+		BlockPool* _pool;
+	};
+
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
@@ -0,0 +1,148 @@
+#include "AssetArchive.h"
+#include "Compression.h"
+#include "Logger.h"
+#include "vke_hash.h"
+#include "vke_profile.h"
+
+#include <cstring>
+#include <vector>
+
+namespace VKE
+{
+	AssetArchive::AssetArchive()
+		: _header(nullptr), _entries(nullptr), _names(nullptr)
+	{
+	}
+
+	AssetArchive::~AssetArchive()
+	{
+		Close();
+	}
+
+	bool AssetArchive::Open(const char* path)
+	{
+		PROFILE_FUNCTION();
+		Close();
+
+		if (!Platform::MapFile(path, &_file)) {
+			return false;
+		}
+
+		const uint8_t* base = static_cast<const uint8_t*>(_file.Data);
+		const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(base);
+		if (_file.Size < sizeof(ArchiveHeader) || header->Magic != ARCHIVE_MAGIC || header->Version != ARCHIVE_VERSION ||
+			header->FileSize != _file.Size) {
+			Logger::Error("%s is not a valid asset archive", path);
+			Close();
+			return false;
+		}
+
+		const uint64_t entriesSize = (uint64_t)header->EntryCount * sizeof(ArchiveEntry);
+		if (header->EntriesOffset % alignof(ArchiveEntry) != 0 || header->EntriesOffset + entriesSize > _file.Size ||
+			header->NamesOffset + header->NamesSize > _file.Size) {
+			Logger::Error("Asset archive %s has a corrupt table of contents", path);
+			Close();
+			return false;
+		}
+
+		const ArchiveEntry* entries = reinterpret_cast<const ArchiveEntry*>(base + header->EntriesOffset);
+		for (uint32_t i = 0; i < header->EntryCount; ++i) {
+			if (entries[i].Offset + entries[i].StoredSize > _file.Size || entries[i].NameOffset >= header->NamesSize) {
+				Logger::Error("Asset archive %s has an entry outside the file", path);
+				Close();
+				return false;
+			}
+			// Uncompressed entries are read straight from the mapping, Size bytes of it
+			if (!(entries[i].Flags & ARCHIVE_ENTRY_COMPRESSED) && entries[i].Size != entries[i].StoredSize) {
+				Logger::Error("Asset archive %s has an uncompressed entry whose size doesn't match its stored size", path);
+				Close();
+				return false;
+			}
+		}
+
+		_header = header;
+		_entries = entries;
+		_names = reinterpret_cast<const char*>(base + header->NamesOffset);
+
+		Logger::Info("Mapped asset archive %s (%u entries, %llu bytes)", path, _header->EntryCount, (unsigned long long)_file.Size);
+		return true;
+	}
+
+	void AssetArchive::Close()
+	{
+		Platform::UnmapFile(&_file);
+		_header = nullptr;
+		_entries = nullptr;
+		_names = nullptr;
+	}
+
+	const ArchiveEntry* AssetArchive::Find(const char* name) const
+	{
+		if (!_header) {
+			return nullptr;
+		}
+
+		const uint64_t hash = HashBytes(name, strlen(name));
+
+		// Entries are sorted by name hash
+		uint32_t low = 0;
+		uint32_t high = _header->EntryCount;
+		while (low < high) {
+			const uint32_t mid = low + (high - low) / 2;
+			if (_entries[mid].NameHash < hash) {
+				low = mid + 1;
+			}
+			else {
+				high = mid;
+			}
+		}
+
+		for (uint32_t i = low; i < _header->EntryCount && _entries[i].NameHash == hash; ++i) {
+			if (strcmp(GetName(&_entries[i]), name) == 0) {
+				return &_entries[i];
+			}
+		}
+		return nullptr;
+	}
+
+	const char* AssetArchive::GetName(const ArchiveEntry* entry) const
+	{
+		return _names + entry->NameOffset;
+	}
+
+	const void* AssetArchive::GetMappedData(const ArchiveEntry* entry) const
+	{
+		if (entry->Flags & ARCHIVE_ENTRY_COMPRESSED) {
+			return nullptr;
+		}
+		return static_cast<const uint8_t*>(_file.Data) + entry->Offset;
+	}
+
+	bool AssetArchive::Read(const ArchiveEntry* entry, void* dst) const
+	{
+		PROFILE_FUNCTION();
+
+		const uint8_t* stored = static_cast<const uint8_t*>(_file.Data) + entry->Offset;
+		if (entry->Flags & ARCHIVE_ENTRY_COMPRESSED) {
+			if (!Compression::Lz4Decompress(stored, entry->StoredSize, static_cast<uint8_t*>(dst), entry->Size)) {
+				Logger::Error("Failed to decompress archive entry %s", GetName(entry));
+				return false;
+			}
+			return true;
+		}
+
+		memcpy(dst, stored, entry->Size);
+		return true;
+	}
+
+	bool AssetArchive::Verify(const ArchiveEntry* entry) const
+	{
+		const void* mapped = GetMappedData(entry);
+		if (mapped) {
+			return HashBytes(mapped, entry->Size) == entry->ContentHash;
+		}
+
+		std::vector<uint8_t> data(entry->Size);
+		return Read(entry, data.data()) && HashBytes(data.data(), data.size()) == entry->ContentHash;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Platform.h"
+#include "vke_archive_format.h"
+
+namespace VKE
+{
+	// A packed .vkpak archive, memory-mapped for the lifetime of the object.
+	class AssetArchive
+	{
+	public:
+		AssetArchive();
+		~AssetArchive();
+
+		// Maps the archive and validates its header and table of contents.
+		bool Open(const char* path);
+		void Close();
+		bool IsOpen() const { return _file.Data != nullptr; }
+
+		// Looks up an entry by its '/'-separated path, e.g. "shaders/main.vert.spv".
+		const ArchiveEntry* Find(const char* name) const;
+		const char* GetName(const ArchiveEntry* entry) const;
+		uint32_t GetEntryCount() const { return _header ? _header->EntryCount : 0; }
+
+		// Zero-copy access to an uncompressed entry, straight from the mapping. nullptr for compressed entries.
+		const void* GetMappedData(const ArchiveEntry* entry) const;
+
+		// Copies or decompresses the entry into dst, which must hold entry->Size bytes.
+		bool Read(const ArchiveEntry* entry, void* dst) const;
+
+		// Re-hashes the entry's contents and compares them with the table of contents.
+		bool Verify(const ArchiveEntry* entry) const;
+
+	private:
+		MappedFile _file;
+		const ArchiveHeader* _header;
+		const ArchiveEntry* _entries;
+		const char* _names;
+	};
+}
@@ -0,0 +1,695 @@
+#include "AsyncIO.h"
+#include "Logger.h"
+#include "vke_assert.h"
+#include "vke_defs.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifdef PLATFORM_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace VKE
+{
+	// Longer reads are split so every chunk fits in a 32-bit length.
+	static constexpr uint64_t MAX_READ_CHUNK = 1ull << 30;
+
+#ifdef PLATFORM_LINUX
+	// Completions carry the request pointer; the wakeup read uses 0.
+	static constexpr uint64_t RING_WAKEUP = 0;
+
+	// A raw io_uring instance, driven only by the ring thread. An eventfd read is kept outstanding so
+	// new requests can interrupt a wait for completions.
+	struct AsyncIO::Ring
+	{
+		int Fd = -1;
+		int WakeupFd = -1;
+		uint64_t WakeupValue = 0;
+		// Reads issued and not yet reaped, excluding the wakeup read
+		uint32_t InFlight = 0;
+		uint32_t ToSubmit = 0;
+
+		void* SqMemory = MAP_FAILED;
+		size_t SqMemorySize = 0;
+		void* CqMemory = MAP_FAILED;
+		size_t CqMemorySize = 0;
+		io_uring_sqe* Sqes = (io_uring_sqe*)MAP_FAILED;
+		size_t SqesSize = 0;
+
+		uint32_t* SqTail = nullptr;
+		uint32_t SqMask = 0;
+		uint32_t* SqArray = nullptr;
+		uint32_t* CqHead = nullptr;
+		uint32_t* CqTail = nullptr;
+		uint32_t CqMask = 0;
+		io_uring_cqe* Cqes = nullptr;
+
+		io_uring_sqe* NextSqe()
+		{
+			const uint32_t tail = *SqTail;
+			const uint32_t index = tail & SqMask;
+			io_uring_sqe* sqe = &Sqes[index];
+			memset(sqe, 0, sizeof(*sqe));
+			SqArray[index] = index;
+			__atomic_store_n(SqTail, tail + 1, __ATOMIC_RELEASE);
+			ToSubmit++;
+			return sqe;
+		}
+
+		void ArmWakeup()
+		{
+			io_uring_sqe* sqe = NextSqe();
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = WakeupFd;
+			sqe->addr = (uint64_t)(uintptr_t)&WakeupValue;
+			sqe->len = sizeof(WakeupValue);
+			sqe->off = (uint64_t)-1;
+			sqe->user_data = RING_WAKEUP;
+		}
+
+		void Wake()
+		{
+			const uint64_t one = 1;
+			while (write(WakeupFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+			}
+		}
+
+		// Submits queued SQEs and waits for at least one completion.
+		void SubmitAndWait()
+		{
+			for (;;) {
+				const int submitted = (int)syscall(__NR_io_uring_enter, Fd, ToSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (submitted >= 0) {
+					ToSubmit -= (uint32_t)submitted;
+					return;
+				}
+				if (errno != EINTR && errno != EAGAIN) {
+					Logger::Fatal("io_uring_enter failed (errno %d)", errno);
+				}
+			}
+		}
+	};
+#else
+	struct AsyncIO::Ring
+	{
+	};
+#endif
+
+	AsyncIO::AsyncIO(uint32_t queueDepth, uint32_t fallbackWorkerCount)
+		: _queueDepth(queueDepth), _ring(nullptr), _nextHandle(1), _inFlight(0), _running(true),
+		_stats(), _windowStart(std::chrono::steady_clock::now()), _windowBytes(0), _windowRequests(0)
+	{
+		ASSERT_MSG(queueDepth > 0, "Async IO needs a queue depth of at least one");
+
+		if (CreateRing(queueDepth)) {
+			_workers.emplace_back([this]() { RingLoop(); });
+			Logger::Info("Async IO using io_uring with queue depth %u", queueDepth);
+			return;
+		}
+
+		ASSERT_MSG(fallbackWorkerCount > 0, "Async IO needs at least one worker");
+		for (uint32_t i = 0; i < fallbackWorkerCount; ++i) {
+			_workers.emplace_back([this]() { WorkerLoop(); });
+		}
+		Logger::Info("Async IO using %u blocking worker threads", fallbackWorkerCount);
+	}
+
+	AsyncIO::~AsyncIO()
+	{
+		// Queued reads are dropped; issued ones are allowed to land before their buffers go away.
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_running = false;
+			for (auto& queue : _pending) {
+				queue.clear();
+			}
+		}
+		_workCondition.notify_all();
+#ifdef PLATFORM_LINUX
+		if (_ring) {
+			_ring->Wake();
+		}
+#endif
+		for (auto& worker : _workers) {
+			worker.join();
+		}
+		DestroyRing();
+
+		// Anything left was never polled or never issued
+		for (auto& pair : _requests) {
+			if (pair.second->OwnsBuffer) {
+				free(pair.second->Buffer);
+			}
+			delete pair.second;
+		}
+		_requests.clear();
+		_completed.clear();
+	}
+
+	IORequestHandle AsyncIO::Read(const IOReadDesc& desc)
+	{
+		IORequestHandle handle;
+		ReadBatch(&desc, 1, &handle);
+		return handle;
+	}
+
+	void AsyncIO::ReadBatch(const IOReadDesc* descs, uint32_t count, IORequestHandle* handles)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (uint32_t i = 0; i < count; ++i) {
+				Request* request = CreateRequest(descs[i]);
+				_requests[request->Handle] = request;
+				_pending[(uint32_t)request->Priority].push_back(request);
+				_stats.Submitted++;
+				if (handles) {
+					handles[i] = request->Handle;
+				}
+			}
+		}
+
+#ifdef PLATFORM_LINUX
+		if (_ring) {
+			_ring->Wake();
+			return;
+		}
+#endif
+		_workCondition.notify_all();
+	}
+
+	bool AsyncIO::Cancel(IORequestHandle handle)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _requests.find(handle);
+			if (it == _requests.end() || it->second->Status != IOStatus::Pending) {
+				return false;
+			}
+
+			Request* request = it->second;
+			auto& queue = _pending[(uint32_t)request->Priority];
+			auto queued = std::find(queue.begin(), queue.end(), request);
+			if (queued == queue.end()) {
+				// Already issued. Regular file reads cannot be interrupted, so the result is discarded instead.
+				request->CancelRequested = true;
+				return true;
+			}
+
+			queue.erase(queued);
+			request->Status = IOStatus::Cancelled;
+			_stats.Cancelled++;
+			_completed.push_back(request);
+		}
+		_completionCondition.notify_all();
+		return true;
+	}
+
+	uint32_t AsyncIO::Poll()
+	{
+		PROFILE_FUNCTION();
+
+		// Swapped with _completed so both keep their capacity and an idle frame allocates nothing
+		std::vector<Request*>& completed = _polled;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			completed.swap(_completed);
+			for (Request* request : completed) {
+				_requests.erase(request->Handle);
+			}
+
+			const auto now = std::chrono::steady_clock::now();
+			const double elapsed = std::chrono::duration<double>(now - _windowStart).count();
+			if (elapsed >= 1.0) {
+				_stats.ThroughputMBps = (double)(_stats.BytesRead - _windowBytes) / (1024.0 * 1024.0) / elapsed;
+				_stats.Iops = (double)(_stats.Completed - _windowRequests) / elapsed;
+				_windowStart = now;
+				_windowBytes = _stats.BytesRead;
+				_windowRequests = _stats.Completed;
+			}
+		}
+
+		for (Request* request : completed) {
+			IOResult result;
+			result.Handle = request->Handle;
+			result.Status = request->Status;
+			result.Path = request->Path.c_str();
+			result.Data = request->Buffer;
+			result.Size = request->BytesRead;
+			result.UserData = request->UserData;
+
+			if (request->Status != IOStatus::Complete) {
+				if (request->OwnsBuffer) {
+					free(request->Buffer);
+				}
+				result.Data = nullptr;
+				result.Size = 0;
+			}
+
+			if (request->Callback) {
+				request->Callback(result);
+			}
+			else if (request->OwnsBuffer && result.Data) {
+				free(result.Data);
+			}
+			delete request;
+		}
+
+		const uint32_t count = (uint32_t)completed.size();
+		completed.clear();
+		return count;
+	}
+
+	void AsyncIO::Wait(IORequestHandle handle)
+	{
+		PROFILE_FUNCTION();
+		std::unique_lock<std::mutex> lock(_mutex);
+		_completionCondition.wait(lock, [this, handle]() {
+			auto it = _requests.find(handle);
+			return it == _requests.end() || it->second->Status != IOStatus::Pending;
+		});
+	}
+
+	void AsyncIO::WaitIdle()
+	{
+		PROFILE_FUNCTION();
+		std::unique_lock<std::mutex> lock(_mutex);
+		_completionCondition.wait(lock, [this]() { return !HasPending() && _inFlight == 0; });
+	}
+
+	AsyncIOStats AsyncIO::GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		AsyncIOStats stats = _stats;
+		stats.Pending = 0;
+		for (auto& queue : _pending) {
+			stats.Pending += (uint32_t)queue.size();
+		}
+		stats.InFlight = _inFlight;
+		return stats;
+	}
+
+	void AsyncIO::FreeBuffer(void* buffer)
+	{
+		free(buffer);
+	}
+
+	AsyncIO::Request* AsyncIO::CreateRequest(const IOReadDesc& desc)
+	{
+		ASSERT_MSG(desc.Path != nullptr, "Async read without a path");
+		ASSERT_MSG(desc.Buffer == nullptr || desc.Size > 0, "Reads into a caller buffer need an explicit size");
+
+		Request* request = new Request();
+		request->Handle = _nextHandle++;
+		request->Path = desc.Path;
+		request->Offset = desc.Offset;
+		request->Size = desc.Size;
+		request->BytesRead = 0;
+		request->Buffer = desc.Buffer;
+		request->OwnsBuffer = false;
+		request->CancelRequested = false;
+		request->Priority = desc.Priority;
+		request->Status = IOStatus::Pending;
+		request->Callback = desc.Callback;
+		request->UserData = desc.UserData;
+		request->File = -1;
+		return request;
+	}
+
+	// Caller holds _mutex. Marks the request as issued.
+	AsyncIO::Request* AsyncIO::PopPending()
+	{
+		for (auto& queue : _pending) {
+			if (!queue.empty()) {
+				Request* request = queue.front();
+				queue.pop_front();
+				_inFlight++;
+				_stats.PeakInFlight = std::max(_stats.PeakInFlight, _inFlight);
+				return request;
+			}
+		}
+		return nullptr;
+	}
+
+	bool AsyncIO::HasPending() const
+	{
+		for (auto& queue : _pending) {
+			if (!queue.empty()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Resolves the read range against the file size and allocates the destination if needed.
+	bool AsyncIO::AllocateBuffer(Request* request, uint64_t fileSize)
+	{
+		if (request->Offset > fileSize) {
+			return false;
+		}
+
+		if (request->Size == 0) {
+			request->Size = fileSize - request->Offset;
+		}
+		else if (request->Size > fileSize - request->Offset) {
+			return false;
+		}
+
+		if (!request->Buffer) {
+			request->Buffer = malloc(std::max<uint64_t>(request->Size, 1));
+			request->OwnsBuffer = request->Buffer != nullptr;
+		}
+		return request->Buffer != nullptr;
+	}
+
+	void AsyncIO::Complete(Request* request, IOStatus status)
+	{
+#ifdef PLATFORM_LINUX
+		if (request->File >= 0) {
+			close(request->File);
+			request->File = -1;
+		}
+#endif
+		if (status == IOStatus::Failed) {
+			Logger::Warn("Async read of %s failed", request->Path.c_str());
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (status == IOStatus::Complete && request->CancelRequested) {
+				status = IOStatus::Cancelled;
+			}
+
+			request->Status = status;
+			_inFlight--;
+			switch (status) {
+			case IOStatus::Complete:
+				_stats.Completed++;
+				_stats.BytesRead += request->BytesRead;
+				break;
+			case IOStatus::Failed:
+				_stats.Failed++;
+				break;
+			default:
+				_stats.Cancelled++;
+				break;
+			}
+			_completed.push_back(request);
+		}
+		_completionCondition.notify_all();
+	}
+
+	// Fallback path: each worker performs one blocking read at a time.
+	void AsyncIO::WorkerLoop()
+	{
+		PROFILE_THREAD("IOWorker");
+		MEMORY_THREAD(IO);
+
+		for (;;) {
+			Request* request;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_workCondition.wait(lock, [this]() { return HasPending() || !_running; });
+				if (!_running) {
+					return;
+				}
+				request = PopPending();
+			}
+
+			ReadBlocking(request);
+		}
+	}
+
+	void AsyncIO::ReadBlocking(Request* request)
+	{
+		PROFILE_FUNCTION();
+
+		std::ifstream file(request->Path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			Complete(request, IOStatus::Failed);
+			return;
+		}
+
+		if (!AllocateBuffer(request, (uint64_t)file.tellg())) {
+			Complete(request, IOStatus::Failed);
+			return;
+		}
+
+		file.seekg(request->Offset);
+		char* buffer = static_cast<char*>(request->Buffer);
+		while (request->BytesRead < request->Size) {
+			const uint64_t chunk = std::min(request->Size - request->BytesRead, MAX_READ_CHUNK);
+			file.read(buffer + request->BytesRead, (std::streamsize)chunk);
+			request->BytesRead += (uint64_t)file.gcount();
+			if (!file) {
+				break;
+			}
+		}
+
+		Complete(request, request->BytesRead == request->Size ? IOStatus::Complete : IOStatus::Failed);
+	}
+
+#ifdef PLATFORM_LINUX
+	static bool ProbeRingRead(int fd)
+	{
+		const uint32_t opCount = IORING_OP_LAST;
+		std::vector<uint8_t> storage(sizeof(io_uring_probe) + opCount * sizeof(io_uring_probe_op), 0);
+		io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+		// Kernels without IORING_REGISTER_PROBE fail with EINVAL, and have no IORING_OP_READ either
+		if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, opCount) < 0) {
+			return false;
+		}
+		return probe->ops_len > IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+	}
+#endif
+
+	bool AsyncIO::CreateRing(uint32_t queueDepth)
+	{
+#ifdef PLATFORM_LINUX
+		// One extra slot for the wakeup read, which is always outstanding
+		io_uring_params params = {};
+		const int fd = (int)syscall(__NR_io_uring_setup, queueDepth + 1, &params);
+		if (fd < 0) {
+			Logger::Warn("io_uring unavailable (errno %d), using worker threads for async IO", errno);
+			return false;
+		}
+
+		_ring = new Ring();
+		Ring* ring = _ring;
+		ring->Fd = fd;
+		ring->SqMemorySize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		ring->CqMemorySize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		ring->SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+		// Since 5.4 both rings live in a single mapping
+		const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMapping) {
+			ring->SqMemorySize = std::max(ring->SqMemorySize, ring->CqMemorySize);
+		}
+
+		ring->SqMemory = mmap(nullptr, ring->SqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (singleMapping) {
+			ring->CqMemory = ring->SqMemory;
+			ring->CqMemorySize = 0;
+		}
+		else {
+			ring->CqMemory = mmap(nullptr, ring->CqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		}
+		ring->Sqes = (io_uring_sqe*)mmap(nullptr, ring->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		ring->WakeupFd = eventfd(0, EFD_CLOEXEC);
+
+		if (ring->SqMemory == MAP_FAILED || ring->CqMemory == MAP_FAILED || ring->Sqes == MAP_FAILED || ring->WakeupFd < 0) {
+			Logger::Warn("Unable to map io_uring queues (errno %d), using worker threads for async IO", errno);
+			DestroyRing();
+			return false;
+		}
+
+		uint8_t* sq = static_cast<uint8_t*>(ring->SqMemory);
+		ring->SqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+		ring->SqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+		ring->SqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+		uint8_t* cq = static_cast<uint8_t*>(ring->CqMemory);
+		ring->CqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+		ring->CqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+		ring->CqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+		ring->Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		// IORING_OP_READ arrived in 5.6, together with probing; on older kernels every read would fail
+		if (!ProbeRingRead(fd)) {
+			Logger::Warn("io_uring has no IORING_OP_READ on this kernel, using worker threads for async IO");
+			DestroyRing();
+			return false;
+		}
+
+		ring->ArmWakeup();
+		return true;
+#else
+		(void)queueDepth;
+		return false;
+#endif
+	}
+
+	void AsyncIO::DestroyRing()
+	{
+#ifdef PLATFORM_LINUX
+		if (!_ring) {
+			return;
+		}
+
+		if (_ring->Sqes != MAP_FAILED) {
+			munmap(_ring->Sqes, _ring->SqesSize);
+		}
+		if (_ring->CqMemory != MAP_FAILED && _ring->CqMemory != _ring->SqMemory) {
+			munmap(_ring->CqMemory, _ring->CqMemorySize);
+		}
+		if (_ring->SqMemory != MAP_FAILED) {
+			munmap(_ring->SqMemory, _ring->SqMemorySize);
+		}
+		if (_ring->WakeupFd >= 0) {
+			close(_ring->WakeupFd);
+		}
+		close(_ring->Fd);
+		delete _ring;
+		_ring = nullptr;
+#endif
+	}
+
+	// io_uring path: a single thread keeps up to _queueDepth reads in flight and reaps their completions.
+	void AsyncIO::RingLoop()
+	{
+#ifdef PLATFORM_LINUX
+		PROFILE_THREAD("IORing");
+		MEMORY_THREAD(IO);
+
+		Ring* ring = _ring;
+		std::vector<Request*> issue;
+		for (;;) {
+			issue.clear();
+			bool running;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				running = _running;
+				while (running && ring->InFlight + issue.size() < _queueDepth) {
+					Request* request = PopPending();
+					if (!request) {
+						break;
+					}
+					issue.push_back(request);
+				}
+			}
+
+			if (!running && ring->InFlight == 0) {
+				return;
+			}
+
+			for (Request* request : issue) {
+				if (OpenForRing(request)) {
+					SubmitRingRead(request);
+				}
+			}
+
+			// Every request taken failed or finished while opening, so there is nothing to wait for and the
+			// wakeup for the rest of the queue has already been consumed
+			if (ring->InFlight == 0 && !issue.empty()) {
+				continue;
+			}
+
+			{
+				PROFILE_SCOPE("SubmitAndWait");
+				ring->SubmitAndWait();
+			}
+
+			uint32_t head = *ring->CqHead;
+			const uint32_t tail = __atomic_load_n(ring->CqTail, __ATOMIC_ACQUIRE);
+			while (head != tail) {
+				const io_uring_cqe* cqe = &ring->Cqes[head & ring->CqMask];
+				const uint64_t userData = cqe->user_data;
+				const int32_t result = cqe->res;
+				head++;
+
+				if (userData == RING_WAKEUP) {
+					ring->ArmWakeup();
+					continue;
+				}
+
+				Request* request = reinterpret_cast<Request*>((uintptr_t)userData);
+				ring->InFlight--;
+
+				if (result == -EINTR || result == -EAGAIN) {
+					SubmitRingRead(request);
+				}
+				else if (result <= 0) {
+					// An error, or the file shrank under us
+					Complete(request, IOStatus::Failed);
+				}
+				else {
+					request->BytesRead += (uint64_t)result;
+					if (request->BytesRead < request->Size) {
+						SubmitRingRead(request);
+					}
+					else {
+						Complete(request, IOStatus::Complete);
+					}
+				}
+			}
+			__atomic_store_n(ring->CqHead, head, __ATOMIC_RELEASE);
+		}
+#endif
+	}
+
+	// Opening is synchronous; it is cheap next to the reads it enables. Returns false if the request
+	// completed without needing a read.
+	bool AsyncIO::OpenForRing(Request* request)
+	{
+#ifdef PLATFORM_LINUX
+		request->File = open(request->Path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (request->File < 0) {
+			Complete(request, IOStatus::Failed);
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(request->File, &info) != 0 || !AllocateBuffer(request, (uint64_t)info.st_size)) {
+			Complete(request, IOStatus::Failed);
+			return false;
+		}
+
+		if (request->Size == 0) {
+			Complete(request, IOStatus::Complete);
+			return false;
+		}
+		return true;
+#else
+		(void)request;
+		return false;
+#endif
+	}
+
+	void AsyncIO::SubmitRingRead(Request* request)
+	{
+#ifdef PLATFORM_LINUX
+		io_uring_sqe* sqe = _ring->NextSqe();
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = request->File;
+		sqe->addr = (uint64_t)(uintptr_t)(static_cast<uint8_t*>(request->Buffer) + request->BytesRead);
+		sqe->len = (uint32_t)std::min(request->Size - request->BytesRead, MAX_READ_CHUNK);
+		sqe->off = request->Offset + request->BytesRead;
+		sqe->user_data = (uint64_t)(uintptr_t)request;
+		_ring->InFlight++;
+#else
+		(void)request;
+#endif
+	}
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef VKE_DEFAULT_IO_QUEUE_DEPTH
+#define VKE_DEFAULT_IO_QUEUE_DEPTH 64
+#endif
+
+#ifndef VKE_DEFAULT_IO_WORKERS
+#define VKE_DEFAULT_IO_WORKERS 4
+#endif
+
+namespace VKE
+{
+	typedef uint64_t IORequestHandle;
+	constexpr IORequestHandle INVALID_IO_REQUEST = 0;
+
+	enum class IOPriority : uint32_t
+	{
+		High,
+		Normal,
+		Low,
+		Count
+	};
+
+	enum class IOStatus : uint32_t
+	{
+		Pending,
+		Complete,
+		Failed,
+		Cancelled
+	};
+
+	struct IOResult
+	{
+		IORequestHandle Handle;
+		IOStatus Status;
+		const char* Path;
+		// When AsyncIO allocated the buffer, a completed read hands it to the callback, which must
+		// release it with AsyncIO::FreeBuffer. Null for failed or cancelled reads.
+		void* Data;
+		uint64_t Size;
+		void* UserData;
+	};
+
+	typedef void (*IOCallback)(const IOResult& result);
+
+	struct IOReadDesc
+	{
+		const char* Path = nullptr;
+		uint64_t Offset = 0;
+		// 0 reads to the end of the file.
+		uint64_t Size = 0;
+		// Optional destination of at least Size bytes. Allocated by AsyncIO when null.
+		void* Buffer = nullptr;
+		IOPriority Priority = IOPriority::Normal;
+		IOCallback Callback = nullptr;
+		void* UserData = nullptr;
+	};
+
+	struct AsyncIOStats
+	{
+		uint64_t Submitted;
+		uint64_t Completed;
+		uint64_t Failed;
+		uint64_t Cancelled;
+		uint64_t BytesRead;
+		// Queued but not yet issued
+		uint32_t Pending;
+		// Issued reads, i.e. the current queue depth
+		uint32_t InFlight;
+		uint32_t PeakInFlight;
+		// Measured over the last window of roughly a second, updated by Poll
+		double ThroughputMBps;
+		double Iops;
+	};
+
+	// Asynchronous file reads. Uses io_uring on Linux when the kernel allows it, and a pool of
+	// blocking worker threads everywhere else. Callbacks run on the thread that calls Poll.
+	class AsyncIO
+	{
+	public:
+		AsyncIO(uint32_t queueDepth = VKE_DEFAULT_IO_QUEUE_DEPTH, uint32_t fallbackWorkerCount = VKE_DEFAULT_IO_WORKERS);
+		~AsyncIO();
+
+		IORequestHandle Read(const IOReadDesc& desc);
+		// Queues every read under a single lock and wakeup. handles may be null.
+		void ReadBatch(const IOReadDesc* descs, uint32_t count, IORequestHandle* handles = nullptr);
+
+		// Queued reads are dropped; reads already issued finish but report Cancelled.
+		// Returns false if the request has already completed.
+		bool Cancel(IORequestHandle handle);
+
+		// Runs the callbacks of completed requests. Call once per frame.
+		uint32_t Poll();
+
+		// Blocks until the request has completed. Its callback still runs from Poll.
+		void Wait(IORequestHandle handle);
+		// Blocks until nothing is queued or in flight.
+		void WaitIdle();
+
+		bool UsesIoUring() const { return _ring != nullptr; }
+		AsyncIOStats GetStats() const;
+
+		static void FreeBuffer(void* buffer);
+
+	private:
+		struct Request
+		{
+			IORequestHandle Handle;
+			std::string Path;
+			uint64_t Offset;
+			uint64_t Size;
+			uint64_t BytesRead;
+			void* Buffer;
+			bool OwnsBuffer;
+			bool CancelRequested;
+			IOPriority Priority;
+			IOStatus Status;
+			IOCallback Callback;
+			void* UserData;
+			int File;
+		};
+
+		struct Ring;
+
+		Request* CreateRequest(const IOReadDesc& desc);
+		Request* PopPending();
+		bool HasPending() const;
+		bool AllocateBuffer(Request* request, uint64_t fileSize);
+		void Complete(Request* request, IOStatus status);
+
+		void WorkerLoop();
+		void ReadBlocking(Request* request);
+
+		// io_uring path (Linux)
+		bool CreateRing(uint32_t queueDepth);
+		void DestroyRing();
+		void RingLoop();
+		bool OpenForRing(Request* request);
+		void SubmitRingRead(Request* request);
+
+		uint32_t _queueDepth;
+		Ring* _ring;
+
+		mutable std::mutex _mutex;
+		std::condition_variable _workCondition;
+		std::condition_variable _completionCondition;
+		std::deque<Request*> _pending[(uint32_t)IOPriority::Count];
+		std::unordered_map<IORequestHandle, Request*> _requests;
+		std::vector<Request*> _completed;
+		// Only touched by Poll
+		std::vector<Request*> _polled;
+		IORequestHandle _nextHandle;
+		uint32_t _inFlight;
+		bool _running;
+		std::vector<std::thread> _workers;
+
+		// Guarded by _mutex
+		AsyncIOStats _stats;
+		std::chrono::steady_clock::time_point _windowStart;
+		uint64_t _windowBytes;
+		uint64_t _windowRequests;
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Profiler.h"
+#include "vke_types.h"
+
+// Shared by the --bench-* command line benchmarks
+
+namespace VKE
+{
+	// Runs per measurement; the fastest one is reported
+	constexpr uint32_t BENCHMARK_REPEATS = 5;
+
+	// xorshift32, so the generated scenes are the same on every run and platform
+	inline uint32_t NextRandom(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	inline float RandomFloat(uint32_t& state, float min, float max)
+	{
+		return min + (max - min) * (float)(NextRandom(state) & 0xFFFFFF) / (float)0xFFFFFF;
+	}
+
+	// Best time of run in milliseconds, with prepare called untimed before each repeat
+	template<typename Prepare, typename Run>
+	float64_t BestOf(Prepare prepare, Run run)
+	{
+		float64_t bestMs = 1e30;
+		for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+			prepare();
+			const uint64_t startNs = Profiler::Now();
+			run();
+			bestMs = std::min(bestMs, (float64_t)(Profiler::Now() - startNs) / 1e6);
+		}
+		return bestMs;
+	}
+
+	template<typename Run>
+	float64_t BestOf(Run run)
+	{
+		return BestOf([]() {}, run);
+	}
+}
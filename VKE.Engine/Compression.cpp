@@ -0,0 +1,187 @@
+#include "Compression.h"
+
+#include <cstring>
+
+namespace VKE
+{
+	static constexpr uint32_t MIN_MATCH = 4;
+	// The format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end.
+	static constexpr uint64_t LAST_LITERALS = 5;
+	static constexpr uint64_t MF_LIMIT = 12;
+	static constexpr uint32_t MAX_OFFSET = 65535;
+	static constexpr uint32_t HASH_BITS = 12;
+
+	static inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	static inline uint32_t HashSequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	static inline uint8_t* WriteLength(uint8_t* op, uint64_t length)
+	{
+		while (length >= 255) {
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = (uint8_t)length;
+		return op;
+	}
+
+	uint64_t Compression::Lz4CompressBound(uint64_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	uint64_t Compression::Lz4Compress(const uint8_t* src, uint64_t srcSize, uint8_t* dst, uint64_t dstCapacity)
+	{
+		if (dstCapacity < Lz4CompressBound(srcSize)) {
+			return 0;
+		}
+
+		// Positions are stored +1 so zero means empty.
+		uint32_t table[1 << HASH_BITS] = {};
+
+		uint8_t* op = dst;
+		uint64_t anchor = 0;
+		uint64_t ip = 0;
+
+		if (srcSize > MF_LIMIT) {
+			const uint64_t matchLimit = srcSize - LAST_LITERALS;
+			const uint64_t mfLimit = srcSize - MF_LIMIT;
+
+			while (ip < mfLimit) {
+				const uint32_t sequence = Read32(src + ip);
+				const uint32_t hash = HashSequence(sequence);
+				const uint64_t candidate = table[hash];
+				table[hash] = (uint32_t)(ip + 1);
+
+				if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET || Read32(src + candidate - 1) != sequence) {
+					++ip;
+					continue;
+				}
+
+				const uint64_t ref = candidate - 1;
+				uint64_t matchLength = MIN_MATCH;
+				while (ip + matchLength < matchLimit && src[ref + matchLength] == src[ip + matchLength]) {
+					++matchLength;
+				}
+
+				// Token, literals, offset, match length
+				const uint64_t literalLength = ip - anchor;
+				uint8_t* token = op++;
+				*token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+				if (literalLength >= 15) {
+					op = WriteLength(op, literalLength - 15);
+				}
+				memcpy(op, src + anchor, literalLength);
+				op += literalLength;
+
+				const uint32_t offset = (uint32_t)(ip - ref);
+				*op++ = (uint8_t)(offset & 0xFF);
+				*op++ = (uint8_t)(offset >> 8);
+
+				const uint64_t extraMatch = matchLength - MIN_MATCH;
+				*token |= (uint8_t)(extraMatch >= 15 ? 15 : extraMatch);
+				if (extraMatch >= 15) {
+					op = WriteLength(op, extraMatch - 15);
+				}
+
+				ip += matchLength;
+				anchor = ip;
+			}
+		}
+
+		// Last literals
+		const uint64_t literalLength = srcSize - anchor;
+		*op++ = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+		if (literalLength >= 15) {
+			op = WriteLength(op, literalLength - 15);
+		}
+		if (literalLength > 0) {
+			memcpy(op, src + anchor, literalLength);
+		}
+		op += literalLength;
+
+		return (uint64_t)(op - dst);
+	}
+
+	bool Compression::Lz4Decompress(const uint8_t* src, uint64_t srcSize, uint8_t* dst, uint64_t dstSize)
+	{
+		uint64_t ip = 0;
+		uint64_t op = 0;
+
+		while (ip < srcSize) {
+			const uint8_t token = src[ip++];
+
+			// Literals
+			uint64_t literalLength = token >> 4;
+			if (literalLength == 15) {
+				uint8_t b;
+				do {
+					if (ip >= srcSize) {
+						return false;
+					}
+					b = src[ip++];
+					literalLength += b;
+				} while (b == 255);
+			}
+			if (literalLength > srcSize - ip || literalLength > dstSize - op) {
+				return false;
+			}
+			memcpy(dst + op, src + ip, literalLength);
+			ip += literalLength;
+			op += literalLength;
+
+			// The last sequence has no match
+			if (ip == srcSize) {
+				break;
+			}
+
+			// Match
+			if (srcSize - ip < 2) {
+				return false;
+			}
+			const uint64_t offset = (uint64_t)src[ip] | ((uint64_t)src[ip + 1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > op) {
+				return false;
+			}
+
+			uint64_t matchLength = token & 15;
+			if (matchLength == 15) {
+				uint8_t b;
+				do {
+					if (ip >= srcSize) {
+						return false;
+					}
+					b = src[ip++];
+					matchLength += b;
+				} while (b == 255);
+			}
+			matchLength += MIN_MATCH;
+			if (matchLength > dstSize - op) {
+				return false;
+			}
+
+			// Matches may overlap their own output, so copy forward byte by byte when they do.
+			const uint8_t* match = dst + op - offset;
+			if (offset >= matchLength) {
+				memcpy(dst + op, match, matchLength);
+			}
+			else {
+				for (uint64_t i = 0; i < matchLength; ++i) {
+					dst[op + i] = match[i];
+				}
+			}
+			op += matchLength;
+		}
+
+		return op == dstSize;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+namespace VKE {
+	// LZ4 block format: fast enough to decode at load time, used for archive entries
+	// that cannot be consumed in place.
+	class Compression
+	{
+	public:
+		static uint64_t Lz4CompressBound(uint64_t size);
+
+		// Returns the compressed size, or 0 if dst is too small.
+		static uint64_t Lz4Compress(const uint8_t* src, uint64_t srcSize, uint8_t* dst, uint64_t dstCapacity);
+
+		// Decodes exactly dstSize bytes. Returns false on malformed input.
+		static bool Lz4Decompress(const uint8_t* src, uint64_t srcSize, uint8_t* dst, uint64_t dstSize);
+	};
+}
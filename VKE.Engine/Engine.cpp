@@ -1,18 +1,105 @@
 #include "Engine.h"
 #include "Platform.h"
 #include "VulkanRenderer.h"
+#include "VulkanUploadQueue.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanTextureStreamer.h"
+#include "AssetArchive.h"
+#include "AsyncIO.h"
+#include "JobSystem.h"
+#include "EntityWorld.h"
+#include "Allocators.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
 
 namespace VKE
 {
-	Engine::Engine(const char* applicationName)
+	// Frames allowed to fill caches, pools and containers before any heap allocation is reported
+	static constexpr uint64_t ALLOCATION_WARMUP_FRAMES = 120;
+
+	Engine::Engine(const char* applicationName, const char* deviceOverride)
+		: _frameCount(0), _allocatingFrames(0), _steadyMainAllocations(0), _steadyAllocations(0)
 	{
-		_platform = new Platform(this, applicationName);
-		_renderer = new VulkanRenderer(_platform);
+		{
+			// The main thread becomes worker 0
+			MEMORY_SCOPE(Jobs);
+			_jobs = new JobSystem();
+		}
+		{
+			MEMORY_SCOPE(Entities);
+			_world = new EntityWorld(_jobs);
+		}
+		{
+			MEMORY_SCOPE(Platform);
+			_platform = new Platform(this, applicationName);
+		}
+		{
+			// Production builds ship a packed archive; without one, assets are read as loose files.
+			MEMORY_SCOPE(Assets);
+			_assets = new AssetArchive();
+			if (!_assets->Open("assets.vkpak")) {
+				Logger::Info("No asset archive found, using loose asset files");
+			}
+		}
+		{
+			MEMORY_SCOPE(IO);
+			_io = new AsyncIO();
+		}
+		{
+			MEMORY_SCOPE(Renderer);
+			_renderer = new VulkanRenderer(_platform, _assets, _io, _jobs, VKE_DEFAULT_FRAMES_IN_FLIGHT, deviceOverride);
+		}
+#ifdef ENABLE_MEMORY_TRACKING
+		_memoryMonitor = new MemoryMonitor();
+#endif
 	}
 
 	Engine::~Engine()
 	{
-		
+		if (_frameCount > ALLOCATION_WARMUP_FRAMES) {
+			Logger::Info("Heap: %llu of %llu frames after warm-up allocated, %llu allocations on the main thread, %llu on all threads",
+				(unsigned long long)_allocatingFrames, (unsigned long long)(_frameCount - ALLOCATION_WARMUP_FRAMES),
+				(unsigned long long)_steadyMainAllocations, (unsigned long long)_steadyAllocations);
+		}
+#ifdef ENABLE_MEMORY_TRACKING
+		_memoryMonitor->LogSummary();
+		delete _memoryMonitor;
+#endif
+
+		const VulkanUploadStats uploadStats = _renderer->GetUploadQueue()->GetStats();
+		Logger::Info("Uploads: %llu bytes, %.1f MB/s, latency %.2f ms (peak %.2f ms), %llu stalls",
+			(unsigned long long)uploadStats.TotalBytes, uploadStats.BandwidthMBps, uploadStats.LatencyMs, uploadStats.PeakLatencyMs,
+			(unsigned long long)uploadStats.Stalls);
+		const VulkanTextureStreamingStats textureStats = _renderer->GetTextures()->GetStats();
+		Logger::Info("Textures: %u streamed, %llu of %llu bytes resident, %llu mips streamed in, %llu evicted, %llu thrashed, %llu failed allocations",
+			textureStats.TextureCount, (unsigned long long)textureStats.ResidentBytes, (unsigned long long)textureStats.BudgetBytes,
+			(unsigned long long)textureStats.StreamedMips, (unsigned long long)textureStats.EvictedMips, (unsigned long long)textureStats.Thrash,
+			(unsigned long long)textureStats.FailedAllocations);
+		delete _renderer;
+
+		AsyncIOStats ioStats = _io->GetStats();
+		Logger::Info("Async IO: %llu reads (%llu failed), %llu bytes, peak queue depth %u",
+			(unsigned long long)ioStats.Completed, (unsigned long long)ioStats.Failed, (unsigned long long)ioStats.BytesRead, ioStats.PeakInFlight);
+		delete _io;
+		delete _assets;
+		delete _platform;
+
+		Logger::Info("Entities: %u in %u archetypes, %u chunks", _world->GetEntityCount(), _world->GetArchetypeCount(),
+			_world->GetChunkCount());
+		delete _world;
+
+		uint64_t jobsExecuted = 0;
+		uint64_t steals = 0;
+		for (uint32_t i = 0; i < _jobs->GetWorkerCount(); i++) {
+			const JobWorkerStats stats = _jobs->GetWorkerStats(i);
+			jobsExecuted += stats.JobsExecuted;
+			steals += stats.Steals;
+		}
+		Logger::Info("Jobs: %llu executed, %llu stolen", (unsigned long long)jobsExecuted, (unsigned long long)steals);
+		delete _jobs;
 	}
 
 	void Engine::Run()
@@ -22,7 +109,53 @@ namespace VKE
 
 	void Engine::OnLoop(const float32_t deltaTime)
 	{
-		
+		PROFILE_FUNCTION();
+		const uint64_t mainAllocations = HeapCounter::GetThreadAllocations();
+		const uint64_t allocations = HeapCounter::GetAllocations();
+
+		{
+			// Completion callbacks for reads that landed since the last frame
+			MEMORY_SCOPE(IO);
+			_io->Poll();
+		}
+		{
+			MEMORY_SCOPE(Entities);
+			_world->Update(deltaTime);
+		}
+		{
+			MEMORY_SCOPE(Renderer);
+			_renderer->DrawFrame();
+		}
+		++_frameCount;
+
+#ifdef ENABLE_MEMORY_TRACKING
+		{
+			PROFILE_SCOPE("MemorySnapshot");
+			const VulkanMemoryAllocator* memory = _renderer->GetMemoryAllocator();
+			MemoryDeviceHeap heaps[VKE_MEMORY_MAX_DEVICE_HEAPS];
+			const uint32_t heapCount = std::min(memory->GetHeapCount(), (uint32_t)VKE_MEMORY_MAX_DEVICE_HEAPS);
+			for (uint32_t i = 0; i < heapCount; i++) {
+				const VulkanHeapStats stats = memory->GetHeapStats(i);
+				heaps[i].Size = stats.HeapSize;
+				heaps[i].Budget = stats.Budget;
+				heaps[i].Usage = stats.Usage;
+				heaps[i].DeviceLocal = stats.DeviceLocal;
+			}
+			_memoryMonitor->Update(_frameCount, heaps, heapCount);
+		}
+#endif
+
+		// Past the warm-up, frame work should come from arenas, pools and reused containers only
+		if (_frameCount <= ALLOCATION_WARMUP_FRAMES) {
+			return;
+		}
+		const uint64_t frameMainAllocations = HeapCounter::GetThreadAllocations() - mainAllocations;
+		_steadyMainAllocations += frameMainAllocations;
+		_steadyAllocations += HeapCounter::GetAllocations() - allocations;
+		if (frameMainAllocations > 0 && _allocatingFrames++ == 0) {
+			Logger::Warn("Frame %llu made %llu heap allocations on the main thread", (unsigned long long)_frameCount,
+				(unsigned long long)frameMainAllocations);
+		}
 	}
 
 }
\ No newline at end of file
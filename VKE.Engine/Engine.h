@@ -5,18 +5,43 @@
 namespace VKE {
 	class Platform;
 	class VulkanRenderer;
+	class AssetArchive;
+	class AsyncIO;
+	class JobSystem;
+	class EntityWorld;
+	class MemoryMonitor;
 	
 	class Engine
 	{
 	public:
-		Engine(const char* applicationName);
+		// deviceOverride picks the GPU by UUID or name, see VulkanRenderer
+		Engine(const char* applicationName, const char* deviceOverride = nullptr);
 		~Engine();
 		
 		void Run();
 
+		VulkanRenderer* GetRenderer() const { return _renderer; }
+		JobSystem* GetJobs() const { return _jobs; }
+		// Game state; its systems run at the start of every frame
+		EntityWorld* GetWorld() const { return _world; }
+
 		void OnLoop(const float32_t deltaTime);
 	private:
 		Platform* _platform;
+		JobSystem* _jobs;
+		EntityWorld* _world;
+		AssetArchive* _assets;
+		AsyncIO* _io;
 		VulkanRenderer* _renderer;
+
+		// Heap allocations made by frames past the warm-up
+		uint64_t _frameCount;
+		uint64_t _allocatingFrames;
+		uint64_t _steadyMainAllocations;
+		uint64_t _steadyAllocations;
+
+#ifdef ENABLE_MEMORY_TRACKING
+		MemoryMonitor* _memoryMonitor;
+#endif
 	};
 }
@@ -0,0 +1,204 @@
+#include "EntityBenchmark.h"
+#include "BenchmarkUtils.h"
+#include "EntityWorld.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace VKE
+{
+	static constexpr float32_t BENCHMARK_DELTA_TIME = 1.0f / 60.0f;
+	// One entity in this many is destroyed and re-created per frame in the churn workload
+	static constexpr uint32_t CHURN_INTERVAL = 100;
+
+	namespace
+	{
+		struct PositionComponent { float X, Y, Z; };
+		struct VelocityComponent { float X, Y, Z; };
+		struct HealthComponent { float Value, Regeneration; };
+		// What a game object carries that the per-frame loops never touch
+		struct ColdComponent
+		{
+			float Transform[16];
+			uint32_t Flags[8];
+		};
+
+		// The baseline: one struct per object, every loop strides over all of it
+		struct GameObject
+		{
+			PositionComponent Position;
+			VelocityComponent Velocity;
+			HealthComponent Health;
+			bool HasHealth;
+			ColdComponent Cold;
+		};
+
+		struct EntityWorkload;
+
+		struct BenchmarkState
+		{
+			EntityWorld* World;
+			EntityWorkload* Workload;
+			std::vector<GameObject> Objects;
+			float32_t DeltaTime;
+			uint32_t Frame;
+		};
+	}
+
+	// Integrate: position += velocity * dt on every object
+
+	static void IntegrateObjects(BenchmarkState* state)
+	{
+		const float dt = state->DeltaTime;
+		for (GameObject& object : state->Objects) {
+			object.Position.X += object.Velocity.X * dt;
+			object.Position.Y += object.Velocity.Y * dt;
+			object.Position.Z += object.Velocity.Z * dt;
+		}
+	}
+
+	static void IntegrateChunk(const ChunkView& chunk, void* userData)
+	{
+		const float dt = ((const BenchmarkState*)userData)->DeltaTime;
+		PositionComponent* positions = chunk.Get<PositionComponent>();
+		const VelocityComponent* velocities = chunk.Get<VelocityComponent>();
+		for (uint32_t i = 0; i < chunk.GetCount(); i++) {
+			positions[i].X += velocities[i].X * dt;
+			positions[i].Y += velocities[i].Y * dt;
+			positions[i].Z += velocities[i].Z * dt;
+		}
+	}
+
+	// Regenerate: health on the half of the objects that have it
+
+	static void RegenerateObjects(BenchmarkState* state)
+	{
+		const float dt = state->DeltaTime;
+		for (GameObject& object : state->Objects) {
+			if (object.HasHealth) {
+				object.Health.Value = std::min(object.Health.Value + object.Health.Regeneration * dt, 100.0f);
+			}
+		}
+	}
+
+	static void RegenerateChunk(const ChunkView& chunk, void* userData)
+	{
+		const float dt = ((const BenchmarkState*)userData)->DeltaTime;
+		HealthComponent* health = chunk.Get<HealthComponent>();
+		for (uint32_t i = 0; i < chunk.GetCount(); i++) {
+			health[i].Value = std::min(health[i].Value + health[i].Regeneration * dt, 100.0f);
+		}
+	}
+
+	// Churn: jobs queue a destroy and a replacement for 1% of the entities, applied by Playback
+
+	static void ChurnChunk(const ChunkView& chunk, void* userData)
+	{
+		const BenchmarkState* state = (const BenchmarkState*)userData;
+		EntityCommandBuffer& commands = state->World->GetCommandBuffer();
+		const Entity* entities = chunk.GetEntities();
+		const PositionComponent* positions = chunk.Get<PositionComponent>();
+		for (uint32_t i = 0; i < chunk.GetCount(); i++) {
+			if ((entities[i].Index + state->Frame) % CHURN_INTERVAL == 0) {
+				commands.Destroy(entities[i]);
+				const Entity replacement = commands.Create(GetComponentMask<PositionComponent, VelocityComponent, ColdComponent>());
+				commands.Add(replacement, positions[i]);
+				commands.Add(replacement, VelocityComponent{ 1.0f, 0.0f, 0.0f });
+			}
+		}
+	}
+
+	namespace
+	{
+		struct EntityWorkload
+		{
+			const char* Name;
+			void (*RunObjects)(BenchmarkState* state);
+			ChunkFunction Chunk;
+			EntityQuery Query;
+			// Bytes each matching entity reads and writes
+			uint32_t HotBytes;
+		};
+	}
+
+	static void RunChunksSerial(BenchmarkState* state)
+	{
+		state->World->ForEachChunk(state->Workload->Query, state->Workload->Chunk, state);
+	}
+
+	static void RunChunksParallel(BenchmarkState* state)
+	{
+		state->World->ForEachChunkParallel(state->Workload->Query, state->Workload->Chunk, state);
+	}
+
+	void RunEntityBenchmark(uint32_t entityCount)
+	{
+		JobSystem jobs;
+		EntityWorld world(&jobs);
+
+		BenchmarkState state;
+		state.World = &world;
+		state.Workload = nullptr;
+		state.DeltaTime = BENCHMARK_DELTA_TIME;
+		state.Frame = 0;
+		state.Objects.resize(entityCount);
+
+		// Every other object has health, in both layouts
+		const ComponentMask moving = GetComponentMask<PositionComponent, VelocityComponent, ColdComponent>();
+		for (uint32_t i = 0; i < entityCount; i++) {
+			GameObject& object = state.Objects[i];
+			object = GameObject();
+			object.Position = { (float)i, 0.0f, 0.0f };
+			object.Velocity = { 1.0f, 2.0f, 3.0f };
+			object.Health = { 50.0f, 1.0f };
+			object.HasHealth = (i & 1) != 0;
+
+			const Entity entity = world.Create(object.HasHealth ? moving | GetComponentMask<HealthComponent>() : moving);
+			*world.Get<PositionComponent>(entity) = object.Position;
+			*world.Get<VelocityComponent>(entity) = object.Velocity;
+			if (object.HasHealth) {
+				*world.Get<HealthComponent>(entity) = object.Health;
+			}
+		}
+
+		Logger::Info("Entity benchmark, %u entities in %u chunks of %u KB, %u workers, best of %u runs", entityCount,
+			world.GetChunkCount(), VKE_ECS_CHUNK_SIZE / 1024, jobs.GetWorkerCount(), BENCHMARK_REPEATS);
+
+		// Bandwidth counts only the bytes the loop needs, so the array of structs pays for striding over the rest
+		EntityWorkload workloads[] = {
+			{ "Integrate", IntegrateObjects, IntegrateChunk, EntityQuery(GetComponentMask<PositionComponent, VelocityComponent>()),
+				(uint32_t)(2 * sizeof(PositionComponent) + sizeof(VelocityComponent)) },
+			{ "Regenerate 50%", RegenerateObjects, RegenerateChunk, EntityQuery(GetComponentMask<HealthComponent>()),
+				(uint32_t)(2 * sizeof(HealthComponent)) }
+		};
+		for (EntityWorkload& workload : workloads) {
+			state.Workload = &workload;
+			const float64_t bytes = (float64_t)world.Count(workload.Query) * workload.HotBytes;
+			const float64_t objectsMs = BestOf([&]() { workload.RunObjects(&state); });
+			const float64_t serialMs = BestOf([&]() { RunChunksSerial(&state); });
+			const float64_t parallelMs = BestOf([&]() { RunChunksParallel(&state); });
+			Logger::Info("  %-14s | %u-byte structs %8.3f ms %6.2f GB/s | chunks %8.3f ms %6.2f GB/s %5.2fx | parallel %8.3f ms %6.2f GB/s %5.2fx",
+				workload.Name, (uint32_t)sizeof(GameObject), objectsMs, bytes / (objectsMs * 1e6), serialMs, bytes / (serialMs * 1e6),
+				objectsMs / serialMs, parallelMs, bytes / (parallelMs * 1e6), objectsMs / parallelMs);
+		}
+
+		// Structural changes queued from parallel jobs, then applied on this thread
+		EntityQuery everything(GetComponentMask<PositionComponent>());
+		float64_t recordMs = 1e30;
+		float64_t playbackMs = 1e30;
+		for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+			state.Frame++;
+			const uint64_t startNs = Profiler::Now();
+			world.ForEachChunkParallel(everything, ChurnChunk, &state);
+			const uint64_t recordedNs = Profiler::Now();
+			world.Playback();
+			recordMs = std::min(recordMs, (float64_t)(recordedNs - startNs) / 1e6);
+			playbackMs = std::min(playbackMs, (float64_t)(Profiler::Now() - recordedNs) / 1e6);
+		}
+		Logger::Info("  Churn %u%%       | recorded in %.3f ms, played back in %.3f ms, %u entities after", 100 / CHURN_INTERVAL, recordMs,
+			playbackMs, world.GetEntityCount());
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// Fills an EntityWorld and an array of structs with entityCount objects and logs the time and memory
+	// bandwidth of the same per-frame workloads on both, single threaded and on the job system, plus the cost
+	// of deferred structural changes. Run from the command line with --bench-entities [count].
+	void RunEntityBenchmark(uint32_t entityCount = 1000000);
+}
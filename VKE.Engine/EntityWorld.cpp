@@ -0,0 +1,460 @@
+#include "EntityWorld.h"
+#include "JobSystem.h"
+#include "vke_profile.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace VKE
+{
+	static_assert(VKE_ECS_MAX_COMPONENTS <= 64, "Component masks have 64 bits");
+
+	// Marks a placeholder from EntityCommandBuffer::Create; real generations never reach it
+	static constexpr uint32_t DEFERRED_GENERATION = UINT32_MAX;
+
+	static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Component registry
+
+	static std::mutex g_componentMutex;
+	static ComponentInfo g_components[VKE_ECS_MAX_COMPONENTS];
+	static std::atomic<uint32_t> g_componentCount(0);
+
+	ComponentId ComponentRegistry::Register(const char* name, uint32_t size, uint32_t alignment)
+	{
+		std::lock_guard<std::mutex> lock(g_componentMutex);
+		const uint32_t id = g_componentCount.load(std::memory_order_relaxed);
+		ASSERT_MSG(id < VKE_ECS_MAX_COMPONENTS, "Too many component types, raise VKE_ECS_MAX_COMPONENTS");
+		ASSERT_MSG(alignment <= VKE_ECS_COLUMN_ALIGNMENT, "Component alignment is larger than a column's");
+		g_components[id] = { name, size, alignment };
+		g_componentCount.store(id + 1, std::memory_order_release);
+		return id;
+	}
+
+	const ComponentInfo& ComponentRegistry::GetInfo(ComponentId id)
+	{
+		ASSERT(id < g_componentCount.load(std::memory_order_acquire));
+		return g_components[id];
+	}
+
+	uint32_t ComponentRegistry::GetCount()
+	{
+		return g_componentCount.load(std::memory_order_acquire);
+	}
+
+	// Query
+
+	EntityQuery::EntityQuery(ComponentMask all, ComponentMask none)
+		: _all(all), _none(none), _world(nullptr), _testedArchetypes(0)
+	{
+	}
+
+	// Command buffer
+
+	Entity EntityCommandBuffer::Create(ComponentMask components)
+	{
+		const Entity placeholder = { _createCount++, DEFERRED_GENERATION };
+		Record(CommandType::Create, placeholder, 0, &components, sizeof(components));
+		return placeholder;
+	}
+
+	void EntityCommandBuffer::Destroy(Entity entity)
+	{
+		Record(CommandType::Destroy, entity, 0, nullptr, 0);
+	}
+
+	void EntityCommandBuffer::Record(CommandType type, Entity target, ComponentId component, const void* data, uint32_t size)
+	{
+		const Command command = { type, component, target, size };
+		const size_t offset = _data.size();
+		_data.resize(offset + sizeof(Command) + size);
+		memcpy(&_data[offset], &command, sizeof(Command));
+		if (size > 0) {
+			memcpy(&_data[offset + sizeof(Command)], data, size);
+		}
+	}
+
+	void EntityCommandBuffer::Clear()
+	{
+		// Keeps the capacity, so steady recording doesn't allocate
+		_data.clear();
+		_createCount = 0;
+	}
+
+	// World
+
+	EntityWorld::EntityWorld(JobSystem* jobs)
+		: _jobs(jobs), _chunkPool(VKE_ECS_CHUNK_SIZE, VKE_ECS_COLUMN_ALIGNMENT, 64), _entityCount(0), _iterating(0)
+	{
+		_commandBuffers.resize(jobs != nullptr ? jobs->GetWorkerCount() : 1);
+	}
+
+	EntityWorld::~EntityWorld()
+	{
+		for (EntityArchetype* archetype : _archetypes) {
+			for (const EntityChunk& chunk : archetype->Chunks) {
+				_chunkPool.Free(chunk.Data);
+			}
+			delete archetype;
+		}
+	}
+
+	EntityArchetype* EntityWorld::GetArchetype(ComponentMask mask)
+	{
+		auto found = _archetypeLookup.find(mask);
+		if (found != _archetypeLookup.end()) {
+			return found->second;
+		}
+
+		EntityArchetype* archetype = new EntityArchetype();
+		archetype->Mask = mask;
+		archetype->Count = 0;
+		uint32_t entitySize = sizeof(Entity);
+		for (ComponentId id = 0; id < VKE_ECS_MAX_COMPONENTS; id++) {
+			archetype->Offsets[id] = UINT32_MAX;
+			if (mask & (ComponentMask(1) << id)) {
+				const ComponentInfo& info = ComponentRegistry::GetInfo(id);
+				archetype->Columns.push_back({ id, 0, info.Size });
+				entitySize += info.Size;
+			}
+		}
+
+		// As many rows as fit once every column is padded to its alignment
+		uint32_t capacity = VKE_ECS_CHUNK_SIZE / entitySize + 1;
+		uint32_t size;
+		do {
+			capacity--;
+			size = AlignUp(sizeof(Entity) * capacity, VKE_ECS_COLUMN_ALIGNMENT);
+			for (EntityColumn& column : archetype->Columns) {
+				column.Offset = size;
+				size = AlignUp(size + column.Size * capacity, VKE_ECS_COLUMN_ALIGNMENT);
+			}
+		} while (size > VKE_ECS_CHUNK_SIZE);
+		ASSERT_MSG(capacity > 0, "Archetype's components don't fit in one chunk");
+		archetype->Capacity = capacity;
+		for (const EntityColumn& column : archetype->Columns) {
+			archetype->Offsets[column.Component] = column.Offset;
+		}
+
+		_archetypes.push_back(archetype);
+		_archetypeLookup[mask] = archetype;
+		return archetype;
+	}
+
+	void EntityWorld::InsertRow(uint32_t index, EntityArchetype* archetype)
+	{
+		if (archetype->Chunks.empty() || archetype->Chunks.back().Count == archetype->Capacity) {
+			archetype->Chunks.push_back({ (uint8_t*)_chunkPool.Allocate(), 0 });
+		}
+
+		EntityChunk& chunk = archetype->Chunks.back();
+		EntityRecord& record = _entities[index];
+		record.Archetype = archetype;
+		record.Chunk = (uint32_t)archetype->Chunks.size() - 1;
+		record.Row = chunk.Count++;
+		archetype->Count++;
+		((Entity*)chunk.Data)[record.Row] = { index, record.Generation };
+	}
+
+	void EntityWorld::RemoveRow(EntityArchetype* archetype, uint32_t chunkIndex, uint32_t row)
+	{
+		EntityChunk& chunk = archetype->Chunks[chunkIndex];
+		EntityChunk& last = archetype->Chunks.back();
+		const uint32_t lastRow = last.Count - 1;
+		if (&chunk != &last || row != lastRow) {
+			const Entity moved = ((Entity*)last.Data)[lastRow];
+			((Entity*)chunk.Data)[row] = moved;
+			for (const EntityColumn& column : archetype->Columns) {
+				memcpy(chunk.Data + column.Offset + row * column.Size, last.Data + column.Offset + lastRow * column.Size, column.Size);
+			}
+			_entities[moved.Index].Chunk = chunkIndex;
+			_entities[moved.Index].Row = row;
+		}
+
+		last.Count--;
+		archetype->Count--;
+		if (last.Count == 0) {
+			_chunkPool.Free(last.Data);
+			archetype->Chunks.pop_back();
+		}
+	}
+
+	void EntityWorld::MoveEntity(uint32_t index, EntityArchetype* destination)
+	{
+		EntityRecord& record = _entities[index];
+		EntityArchetype* source = record.Archetype;
+		const uint32_t sourceChunk = record.Chunk;
+		const uint32_t sourceRow = record.Row;
+		InsertRow(index, destination);
+
+		// Shared components are copied, new ones zeroed
+		const uint8_t* from = source->Chunks[sourceChunk].Data;
+		uint8_t* to = destination->Chunks[record.Chunk].Data;
+		for (const EntityColumn& column : destination->Columns) {
+			uint8_t* target = to + column.Offset + record.Row * column.Size;
+			const uint32_t sourceOffset = source->Offsets[column.Component];
+			if (sourceOffset != UINT32_MAX) {
+				memcpy(target, from + sourceOffset + sourceRow * column.Size, column.Size);
+			}
+			else {
+				memset(target, 0, column.Size);
+			}
+		}
+
+		RemoveRow(source, sourceChunk, sourceRow);
+	}
+
+	// Entities
+
+	Entity EntityWorld::Create(ComponentMask components)
+	{
+		ASSERT_MSG(_iterating == 0, "Structural change during a query, use a command buffer");
+
+		uint32_t index;
+		if (!_freeEntities.empty()) {
+			index = _freeEntities.back();
+			_freeEntities.pop_back();
+		}
+		else {
+			index = (uint32_t)_entities.size();
+			_entities.push_back({ nullptr, 0, 0, 1 });
+		}
+
+		EntityArchetype* archetype = GetArchetype(components);
+		InsertRow(index, archetype);
+		const EntityRecord& record = _entities[index];
+		uint8_t* data = archetype->Chunks[record.Chunk].Data;
+		for (const EntityColumn& column : archetype->Columns) {
+			memset(data + column.Offset + record.Row * column.Size, 0, column.Size);
+		}
+
+		_entityCount++;
+		return { index, record.Generation };
+	}
+
+	void EntityWorld::Destroy(Entity entity)
+	{
+		ASSERT_MSG(_iterating == 0, "Structural change during a query, use a command buffer");
+		ASSERT_MSG(IsAlive(entity), "Destroying a dead entity");
+
+		EntityRecord& record = _entities[entity.Index];
+		RemoveRow(record.Archetype, record.Chunk, record.Row);
+		record.Archetype = nullptr;
+		// Skips the placeholder marker when it wraps
+		record.Generation = record.Generation + 1 >= DEFERRED_GENERATION ? 1 : record.Generation + 1;
+		_freeEntities.push_back(entity.Index);
+		_entityCount--;
+	}
+
+	bool EntityWorld::IsAlive(Entity entity) const
+	{
+		return entity.Index < _entities.size() && _entities[entity.Index].Generation == entity.Generation &&
+			_entities[entity.Index].Archetype != nullptr;
+	}
+
+	void* EntityWorld::AddComponent(Entity entity, ComponentId component)
+	{
+		ASSERT_MSG(_iterating == 0, "Structural change during a query, use a command buffer");
+		ASSERT_MSG(IsAlive(entity), "Adding a component to a dead entity");
+
+		const EntityRecord& record = _entities[entity.Index];
+		const ComponentMask bit = ComponentMask(1) << component;
+		if ((record.Archetype->Mask & bit) == 0) {
+			MoveEntity(entity.Index, GetArchetype(record.Archetype->Mask | bit));
+		}
+		return GetComponent(entity, component);
+	}
+
+	void EntityWorld::RemoveComponent(Entity entity, ComponentId component)
+	{
+		ASSERT_MSG(_iterating == 0, "Structural change during a query, use a command buffer");
+		ASSERT_MSG(IsAlive(entity), "Removing a component from a dead entity");
+
+		const EntityRecord& record = _entities[entity.Index];
+		const ComponentMask bit = ComponentMask(1) << component;
+		if (record.Archetype->Mask & bit) {
+			MoveEntity(entity.Index, GetArchetype(record.Archetype->Mask & ~bit));
+		}
+	}
+
+	void* EntityWorld::GetComponent(Entity entity, ComponentId component) const
+	{
+		ASSERT_MSG(IsAlive(entity), "Reading a component of a dead entity");
+
+		const EntityRecord& record = _entities[entity.Index];
+		const uint32_t offset = record.Archetype->Offsets[component];
+		if (offset == UINT32_MAX) {
+			return nullptr;
+		}
+		const ComponentInfo& info = ComponentRegistry::GetInfo(component);
+		return record.Archetype->Chunks[record.Chunk].Data + offset + record.Row * info.Size;
+	}
+
+	// Queries
+
+	void EntityWorld::UpdateQuery(EntityQuery& query)
+	{
+		ASSERT_MSG(query._world == nullptr || query._world == this, "Query used with more than one world");
+		query._world = this;
+
+		// Archetypes are never removed, so only the new ones need testing
+		for (uint32_t i = query._testedArchetypes; i < (uint32_t)_archetypes.size(); i++) {
+			EntityArchetype* archetype = _archetypes[i];
+			if ((archetype->Mask & query._all) == query._all && (archetype->Mask & query._none) == 0) {
+				query._archetypes.push_back(archetype);
+			}
+		}
+		query._testedArchetypes = (uint32_t)_archetypes.size();
+	}
+
+	uint32_t EntityWorld::Count(EntityQuery& query)
+	{
+		UpdateQuery(query);
+		uint32_t count = 0;
+		for (const EntityArchetype* archetype : query._archetypes) {
+			count += archetype->Count;
+		}
+		return count;
+	}
+
+	void EntityWorld::ForEachChunk(EntityQuery& query, ChunkFunction function, void* userData)
+	{
+		PROFILE_FUNCTION();
+		UpdateQuery(query);
+
+		_iterating++;
+		ChunkView view;
+		for (const EntityArchetype* archetype : query._archetypes) {
+			view._archetype = archetype;
+			for (const EntityChunk& chunk : archetype->Chunks) {
+				view._data = chunk.Data;
+				view._count = chunk.Count;
+				function(view, userData);
+			}
+		}
+		_iterating--;
+	}
+
+	struct EntityWorld::ParallelChunks
+	{
+		const ChunkView* Chunks;
+		ChunkFunction Function;
+		void* UserData;
+	};
+
+	void EntityWorld::RunChunks(uint32_t begin, uint32_t end, void* userData)
+	{
+		const ParallelChunks* chunks = (const ParallelChunks*)userData;
+		for (uint32_t i = begin; i < end; i++) {
+			chunks->Function(chunks->Chunks[i], chunks->UserData);
+		}
+	}
+
+	void EntityWorld::ForEachChunkParallel(EntityQuery& query, ChunkFunction function, void* userData)
+	{
+		PROFILE_FUNCTION();
+		if (_jobs == nullptr) {
+			ForEachChunk(query, function, userData);
+			return;
+		}
+		UpdateQuery(query);
+
+		// Flattened first so the job system can hand out chunks from every archetype evenly
+		query._chunks.clear();
+		for (const EntityArchetype* archetype : query._archetypes) {
+			for (const EntityChunk& chunk : archetype->Chunks) {
+				ChunkView view;
+				view._archetype = archetype;
+				view._data = chunk.Data;
+				view._count = chunk.Count;
+				query._chunks.push_back(view);
+			}
+		}
+
+		_iterating++;
+		ParallelChunks chunks = { query._chunks.data(), function, userData };
+		_jobs->ParallelFor((uint32_t)query._chunks.size(), RunChunks, &chunks, 0, "EntityChunks");
+		_iterating--;
+	}
+
+	// Deferred changes
+
+	EntityCommandBuffer& EntityWorld::GetCommandBuffer()
+	{
+		const uint32_t worker = JobSystem::GetCurrentWorker();
+		return _commandBuffers[worker < (uint32_t)_commandBuffers.size() ? worker : 0];
+	}
+
+	void EntityWorld::Playback()
+	{
+		PROFILE_FUNCTION();
+		for (EntityCommandBuffer& buffer : _commandBuffers) {
+			if (buffer.IsEmpty()) {
+				continue;
+			}
+
+			_createdEntities.clear();
+			size_t offset = 0;
+			while (offset < buffer._data.size()) {
+				EntityCommandBuffer::Command command;
+				memcpy(&command, &buffer._data[offset], sizeof(command));
+				const uint8_t* data = buffer._data.data() + offset + sizeof(command);
+				offset += sizeof(command) + command.Size;
+
+				Entity target = command.Target;
+				if (target.Generation == DEFERRED_GENERATION) {
+					target = target.Index < _createdEntities.size() ? _createdEntities[target.Index] : INVALID_ENTITY;
+				}
+
+				// Several jobs may have queued changes to the same entity; the first destroy wins
+				switch (command.Type) {
+				case EntityCommandBuffer::CommandType::Create: {
+					ComponentMask components;
+					memcpy(&components, data, sizeof(components));
+					_createdEntities.push_back(Create(components));
+					break;
+				}
+				case EntityCommandBuffer::CommandType::Destroy:
+					if (IsAlive(target)) {
+						Destroy(target);
+					}
+					break;
+				case EntityCommandBuffer::CommandType::Add:
+					if (IsAlive(target)) {
+						memcpy(AddComponent(target, command.Component), data, command.Size);
+					}
+					break;
+				case EntityCommandBuffer::CommandType::Remove:
+					if (IsAlive(target)) {
+						RemoveComponent(target, command.Component);
+					}
+					break;
+				}
+			}
+			buffer.Clear();
+		}
+	}
+
+	// Systems
+
+	void EntityWorld::AddSystem(const char* name, EntitySystemFunction function, void* userData)
+	{
+		_systems.push_back({ name, function, userData });
+	}
+
+	void EntityWorld::Update(float32_t deltaTime)
+	{
+		PROFILE_FUNCTION();
+
+		// Changes recorded outside any system since the last frame
+		Playback();
+		for (const EntitySystem& system : _systems) {
+			PROFILE_SCOPE(system.Name);
+			system.Function(*this, deltaTime, system.UserData);
+			Playback();
+		}
+	}
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "Allocators.h"
+#include "vke_assert.h"
+#include "vke_types.h"
+
+// Every chunk holds the same number of bytes, split into one column per component
+#ifndef VKE_ECS_CHUNK_SIZE
+#define VKE_ECS_CHUNK_SIZE (16 * 1024)
+#endif
+
+// One bit each in a ComponentMask, so no more than 64
+#ifndef VKE_ECS_MAX_COMPONENTS
+#define VKE_ECS_MAX_COMPONENTS 64
+#endif
+
+// Columns start on a cache line
+#define VKE_ECS_COLUMN_ALIGNMENT 64
+
+namespace VKE
+{
+	class JobSystem;
+	class EntityWorld;
+
+	// Index into the world's entity table, and the generation that slot had when the entity was created.
+	// A destroyed entity's handle stops matching as soon as the slot is reused.
+	struct Entity
+	{
+		uint32_t Index;
+		uint32_t Generation;
+
+		bool operator==(const Entity& other) const { return Index == other.Index && Generation == other.Generation; }
+		bool operator!=(const Entity& other) const { return !(*this == other); }
+	};
+	constexpr Entity INVALID_ENTITY = { UINT32_MAX, 0 };
+
+	typedef uint32_t ComponentId;
+	typedef uint64_t ComponentMask;
+
+	struct ComponentInfo
+	{
+		const char* Name;
+		uint32_t Size;
+		uint32_t Alignment;
+	};
+
+	// Process-wide, so ids match across worlds. Components are registered on first use by GetComponentId.
+	class ComponentRegistry
+	{
+	public:
+		static ComponentId Register(const char* name, uint32_t size, uint32_t alignment);
+		static const ComponentInfo& GetInfo(ComponentId id);
+		static uint32_t GetCount();
+	};
+
+	// Components are plain data: chunks move them with memcpy and never run constructors or destructors
+	template<typename T>
+	ComponentId GetComponentId()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Components must be trivially copyable");
+		static const ComponentId id = ComponentRegistry::Register(typeid(T).name(), sizeof(T), alignof(T));
+		return id;
+	}
+
+	template<typename... Components>
+	ComponentMask GetComponentMask()
+	{
+		return ((ComponentMask(1) << GetComponentId<Components>()) | ... | ComponentMask(0));
+	}
+
+	struct EntityColumn
+	{
+		ComponentId Component;
+		uint32_t Offset;
+		uint32_t Size;
+	};
+
+	struct EntityChunk
+	{
+		uint8_t* Data;
+		uint32_t Count;
+	};
+
+	// Every entity with exactly one set of components. Its chunks are all full except the last, and each
+	// starts with the entity column followed by one column per component.
+	struct EntityArchetype
+	{
+		ComponentMask Mask;
+		// Byte offset of each component's column in a chunk, UINT32_MAX when the archetype doesn't have it
+		uint32_t Offsets[VKE_ECS_MAX_COMPONENTS];
+		std::vector<EntityColumn> Columns;
+		uint32_t Capacity;
+		uint32_t Count;
+		std::vector<EntityChunk> Chunks;
+	};
+
+	// One chunk handed to a query callback. Get<T>()[i] is the component of GetEntities()[i].
+	class ChunkView
+	{
+	public:
+		uint32_t GetCount() const { return _count; }
+		const Entity* GetEntities() const { return (const Entity*)_data; }
+
+		// Null when the chunk's archetype doesn't have the component
+		template<typename T>
+		T* Get() const
+		{
+			const uint32_t offset = _archetype->Offsets[GetComponentId<T>()];
+			return offset != UINT32_MAX ? (T*)(_data + offset) : nullptr;
+		}
+
+		template<typename T>
+		bool Has() const { return _archetype->Offsets[GetComponentId<T>()] != UINT32_MAX; }
+
+	private:
+		friend class EntityWorld;
+
+		const EntityArchetype* _archetype;
+		uint8_t* _data;
+		uint32_t _count;
+	};
+
+	// Matches the archetypes that have every component in all and none in none. Keep a query across frames
+	// and use it with one world only: the matching archetypes are cached, and only archetypes created
+	// since the last use are tested.
+	class EntityQuery
+	{
+	public:
+		explicit EntityQuery(ComponentMask all, ComponentMask none = 0);
+
+		ComponentMask GetAll() const { return _all; }
+		ComponentMask GetNone() const { return _none; }
+
+	private:
+		friend class EntityWorld;
+
+		ComponentMask _all;
+		ComponentMask _none;
+		const EntityWorld* _world;
+		std::vector<EntityArchetype*> _archetypes;
+		uint32_t _testedArchetypes;
+		// Reused by parallel iteration
+		std::vector<ChunkView> _chunks;
+	};
+
+	// Structural changes recorded while queries run and applied later by EntityWorld::Playback. Entities
+	// created here are placeholders that only mean something to later commands in the same buffer.
+	class EntityCommandBuffer
+	{
+	public:
+		Entity Create(ComponentMask components = 0);
+		void Destroy(Entity entity);
+
+		template<typename T>
+		void Add(Entity entity, const T& component) { Record(CommandType::Add, entity, GetComponentId<T>(), &component, sizeof(T)); }
+		template<typename T>
+		void Remove(Entity entity) { Record(CommandType::Remove, entity, GetComponentId<T>(), nullptr, 0); }
+
+		bool IsEmpty() const { return _data.empty(); }
+
+	private:
+		friend class EntityWorld;
+
+		enum class CommandType : uint32_t
+		{
+			Create,
+			Destroy,
+			Add,
+			Remove
+		};
+
+		// Followed by Size bytes of component data, or the component mask of a Create
+		struct Command
+		{
+			CommandType Type;
+			ComponentId Component;
+			Entity Target;
+			uint32_t Size;
+		};
+
+		void Record(CommandType type, Entity target, ComponentId component, const void* data, uint32_t size);
+		void Clear();
+
+		std::vector<uint8_t> _data;
+		uint32_t _createCount = 0;
+	};
+
+	typedef void (*ChunkFunction)(const ChunkView& chunk, void* userData);
+	typedef void (*EntitySystemFunction)(EntityWorld& world, float32_t deltaTime, void* userData);
+
+	// Archetype-based entity storage. Components live in SoA columns inside fixed-size chunks, so a query
+	// walks contiguous arrays of exactly the components it asked for.
+	//
+	// Structural changes (Create, Destroy, Add, Remove) move entities between chunks and must not happen
+	// while a query is iterating; record them in the calling worker's command buffer instead. Everything
+	// else is for the thread that owns the world.
+	class EntityWorld
+	{
+	public:
+		// jobs may be null; parallel queries then run on the calling thread
+		explicit EntityWorld(JobSystem* jobs = nullptr);
+		~EntityWorld();
+
+		// Entities. New components are zeroed.
+		Entity Create(ComponentMask components = 0);
+		void Destroy(Entity entity);
+		bool IsAlive(Entity entity) const;
+
+		void* AddComponent(Entity entity, ComponentId component);
+		void RemoveComponent(Entity entity, ComponentId component);
+		// Null when the entity doesn't have it. Valid until the next structural change.
+		void* GetComponent(Entity entity, ComponentId component) const;
+
+		template<typename T>
+		T* Add(Entity entity, const T& component)
+		{
+			T* destination = (T*)AddComponent(entity, GetComponentId<T>());
+			memcpy((void*)destination, &component, sizeof(T));
+			return destination;
+		}
+		template<typename T>
+		void Remove(Entity entity) { RemoveComponent(entity, GetComponentId<T>()); }
+		template<typename T>
+		T* Get(Entity entity) const { return (T*)GetComponent(entity, GetComponentId<T>()); }
+
+		// Queries
+		uint32_t Count(EntityQuery& query);
+		void ForEachChunk(EntityQuery& query, ChunkFunction function, void* userData);
+		// Chunks are spread across the job system. The function runs concurrently and may only write the
+		// chunk it was given; structural changes go through GetCommandBuffer.
+		void ForEachChunkParallel(EntityQuery& query, ChunkFunction function, void* userData);
+
+		// The calling worker's buffer, so jobs record without locking. Threads that are not workers share
+		// the first one with the main thread.
+		EntityCommandBuffer& GetCommandBuffer();
+		// Applies and clears every command buffer, in worker order
+		void Playback();
+
+		// Systems run in the order they were added, each followed by a Playback
+		void AddSystem(const char* name, EntitySystemFunction function, void* userData);
+		void Update(float32_t deltaTime);
+
+		JobSystem* GetJobs() const { return _jobs; }
+		uint32_t GetEntityCount() const { return _entityCount; }
+		uint32_t GetArchetypeCount() const { return (uint32_t)_archetypes.size(); }
+		uint32_t GetChunkCount() const { return _chunkPool.GetUsed(); }
+
+		EntityWorld(const EntityWorld&) = delete;
+		EntityWorld& operator=(const EntityWorld&) = delete;
+
+	private:
+		struct EntityRecord
+		{
+			EntityArchetype* Archetype;
+			uint32_t Chunk;
+			uint32_t Row;
+			uint32_t Generation;
+		};
+
+		struct EntitySystem
+		{
+			const char* Name;
+			EntitySystemFunction Function;
+			void* UserData;
+		};
+
+		EntityArchetype* GetArchetype(ComponentMask mask);
+		// Appends a row for the entity to the archetype's last chunk
+		void InsertRow(uint32_t index, EntityArchetype* archetype);
+		// Fills the hole with the archetype's last row, so chunks stay packed
+		void RemoveRow(EntityArchetype* archetype, uint32_t chunk, uint32_t row);
+		void MoveEntity(uint32_t index, EntityArchetype* destination);
+		void UpdateQuery(EntityQuery& query);
+
+		struct ParallelChunks;
+		static void RunChunks(uint32_t begin, uint32_t end, void* userData);
+
+		JobSystem* _jobs;
+		BlockPool _chunkPool;
+
+		std::vector<EntityRecord> _entities;
+		std::vector<uint32_t> _freeEntities;
+		uint32_t _entityCount;
+
+		std::vector<EntityArchetype*> _archetypes;
+		std::unordered_map<ComponentMask, EntityArchetype*> _archetypeLookup;
+
+		std::vector<EntityCommandBuffer> _commandBuffers;
+		// Real entities for the placeholders of the buffer being played back
+		std::vector<Entity> _createdEntities;
+		std::vector<EntitySystem> _systems;
+
+		// Queries in progress; structural changes are not allowed meanwhile
+		uint32_t _iterating;
+	};
+}
@@ -0,0 +1,87 @@
+#include "IOBenchmark.h"
+#include "BenchmarkUtils.h"
+#include "AsyncIO.h"
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace VKE
+{
+	static constexpr uint64_t IO_BENCHMARK_BLOCK_SIZE = 64 * 1024;
+	// Small enough to stay in the page cache, so the numbers show the submission path rather than the disk
+	static constexpr uint32_t IO_BENCHMARK_BLOCK_COUNT = 256;
+
+	// Missing files fail while opening, before any read is issued. More of them than the queue is deep
+	// means whole rounds of issuing end with nothing in flight.
+	static constexpr uint32_t IO_FAILURE_QUEUE_DEPTH = 4;
+	static constexpr uint32_t IO_FAILURE_MISSING_READS = 8;
+	static constexpr uint32_t IO_FAILURE_VALID_READS = 4;
+	static constexpr uint32_t IO_FAILURE_ROUNDS = 4;
+
+	void RunIOBenchmark(uint32_t readCount)
+	{
+		const std::string path = (std::filesystem::temp_directory_path() / "vke_io_benchmark.bin").string();
+		const std::string missingPath = (std::filesystem::temp_directory_path() / "vke_io_benchmark_missing.bin").string();
+		{
+			std::vector<uint8_t> data(IO_BENCHMARK_BLOCK_SIZE * IO_BENCHMARK_BLOCK_COUNT);
+			uint32_t state = 0x9E3779B9;
+			for (uint8_t& byte : data) {
+				byte = (uint8_t)NextRandom(state);
+			}
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(data.data()), data.size());
+			if (file.fail()) {
+				Logger::Error("Unable to write %s", path.c_str());
+				return;
+			}
+		}
+		std::filesystem::remove(missingPath);
+
+		std::vector<IOReadDesc> reads(readCount);
+		for (uint32_t i = 0; i < readCount; i++) {
+			reads[i].Path = path.c_str();
+			reads[i].Offset = (i % IO_BENCHMARK_BLOCK_COUNT) * IO_BENCHMARK_BLOCK_SIZE;
+			reads[i].Size = IO_BENCHMARK_BLOCK_SIZE;
+		}
+
+		Logger::Info("Async IO benchmark, %u reads of %llu KB", readCount, (unsigned long long)(IO_BENCHMARK_BLOCK_SIZE / 1024));
+		const uint32_t queueDepths[] = { 1, 4, 16, 64 };
+		for (uint32_t queueDepth : queueDepths) {
+			AsyncIO io(queueDepth);
+			// Poll frees the buffers AsyncIO allocated, so every repeat starts from the same state
+			const float64_t ms = BestOf([&]() {
+				io.ReadBatch(reads.data(), readCount);
+				io.WaitIdle();
+				io.Poll();
+			});
+			const float64_t megabytes = (float64_t)readCount * IO_BENCHMARK_BLOCK_SIZE / (1024.0 * 1024.0);
+			Logger::Info("  Queue depth %2u (%s) | %8.3f ms | %8.1f MB/s | %9.0f IOPS", queueDepth,
+				io.UsesIoUring() ? "io_uring" : "workers", ms, megabytes / (ms / 1000.0), readCount / (ms / 1000.0));
+		}
+
+		// A regression here hangs in WaitIdle rather than reporting a mismatch
+		std::vector<IOReadDesc> mixed(IO_FAILURE_MISSING_READS + IO_FAILURE_VALID_READS);
+		for (uint32_t i = 0; i < (uint32_t)mixed.size(); i++) {
+			mixed[i].Path = i < IO_FAILURE_MISSING_READS ? missingPath.c_str() : path.c_str();
+			mixed[i].Offset = (i % IO_BENCHMARK_BLOCK_COUNT) * IO_BENCHMARK_BLOCK_SIZE;
+			mixed[i].Size = IO_BENCHMARK_BLOCK_SIZE;
+		}
+		AsyncIO io(IO_FAILURE_QUEUE_DEPTH);
+		for (uint32_t round = 0; round < IO_FAILURE_ROUNDS; round++) {
+			io.ReadBatch(mixed.data(), (uint32_t)mixed.size());
+			io.WaitIdle();
+			io.Poll();
+		}
+		const AsyncIOStats stats = io.GetStats();
+		const bool matches = stats.Failed == IO_FAILURE_MISSING_READS * IO_FAILURE_ROUNDS &&
+			stats.Completed == IO_FAILURE_VALID_READS * IO_FAILURE_ROUNDS;
+		Logger::Info("  Missing files mixed in   | %llu failed, %llu completed | %s", (unsigned long long)stats.Failed,
+			(unsigned long long)stats.Completed, matches ? "ok" : "MISMATCH");
+
+		std::filesystem::remove(path);
+	}
+}
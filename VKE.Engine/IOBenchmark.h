@@ -0,0 +1,11 @@
+#pragma once
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// Reads readCount 64 KB blocks of a temporary file through AsyncIO at several queue depths and logs the
+	// time, throughput and IOPS of each, then checks that batches mixing missing files with valid reads all
+	// complete. Run from the command line with --bench-io [reads].
+	void RunIOBenchmark(uint32_t readCount = 4096);
+}
@@ -0,0 +1,163 @@
+#include "JobBenchmark.h"
+#include "BenchmarkUtils.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace VKE
+{
+
+	// Enough integer work per item that scheduling overhead is small but not negligible
+	static uint32_t Churn(uint32_t seed, uint32_t iterations)
+	{
+		uint32_t x = seed | 1;
+		for (uint32_t i = 0; i < iterations; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+		}
+		return x;
+	}
+
+	// Workloads
+
+	struct BenchmarkData
+	{
+		JobSystem* Jobs;
+		std::vector<uint32_t> Results;
+	};
+
+	// ParallelFor over a large array: throughput with automatic grain sizing
+	static void ParallelForItems(uint32_t begin, uint32_t end, void* userData)
+	{
+		BenchmarkData* data = (BenchmarkData*)userData;
+		for (uint32_t i = begin; i < end; i++) {
+			data->Results[i] = Churn(i, 256);
+		}
+	}
+
+	static void RunParallelForWorkload(BenchmarkData* data)
+	{
+		data->Jobs->ParallelFor((uint32_t)data->Results.size(), ParallelForItems, data);
+	}
+
+	// Many small jobs submitted from one thread: queue and steal overhead
+	static void SmallJob(void* userData)
+	{
+		uint32_t* result = (uint32_t*)userData;
+		*result = Churn(*result, 1024);
+	}
+
+	static void RunSmallJobsWorkload(BenchmarkData* data)
+	{
+		static constexpr uint32_t BatchSize = 256;
+		JobDesc jobs[BatchSize];
+		JobCounter counter(0);
+		for (uint32_t first = 0; first < (uint32_t)data->Results.size(); first += BatchSize) {
+			const uint32_t count = std::min(BatchSize, (uint32_t)data->Results.size() - first);
+			for (uint32_t i = 0; i < count; i++) {
+				jobs[i] = { SmallJob, &data->Results[first + i], "SmallJob" };
+			}
+			data->Jobs->Run(jobs, count, &counter);
+		}
+		data->Jobs->Wait(&counter);
+	}
+
+	// Recursive fork-join: jobs that spawn jobs and wait on them from inside a worker
+	struct TreeNode
+	{
+		JobSystem* Jobs;
+		uint32_t Depth;
+		uint32_t Seed;
+		uint32_t Result;
+	};
+
+	static void TreeJob(void* userData)
+	{
+		TreeNode* node = (TreeNode*)userData;
+		if (node->Depth == 0) {
+			node->Result = Churn(node->Seed, 4096);
+			return;
+		}
+
+		TreeNode children[2] = {
+			{ node->Jobs, node->Depth - 1, node->Seed * 2, 0 },
+			{ node->Jobs, node->Depth - 1, node->Seed * 2 + 1, 0 }
+		};
+		JobCounter counter(0);
+		node->Jobs->Run(TreeJob, &children[0], &counter, "TreeJob");
+		TreeJob(&children[1]);
+		node->Jobs->Wait(&counter);
+		node->Result = children[0].Result ^ children[1].Result;
+	}
+
+	static void RunTreeWorkload(BenchmarkData* data)
+	{
+		TreeNode root = { data->Jobs, 14, 1, 0 };
+		TreeJob(&root);
+		data->Results[0] = root.Result;
+	}
+
+	struct BenchmarkWorkload
+	{
+		const char* Name;
+		void (*Run)(BenchmarkData* data);
+		uint32_t ItemCount;
+		float64_t BaselineMs;
+	};
+
+	void RunJobBenchmark(uint32_t maxWorkers)
+	{
+		if (maxWorkers == 0) {
+			maxWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		BenchmarkWorkload workloads[] = {
+			{ "ParallelFor 1M items", RunParallelForWorkload, 1u << 20, 0.0 },
+			{ "64K small jobs", RunSmallJobsWorkload, 1u << 16, 0.0 },
+			{ "Fork-join tree, 16K leaves", RunTreeWorkload, 1, 0.0 }
+		};
+
+		Logger::Info("Job system benchmark, 1 to %u workers, best of %u runs", maxWorkers, BENCHMARK_REPEATS);
+		for (uint32_t workerCount = 1; workerCount <= maxWorkers; workerCount++) {
+			JobSystemDesc desc;
+			desc.WorkerCount = workerCount;
+			desc.PinThreads = true;
+			JobSystem jobs(desc);
+
+			for (auto& workload : workloads) {
+				BenchmarkData data;
+				data.Jobs = &jobs;
+				data.Results.resize(workload.ItemCount);
+
+				// One warm-up run wakes the workers and faults in the results
+				workload.Run(&data);
+				jobs.ResetStats();
+
+				const float64_t bestMs = BestOf([&]() { workload.Run(&data); });
+
+				uint64_t steals = 0;
+				uint64_t failedSteals = 0;
+				float64_t utilization = 0.0;
+				for (uint32_t i = 0; i < workerCount; i++) {
+					const JobWorkerStats stats = jobs.GetWorkerStats(i);
+					steals += stats.Steals;
+					failedSteals += stats.FailedSteals;
+					utilization += stats.Utilization;
+				}
+
+				if (workerCount == 1) {
+					workload.BaselineMs = bestMs;
+				}
+				const float64_t speedup = workload.BaselineMs / bestMs;
+				Logger::Info("  %2u workers | %-28s | %8.2f ms | %5.2fx | %3.0f%% efficiency | %3.0f%% utilization | %llu steals (%llu failed)",
+					workerCount, workload.Name, bestMs, speedup, 100.0 * speedup / workerCount, 100.0 * utilization / workerCount,
+					(unsigned long long)steals, (unsigned long long)failedSteals);
+			}
+		}
+	}
+}
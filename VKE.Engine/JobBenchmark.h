@@ -0,0 +1,10 @@
+#pragma once
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// Measures the job system with 1 to maxWorkers workers (0 = every hardware thread) and logs the time,
+	// speedup and steal counts of each workload. Run from the command line with --bench-jobs [workers].
+	void RunJobBenchmark(uint32_t maxWorkers = 0);
+}
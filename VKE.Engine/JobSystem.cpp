@@ -0,0 +1,462 @@
+#include "JobSystem.h"
+#include "Platform.h"
+#include "Profiler.h"
+#include "Logger.h"
+#include "vke_assert.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+
+namespace VKE
+{
+	static_assert((VKE_JOB_QUEUE_SIZE & (VKE_JOB_QUEUE_SIZE - 1)) == 0, "VKE_JOB_QUEUE_SIZE must be a power of two");
+
+	// Idle workers look for work this many times before going to sleep
+	static constexpr uint32_t IDLE_SPINS = 64;
+
+	static thread_local uint32_t t_workerIndex = UINT32_MAX;
+	static thread_local JobSystem* t_jobSystem = nullptr;
+	// Jobs running on this thread, counting those run from a Wait inside another job
+	static thread_local uint32_t t_jobDepth = 0;
+
+	struct JobSystem::ParallelForContext
+	{
+		ParallelForFunction Function;
+		void* UserData;
+		uint32_t Count;
+		uint32_t GrainSize;
+		std::atomic<uint32_t> Next;
+	};
+
+	// Deque
+
+	JobSystem::Deque::Deque()
+		: _top(0), _bottom(0)
+	{
+		for (auto& job : _jobs) {
+			job.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	bool JobSystem::Deque::Push(Job* job)
+	{
+		const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+		const int64_t top = _top.load(std::memory_order_acquire);
+		if (bottom - top >= VKE_JOB_QUEUE_SIZE) {
+			return false;
+		}
+		// Release on the slot as well as on bottom, so a thief that reads the slot also sees the job's fields
+		_jobs[bottom & (VKE_JOB_QUEUE_SIZE - 1)].store(job, std::memory_order_release);
+		_bottom.store(bottom + 1, std::memory_order_release);
+		return true;
+	}
+
+	JobSystem::Job* JobSystem::Deque::Pop()
+	{
+		const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+		_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = _top.load(std::memory_order_relaxed);
+
+		if (top > bottom) {
+			// Empty
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = _jobs[bottom & (VKE_JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (top == bottom) {
+			// Last job; race the thieves for it
+			if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				job = nullptr;
+			}
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	JobSystem::Job* JobSystem::Deque::Steal()
+	{
+		int64_t top = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottom = _bottom.load(std::memory_order_acquire);
+		if (top >= bottom) {
+			return nullptr;
+		}
+
+		Job* job = _jobs[top & (VKE_JOB_QUEUE_SIZE - 1)].load(std::memory_order_acquire);
+		if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+		return job;
+	}
+
+	// Job system
+
+	JobSystem::JobSystem(const JobSystemDesc& desc)
+		: _workerCount(desc.WorkerCount), _running(true), _externalHead(nullptr), _externalTail(nullptr), _queuedJobs(0), _sleepingWorkers(0), _hook(nullptr),
+		_hookUserData(nullptr), _statsStartNs(Profiler::Now())
+	{
+		ASSERT_MSG(t_jobSystem == nullptr, "The creating thread is already a worker of another job system");
+		if (_workerCount == 0) {
+			_workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		_workers = new Worker[_workerCount];
+		for (uint32_t i = 0; i < _workerCount; i++) {
+			// Any non-zero seed works for xorshift
+			_workers[i].Random = 0x9E3779B9u * (i + 1);
+		}
+
+		t_workerIndex = 0;
+		t_jobSystem = this;
+
+		for (uint32_t i = 1; i < _workerCount; i++) {
+			_threads.emplace_back([this, i, desc]() {
+				PROFILE_THREAD("JobWorker");
+				MEMORY_THREAD(Jobs);
+				if (desc.PinThreads && !Platform::PinCurrentThread(i)) {
+					Logger::Warn("Could not pin job worker %u", i);
+				}
+				WorkerLoop(i);
+			});
+		}
+		Logger::Info("Job system with %u workers%s", _workerCount, desc.PinThreads ? ", pinned" : "");
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+			_running.store(false);
+		}
+		_sleepCondition.notify_all();
+		for (auto& thread : _threads) {
+			thread.join();
+		}
+
+		while (_externalHead) {
+			Job* job = _externalHead;
+			_externalHead = job->Next;
+			_externalPool.Delete(job);
+		}
+		delete[] _workers;
+
+		t_workerIndex = UINT32_MAX;
+		t_jobSystem = nullptr;
+	}
+
+	uint32_t JobSystem::GetCurrentWorker()
+	{
+		return t_workerIndex;
+	}
+
+	void JobSystem::Run(const JobDesc* jobs, uint32_t count, JobCounter* counter)
+	{
+		if (count == 0) {
+			return;
+		}
+		if (counter) {
+			counter->fetch_add(count, std::memory_order_relaxed);
+		}
+
+		// Other threads queue through the external list
+		if (t_jobSystem != this) {
+			{
+				std::lock_guard<std::mutex> lock(_externalMutex);
+				for (uint32_t i = 0; i < count; i++) {
+					Job* job = _externalPool.New();
+					job->Function = jobs[i].Function;
+					job->UserData = jobs[i].UserData;
+					job->Name = jobs[i].Name;
+					job->Counter = counter;
+					job->External = true;
+					job->Next = nullptr;
+					if (_externalTail) {
+						_externalTail->Next = job;
+					}
+					else {
+						_externalHead = job;
+					}
+					_externalTail = job;
+				}
+			}
+			_queuedJobs.fetch_add((int32_t)count);
+			WakeWorkers(count);
+			return;
+		}
+
+		Worker& worker = _workers[t_workerIndex];
+		uint32_t queued = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			Job* job = &worker.Pool[worker.PoolNext++ & (VKE_JOB_QUEUE_SIZE - 1)];
+			// The slot's previous job is still queued or running when the pool wraps that quickly
+			const bool free = !job->Busy.load(std::memory_order_acquire);
+			if (free) {
+				job->Function = jobs[i].Function;
+				job->UserData = jobs[i].UserData;
+				job->Name = jobs[i].Name;
+				job->Counter = counter;
+				job->External = false;
+				job->Busy.store(true, std::memory_order_relaxed);
+			}
+
+			if (free && worker.Queue.Push(job)) {
+				queued++;
+				continue;
+			}
+
+			// Out of room: run it right here
+			if (free) {
+				job->Busy.store(false, std::memory_order_release);
+			}
+			Job inlineJob;
+			inlineJob.Function = jobs[i].Function;
+			inlineJob.UserData = jobs[i].UserData;
+			inlineJob.Name = jobs[i].Name;
+			inlineJob.Counter = counter;
+			inlineJob.External = false;
+			inlineJob.Busy.store(true, std::memory_order_relaxed);
+			Execute(&inlineJob, t_workerIndex);
+		}
+
+		if (queued > 0) {
+			_queuedJobs.fetch_add((int32_t)queued);
+			WakeWorkers(queued);
+		}
+	}
+
+	void JobSystem::Run(JobFunction function, void* userData, JobCounter* counter, const char* name)
+	{
+		const JobDesc job = { function, userData, name };
+		Run(&job, 1, counter);
+	}
+
+	void JobSystem::Wait(const JobCounter* counter)
+	{
+		PROFILE_FUNCTION();
+		const uint32_t workerIndex = t_jobSystem == this ? t_workerIndex : UINT32_MAX;
+		while (counter->load(std::memory_order_acquire) != 0) {
+			Job* job = FindJob(workerIndex);
+			if (job) {
+				Execute(job, workerIndex);
+			}
+			else {
+				// The remaining jobs are running elsewhere
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void JobSystem::RunParallelFor(void* userData)
+	{
+		ParallelForContext* context = (ParallelForContext*)userData;
+		for (;;) {
+			const uint32_t begin = context->Next.fetch_add(context->GrainSize, std::memory_order_relaxed);
+			if (begin >= context->Count) {
+				return;
+			}
+			const uint32_t end = std::min(context->Count - begin, context->GrainSize) + begin;
+			context->Function(begin, end, context->UserData);
+		}
+	}
+
+	void JobSystem::ParallelFor(uint32_t count, ParallelForFunction function, void* userData, uint32_t grainSize, const char* name)
+	{
+		if (count == 0) {
+			return;
+		}
+		if (grainSize == 0) {
+			grainSize = std::max(count / (_workerCount * VKE_JOB_CHUNKS_PER_WORKER), 1u);
+		}
+
+		// Chunks are claimed from a shared cursor, so one job per worker is enough and a worker that draws
+		// cheap items simply claims more of them
+		const uint32_t chunkCount = (count + grainSize - 1) / grainSize;
+		if (chunkCount == 1) {
+			function(0, count, userData);
+			return;
+		}
+
+		ParallelForContext context;
+		context.Function = function;
+		context.UserData = userData;
+		context.Count = count;
+		context.GrainSize = grainSize;
+		context.Next.store(0, std::memory_order_relaxed);
+
+		JobDesc jobs[64];
+		const uint32_t jobCount = std::min(std::min(chunkCount, _workerCount), (uint32_t)(sizeof(jobs) / sizeof(jobs[0])));
+		for (uint32_t i = 0; i < jobCount; i++) {
+			jobs[i] = { RunParallelFor, &context, name ? name : "ParallelFor" };
+		}
+
+		JobCounter counter(0);
+		Run(jobs, jobCount, &counter);
+		Wait(&counter);
+	}
+
+	void JobSystem::WorkerLoop(uint32_t workerIndex)
+	{
+		t_workerIndex = workerIndex;
+		t_jobSystem = this;
+
+		uint32_t idleSpins = 0;
+		while (_running.load(std::memory_order_relaxed)) {
+			Job* job = FindJob(workerIndex);
+			if (job) {
+				Execute(job, workerIndex);
+				idleSpins = 0;
+				continue;
+			}
+
+			if (++idleSpins < IDLE_SPINS) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Sleep until something is queued. Submitters raise _queuedJobs before they check for sleepers,
+			// and the check below happens after registering as one, so no wakeup is lost.
+			std::unique_lock<std::mutex> lock(_sleepMutex);
+			_sleepingWorkers.fetch_add(1);
+			_sleepCondition.wait(lock, [this]() { return _queuedJobs.load() > 0 || !_running.load(); });
+			_sleepingWorkers.fetch_sub(1);
+			idleSpins = 0;
+		}
+
+		t_workerIndex = UINT32_MAX;
+		t_jobSystem = nullptr;
+	}
+
+	JobSystem::Job* JobSystem::FindJob(uint32_t workerIndex)
+	{
+		Job* job = nullptr;
+		if (workerIndex != UINT32_MAX) {
+			job = _workers[workerIndex].Queue.Pop();
+		}
+
+		if (!job) {
+			std::lock_guard<std::mutex> lock(_externalMutex);
+			if (_externalHead) {
+				job = _externalHead;
+				_externalHead = job->Next;
+				if (!_externalHead) {
+					_externalTail = nullptr;
+				}
+			}
+		}
+
+		if (!job && _workerCount > 1) {
+			// Steal, starting from a random victim
+			uint32_t start = 0;
+			if (workerIndex != UINT32_MAX) {
+				uint32_t& random = _workers[workerIndex].Random;
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				start = random;
+			}
+			for (uint32_t i = 0; i < _workerCount && !job; i++) {
+				const uint32_t victim = (start + i) % _workerCount;
+				if (victim == workerIndex) {
+					continue;
+				}
+				job = _workers[victim].Queue.Steal();
+				if (workerIndex != UINT32_MAX) {
+					std::atomic<uint64_t>& stat = job ? _workers[workerIndex].Steals : _workers[workerIndex].FailedSteals;
+					stat.store(stat.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		if (job) {
+			_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	void JobSystem::Execute(Job* job, uint32_t workerIndex)
+	{
+		JobCounter* counter = job->Counter;
+		const char* name = job->Name;
+		const uint64_t startNs = Profiler::Now();
+		t_jobDepth++;
+		{
+			PROFILE_SCOPE(name ? name : "Job");
+			job->Function(job->UserData);
+		}
+		t_jobDepth--;
+		const uint64_t endNs = Profiler::Now();
+
+		if (job->External) {
+			std::lock_guard<std::mutex> lock(_externalMutex);
+			_externalPool.Delete(job);
+		}
+		else {
+			job->Busy.store(false, std::memory_order_release);
+		}
+
+		if (workerIndex != UINT32_MAX) {
+			Worker& worker = _workers[workerIndex];
+			worker.JobsExecuted.store(worker.JobsExecuted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			// Nested jobs are already part of the outer job's time
+			if (t_jobDepth == 0) {
+				worker.BusyNs.store(worker.BusyNs.load(std::memory_order_relaxed) + (endNs - startNs), std::memory_order_relaxed);
+			}
+			if (_hook) {
+				_hook(workerIndex, name, startNs, endNs, _hookUserData);
+			}
+		}
+
+		// Last, since a waiter may free the counter as soon as it reaches zero
+		if (counter) {
+			counter->fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void JobSystem::WakeWorkers(uint32_t count)
+	{
+		if (_sleepingWorkers.load() == 0) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		if (count == 1) {
+			_sleepCondition.notify_one();
+		}
+		else {
+			_sleepCondition.notify_all();
+		}
+	}
+
+	void JobSystem::SetHook(JobHook hook, void* userData)
+	{
+		_hook = hook;
+		_hookUserData = userData;
+	}
+
+	JobWorkerStats JobSystem::GetWorkerStats(uint32_t workerIndex) const
+	{
+		ASSERT_MSG(workerIndex < _workerCount, "Invalid worker index");
+		const Worker& worker = _workers[workerIndex];
+		JobWorkerStats stats;
+		stats.JobsExecuted = worker.JobsExecuted.load(std::memory_order_relaxed);
+		stats.Steals = worker.Steals.load(std::memory_order_relaxed);
+		stats.FailedSteals = worker.FailedSteals.load(std::memory_order_relaxed);
+		stats.BusyNs = worker.BusyNs.load(std::memory_order_relaxed);
+		const uint64_t elapsedNs = Profiler::Now() - _statsStartNs.load(std::memory_order_relaxed);
+		stats.Utilization = elapsedNs > 0 ? std::min((float64_t)stats.BusyNs / (float64_t)elapsedNs, 1.0) : 0.0;
+		return stats;
+	}
+
+	void JobSystem::ResetStats()
+	{
+		for (uint32_t i = 0; i < _workerCount; i++) {
+			_workers[i].JobsExecuted.store(0, std::memory_order_relaxed);
+			_workers[i].Steals.store(0, std::memory_order_relaxed);
+			_workers[i].FailedSteals.store(0, std::memory_order_relaxed);
+			_workers[i].BusyNs.store(0, std::memory_order_relaxed);
+		}
+		_statsStartNs.store(Profiler::Now(), std::memory_order_relaxed);
+	}
+}
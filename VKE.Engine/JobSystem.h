@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Allocators.h"
+#include "vke_types.h"
+
+// Jobs each worker can have queued, and the size of its job pool. Power of two.
+#ifndef VKE_JOB_QUEUE_SIZE
+#define VKE_JOB_QUEUE_SIZE 4096
+#endif
+
+// Dynamic chunks handed out per worker by ParallelFor when no grain size is given
+#ifndef VKE_JOB_CHUNKS_PER_WORKER
+#define VKE_JOB_CHUNKS_PER_WORKER 8
+#endif
+
+namespace VKE
+{
+	typedef void (*JobFunction)(void* userData);
+	// Runs items [begin, end)
+	typedef void (*ParallelForFunction)(uint32_t begin, uint32_t end, void* userData);
+	// Called on the worker after every job, e.g. to feed an external profiler
+	typedef void (*JobHook)(uint32_t workerIndex, const char* name, uint64_t startNs, uint64_t endNs, void* userData);
+
+	// Jobs still to finish. Start at zero, hand to Run, then Wait on it.
+	typedef std::atomic<uint32_t> JobCounter;
+
+	struct JobDesc
+	{
+		JobFunction Function;
+		void* UserData;
+		// Shown in profiler captures; may be null
+		const char* Name;
+	};
+
+	struct JobSystemDesc
+	{
+		// Including the thread that creates the job system. 0 uses one per hardware thread.
+		uint32_t WorkerCount = 0;
+		// Pins worker threads to one core each. The creating thread is left alone.
+		bool PinThreads = false;
+	};
+
+	struct JobWorkerStats
+	{
+		uint64_t JobsExecuted;
+		uint64_t Steals;
+		// Steal attempts that found the victim empty or lost the race for its last job
+		uint64_t FailedSteals;
+		uint64_t BusyNs;
+		// Share of the time since the last ResetStats spent running jobs
+		float64_t Utilization;
+	};
+
+	// Work-stealing scheduler with one worker per core. Every worker owns a Chase-Lev deque: it pushes and
+	// pops jobs at the bottom without locks, and idle workers steal from the top of random victims.
+	// The thread that creates the job system is worker 0 and only runs jobs while it waits.
+	//
+	// Waiting on a counter never blocks a worker; it keeps running other jobs until the counter reaches
+	// zero, so jobs can wait on jobs they spawned. Threads that are not workers may submit and wait too.
+	class JobSystem
+	{
+	public:
+		JobSystem(const JobSystemDesc& desc = JobSystemDesc());
+		// Stops the workers once their current jobs finish. Jobs still queued never run, so wait on every
+		// counter before destroying the job system.
+		~JobSystem();
+
+		// counter, if any, is raised by count now and lowered as each job finishes
+		void Run(const JobDesc* jobs, uint32_t count, JobCounter* counter);
+		void Run(JobFunction function, void* userData, JobCounter* counter, const char* name = nullptr);
+		// Runs other jobs until the counter reaches zero
+		void Wait(const JobCounter* counter);
+
+		// Splits [0, count) into chunks of grainSize items, runs them across the workers and waits. With a
+		// grain size of 0 the chunks are sized so every worker gets several, which balances uneven items.
+		void ParallelFor(uint32_t count, ParallelForFunction function, void* userData, uint32_t grainSize = 0,
+			const char* name = nullptr);
+
+		uint32_t GetWorkerCount() const { return _workerCount; }
+		// Index of the calling thread, or UINT32_MAX when it is not a worker of any job system
+		static uint32_t GetCurrentWorker();
+
+		// Set while no jobs are running
+		void SetHook(JobHook hook, void* userData);
+		JobWorkerStats GetWorkerStats(uint32_t workerIndex) const;
+		void ResetStats();
+
+	private:
+		struct Job
+		{
+			JobFunction Function;
+			void* UserData;
+			const char* Name;
+			JobCounter* Counter;
+			// Allocated from the external pool by a thread that is not a worker, freed once it has run
+			bool External;
+			// Next in the external list
+			Job* Next;
+			// Set from allocation until the job has run, so the pool never hands out a queued job
+			std::atomic<bool> Busy{ false };
+		};
+
+		// Fixed size Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory
+		// Models"). Push and Pop only on the owning worker; Steal from any thread.
+		class Deque
+		{
+		public:
+			Deque();
+			bool Push(Job* job);
+			Job* Pop();
+			// Returns null when empty or when another thief won the race
+			Job* Steal();
+
+		private:
+			alignas(64) std::atomic<int64_t> _top;
+			alignas(64) std::atomic<int64_t> _bottom;
+			std::atomic<Job*> _jobs[VKE_JOB_QUEUE_SIZE];
+		};
+
+		struct alignas(64) Worker
+		{
+			Deque Queue;
+			Job Pool[VKE_JOB_QUEUE_SIZE];
+			uint32_t PoolNext = 0;
+			uint32_t Random = 0;
+
+			// Written by the owner only
+			std::atomic<uint64_t> JobsExecuted{ 0 };
+			std::atomic<uint64_t> Steals{ 0 };
+			std::atomic<uint64_t> FailedSteals{ 0 };
+			std::atomic<uint64_t> BusyNs{ 0 };
+		};
+
+		struct ParallelForContext;
+		static void RunParallelFor(void* userData);
+
+		void WorkerLoop(uint32_t workerIndex);
+		Job* FindJob(uint32_t workerIndex);
+		void Execute(Job* job, uint32_t workerIndex);
+		void WakeWorkers(uint32_t count);
+
+		uint32_t _workerCount;
+		Worker* _workers;
+		std::vector<std::thread> _threads;
+		std::atomic<bool> _running;
+
+		// Jobs submitted by threads that are not workers, oldest first
+		std::mutex _externalMutex;
+		ObjectPool<Job> _externalPool;
+		Job* _externalHead;
+		Job* _externalTail;
+
+		// Idle workers sleep until something is queued
+		std::atomic<int32_t> _queuedJobs;
+		std::atomic<uint32_t> _sleepingWorkers;
+		std::mutex _sleepMutex;
+		std::condition_variable _sleepCondition;
+
+		JobHook _hook;
+		void* _hookUserData;
+		std::atomic<uint64_t> _statsStartNs;
+	};
+}
@@ -1,55 +1,373 @@
 #include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
-#include <string>
-#include <iostream>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 #include "vke_assert.h"
+#include "vke_memory.h"
 
 namespace VKE
 {
-	void Logger::WriteLog(const char* prepend, const char* message, va_list args)
+	static const char* LevelPrefix(LogLevel level)
 	{
-		vprintf((std::string(prepend) + message + "\n").c_str(), args);
+		switch (level)
+		{
+		case LogLevel::Trace: return "[TRACE]: ";
+		case LogLevel::Info: return "[INFO]: ";
+		case LogLevel::Warn: return "[WARN]: ";
+		case LogLevel::Error: return "[ERROR]: ";
+		case LogLevel::Fatal:
+		default: return "[FATAL]: ";
+		}
 	}
 
-	void Logger::Trace(const char * message, ...)
+	// Expands a record into out. Each conversion in the format string is handed to snprintf on its own
+	// with the stored argument, after its length modifier is replaced with the one matching our storage type.
+	static uint32_t FormatRecord(const LogRecord& record, char* out, uint32_t capacity)
 	{
-		va_list args;
-		va_start(args, message);
-		WriteLog("[TRACE]: ", message, args);
-		va_end(args);
+		uint32_t length = 0;
+		auto append = [&](const char* str, uint32_t count) {
+			if (length + count >= capacity) {
+				count = capacity - 1 - length;
+			}
+			memcpy(out + length, str, count);
+			length += count;
+		};
+
+		const char* prefix = LevelPrefix(record.Level);
+		append(prefix, (uint32_t)strlen(prefix));
+
+		uint32_t argIndex = 0;
+		const char* c = record.Format;
+		while (*c && length < capacity - 1) {
+			if (*c != '%') {
+				const char* literalEnd = c;
+				while (*literalEnd && *literalEnd != '%') {
+					++literalEnd;
+				}
+				append(c, (uint32_t)(literalEnd - c));
+				c = literalEnd;
+				continue;
+			}
+
+			if (c[1] == '%') {
+				append("%", 1);
+				c += 2;
+				continue;
+			}
+
+			// Flags, width and precision are kept, length modifiers are dropped. A '*' width or precision takes
+			// the next argument and is written into the spec as digits, since snprintf gets a single value.
+			char spec[32];
+			uint32_t specLength = 0;
+			spec[specLength++] = *c++;
+			while (*c && strchr("-+ #0123456789.*", *c) && specLength < sizeof(spec) - 4) {
+				if (*c != '*') {
+					spec[specLength++] = *c++;
+					continue;
+				}
+				++c;
+				const int64_t star = argIndex < record.ArgCount ? record.Args[argIndex++].Signed : 0;
+				const int digits = snprintf(spec + specLength, sizeof(spec) - 4 - specLength, "%d", (int)star);
+				if (digits > 0) {
+					specLength = std::min(specLength + (uint32_t)digits, (uint32_t)sizeof(spec) - 5);
+				}
+			}
+			while (*c && strchr("hljztL", *c)) {
+				++c;
+			}
+
+			const char conversion = *c;
+			if (conversion == '\0') {
+				break;
+			}
+			++c;
+
+			if (argIndex >= record.ArgCount) {
+				append("<missing>", 9);
+				continue;
+			}
+			const LogArg& arg = record.Args[argIndex++];
+
+			// Room for the longest captured string plus some padding
+			char value[LogRecord::StringCapacity + 64];
+			int written = 0;
+			switch (conversion)
+			{
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+			case 'c':
+				if (conversion == 'c') {
+					spec[specLength++] = 'c';
+					spec[specLength] = '\0';
+					written = snprintf(value, sizeof(value), spec, (int)arg.Signed);
+				}
+				else {
+					spec[specLength++] = 'l';
+					spec[specLength++] = 'l';
+					spec[specLength++] = conversion;
+					spec[specLength] = '\0';
+					if (arg.Type == LogArgType::Float) {
+						written = snprintf(value, sizeof(value), spec, (long long)arg.Float);
+					}
+					else if (conversion == 'd' || conversion == 'i') {
+						written = snprintf(value, sizeof(value), spec, (long long)arg.Signed);
+					}
+					else {
+						written = snprintf(value, sizeof(value), spec, (unsigned long long)arg.Unsigned);
+					}
+				}
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				spec[specLength++] = conversion;
+				spec[specLength] = '\0';
+				written = snprintf(value, sizeof(value), spec, arg.Type == LogArgType::Float ? arg.Float : (double)arg.Signed);
+				break;
+			case 's':
+				spec[specLength++] = 's';
+				spec[specLength] = '\0';
+				written = snprintf(value, sizeof(value), spec, arg.Type == LogArgType::String ? record.Strings + arg.StringOffset : "<invalid>");
+				break;
+			case 'p':
+			default:
+				spec[specLength++] = 'p';
+				spec[specLength] = '\0';
+				written = snprintf(value, sizeof(value), spec, arg.Pointer);
+				break;
+			}
+
+			if (written > 0) {
+				append(value, written < (int)sizeof(value) ? (uint32_t)written : (uint32_t)sizeof(value) - 1);
+			}
+		}
+
+		out[length++] = '\n';
+		return length;
+	}
+
+	// Bounded multi-producer single-consumer queue (sequence-numbered slots). Producers claim a slot
+	// with one CAS and never block; when the ring is full the message is dropped and counted.
+	class LogQueue
+	{
+	public:
+		static constexpr uint64_t Capacity = 4096;
+		static constexpr uint32_t BatchCapacity = 16 * 1024;
+
+		LogQueue()
+		{
+			MEMORY_SCOPE(Logger);
+			for (uint64_t i = 0; i < Capacity; ++i) {
+				_records[i].Sequence.store(i, std::memory_order_relaxed);
+			}
+			_thread = std::thread([this]() { Run(); });
+		}
+
+		~LogQueue()
+		{
+			Stop();
+		}
+
+		LogRecord* BeginWrite(uint64_t* position)
+		{
+			uint64_t pos = _enqueuePosition.load(std::memory_order_relaxed);
+			for (;;) {
+				LogRecord& record = _records[pos & (Capacity - 1)];
+				const uint64_t sequence = record.Sequence.load(std::memory_order_acquire);
+				const int64_t diff = (int64_t)sequence - (int64_t)pos;
+				if (diff == 0) {
+					if (_enqueuePosition.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						*position = pos;
+						return &record;
+					}
+				}
+				else if (diff < 0) {
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				else {
+					pos = _enqueuePosition.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		void EndWrite(LogRecord* record, uint64_t position)
+		{
+			record->Sequence.store(position + 1, std::memory_order_release);
+		}
+
+		void Flush()
+		{
+			const uint64_t target = _enqueuePosition.load(std::memory_order_acquire);
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.notify_one();
+			_flushed.wait(lock, [&]() { return _written.load(std::memory_order_acquire) >= target || !_running; });
+		}
+
+		void Stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_running) {
+					return;
+				}
+				_running = false;
+			}
+			_wake.notify_one();
+			_thread.join();
+		}
+
+		uint64_t GetDroppedCount() const
+		{
+			return _dropped.load(std::memory_order_relaxed);
+		}
+
+	private:
+		// Formats and writes everything that is ready. Returns true if anything was written.
+		bool Drain()
+		{
+			uint32_t batchLength = 0;
+			bool any = false;
+
+			for (;;) {
+				LogRecord& record = _records[_dequeuePosition & (Capacity - 1)];
+				const uint64_t sequence = record.Sequence.load(std::memory_order_acquire);
+				if (sequence != _dequeuePosition + 1) {
+					// Empty, or the producer that claimed this slot has not finished writing it yet.
+					break;
+				}
+
+				if (batchLength + 1024 > BatchCapacity) {
+					fwrite(_batch, 1, batchLength, stdout);
+					batchLength = 0;
+				}
+				batchLength += FormatRecord(record, _batch + batchLength, 1024);
+
+				record.Sequence.store(_dequeuePosition + Capacity, std::memory_order_release);
+				_dequeuePosition++;
+				_written.store(_dequeuePosition, std::memory_order_release);
+				any = true;
+			}
+
+			const uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+			if (dropped != _reportedDropped) {
+				if (batchLength + 128 > BatchCapacity) {
+					fwrite(_batch, 1, batchLength, stdout);
+					batchLength = 0;
+				}
+				batchLength += snprintf(_batch + batchLength, BatchCapacity - batchLength,
+					"[WARN]: Logger dropped %llu messages\n", (unsigned long long)(dropped - _reportedDropped));
+				_reportedDropped = dropped;
+			}
+
+			if (batchLength > 0) {
+				fwrite(_batch, 1, batchLength, stdout);
+				fflush(stdout);
+			}
+			return any;
+		}
+
+		void Run()
+		{
+			MEMORY_THREAD(Logger);
+			for (;;) {
+				if (Drain()) {
+					_flushed.notify_all();
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(_mutex);
+				_flushed.notify_all();
+				if (!_running) {
+					break;
+				}
+				_wake.wait_for(lock, std::chrono::milliseconds(2));
+			}
+			Drain();
+		}
+
+		LogRecord _records[Capacity];
+		std::atomic<uint64_t> _enqueuePosition{ 0 };
+		uint64_t _dequeuePosition = 0;
+		std::atomic<uint64_t> _written{ 0 };
+		std::atomic<uint64_t> _dropped{ 0 };
+		uint64_t _reportedDropped = 0;
+
+		char _batch[BatchCapacity];
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _flushed;
+		bool _running = true;
+		std::thread _thread;
+	};
+
+	static LogQueue& GetQueue()
+	{
+		static LogQueue queue;
+		return queue;
 	}
-	
-	void Logger::Info(const char* message, ...)
+
+	LogRecord* Logger::BeginWrite(uint64_t* position)
 	{
-		va_list args;
-		va_start(args, message);
-		WriteLog("[INFO]: ", message, args);
-		va_end(args);
+		return GetQueue().BeginWrite(position);
 	}
 
-	void Logger::Warn(const char* message, ...)
+	void Logger::EndWrite(LogRecord* record, uint64_t position)
 	{
-		va_list args;
-		va_start(args, message);
-		WriteLog("[WARN]: ", message, args);
-		va_end(args);
+		GetQueue().EndWrite(record, position);
 	}
 
-	void Logger::Error(const char* message, ...)
+	uint32_t Logger::CopyString(LogRecord& record, const char* str)
 	{
-		va_list args;
-		va_start(args, message);
-		WriteLog("[ERROR]: ", message, args);
-		va_end(args);
+		const uint32_t offset = record.StringBytes;
+		uint32_t length = offset;
+		if (str) {
+			while (*str && length < LogRecord::StringCapacity - 1) {
+				record.Strings[length++] = *str++;
+			}
+		}
+		record.Strings[length++] = '\0';
+		record.StringBytes = (uint16_t)(length < LogRecord::StringCapacity ? length : LogRecord::StringCapacity - 1);
+		return offset;
 	}
 
-	void Logger::Fatal(const char* message, ...)
+	void Logger::Flush()
 	{
-		va_list args;
-		va_start(args, message);
-		WriteLog("[FATAL]: ", message, args);
-		va_end(args);
+		GetQueue().Flush();
+	}
+
+	void Logger::Shutdown()
+	{
+		GetQueue().Stop();
+	}
+
+	uint64_t Logger::GetDroppedMessageCount()
+	{
+		return GetQueue().GetDroppedCount();
+	}
+
+	void Logger::WriteFatal(const LogRecord& record)
+	{
+		Flush();
+
+		char buffer[1024];
+		const uint32_t length = FormatRecord(record, buffer, sizeof(buffer));
+		fwrite(buffer, 1, length, stderr);
+		fflush(stderr);
 
 		ASSERT(false);
 	}
@@ -1,18 +1,185 @@
 #pragma once
 
-#include <cstdarg>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+#include "vke_defs.h"
+
+#define VKE_LOG_LEVEL_TRACE 0
+#define VKE_LOG_LEVEL_INFO 1
+#define VKE_LOG_LEVEL_WARN 2
+#define VKE_LOG_LEVEL_ERROR 3
+#define VKE_LOG_LEVEL_FATAL 4
+
+// Calls below this level are removed at compile time. Their arguments are still evaluated, so keep
+// expensive ones out of Trace and Info calls.
+#ifndef VKE_MIN_LOG_LEVEL
+	#ifdef NDEBUG
+		#define VKE_MIN_LOG_LEVEL VKE_LOG_LEVEL_WARN
+	#else
+		#define VKE_MIN_LOG_LEVEL VKE_LOG_LEVEL_TRACE
+	#endif
+#endif
 
 namespace VKE {
+	enum class LogLevel : uint8_t
+	{
+		Trace = VKE_LOG_LEVEL_TRACE,
+		Info = VKE_LOG_LEVEL_INFO,
+		Warn = VKE_LOG_LEVEL_WARN,
+		Error = VKE_LOG_LEVEL_ERROR,
+		Fatal = VKE_LOG_LEVEL_FATAL
+	};
+
+	enum class LogArgType : uint8_t
+	{
+		Signed,
+		Unsigned,
+		Float,
+		Pointer,
+		String
+	};
+
+	struct LogArg
+	{
+		LogArgType Type;
+		union
+		{
+			int64_t Signed;
+			uint64_t Unsigned;
+			double Float;
+			const void* Pointer;
+			uint32_t StringOffset; // Into LogRecord::Strings
+		};
+	};
+
+	// One queued message. The format string is kept by pointer (format strings are literals),
+	// arguments are stored raw and strings are copied so the caller's buffers can go away.
+	struct LogRecord
+	{
+		static constexpr uint32_t MaxArgs = 12;
+		static constexpr uint32_t StringCapacity = 320;
+
+		std::atomic<uint64_t> Sequence;
+		const char* Format;
+		LogLevel Level;
+		uint8_t ArgCount;
+		uint16_t StringBytes;
+		LogArg Args[MaxArgs];
+		char Strings[StringCapacity];
+	};
+
 	class Logger
 	{
 	public:
-		static void Trace(const char* message, ...);
-		static void Info(const char* message, ...);
-		static void Warn(const char* message, ...);
-		static void Error(const char* message, ...);
-		static void Fatal(const char* message, ...);
+		template<typename... Args>
+		static FORCEINLINE void Trace(const char* message, Args... args)
+		{
+			Write<LogLevel::Trace>(message, args...);
+		}
+
+		template<typename... Args>
+		static FORCEINLINE void Info(const char* message, Args... args)
+		{
+			Write<LogLevel::Info>(message, args...);
+		}
+
+		template<typename... Args>
+		static FORCEINLINE void Warn(const char* message, Args... args)
+		{
+			Write<LogLevel::Warn>(message, args...);
+		}
+
+		template<typename... Args>
+		static FORCEINLINE void Error(const char* message, Args... args)
+		{
+			Write<LogLevel::Error>(message, args...);
+		}
+
+		// Fatal messages bypass the queue: everything queued so far is flushed, the message
+		// is written synchronously and the assert fires.
+		template<typename... Args>
+		static void Fatal(const char* message, Args... args)
+		{
+			LogRecord record;
+			Capture(record, LogLevel::Fatal, message, args...);
+			WriteFatal(record);
+		}
+
+		// Blocks until every message queued before the call has been written.
+		static void Flush();
+		// Drains the queue and stops the background writer.
+		static void Shutdown();
+
+		// Messages discarded because the queue was full.
+		static uint64_t GetDroppedMessageCount();
 
 	private:
-		static void WriteLog(const char* prepend, const char* message, va_list args);
+		template<LogLevel Level, typename... Args>
+		static FORCEINLINE void Write(const char* message, Args... args)
+		{
+			if constexpr ((int)Level >= VKE_MIN_LOG_LEVEL) {
+				uint64_t position;
+				LogRecord* record = BeginWrite(&position);
+				if (record) {
+					Capture(*record, Level, message, args...);
+					EndWrite(record, position);
+				}
+			}
+		}
+
+		template<typename... Args>
+		static FORCEINLINE void Capture(LogRecord& record, LogLevel level, const char* message, Args... args)
+		{
+			record.Format = message;
+			record.Level = level;
+			record.ArgCount = 0;
+			record.StringBytes = 0;
+			(CaptureArg(record, args), ...);
+		}
+
+		template<typename T>
+		static FORCEINLINE void CaptureArg(LogRecord& record, T value)
+		{
+			if (record.ArgCount == LogRecord::MaxArgs) {
+				return;
+			}
+
+			LogArg& arg = record.Args[record.ArgCount++];
+			if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+				arg.Type = LogArgType::String;
+				arg.StringOffset = CopyString(record, value);
+			}
+			else if constexpr (std::is_floating_point_v<T>) {
+				arg.Type = LogArgType::Float;
+				arg.Float = (double)value;
+			}
+			else if constexpr (std::is_enum_v<T>) {
+				arg.Type = LogArgType::Signed;
+				arg.Signed = (int64_t)value;
+			}
+			else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+				arg.Type = LogArgType::Signed;
+				arg.Signed = (int64_t)value;
+			}
+			else if constexpr (std::is_integral_v<T>) {
+				arg.Type = LogArgType::Unsigned;
+				arg.Unsigned = (uint64_t)value;
+			}
+			else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+				arg.Type = LogArgType::Pointer;
+				arg.Pointer = (const void*)value;
+			}
+			else {
+				static_assert(std::is_pointer_v<T>, "Unsupported log argument type");
+			}
+		}
+
+		static uint32_t CopyString(LogRecord& record, const char* str);
+
+		static LogRecord* BeginWrite(uint64_t* position);
+		static void EndWrite(LogRecord* record, uint64_t position);
+		static void WriteFatal(const LogRecord& record);
 	};
 }
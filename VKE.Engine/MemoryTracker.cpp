@@ -0,0 +1,302 @@
+#ifdef ENABLE_MEMORY_TRACKING
+#include "MemoryTracker.h"
+#include "Logger.h"
+#include "vke_assert.h"
+
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace VKE
+{
+	static const char* const TAG_NAMES[(uint32_t)MemoryTag::Count] = {
+		"General", "Renderer", "Platform", "Assets", "Logger", "IO", "Jobs", "Entities", "Vulkan"
+	};
+
+	const char* GetMemoryTagName(MemoryTag tag)
+	{
+		return tag < MemoryTag::Count ? TAG_NAMES[(uint32_t)tag] : "Unknown";
+	}
+
+	// Counters
+
+	struct TagCounters
+	{
+		std::atomic<uint64_t> CurrentBytes;
+		std::atomic<uint64_t> PeakBytes;
+		std::atomic<uint64_t> Allocations;
+		std::atomic<uint64_t> Frees;
+	};
+
+	// Zero-initialized before any constructor runs, so allocations made during static initialization count
+	static TagCounters g_tags[(uint32_t)MemoryTag::Count];
+	static thread_local MemoryTag t_tag = MemoryTag::General;
+
+	void MemoryTracker::SetThreadTag(MemoryTag tag)
+	{
+		t_tag = tag;
+	}
+
+	MemoryTag MemoryTracker::GetThreadTag()
+	{
+		return t_tag;
+	}
+
+	void MemoryTracker::RecordAllocation(MemoryTag tag, uint64_t size)
+	{
+		TagCounters& counters = g_tags[(uint32_t)tag];
+		counters.Allocations.fetch_add(1, std::memory_order_relaxed);
+		const uint64_t current = counters.CurrentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+		uint64_t peak = counters.PeakBytes.load(std::memory_order_relaxed);
+		while (current > peak && !counters.PeakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+		}
+	}
+
+	void MemoryTracker::RecordFree(MemoryTag tag, uint64_t size)
+	{
+		TagCounters& counters = g_tags[(uint32_t)tag];
+		counters.Frees.fetch_add(1, std::memory_order_relaxed);
+		counters.CurrentBytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+	MemoryTagStats MemoryTracker::GetStats(MemoryTag tag)
+	{
+		const TagCounters& counters = g_tags[(uint32_t)tag];
+		MemoryTagStats stats;
+		stats.CurrentBytes = counters.CurrentBytes.load(std::memory_order_relaxed);
+		stats.PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+		stats.Allocations = counters.Allocations.load(std::memory_order_relaxed);
+		stats.Frees = counters.Frees.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void MemoryTracker::CaptureSnapshot(uint64_t frameNumber, const MemoryDeviceHeap* heaps, uint32_t heapCount, MemorySnapshot* snapshot)
+	{
+		snapshot->FrameNumber = frameNumber;
+		for (uint32_t i = 0; i < (uint32_t)MemoryTag::Count; i++) {
+			snapshot->Tags[i] = GetStats((MemoryTag)i);
+		}
+		snapshot->DeviceHeapCount = std::min(heapCount, (uint32_t)VKE_MEMORY_MAX_DEVICE_HEAPS);
+		for (uint32_t i = 0; i < snapshot->DeviceHeapCount; i++) {
+			snapshot->DeviceHeaps[i] = heaps[i];
+		}
+	}
+
+	// Tracked allocations
+
+	// Sits right before the returned pointer. Offset leads back to the start of the underlying block.
+	struct AllocationHeader
+	{
+		uint64_t Size;
+		uint32_t Offset;
+		MemoryTag Tag;
+	};
+	static_assert(sizeof(AllocationHeader) <= 16, "The header must fit the minimum alignment");
+
+	void* MemoryTracker::Allocate(size_t size, size_t alignment, MemoryTag tag)
+	{
+		// The header takes a whole alignment unit so the returned pointer keeps the requested alignment
+		alignment = std::max(alignment, (size_t)16);
+		ASSERT_MSG((alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+#ifdef _MSC_VER
+		uint8_t* block = (uint8_t*)_aligned_malloc(size + alignment, alignment);
+#else
+		void* pointer = nullptr;
+		uint8_t* block = posix_memalign(&pointer, alignment, size + alignment) == 0 ? (uint8_t*)pointer : nullptr;
+#endif
+		if (!block) {
+			return nullptr;
+		}
+
+		uint8_t* memory = block + alignment;
+		AllocationHeader* header = (AllocationHeader*)memory - 1;
+		header->Size = size;
+		header->Offset = (uint32_t)alignment;
+		header->Tag = tag;
+		RecordAllocation(tag, size);
+		return memory;
+	}
+
+	void MemoryTracker::Free(void* pointer)
+	{
+		if (!pointer) {
+			return;
+		}
+
+		const AllocationHeader* header = (const AllocationHeader*)pointer - 1;
+		RecordFree(header->Tag, header->Size);
+		uint8_t* block = (uint8_t*)pointer - header->Offset;
+#ifdef _MSC_VER
+		_aligned_free(block);
+#else
+		std::free(block);
+#endif
+	}
+
+	// Vulkan host allocations
+
+	static void* VKAPI_PTR VulkanAllocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		return size > 0 ? MemoryTracker::Allocate(size, alignment, MemoryTag::Vulkan) : nullptr;
+	}
+
+	static void* VKAPI_PTR VulkanReallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		if (!original) {
+			return VulkanAllocate(userData, size, alignment, scope);
+		}
+		if (size == 0) {
+			MemoryTracker::Free(original);
+			return nullptr;
+		}
+
+		// On failure the original must stay valid
+		void* memory = MemoryTracker::Allocate(size, alignment, MemoryTag::Vulkan);
+		if (memory) {
+			const AllocationHeader* header = (const AllocationHeader*)original - 1;
+			memcpy(memory, original, std::min((size_t)header->Size, size));
+			MemoryTracker::Free(original);
+		}
+		return memory;
+	}
+
+	static void VKAPI_PTR VulkanFree(void* userData, void* memory)
+	{
+		MemoryTracker::Free(memory);
+	}
+
+	// Memory the driver allocates itself, e.g. for executable code, and only reports
+	static void VKAPI_PTR VulkanInternalAllocation(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+	{
+		MemoryTracker::RecordAllocation(MemoryTag::Vulkan, size);
+	}
+
+	static void VKAPI_PTR VulkanInternalFree(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+	{
+		MemoryTracker::RecordFree(MemoryTag::Vulkan, size);
+	}
+
+	static const VkAllocationCallbacks VULKAN_CALLBACKS = {
+		nullptr, VulkanAllocate, VulkanReallocate, VulkanFree, VulkanInternalAllocation, VulkanInternalFree
+	};
+
+	const VkAllocationCallbacks* MemoryTracker::GetVulkanCallbacks()
+	{
+		return &VULKAN_CALLBACKS;
+	}
+
+	// Monitor
+
+	static float64_t ToMB(uint64_t bytes)
+	{
+		return (float64_t)bytes / (1024.0 * 1024.0);
+	}
+
+	MemoryMonitor::MemoryMonitor()
+		: _previous(), _current(), _report(), _frameCount(0), _windowStartBytes(), _growingWindows(), _loggedSpikeTags(0),
+		_loggedLeakTags(0), _loggedOverBudgetHeaps(0)
+	{
+	}
+
+	const MemoryFrameReport& MemoryMonitor::Update(uint64_t frameNumber, const MemoryDeviceHeap* heaps, uint32_t heapCount)
+	{
+		_previous = _current;
+		MemoryTracker::CaptureSnapshot(frameNumber, heaps, heapCount, &_current);
+		_report = {};
+		if (_frameCount++ == 0) {
+			for (uint32_t i = 0; i < (uint32_t)MemoryTag::Count; i++) {
+				_windowStartBytes[i] = _current.Tags[i].CurrentBytes;
+			}
+			return _report;
+		}
+
+		// Loading allocates heavily, so the first window is flagged but not logged
+		const bool log = _frameCount > VKE_MEMORY_LEAK_WINDOW_FRAMES;
+		const bool windowEnd = _frameCount % VKE_MEMORY_LEAK_WINDOW_FRAMES == 0;
+
+		for (uint32_t i = 0; i < (uint32_t)MemoryTag::Count; i++) {
+			const MemoryTagStats& previous = _previous.Tags[i];
+			const MemoryTagStats& current = _current.Tags[i];
+			const uint32_t bit = 1u << i;
+
+			// Spikes: this frame against the last
+			const uint64_t allocations = current.Allocations - previous.Allocations;
+			const uint64_t growth = current.CurrentBytes > previous.CurrentBytes ? current.CurrentBytes - previous.CurrentBytes : 0;
+			if (allocations > VKE_MEMORY_SPIKE_ALLOCATIONS || growth > VKE_MEMORY_SPIKE_BYTES) {
+				_report.SpikeTags |= bit;
+				if (log && !(_loggedSpikeTags & bit)) {
+					Logger::Warn("Memory spike in %s on frame %llu: %llu allocations, %+.2f MB", TAG_NAMES[i],
+						(unsigned long long)frameNumber, (unsigned long long)allocations, ToMB(growth));
+					_loggedSpikeTags |= bit;
+				}
+			}
+
+			// Leaks: live bytes that only ever go up, window after window
+			if (windowEnd) {
+				if (current.CurrentBytes > _windowStartBytes[i]) {
+					_growingWindows[i]++;
+				}
+				else {
+					_growingWindows[i] = 0;
+					_loggedLeakTags &= ~bit;
+				}
+				_windowStartBytes[i] = current.CurrentBytes;
+			}
+			if (_growingWindows[i] >= VKE_MEMORY_LEAK_WINDOWS) {
+				_report.LeakTags |= bit;
+				if (!(_loggedLeakTags & bit)) {
+					Logger::Warn("Possible leak in %s: live memory grew for %u windows of %u frames, now %.2f MB in %llu allocations",
+						TAG_NAMES[i], _growingWindows[i], (uint32_t)VKE_MEMORY_LEAK_WINDOW_FRAMES, ToMB(current.CurrentBytes),
+						(unsigned long long)(current.Allocations - current.Frees));
+					_loggedLeakTags |= bit;
+				}
+			}
+		}
+		if (windowEnd) {
+			_loggedSpikeTags = 0;
+		}
+
+		for (uint32_t i = 0; i < _current.DeviceHeapCount; i++) {
+			const MemoryDeviceHeap& heap = _current.DeviceHeaps[i];
+			const uint32_t bit = 1u << i;
+			if (heap.Budget > 0 && heap.Usage > heap.Budget) {
+				_report.OverBudgetHeaps |= bit;
+				if (!(_loggedOverBudgetHeaps & bit)) {
+					Logger::Warn("Device heap %u is over budget: %.0f MB used of %.0f MB", i, ToMB(heap.Usage), ToMB(heap.Budget));
+					_loggedOverBudgetHeaps |= bit;
+				}
+			}
+			else {
+				_loggedOverBudgetHeaps &= ~bit;
+			}
+		}
+
+		return _report;
+	}
+
+	void MemoryMonitor::LogSummary() const
+	{
+		for (uint32_t i = 0; i < (uint32_t)MemoryTag::Count; i++) {
+			const MemoryTagStats stats = MemoryTracker::GetStats((MemoryTag)i);
+			if (stats.Allocations == 0) {
+				continue;
+			}
+			Logger::Info("Memory %-8s %9.2f MB current, %9.2f MB peak, %llu live of %llu allocations", TAG_NAMES[i],
+				ToMB(stats.CurrentBytes), ToMB(stats.PeakBytes), (unsigned long long)(stats.Allocations - stats.Frees),
+				(unsigned long long)stats.Allocations);
+		}
+		for (uint32_t i = 0; i < _current.DeviceHeapCount; i++) {
+			const MemoryDeviceHeap& heap = _current.DeviceHeaps[i];
+			Logger::Info("Device heap %u%s: %.0f MB used, %.0f MB budget, %.0f MB total", i, heap.DeviceLocal ? " (device local)" : "",
+				ToMB(heap.Usage), ToMB(heap.Budget), ToMB(heap.Size));
+		}
+	}
+}
+
+#endif // ENABLE_MEMORY_TRACKING
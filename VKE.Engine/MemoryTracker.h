@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vke_types.h"
+
+struct VkAllocationCallbacks;
+
+// Device heaps recorded per snapshot; matches VK_MAX_MEMORY_HEAPS
+#ifndef VKE_MEMORY_MAX_DEVICE_HEAPS
+#define VKE_MEMORY_MAX_DEVICE_HEAPS 16
+#endif
+
+// A tag that makes more allocations than this in one frame is reported as a spike
+#ifndef VKE_MEMORY_SPIKE_ALLOCATIONS
+#define VKE_MEMORY_SPIKE_ALLOCATIONS 512
+#endif
+
+// ...or grows by more than this many bytes in one frame
+#ifndef VKE_MEMORY_SPIKE_BYTES
+#define VKE_MEMORY_SPIKE_BYTES (16ull * 1024 * 1024)
+#endif
+
+// Leak detection compares a tag's live bytes at the end of windows of this many frames...
+#ifndef VKE_MEMORY_LEAK_WINDOW_FRAMES
+#define VKE_MEMORY_LEAK_WINDOW_FRAMES 600
+#endif
+
+// ...and reports a leak once they grew across this many windows in a row
+#ifndef VKE_MEMORY_LEAK_WINDOWS
+#define VKE_MEMORY_LEAK_WINDOWS 5
+#endif
+
+namespace VKE
+{
+	enum class MemoryTag : uint8_t
+	{
+		General,
+		Renderer,
+		Platform,
+		Assets,
+		Logger,
+		IO,
+		Jobs,
+		Entities,
+		// Host memory the Vulkan driver and layers allocate through VK_ALLOCATOR
+		Vulkan,
+		Count
+	};
+
+	const char* GetMemoryTagName(MemoryTag tag);
+
+	struct MemoryTagStats
+	{
+		uint64_t CurrentBytes;
+		uint64_t PeakBytes;
+		// Totals since startup; live allocations are the difference
+		uint64_t Allocations;
+		uint64_t Frees;
+	};
+
+	struct MemoryDeviceHeap
+	{
+		uint64_t Size;
+		// VK_EXT_memory_budget's budget and usage for the whole process, or estimates without it
+		uint64_t Budget;
+		uint64_t Usage;
+		bool DeviceLocal;
+	};
+
+	struct MemorySnapshot
+	{
+		uint64_t FrameNumber;
+		MemoryTagStats Tags[(uint32_t)MemoryTag::Count];
+		uint32_t DeviceHeapCount;
+		MemoryDeviceHeap DeviceHeaps[VKE_MEMORY_MAX_DEVICE_HEAPS];
+	};
+
+	// Bit (1 << tag) or (1 << heap) per flagged entry
+	struct MemoryFrameReport
+	{
+		uint32_t SpikeTags;
+		uint32_t LeakTags;
+		uint32_t OverBudgetHeaps;
+	};
+
+	// Process-wide counters behind the tracking macros in vke_memory.h. Tracked allocations carry a small
+	// header with their size and tag, so a free is charged to the tag that allocated it, whichever thread
+	// frees it. Only operator new and Vulkan host allocations are seen; malloc from third-party code is not.
+	class MemoryTracker
+	{
+	public:
+		static void SetThreadTag(MemoryTag tag);
+		static MemoryTag GetThreadTag();
+
+		// Header-tracked allocation, used by operator new and the Vulkan callbacks. Returns nullptr on failure.
+		static void* Allocate(size_t size, size_t alignment, MemoryTag tag);
+		static void Free(void* pointer);
+
+		// For memory the tracker doesn't own, like the driver's internal allocations
+		static void RecordAllocation(MemoryTag tag, uint64_t size);
+		static void RecordFree(MemoryTag tag, uint64_t size);
+
+		static MemoryTagStats GetStats(MemoryTag tag);
+		static void CaptureSnapshot(uint64_t frameNumber, const MemoryDeviceHeap* heaps, uint32_t heapCount, MemorySnapshot* snapshot);
+
+		static const VkAllocationCallbacks* GetVulkanCallbacks();
+	};
+
+	class MemoryTagScope
+	{
+	public:
+		explicit MemoryTagScope(MemoryTag tag)
+			: _previous(MemoryTracker::GetThreadTag())
+		{
+			MemoryTracker::SetThreadTag(tag);
+		}
+
+		~MemoryTagScope()
+		{
+			MemoryTracker::SetThreadTag(_previous);
+		}
+
+	private:
+		MemoryTag _previous;
+	};
+
+	// Takes a snapshot every frame and compares it with the last one. Spikes and heaps over budget are
+	// flagged the frame they happen; a leak once a tag's live bytes have grown for several windows in a row.
+	class MemoryMonitor
+	{
+	public:
+		MemoryMonitor();
+
+		const MemoryFrameReport& Update(uint64_t frameNumber, const MemoryDeviceHeap* heaps, uint32_t heapCount);
+
+		const MemorySnapshot& GetSnapshot() const { return _current; }
+		const MemoryFrameReport& GetReport() const { return _report; }
+		// Current, peak and live counts per tag, and the device heaps
+		void LogSummary() const;
+
+	private:
+		MemorySnapshot _previous;
+		MemorySnapshot _current;
+		MemoryFrameReport _report;
+		uint64_t _frameCount;
+
+		// Leak windows
+		uint64_t _windowStartBytes[(uint32_t)MemoryTag::Count];
+		uint32_t _growingWindows[(uint32_t)MemoryTag::Count];
+		// Already reported, so a condition is logged once rather than every frame
+		uint32_t _loggedSpikeTags;
+		uint32_t _loggedLeakTags;
+		uint32_t _loggedOverBudgetHeaps;
+	};
+}
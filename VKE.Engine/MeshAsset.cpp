@@ -0,0 +1,128 @@
+#include "MeshAsset.h"
+#include "VulkanPipelineState.h"
+#include "Logger.h"
+#include "vke_profile.h"
+
+namespace VKE
+{
+	// The format stores VkFormat values without including Vulkan
+	static_assert((uint32_t)MESH_FORMAT_R16G16_SNORM == (uint32_t)VK_FORMAT_R16G16_SNORM, "MeshFormat no longer matches VkFormat");
+	static_assert((uint32_t)MESH_FORMAT_R16G16_SFLOAT == (uint32_t)VK_FORMAT_R16G16_SFLOAT, "MeshFormat no longer matches VkFormat");
+	static_assert((uint32_t)MESH_FORMAT_R16G16B16A16_UNORM == (uint32_t)VK_FORMAT_R16G16B16A16_UNORM, "MeshFormat no longer matches VkFormat");
+	static_assert(MESH_MAX_ATTRIBUTES <= VulkanVertexLayout::MaxAttributes, "Cooked meshes may have more attributes than a pipeline");
+
+	static uint32_t GetFormatSize(uint32_t format)
+	{
+		switch (format) {
+		case MESH_FORMAT_R16G16_SNORM: return 4;
+		case MESH_FORMAT_R16G16_SFLOAT: return 4;
+		case MESH_FORMAT_R16G16B16A16_UNORM: return 8;
+		default: return 0;
+		}
+	}
+
+	MeshAsset::MeshAsset()
+		: _base(nullptr), _header(nullptr), _attributes(nullptr)
+	{
+	}
+
+	MeshAsset::~MeshAsset()
+	{
+		Close();
+	}
+
+	bool MeshAsset::Open(const char* path)
+	{
+		PROFILE_FUNCTION();
+		Close();
+
+		if (!Platform::MapFile(path, &_file)) {
+			return false;
+		}
+		if (!Load(_file.Data, _file.Size, path)) {
+			Platform::UnmapFile(&_file);
+			return false;
+		}
+		return true;
+	}
+
+	// Written so that offsets near 2^64 from a corrupt header can't wrap around the check
+	static bool RangeFits(uint64_t offset, uint64_t bytes, uint64_t size)
+	{
+		return offset <= size && bytes <= size - offset;
+	}
+
+	bool MeshAsset::Load(const void* data, uint64_t size, const char* name)
+	{
+		// Open hands in its own mapping
+		if (_file.Data != data) {
+			Close();
+		}
+
+		const uint8_t* base = static_cast<const uint8_t*>(data);
+		const MeshHeader* header = reinterpret_cast<const MeshHeader*>(base);
+		if (size < sizeof(MeshHeader) || header->Magic != MESH_MAGIC || header->Version != MESH_VERSION || header->FileSize != size) {
+			Logger::Error("%s is not a valid cooked mesh", name);
+			return false;
+		}
+
+		if (header->AttributeCount > MESH_MAX_ATTRIBUTES || header->AttributesOffset % alignof(MeshAttribute) != 0 ||
+			!RangeFits(header->AttributesOffset, (uint64_t)header->AttributeCount * sizeof(MeshAttribute), size) ||
+			header->VertexDataOffset % MESH_DATA_ALIGNMENT != 0 || header->IndexDataOffset % MESH_DATA_ALIGNMENT != 0 ||
+			!RangeFits(header->VertexDataOffset, (uint64_t)header->VertexCount * header->VertexStride, size) ||
+			!RangeFits(header->IndexDataOffset, (uint64_t)header->IndexCount * header->IndexSize, size) || (header->IndexSize != 2 && header->IndexSize != 4) || header->IndexCount % 3 != 0) {
+			Logger::Error("Cooked mesh %s has a corrupt header", name);
+			return false;
+		}
+
+		const MeshAttribute* attributes = reinterpret_cast<const MeshAttribute*>(base + header->AttributesOffset);
+		for (uint32_t i = 0; i < header->AttributeCount; i++) {
+			const uint32_t formatSize = GetFormatSize(attributes[i].Format);
+			if (attributes[i].Semantic >= MESH_SEMANTIC_COUNT || formatSize == 0 || (uint64_t)attributes[i].Offset + formatSize > header->VertexStride) {
+				Logger::Error("Cooked mesh %s has an unsupported vertex attribute", name);
+				return false;
+			}
+		}
+
+		_base = base;
+		_header = header;
+		_attributes = attributes;
+		return true;
+	}
+
+	void MeshAsset::Close()
+	{
+		Platform::UnmapFile(&_file);
+		_base = nullptr;
+		_header = nullptr;
+		_attributes = nullptr;
+	}
+
+	void MeshAsset::GetVertexLayout(uint32_t binding, VulkanVertexLayout* layout) const
+	{
+		*layout = VulkanVertexLayout();
+		layout->BindingCount = 1;
+		layout->Bindings[0].binding = binding;
+		layout->Bindings[0].stride = _header->VertexStride;
+		layout->Bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		layout->AttributeCount = _header->AttributeCount;
+		for (uint32_t i = 0; i < _header->AttributeCount; i++) {
+			VkVertexInputAttributeDescription& attribute = layout->Attributes[i];
+			attribute.location = _attributes[i].Semantic;
+			attribute.binding = binding;
+			attribute.format = (VkFormat)_attributes[i].Format;
+			attribute.offset = _attributes[i].Offset;
+		}
+	}
+
+	glm::mat4 MeshAsset::GetDequantizeTransform() const
+	{
+		glm::mat4 transform(1.0f);
+		for (uint32_t axis = 0; axis < 3; axis++) {
+			transform[axis][axis] = _header->PositionScale[axis];
+			transform[3][axis] = _header->PositionOffset[axis];
+		}
+		return transform;
+	}
+}
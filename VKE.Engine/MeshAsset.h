@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include "Platform.h"
+#include "vke_mesh_format.h"
+
+namespace VKE
+{
+	struct VulkanVertexLayout;
+
+	// A cooked .vkmesh, either mapped from its own file for the lifetime of the object or viewed in place
+	// inside an archive. Vertex and index data are uploaded exactly as stored.
+	class MeshAsset
+	{
+	public:
+		MeshAsset();
+		~MeshAsset();
+
+		// Maps the file and validates its header
+		bool Open(const char* path);
+		// Views data that outlives the asset, e.g. AssetArchive::GetMappedData. name is for errors only.
+		bool Load(const void* data, uint64_t size, const char* name);
+		void Close();
+		bool IsLoaded() const { return _header != nullptr; }
+
+		const MeshHeader* GetHeader() const { return _header; }
+		uint32_t GetVertexCount() const { return _header->VertexCount; }
+		uint32_t GetIndexCount() const { return _header->IndexCount; }
+
+		// Ready for VulkanUploadQueue::UploadBuffer straight from the mapping
+		const void* GetVertexData() const { return _base + _header->VertexDataOffset; }
+		VkDeviceSize GetVertexDataSize() const { return (VkDeviceSize)_header->VertexCount * _header->VertexStride; }
+		const void* GetIndexData() const { return _base + _header->IndexDataOffset; }
+		VkDeviceSize GetIndexDataSize() const { return (VkDeviceSize)_header->IndexCount * _header->IndexSize; }
+		VkIndexType GetIndexType() const { return _header->IndexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32; }
+
+		// One interleaved per-vertex binding, built from the attribute table. Shader locations are the semantics.
+		void GetVertexLayout(uint32_t binding, VulkanVertexLayout* layout) const;
+		// Turns the stored 0 to 1 positions back into object space. Fold it into the world matrix.
+		glm::mat4 GetDequantizeTransform() const;
+
+	private:
+		MappedFile _file;
+		const uint8_t* _base;
+		const MeshHeader* _header;
+		const MeshAttribute* _attributes;
+	};
+}
@@ -0,0 +1,134 @@
+#include "MeshBenchmark.h"
+#include "BenchmarkUtils.h"
+#include "MeshCooker.h"
+#include "MeshAsset.h"
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+namespace VKE
+{
+	static constexpr float TORUS_RADIUS = 1.0f;
+	static constexpr float TORUS_TUBE_RADIUS = 0.35f;
+
+	void RunMeshBenchmark(uint32_t triangleCount)
+	{
+		// A rings x sides grid wrapped around a torus, with a seam column and row so the UVs stay continuous
+		const uint32_t sides = std::max((uint32_t)std::sqrt((float64_t)triangleCount / 8.0), 3u);
+		const uint32_t rings = std::max(triangleCount / (2 * sides), 3u);
+		std::vector<MeshCookerVertex> vertices;
+		vertices.reserve((rings + 1) * (sides + 1));
+		for (uint32_t ring = 0; ring <= rings; ring++) {
+			const float u = (float)ring / rings;
+			const float ringAngle = u * 6.2831853f;
+			for (uint32_t side = 0; side <= sides; side++) {
+				const float v = (float)side / sides;
+				const float sideAngle = v * 6.2831853f;
+				const float normal[3] = { std::cos(ringAngle) * std::cos(sideAngle), std::sin(sideAngle), std::sin(ringAngle) * std::cos(sideAngle) };
+				MeshCookerVertex vertex;
+				vertex.Position[0] = std::cos(ringAngle) * TORUS_RADIUS + normal[0] * TORUS_TUBE_RADIUS;
+				vertex.Position[1] = normal[1] * TORUS_TUBE_RADIUS;
+				vertex.Position[2] = std::sin(ringAngle) * TORUS_RADIUS + normal[2] * TORUS_TUBE_RADIUS;
+				memcpy(vertex.Normal, normal, sizeof(normal));
+				vertex.TexCoord[0] = u * 8.0f;
+				vertex.TexCoord[1] = v;
+				vertices.push_back(vertex);
+			}
+		}
+
+		std::vector<uint32_t> indices;
+		indices.reserve(rings * sides * 6);
+		for (uint32_t ring = 0; ring < rings; ring++) {
+			for (uint32_t side = 0; side < sides; side++) {
+				const uint32_t a = ring * (sides + 1) + side;
+				const uint32_t b = a + sides + 1;
+				const uint32_t quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+		const uint32_t vertexCount = (uint32_t)vertices.size();
+		const uint32_t indexCount = (uint32_t)indices.size();
+		triangleCount = indexCount / 3;
+		const float gridAcmr = MeshCooker::ComputeAcmr(indices.data(), indexCount, vertexCount);
+
+		// Shuffle triangles and vertices
+		uint32_t seed = 0x9E3779B9u;
+		for (uint32_t triangle = triangleCount - 1; triangle > 0; triangle--) {
+			const uint32_t other = NextRandom(seed) % (triangle + 1);
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				std::swap(indices[triangle * 3 + corner], indices[other * 3 + corner]);
+			}
+		}
+		std::vector<uint32_t> remap(vertexCount);
+		for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+			remap[vertex] = vertex;
+		}
+		for (uint32_t vertex = vertexCount - 1; vertex > 0; vertex--) {
+			std::swap(remap[vertex], remap[NextRandom(seed) % (vertex + 1)]);
+		}
+		std::vector<MeshCookerVertex> shuffled(vertexCount);
+		for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+			shuffled[remap[vertex]] = vertices[vertex];
+		}
+		for (uint32_t& index : indices) {
+			index = remap[index];
+		}
+
+		std::vector<uint8_t> cooked;
+		MeshCookerStats stats = {};
+		const float64_t cookMs = BestOf([&]() {
+			MeshCooker::Cook(shuffled.data(), vertexCount, indices.data(), indexCount, &cooked, &stats);
+		});
+
+		const float64_t millions = triangleCount / 1e6;
+		Logger::Info("Mesh benchmark, %u triangles, %u vertices, best of %u runs", triangleCount, vertexCount, BENCHMARK_REPEATS);
+		Logger::Info("  ACMR with a %u-entry FIFO | grid order %.3f | shuffled %.3f | cooked %.3f, %u overdraw clusters",
+			VKE_MESH_COOKER_CACHE_SIZE, gridAcmr, stats.AcmrBefore, stats.AcmrAfter, stats.Clusters);
+		Logger::Info("  Footprint                | float %8.2f MB | cooked %8.2f MB | %5.2fx smaller | %.2f MB per million triangles",
+			stats.SourceBytes / 1e6, stats.CookedBytes / 1e6, (float64_t)stats.SourceBytes / stats.CookedBytes, stats.CookedBytes / 1e6 / millions);
+		Logger::Info("  Cook                     | %8.3f ms | %8.3f ms per million triangles", cookMs, cookMs / millions);
+
+		const std::string path = (std::filesystem::temp_directory_path() / "vke_mesh_benchmark.vkmesh").string();
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(cooked.data()), cooked.size());
+			if (file.fail()) {
+				Logger::Error("Unable to write %s", path.c_str());
+				return;
+			}
+		}
+
+		// What loading costs on top of the upload itself: map, validate, and copy into staging memory. Against
+		// copying the same mesh as floats and 32-bit indices, with nothing to map or check.
+		std::vector<uint8_t> staging(std::max<size_t>(cooked.size(), stats.SourceBytes));
+		bool loaded = true;
+		const float64_t loadMs = BestOf([&]() {
+			MeshAsset mesh;
+			loaded = mesh.Open(path.c_str());
+			if (loaded) {
+				memcpy(staging.data(), mesh.GetVertexData(), mesh.GetVertexDataSize());
+				memcpy(staging.data() + mesh.GetVertexDataSize(), mesh.GetIndexData(), mesh.GetIndexDataSize());
+			}
+		});
+		const float64_t floatMs = BestOf([&]() {
+			memcpy(staging.data(), shuffled.data(), vertexCount * sizeof(MeshCookerVertex));
+			memcpy(staging.data() + vertexCount * sizeof(MeshCookerVertex), indices.data(), indexCount * sizeof(uint32_t));
+		});
+		std::filesystem::remove(path);
+		if (!loaded) {
+			Logger::Error("Unable to load %s", path.c_str());
+			return;
+		}
+
+		Logger::Info("  Load, warm page cache    | cooked %8.3f ms | float copy %8.3f ms | %8.3f ms per million cooked triangles",
+			loadMs, floatMs, loadMs / millions);
+	}
+}
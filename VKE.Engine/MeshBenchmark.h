@@ -0,0 +1,12 @@
+#pragma once
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// Cooks a torus of about triangleCount triangles, stored in shuffled order the way a careless exporter
+	// might, and logs the cache miss ratio before and after, the memory footprint against float vertices and
+	// 32-bit indices, and the time to cook and to load it, scaled to a million triangles. Run from the
+	// command line with --bench-meshes [triangles].
+	void RunMeshBenchmark(uint32_t triangleCount = 1000000);
+}
@@ -0,0 +1,504 @@
+#include "MeshCooker.h"
+#include "vke_mesh_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace VKE
+{
+	// Forsyth's scoring: the simulated LRU cache is larger than the real one so the optimizer sees further,
+	// recently used vertices score highest, and vertices with few triangles left get a boost so they are
+	// finished off instead of lingering.
+	static constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+	static constexpr float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+	static constexpr float FORSYTH_CACHE_DECAY = 1.5f;
+	static constexpr float FORSYTH_VALENCE_SCALE = 2.0f;
+	static constexpr float FORSYTH_VALENCE_POWER = 0.5f;
+	static constexpr uint32_t FORSYTH_VALENCE_TABLE_SIZE = 64;
+
+	static float VertexScore(int32_t cachePosition, uint32_t remaining)
+	{
+		if (remaining == 0) {
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			// The last triangle's vertices score the same, whichever order they went in
+			score = cachePosition < 3 ? FORSYTH_LAST_TRIANGLE_SCORE :
+				std::pow(1.0f - (float)(cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY);
+		}
+		return score + FORSYTH_VALENCE_SCALE * std::pow((float)remaining, -FORSYTH_VALENCE_POWER);
+	}
+
+	void MeshCooker::OptimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount)
+	{
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// Scores for every cache position and small valence, computed once
+		float cacheScores[FORSYTH_CACHE_SIZE + 1][FORSYTH_VALENCE_TABLE_SIZE];
+		for (uint32_t position = 0; position <= FORSYTH_CACHE_SIZE; position++) {
+			for (uint32_t remaining = 0; remaining < FORSYTH_VALENCE_TABLE_SIZE; remaining++) {
+				cacheScores[position][remaining] = VertexScore(position < FORSYTH_CACHE_SIZE ? (int32_t)position : -1, remaining);
+			}
+		}
+		auto score = [&](int32_t position, uint32_t remaining) {
+			const uint32_t row = position >= 0 ? (uint32_t)position : FORSYTH_CACHE_SIZE;
+			return remaining < FORSYTH_VALENCE_TABLE_SIZE ? cacheScores[row][remaining] : VertexScore(position, remaining);
+		};
+
+		// Triangles of each vertex. The first Remaining entries of a vertex's range are the ones not yet emitted.
+		std::vector<uint32_t> remaining(vertexCount, 0);
+		for (uint32_t i = 0; i < indexCount; i++) {
+			remaining[indices[i]]++;
+		}
+		std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+		for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+			firstTriangle[vertex + 1] = firstTriangle[vertex] + remaining[vertex];
+		}
+		std::vector<uint32_t> vertexTriangles(indexCount);
+		std::vector<uint32_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (uint32_t i = 0; i < indexCount; i++) {
+			vertexTriangles[filled[indices[i]]++] = i / 3;
+		}
+
+		std::vector<float> vertexScores(vertexCount);
+		for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+			vertexScores[vertex] = score(-1, remaining[vertex]);
+		}
+		std::vector<float> triangleScores(triangleCount);
+		std::vector<uint8_t> emitted(triangleCount, 0);
+		int32_t best = 0;
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+			triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] +
+				vertexScores[indices[triangle * 3 + 2]];
+			if (triangleScores[triangle] > triangleScores[best]) {
+				best = (int32_t)triangle;
+			}
+		}
+
+		std::vector<uint32_t> output;
+		output.reserve(indexCount);
+		uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+		uint32_t cacheCount = 0;
+		// Where to look for a new start once the cache has nothing left to offer
+		uint32_t nextUnemitted = 0;
+		while (best >= 0) {
+			const uint32_t* corners = &indices[best * 3];
+			output.insert(output.end(), corners, corners + 3);
+			emitted[best] = 1;
+
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				const uint32_t vertex = corners[corner];
+				uint32_t* triangles = &vertexTriangles[firstTriangle[vertex]];
+				for (uint32_t i = 0; i < remaining[vertex]; i++) {
+					if (triangles[i] == (uint32_t)best) {
+						triangles[i] = triangles[remaining[vertex] - 1];
+						remaining[vertex]--;
+						break;
+					}
+				}
+			}
+
+			// The triangle's vertices move to the front; whatever is pushed past the end leaves the cache
+			uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+			uint32_t newCount = 0;
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				if (std::find(newCache, newCache + newCount, corners[corner]) == newCache + newCount) {
+					newCache[newCount++] = corners[corner];
+				}
+			}
+			for (uint32_t i = 0; i < cacheCount; i++) {
+				if (std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount) {
+					newCache[newCount++] = cache[i];
+				}
+			}
+
+			for (uint32_t i = 0; i < newCount; i++) {
+				const uint32_t vertex = newCache[i];
+				const int32_t position = i < FORSYTH_CACHE_SIZE ? (int32_t)i : -1;
+				const float vertexScore = score(position, remaining[vertex]);
+				const float delta = vertexScore - vertexScores[vertex];
+				vertexScores[vertex] = vertexScore;
+				const uint32_t* triangles = &vertexTriangles[firstTriangle[vertex]];
+				for (uint32_t j = 0; j < remaining[vertex]; j++) {
+					triangleScores[triangles[j]] += delta;
+				}
+			}
+			cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+			memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+
+			// Only triangles that touch the cache changed score, so the best is among them
+			best = -1;
+			float bestScore = -1.0f;
+			for (uint32_t i = 0; i < cacheCount; i++) {
+				const uint32_t vertex = cache[i];
+				const uint32_t* triangles = &vertexTriangles[firstTriangle[vertex]];
+				for (uint32_t j = 0; j < remaining[vertex]; j++) {
+					if (triangleScores[triangles[j]] > bestScore) {
+						bestScore = triangleScores[triangles[j]];
+						best = (int32_t)triangles[j];
+					}
+				}
+			}
+			if (best < 0) {
+				while (nextUnemitted < triangleCount && emitted[nextUnemitted]) {
+					nextUnemitted++;
+				}
+				best = nextUnemitted < triangleCount ? (int32_t)nextUnemitted : -1;
+			}
+		}
+
+		memcpy(indices, output.data(), triangleCount * 3 * sizeof(uint32_t));
+	}
+
+	uint32_t MeshCooker::OptimizeOverdraw(uint32_t* indices, uint32_t indexCount, const MeshCookerVertex* vertices, uint32_t vertexCount)
+	{
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return 0;
+		}
+
+		// A cluster starts wherever a triangle misses on all three vertices, so moving clusters around
+		// leaves the cache behaviour inside each one as it was
+		std::vector<uint32_t> hardStarts;
+		std::vector<uint32_t> cacheTimes(vertexCount, 0);
+		uint32_t time = VKE_MESH_COOKER_CACHE_SIZE + 1;
+		auto countMisses = [&](uint32_t triangle) {
+			uint32_t misses = 0;
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				const uint32_t vertex = indices[triangle * 3 + corner];
+				if (time - cacheTimes[vertex] > VKE_MESH_COOKER_CACHE_SIZE) {
+					cacheTimes[vertex] = time++;
+					misses++;
+				}
+			}
+			return misses;
+		};
+		auto flushCache = [&]() { time += VKE_MESH_COOKER_CACHE_SIZE + 1; };
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+			if (countMisses(triangle) == 3 || triangle == 0) {
+				hardStarts.push_back(triangle);
+			}
+		}
+		hardStarts.push_back(triangleCount);
+
+		// Cache-optimized meshes have few of those, so each is split again wherever the part so far, drawn
+		// from a cold cache, is within the threshold of the whole cluster's miss ratio
+		std::vector<uint32_t> clusterStarts;
+		for (uint32_t hard = 0; hard + 1 < (uint32_t)hardStarts.size(); hard++) {
+			const uint32_t begin = hardStarts[hard];
+			const uint32_t end = hardStarts[hard + 1];
+			flushCache();
+			uint32_t hardMisses = 0;
+			for (uint32_t triangle = begin; triangle < end; triangle++) {
+				hardMisses += countMisses(triangle);
+			}
+			const float targetAcmr = (float)hardMisses / (float)(end - begin) * VKE_MESH_COOKER_OVERDRAW_THRESHOLD;
+
+			flushCache();
+			clusterStarts.push_back(begin);
+			uint32_t misses = 0;
+			for (uint32_t triangle = begin; triangle < end; triangle++) {
+				misses += countMisses(triangle);
+				if (triangle + 1 < end && (float)misses <= targetAcmr * (float)(triangle + 1 - clusterStarts.back())) {
+					clusterStarts.push_back(triangle + 1);
+					flushCache();
+					misses = 0;
+				}
+			}
+		}
+		const uint32_t clusterCount = (uint32_t)clusterStarts.size();
+		clusterStarts.push_back(triangleCount);
+
+		// Area-weighted centroid and normal of each cluster and of the whole mesh
+		struct Cluster
+		{
+			float Centroid[3];
+			float Normal[3];
+			float Area;
+			float Sort;
+		};
+		std::vector<Cluster> clusters(clusterCount);
+		float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+		float meshArea = 0.0f;
+		for (uint32_t index = 0; index < clusterCount; index++) {
+			Cluster& cluster = clusters[index];
+			cluster = Cluster();
+			for (uint32_t triangle = clusterStarts[index]; triangle < clusterStarts[index + 1]; triangle++) {
+				const float* a = vertices[indices[triangle * 3]].Position;
+				const float* b = vertices[indices[triangle * 3 + 1]].Position;
+				const float* c = vertices[indices[triangle * 3 + 2]].Position;
+				const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				const float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+				const float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				for (uint32_t axis = 0; axis < 3; axis++) {
+					cluster.Centroid[axis] += (a[axis] + b[axis] + c[axis]) * (area / 3.0f);
+					cluster.Normal[axis] += normal[axis];
+				}
+				cluster.Area += area;
+			}
+			for (uint32_t axis = 0; axis < 3; axis++) {
+				meshCentroid[axis] += cluster.Centroid[axis];
+			}
+			meshArea += cluster.Area;
+		}
+
+		for (uint32_t axis = 0; axis < 3; axis++) {
+			meshCentroid[axis] = meshArea > 0.0f ? meshCentroid[axis] / meshArea : 0.0f;
+		}
+		for (Cluster& cluster : clusters) {
+			const float normalLength = std::sqrt(cluster.Normal[0] * cluster.Normal[0] + cluster.Normal[1] * cluster.Normal[1] +
+				cluster.Normal[2] * cluster.Normal[2]);
+			cluster.Sort = 0.0f;
+			if (cluster.Area > 0.0f && normalLength > 0.0f) {
+				for (uint32_t axis = 0; axis < 3; axis++) {
+					cluster.Sort += (cluster.Centroid[axis] / cluster.Area - meshCentroid[axis]) * cluster.Normal[axis] / normalLength;
+				}
+			}
+		}
+
+		// Outward-facing first; equal keys keep the cache order
+		std::vector<uint32_t> order(clusterCount);
+		for (uint32_t index = 0; index < clusterCount; index++) {
+			order[index] = index;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return clusters[a].Sort > clusters[b].Sort; });
+
+		std::vector<uint32_t> sorted;
+		sorted.reserve(indexCount);
+		for (uint32_t index : order) {
+			sorted.insert(sorted.end(), indices + clusterStarts[index] * 3, indices + clusterStarts[index + 1] * 3);
+		}
+		memcpy(indices, sorted.data(), triangleCount * 3 * sizeof(uint32_t));
+		return clusterCount;
+	}
+
+	uint32_t MeshCooker::OptimizeVertexFetch(MeshCookerVertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount)
+	{
+		std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+		uint32_t usedCount = 0;
+		for (uint32_t i = 0; i < indexCount; i++) {
+			uint32_t& target = remap[indices[i]];
+			if (target == UINT32_MAX) {
+				target = usedCount++;
+			}
+			indices[i] = target;
+		}
+
+		std::vector<MeshCookerVertex> reordered(usedCount);
+		for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+			if (remap[vertex] != UINT32_MAX) {
+				reordered[remap[vertex]] = vertices[vertex];
+			}
+		}
+		memcpy(vertices, reordered.data(), usedCount * sizeof(MeshCookerVertex));
+		return usedCount;
+	}
+
+	float MeshCooker::ComputeAcmr(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+	{
+		if (indexCount < 3) {
+			return 0.0f;
+		}
+
+		// FIFO: a vertex is a hit while fewer than cacheSize misses happened since it went in
+		std::vector<uint32_t> cacheTimes(vertexCount, 0);
+		uint32_t time = cacheSize + 1;
+		uint32_t misses = 0;
+		for (uint32_t i = 0; i < indexCount; i++) {
+			if (time - cacheTimes[indices[i]] > cacheSize) {
+				cacheTimes[indices[i]] = time++;
+				misses++;
+			}
+		}
+		return (float)misses / (float)(indexCount / 3);
+	}
+
+	// Quantization
+
+	static uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+		const uint32_t floatExponent = (bits >> 23) & 0xFF;
+		uint32_t mantissa = bits & 0x7FFFFF;
+		if (floatExponent == 0xFF) {
+			return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+		}
+
+		const int32_t exponent = (int32_t)floatExponent - 127 + 15;
+		if (exponent >= 31) {
+			return sign | 0x7C00;
+		}
+		if (exponent <= 0) {
+			// Subnormal, or too small for a half
+			if (exponent < -10) {
+				return sign;
+			}
+			mantissa |= 0x800000;
+			const uint32_t shift = (uint32_t)(14 - exponent);
+			return sign | (uint16_t)((mantissa >> shift) + ((mantissa >> (shift - 1)) & 1));
+		}
+		// Rounding may carry into the exponent, which is still the right answer
+		return sign | (uint16_t)((((uint32_t)exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+	}
+
+	static int16_t FloatToSnorm16(float value)
+	{
+		return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+	}
+
+	// Projects the unit normal onto an octahedron and unfolds it into a square: 2 components instead of 3,
+	// with an error spread evenly over the sphere
+	static void EncodeOctahedral(const float* normal, int16_t* encoded)
+	{
+		const float sum = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+		if (sum == 0.0f) {
+			encoded[0] = 0;
+			encoded[1] = 0;
+			return;
+		}
+
+		float x = normal[0] / sum;
+		float y = normal[1] / sum;
+		if (normal[2] < 0.0f) {
+			const float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			const float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		encoded[0] = FloatToSnorm16(x);
+		encoded[1] = FloatToSnorm16(y);
+	}
+
+	// Matches the attribute table written by Cook
+	struct CookedVertex
+	{
+		uint16_t Position[4];
+		int16_t Normal[2];
+		uint16_t TexCoord[2];
+	};
+	static_assert(sizeof(CookedVertex) == 16, "CookedVertex must stay tightly packed");
+
+	static uint64_t AlignOffset(uint64_t offset)
+	{
+		return (offset + MESH_DATA_ALIGNMENT - 1) & ~(uint64_t)(MESH_DATA_ALIGNMENT - 1);
+	}
+
+	bool MeshCooker::Cook(const MeshCookerVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+		std::vector<uint8_t>* output, MeshCookerStats* stats)
+	{
+		if (vertexCount == 0 || indexCount == 0 || indexCount % 3 != 0) {
+			return false;
+		}
+		for (uint32_t i = 0; i < indexCount; i++) {
+			if (indices[i] >= vertexCount) {
+				return false;
+			}
+		}
+
+		std::vector<MeshCookerVertex> cookedVertices(vertices, vertices + vertexCount);
+		std::vector<uint32_t> cookedIndices(indices, indices + indexCount);
+
+		MeshCookerStats cookStats = {};
+		cookStats.TriangleCount = indexCount / 3;
+		cookStats.AcmrBefore = ComputeAcmr(indices, indexCount, vertexCount);
+		cookStats.SourceBytes = (uint64_t)vertexCount * sizeof(MeshCookerVertex) + (uint64_t)indexCount * sizeof(uint32_t);
+
+		OptimizeVertexCache(cookedIndices.data(), indexCount, vertexCount);
+		cookStats.Clusters = OptimizeOverdraw(cookedIndices.data(), indexCount, cookedVertices.data(), vertexCount);
+		const uint32_t usedCount = OptimizeVertexFetch(cookedVertices.data(), vertexCount, cookedIndices.data(), indexCount);
+		cookStats.VertexCount = usedCount;
+		cookStats.AcmrAfter = ComputeAcmr(cookedIndices.data(), indexCount, usedCount);
+
+		MeshHeader header = {};
+		header.Magic = MESH_MAGIC;
+		header.Version = MESH_VERSION;
+		header.VertexCount = usedCount;
+		header.IndexCount = indexCount;
+		header.VertexStride = sizeof(CookedVertex);
+		header.IndexSize = usedCount <= 0xFFFF ? 2 : 4;
+		header.AttributeCount = 3;
+
+		// Bounds, for quantization and culling
+		float minimum[3] = { cookedVertices[0].Position[0], cookedVertices[0].Position[1], cookedVertices[0].Position[2] };
+		float maximum[3] = { minimum[0], minimum[1], minimum[2] };
+		for (uint32_t vertex = 1; vertex < usedCount; vertex++) {
+			for (uint32_t axis = 0; axis < 3; axis++) {
+				minimum[axis] = std::min(minimum[axis], cookedVertices[vertex].Position[axis]);
+				maximum[axis] = std::max(maximum[axis], cookedVertices[vertex].Position[axis]);
+			}
+		}
+		for (uint32_t axis = 0; axis < 3; axis++) {
+			header.PositionOffset[axis] = minimum[axis];
+			header.PositionScale[axis] = maximum[axis] - minimum[axis];
+			header.BoundingSphere[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+		}
+		float radiusSquared = 0.0f;
+		for (uint32_t vertex = 0; vertex < usedCount; vertex++) {
+			float distanceSquared = 0.0f;
+			for (uint32_t axis = 0; axis < 3; axis++) {
+				const float delta = cookedVertices[vertex].Position[axis] - header.BoundingSphere[axis];
+				distanceSquared += delta * delta;
+			}
+			radiusSquared = std::max(radiusSquared, distanceSquared);
+		}
+		header.BoundingSphere[3] = std::sqrt(radiusSquared);
+
+		const MeshAttribute attributes[3] = {
+			{ MESH_SEMANTIC_POSITION, MESH_FORMAT_R16G16B16A16_UNORM, (uint32_t)offsetof(CookedVertex, Position), 0 },
+			{ MESH_SEMANTIC_NORMAL, MESH_FORMAT_R16G16_SNORM, (uint32_t)offsetof(CookedVertex, Normal), 0 },
+			{ MESH_SEMANTIC_TEXCOORD, MESH_FORMAT_R16G16_SFLOAT, (uint32_t)offsetof(CookedVertex, TexCoord), 0 }
+		};
+
+		header.AttributesOffset = sizeof(MeshHeader);
+		header.VertexDataOffset = AlignOffset(header.AttributesOffset + sizeof(attributes));
+		header.IndexDataOffset = AlignOffset(header.VertexDataOffset + (uint64_t)usedCount * header.VertexStride);
+		header.FileSize = header.IndexDataOffset + (uint64_t)indexCount * header.IndexSize;
+
+		output->assign(header.FileSize, 0);
+		uint8_t* base = output->data();
+		memcpy(base, &header, sizeof(header));
+		memcpy(base + header.AttributesOffset, attributes, sizeof(attributes));
+
+		CookedVertex* packed = reinterpret_cast<CookedVertex*>(base + header.VertexDataOffset);
+		for (uint32_t vertex = 0; vertex < usedCount; vertex++) {
+			const MeshCookerVertex& source = cookedVertices[vertex];
+			CookedVertex& destination = packed[vertex];
+			for (uint32_t axis = 0; axis < 3; axis++) {
+				const float scale = header.PositionScale[axis];
+				const float normalized = scale > 0.0f ? (source.Position[axis] - minimum[axis]) / scale : 0.0f;
+				destination.Position[axis] = (uint16_t)std::lround(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f);
+			}
+			destination.Position[3] = 0;
+			EncodeOctahedral(source.Normal, destination.Normal);
+			destination.TexCoord[0] = FloatToHalf(source.TexCoord[0]);
+			destination.TexCoord[1] = FloatToHalf(source.TexCoord[1]);
+		}
+
+		uint8_t* indexData = base + header.IndexDataOffset;
+		if (header.IndexSize == 2) {
+			uint16_t* shortIndices = reinterpret_cast<uint16_t*>(indexData);
+			for (uint32_t i = 0; i < indexCount; i++) {
+				shortIndices[i] = (uint16_t)cookedIndices[i];
+			}
+		}
+		else {
+			memcpy(indexData, cookedIndices.data(), (size_t)indexCount * sizeof(uint32_t));
+		}
+
+		cookStats.CookedBytes = header.FileSize;
+		if (stats) {
+			*stats = cookStats;
+		}
+		return true;
+	}
+}
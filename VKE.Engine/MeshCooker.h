@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Entries of the FIFO post-transform cache ComputeAcmr simulates, a typical size for current GPUs
+#ifndef VKE_MESH_COOKER_CACHE_SIZE
+#define VKE_MESH_COOKER_CACHE_SIZE 16
+#endif
+
+// How much worse than the cache order the overdraw pass may make the miss ratio, for smaller clusters to sort
+#ifndef VKE_MESH_COOKER_OVERDRAW_THRESHOLD
+#define VKE_MESH_COOKER_OVERDRAW_THRESHOLD 1.05f
+#endif
+
+namespace VKE {
+	// What an importer hands the cooker, one per unique vertex
+	struct MeshCookerVertex
+	{
+		float Position[3];
+		float Normal[3];
+		float TexCoord[2];
+	};
+
+	struct MeshCookerStats
+	{
+		uint32_t VertexCount;
+		uint32_t TriangleCount;
+		// Average cache miss ratio: vertex shader invocations per triangle, 0.5 at best and 3 at worst
+		float AcmrBefore;
+		float AcmrAfter;
+		// Groups of triangles the overdraw pass sorted
+		uint32_t Clusters;
+		// Float vertices and 32-bit indices, against the cooked file
+		uint64_t SourceBytes;
+		uint64_t CookedBytes;
+	};
+
+	// Offline mesh optimization and serialization into the .vkmesh format (see vke_mesh_format.h). Used by
+	// VKE.Cooker, and by the engine's mesh benchmark.
+	class MeshCooker
+	{
+	public:
+		// Reorders triangles for the post-transform vertex cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+		static void OptimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+
+		// Splits the cache-ordered triangles into clusters that each start from a cold cache and sorts them
+		// outward-facing first, so from most directions near surfaces are drawn before the ones behind them
+		// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). Returns the
+		// number of clusters.
+		static uint32_t OptimizeOverdraw(uint32_t* indices, uint32_t indexCount, const MeshCookerVertex* vertices, uint32_t vertexCount);
+
+		// Renumbers vertices in the order the indices first use them and drops unused ones. Returns the new count.
+		static uint32_t OptimizeVertexFetch(MeshCookerVertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount);
+
+		static float ComputeAcmr(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+			uint32_t cacheSize = VKE_MESH_COOKER_CACHE_SIZE);
+
+		// Runs the three passes on copies of the input, quantizes and writes a whole .vkmesh to output.
+		// Returns false for empty meshes, lists that aren't triangles and indices out of range.
+		static bool Cook(const MeshCookerVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+			std::vector<uint8_t>* output, MeshCookerStats* stats);
+	};
+}
@@ -0,0 +1,124 @@
+#include "OcclusionBenchmark.h"
+#include "BenchmarkUtils.h"
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace VKE
+{
+	// Buildings per side, each BUILDING_SIZE wide with a street of STREET_WIDTH on two sides
+	static constexpr uint32_t CITY_SIZE = 24;
+	static constexpr float BUILDING_SIZE = 8.0f;
+	static constexpr float STREET_WIDTH = 4.0f;
+
+	void RunOcclusionBenchmark(uint32_t occludeeCount)
+	{
+		occludeeCount = std::max(occludeeCount, 1u);
+
+		// A unit cube, scaled into every building
+		const glm::vec3 cubePositions[8] = {
+			{ 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+			{ 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, { 0.0f, 1.0f, 1.0f }
+		};
+		const uint32_t cubeIndices[36] = {
+			0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+			3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5
+		};
+
+		uint32_t seed = 0x9E3779B9u;
+		const float pitch = BUILDING_SIZE + STREET_WIDTH;
+		std::vector<glm::mat4> buildings;
+		for (uint32_t z = 0; z < CITY_SIZE; z++) {
+			for (uint32_t x = 0; x < CITY_SIZE; x++) {
+				const glm::vec3 size(BUILDING_SIZE, RandomFloat(seed, 6.0f, 30.0f), BUILDING_SIZE);
+				buildings.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x * pitch, 0.0f, z * pitch)), size));
+			}
+		}
+
+		// Small boxes anywhere in the city, on the streets and inside buildings alike
+		const float citySize = CITY_SIZE * pitch;
+		std::vector<glm::vec3> mins(occludeeCount);
+		std::vector<glm::vec3> maxes(occludeeCount);
+		for (uint32_t i = 0; i < occludeeCount; i++) {
+			mins[i] = glm::vec3(RandomFloat(seed, 0.0f, citySize), RandomFloat(seed, 0.0f, 3.0f), RandomFloat(seed, 0.0f, citySize));
+			maxes[i] = mins[i] + glm::vec3(RandomFloat(seed, 0.5f, 2.0f));
+		}
+		std::vector<uint8_t> visible(occludeeCount);
+
+		// Standing at a crossing in one corner, looking diagonally across the city
+		const float crossing = BUILDING_SIZE + STREET_WIDTH * 0.5f;
+		const glm::mat4 view = glm::lookAt(glm::vec3(crossing, 1.7f, crossing), glm::vec3(citySize, 1.7f, citySize * 0.75f),
+			glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(60.0f), (float)OcclusionCuller::Width / OcclusionCuller::Height,
+			0.1f, 1000.0f);
+		const glm::mat4 viewProjection = projection * view;
+
+		JobSystem jobs;
+		OcclusionCuller culler;
+		auto addOccluders = [&]() {
+			culler.Begin(viewProjection);
+			for (const glm::mat4& building : buildings) {
+				culler.AddOccluder(cubePositions, 8, cubeIndices, 36, building);
+			}
+		};
+
+		// Frustum culling alone, with nothing rasterized
+		culler.Begin(viewProjection);
+		culler.Rasterize();
+		const uint32_t inFrustum = culler.TestBoxes(mins.data(), maxes.data(), occludeeCount, visible.data());
+
+		const float64_t binMs = BestOf(addOccluders);
+		const OcclusionStats& stats = culler.GetStats();
+		const SimdLevel bestLevel = GetSimdLevel();
+		Logger::Info("Occlusion benchmark, %u occluders, %u triangles in %u bin references, %ux%u pixels, %s, %u workers, best of %u runs",
+			stats.Occluders, stats.Triangles, stats.BinnedTriangles, OcclusionCuller::Width, OcclusionCuller::Height,
+			GetSimdLevelName(bestLevel), jobs.GetWorkerCount(), BENCHMARK_REPEATS);
+		Logger::Info("  %-30s | %8.3f ms", "Transform, clip and bin", binMs);
+
+		// Every level must produce the scalar depth buffer, give or take FMA rounding
+		culler.SetSimdLevel(SimdLevel::Scalar);
+		culler.Rasterize();
+		const std::vector<float> reference(culler.GetDepth(), culler.GetDepth() + OcclusionCuller::Width * OcclusionCuller::Height);
+		auto maxError = [&]() {
+			float error = 0.0f;
+			for (uint32_t i = 0; i < (uint32_t)reference.size(); i++) {
+				error = std::max(error, std::fabs(culler.GetDepth()[i] - reference[i]));
+			}
+			return error;
+		};
+
+		char name[64];
+		float64_t scalarMs = 0.0;
+		for (uint32_t level = 0; level <= (uint32_t)bestLevel; level++) {
+			culler.SetSimdLevel((SimdLevel)level);
+			const float64_t ms = BestOf([&]() { culler.Rasterize(); });
+			scalarMs = level == 0 ? ms : scalarMs;
+			snprintf(name, sizeof(name), "Rasterize %s", GetSimdLevelName((SimdLevel)level));
+			Logger::Info("  %-30s | %8.3f ms | %6.2fx | max error %.2e", name, ms, scalarMs / ms, maxError());
+		}
+
+		culler.SetSimdLevel(bestLevel);
+		const float64_t parallelMs = BestOf([&]() { culler.Rasterize(&jobs); });
+		snprintf(name, sizeof(name), "Rasterize %s, parallel", GetSimdLevelName(bestLevel));
+		Logger::Info("  %-30s | %8.3f ms | %6.2fx | max error %.2e", name, parallelMs, scalarMs / parallelMs, maxError());
+
+		uint32_t visibleCount = 0;
+		const float64_t testMs = BestOf([&]() {
+			visibleCount = culler.TestBoxes(mins.data(), maxes.data(), occludeeCount, visible.data());
+		});
+		const float64_t parallelTestMs = BestOf([&]() {
+			visibleCount = culler.TestBoxes(mins.data(), maxes.data(), occludeeCount, visible.data(), &jobs);
+		});
+		Logger::Info("  %-30s | %8.3f ms | parallel %8.3f ms | %u boxes, %u in the frustum, %u visible (%.1f%% of the frustum culled)",
+			"Test boxes", testMs, parallelTestMs, occludeeCount, inFrustum, visibleCount,
+			inFrustum > 0 ? 100.0 * (inFrustum - visibleCount) / inFrustum : 0.0);
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// Builds a street-level view into a dense grid of buildings and logs the time to bin and rasterize them
+	// as occluders at each SIMD level, single threaded and on the job system, then to test occludeeCount
+	// random boxes and how many survive frustum and occlusion culling. Run from the command line with
+	// --bench-occlusion [boxes].
+	void RunOcclusionBenchmark(uint32_t occludeeCount = 100000);
+}
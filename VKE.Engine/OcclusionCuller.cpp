@@ -0,0 +1,440 @@
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "vke_assert.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+namespace VKE
+{
+	static_assert(VKE_OCCLUSION_WIDTH % VKE_OCCLUSION_BIN_WIDTH == 0 && VKE_OCCLUSION_HEIGHT % VKE_OCCLUSION_BIN_HEIGHT == 0,
+		"The occlusion buffer must be a whole number of bins");
+	static_assert(VKE_OCCLUSION_BIN_WIDTH % VKE_OCCLUSION_BLOCK_SIZE == 0 && VKE_OCCLUSION_BIN_HEIGHT % VKE_OCCLUSION_BLOCK_SIZE == 0,
+		"Occlusion bins must be a whole number of blocks");
+	static_assert(VKE_OCCLUSION_BLOCK_SIZE % 8 == 0, "Occlusion blocks must be a whole number of AVX2 rows");
+
+	// Triangles smaller than this many square pixels cover no pixel center worth the setup
+	static constexpr float MIN_TRIANGLE_AREA = 1e-6f;
+	// Boxes per ParallelFor chunk in TestBoxes
+	static constexpr uint32_t TEST_BOXES_PER_JOB = 256;
+
+	OcclusionCuller::OcclusionCuller()
+		: _viewProjection(1.0f), _depth(Width * Height, 1.0f), _blockDepth(BlockColumns * BlockRows, 1.0f),
+		_simdLevel(VKE::GetSimdLevel()), _stats()
+	{
+	}
+
+	void OcclusionCuller::SetSimdLevel(SimdLevel level)
+	{
+		_simdLevel = std::min(level, VKE::GetSimdLevel());
+	}
+
+	// Occluders
+
+	void OcclusionCuller::Begin(const glm::mat4& viewProjection)
+	{
+		_viewProjection = viewProjection;
+		_triangles.clear();
+		for (std::vector<uint32_t>& bin : _bins) {
+			bin.clear();
+		}
+		_stats.Occluders = 0;
+		_stats.Triangles = 0;
+		_stats.BinnedTriangles = 0;
+	}
+
+	void OcclusionCuller::AddOccluder(const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+		const glm::mat4& world)
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(indexCount % 3 == 0, "Occluders must be triangle lists");
+
+		const glm::mat4 worldViewProjection = _viewProjection * world;
+		_clipVertices.resize(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			_clipVertices[i] = worldViewProjection * glm::vec4(positions[i], 1.0f);
+		}
+
+		for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+			ASSERT(indices[i] < vertexCount && indices[i + 1] < vertexCount && indices[i + 2] < vertexCount);
+			ClipTriangle(_clipVertices[indices[i]], _clipVertices[indices[i + 1]], _clipVertices[indices[i + 2]]);
+		}
+		_stats.Occluders++;
+	}
+
+	void OcclusionCuller::ClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		// Entirely outside one side of the frustum. The far plane is not clipped; depth above 1 never wins.
+		if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+			(a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+			(a.z > a.w && b.z > b.w && c.z > c.w) || (a.z < 0.0f && b.z < 0.0f && c.z < 0.0f)) {
+			return;
+		}
+		if (a.z >= 0.0f && b.z >= 0.0f && c.z >= 0.0f) {
+			BinTriangle(a, b, c);
+			return;
+		}
+
+		// Crosses the near plane, z = 0 with 0 to 1 depth. What is left is a triangle or a quad.
+		const glm::vec4 input[3] = { a, b, c };
+		glm::vec4 output[4];
+		uint32_t outputCount = 0;
+		for (uint32_t i = 0; i < 3; i++) {
+			const glm::vec4& current = input[i];
+			const glm::vec4& next = input[(i + 1) % 3];
+			if (current.z >= 0.0f) {
+				output[outputCount++] = current;
+			}
+			if ((current.z >= 0.0f) != (next.z >= 0.0f)) {
+				output[outputCount++] = current + (next - current) * (current.z / (current.z - next.z));
+			}
+		}
+		BinTriangle(output[0], output[1], output[2]);
+		if (outputCount == 4) {
+			BinTriangle(output[0], output[2], output[3]);
+		}
+	}
+
+	void OcclusionCuller::BinTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		// To pixels. The viewport is flipped, so +Y in clip space is the top row.
+		glm::vec3 vertices[3];
+		const glm::vec4* clip[3] = { &a, &b, &c };
+		for (uint32_t i = 0; i < 3; i++) {
+			const float inverseW = 1.0f / clip[i]->w;
+			vertices[i] = glm::vec3((clip[i]->x * inverseW * 0.5f + 0.5f) * (float)Width,
+				(0.5f - clip[i]->y * inverseW * 0.5f) * (float)Height, clip[i]->z * inverseW);
+		}
+
+		// Positive area in pixels, so the edge functions are positive inside whichever face this is
+		float area = (vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) -
+			(vertices[1].y - vertices[0].y) * (vertices[2].x - vertices[0].x);
+		if (std::fabs(area) < MIN_TRIANGLE_AREA) {
+			return;
+		}
+		if (area < 0.0f) {
+			std::swap(vertices[1], vertices[2]);
+			area = -area;
+		}
+
+		// Pixels whose centers are inside the bounds, clamped before converting so guard band vertices can't overflow
+		const float minX = std::min(std::min(vertices[0].x, vertices[1].x), vertices[2].x);
+		const float maxX = std::max(std::max(vertices[0].x, vertices[1].x), vertices[2].x);
+		const float minY = std::min(std::min(vertices[0].y, vertices[1].y), vertices[2].y);
+		const float maxY = std::max(std::max(vertices[0].y, vertices[1].y), vertices[2].y);
+
+		Triangle triangle;
+		triangle.MinX = (int32_t)std::ceil(std::max(minX - 0.5f, 0.0f));
+		triangle.MinY = (int32_t)std::ceil(std::max(minY - 0.5f, 0.0f));
+		triangle.MaxX = (int32_t)std::floor(std::min(maxX - 0.5f, (float)(Width - 1)));
+		triangle.MaxY = (int32_t)std::floor(std::min(maxY - 0.5f, (float)(Height - 1)));
+		if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY) {
+			return;
+		}
+
+		for (uint32_t i = 0; i < 3; i++) {
+			const glm::vec3& from = vertices[i];
+			const glm::vec3& to = vertices[(i + 1) % 3];
+			triangle.EdgeA[i] = from.y - to.y;
+			triangle.EdgeB[i] = to.x - from.x;
+			triangle.EdgeC[i] = from.x * to.y - from.y * to.x;
+		}
+
+		// z / w is linear in screen space, so one plane gives the exact depth at every pixel
+		const glm::vec3 edge1 = vertices[1] - vertices[0];
+		const glm::vec3 edge2 = vertices[2] - vertices[0];
+		triangle.DepthA = (edge1.z * edge2.y - edge2.z * edge1.y) / area;
+		triangle.DepthB = (edge2.z * edge1.x - edge1.z * edge2.x) / area;
+		triangle.DepthC = vertices[0].z - triangle.DepthA * vertices[0].x - triangle.DepthB * vertices[0].y;
+
+		const uint32_t index = (uint32_t)_triangles.size();
+		_triangles.push_back(triangle);
+		_stats.Triangles++;
+
+		const uint32_t firstColumn = (uint32_t)triangle.MinX / VKE_OCCLUSION_BIN_WIDTH;
+		const uint32_t lastColumn = (uint32_t)triangle.MaxX / VKE_OCCLUSION_BIN_WIDTH;
+		const uint32_t firstRow = (uint32_t)triangle.MinY / VKE_OCCLUSION_BIN_HEIGHT;
+		const uint32_t lastRow = (uint32_t)triangle.MaxY / VKE_OCCLUSION_BIN_HEIGHT;
+		for (uint32_t row = firstRow; row <= lastRow; row++) {
+			for (uint32_t column = firstColumn; column <= lastColumn; column++) {
+				_bins[row * BinColumns + column].push_back(index);
+				_stats.BinnedTriangles++;
+			}
+		}
+	}
+
+	// Rasterization
+
+	void OcclusionCuller::Rasterize(JobSystem* jobs)
+	{
+		PROFILE_FUNCTION();
+		const uint64_t startNs = Profiler::Now();
+
+		// Every bin is cleared by its own job, so empty bins still cost a job
+		const uint32_t binCount = BinColumns * BinRows;
+		if (jobs != nullptr) {
+			jobs->ParallelFor(binCount, RasterizeBins, this, 1, "OcclusionBin");
+		}
+		else {
+			RasterizeBins(0, binCount, this);
+		}
+
+		_stats.RasterizeMs = (float64_t)(Profiler::Now() - startNs) / 1e6;
+	}
+
+	void OcclusionCuller::RasterizeBins(uint32_t begin, uint32_t end, void* userData)
+	{
+		OcclusionCuller* culler = (OcclusionCuller*)userData;
+		for (uint32_t bin = begin; bin < end; bin++) {
+			culler->RasterizeBin(bin);
+		}
+	}
+
+	void OcclusionCuller::RasterizeBin(uint32_t bin)
+	{
+		const int32_t binX = (int32_t)(bin % BinColumns) * VKE_OCCLUSION_BIN_WIDTH;
+		const int32_t binY = (int32_t)(bin / BinColumns) * VKE_OCCLUSION_BIN_HEIGHT;
+		const int32_t binMaxX = binX + VKE_OCCLUSION_BIN_WIDTH - 1;
+		const int32_t binMaxY = binY + VKE_OCCLUSION_BIN_HEIGHT - 1;
+
+		for (int32_t y = binY; y <= binMaxY; y++) {
+			std::fill_n(&_depth[y * Width + binX], VKE_OCCLUSION_BIN_WIDTH, 1.0f);
+		}
+
+		for (uint32_t index : _bins[bin]) {
+			const Triangle& triangle = _triangles[index];
+			const int32_t minX = std::max(triangle.MinX, binX);
+			const int32_t minY = std::max(triangle.MinY, binY);
+			const int32_t maxX = std::min(triangle.MaxX, binMaxX);
+			const int32_t maxY = std::min(triangle.MaxY, binMaxY);
+			if (_simdLevel == SimdLevel::AVX2) {
+				RasterizeAVX2(triangle, minX, minY, maxX, maxY);
+			}
+			else if (_simdLevel == SimdLevel::SSE2) {
+				RasterizeSSE2(triangle, minX, minY, maxX, maxY);
+			}
+			else {
+				RasterizeScalar(triangle, minX, minY, maxX, maxY);
+			}
+		}
+
+		// The block level: the farthest depth in each block, so a box nearer than it is visible without
+		// looking at pixels
+		for (int32_t blockY = binY / VKE_OCCLUSION_BLOCK_SIZE; blockY <= binMaxY / VKE_OCCLUSION_BLOCK_SIZE; blockY++) {
+			for (int32_t blockX = binX / VKE_OCCLUSION_BLOCK_SIZE; blockX <= binMaxX / VKE_OCCLUSION_BLOCK_SIZE; blockX++) {
+				float farthest = 0.0f;
+				for (int32_t y = 0; y < VKE_OCCLUSION_BLOCK_SIZE; y++) {
+					const float* row = &_depth[(blockY * VKE_OCCLUSION_BLOCK_SIZE + y) * Width + blockX * VKE_OCCLUSION_BLOCK_SIZE];
+					for (int32_t x = 0; x < VKE_OCCLUSION_BLOCK_SIZE; x++) {
+						farthest = std::max(farthest, row[x]);
+					}
+				}
+				_blockDepth[blockY * BlockColumns + blockX] = farthest;
+			}
+		}
+	}
+
+	// Kernels. All three keep the nearer depth wherever the pixel center passes every edge function.
+
+	void OcclusionCuller::RasterizeScalar(const Triangle& triangle, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+	{
+		for (int32_t y = minY; y <= maxY; y++) {
+			const float centerY = (float)y + 0.5f;
+			const float row0 = triangle.EdgeB[0] * centerY + triangle.EdgeC[0];
+			const float row1 = triangle.EdgeB[1] * centerY + triangle.EdgeC[1];
+			const float row2 = triangle.EdgeB[2] * centerY + triangle.EdgeC[2];
+			const float rowDepth = triangle.DepthB * centerY + triangle.DepthC;
+			float* depth = &_depth[y * Width];
+			for (int32_t x = minX; x <= maxX; x++) {
+				const float centerX = (float)x + 0.5f;
+				if (triangle.EdgeA[0] * centerX + row0 >= 0.0f && triangle.EdgeA[1] * centerX + row1 >= 0.0f &&
+					triangle.EdgeA[2] * centerX + row2 >= 0.0f) {
+					depth[x] = std::min(depth[x], triangle.DepthA * centerX + rowDepth);
+				}
+			}
+		}
+	}
+
+	void OcclusionCuller::RasterizeSSE2(const Triangle& triangle, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+	{
+#ifdef VKE_SIMD_X86
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 edgeA0 = _mm_set1_ps(triangle.EdgeA[0]);
+		const __m128 edgeA1 = _mm_set1_ps(triangle.EdgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(triangle.EdgeA[2]);
+		const __m128 depthA = _mm_set1_ps(triangle.DepthA);
+		const int32_t firstX = minX & ~3;
+
+		for (int32_t y = minY; y <= maxY; y++) {
+			const float centerY = (float)y + 0.5f;
+			const __m128 row0 = _mm_set1_ps(triangle.EdgeB[0] * centerY + triangle.EdgeC[0]);
+			const __m128 row1 = _mm_set1_ps(triangle.EdgeB[1] * centerY + triangle.EdgeC[1]);
+			const __m128 row2 = _mm_set1_ps(triangle.EdgeB[2] * centerY + triangle.EdgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(triangle.DepthB * centerY + triangle.DepthC);
+			float* depth = &_depth[y * Width];
+			for (int32_t x = firstX; x <= maxX; x += 4) {
+				const __m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+				const __m128 inside = _mm_and_ps(_mm_and_ps(
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, centerX), row0), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, centerX), row1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, centerX), row2), zero));
+				if (_mm_movemask_ps(inside) == 0) {
+					continue;
+				}
+				const __m128 previous = _mm_loadu_ps(depth + x);
+				const __m128 nearer = _mm_min_ps(previous, _mm_add_ps(_mm_mul_ps(depthA, centerX), rowDepth));
+				_mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, previous)));
+			}
+		}
+#else
+		RasterizeScalar(triangle, minX, minY, maxX, maxY);
+#endif
+	}
+
+	VKE_TARGET_AVX2 void OcclusionCuller::RasterizeAVX2(const Triangle& triangle, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+	{
+#ifdef VKE_SIMD_X86
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const __m256 edgeA0 = _mm256_set1_ps(triangle.EdgeA[0]);
+		const __m256 edgeA1 = _mm256_set1_ps(triangle.EdgeA[1]);
+		const __m256 edgeA2 = _mm256_set1_ps(triangle.EdgeA[2]);
+		const __m256 depthA = _mm256_set1_ps(triangle.DepthA);
+		const int32_t firstX = minX & ~7;
+
+		for (int32_t y = minY; y <= maxY; y++) {
+			const float centerY = (float)y + 0.5f;
+			const __m256 row0 = _mm256_set1_ps(triangle.EdgeB[0] * centerY + triangle.EdgeC[0]);
+			const __m256 row1 = _mm256_set1_ps(triangle.EdgeB[1] * centerY + triangle.EdgeC[1]);
+			const __m256 row2 = _mm256_set1_ps(triangle.EdgeB[2] * centerY + triangle.EdgeC[2]);
+			const __m256 rowDepth = _mm256_set1_ps(triangle.DepthB * centerY + triangle.DepthC);
+			float* depth = &_depth[y * Width];
+			for (int32_t x = firstX; x <= maxX; x += 8) {
+				const __m256 centerX = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+				const __m256 inside = _mm256_and_ps(_mm256_and_ps(
+					_mm256_cmp_ps(_mm256_fmadd_ps(edgeA0, centerX, row0), zero, _CMP_GE_OQ),
+					_mm256_cmp_ps(_mm256_fmadd_ps(edgeA1, centerX, row1), zero, _CMP_GE_OQ)),
+					_mm256_cmp_ps(_mm256_fmadd_ps(edgeA2, centerX, row2), zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(inside) == 0) {
+					continue;
+				}
+				const __m256 previous = _mm256_loadu_ps(depth + x);
+				const __m256 nearer = _mm256_min_ps(previous, _mm256_fmadd_ps(depthA, centerX, rowDepth));
+				_mm256_storeu_ps(depth + x, _mm256_blendv_ps(previous, nearer, inside));
+			}
+		}
+#else
+		RasterizeScalar(triangle, minX, minY, maxX, maxY);
+#endif
+	}
+
+	// Occludees
+
+	bool OcclusionCuller::TestBox(const glm::vec3& min, const glm::vec3& max) const
+	{
+		// The corners are the min corner plus any mix of the three scaled axes
+		const glm::vec4 origin = _viewProjection * glm::vec4(min, 1.0f);
+		const glm::vec3 extent = max - min;
+		const glm::vec4 axes[3] = { _viewProjection[0] * extent.x, _viewProjection[1] * extent.y, _viewProjection[2] * extent.z };
+
+		float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+		float maxX = -FLT_MAX, maxY = -FLT_MAX;
+		for (uint32_t corner = 0; corner < 8; corner++) {
+			glm::vec4 clip = origin;
+			for (uint32_t axis = 0; axis < 3; axis++) {
+				if (corner & (1u << axis)) {
+					clip += axes[axis];
+				}
+			}
+			// Reaches the near plane: the camera may be inside it
+			if (clip.z < 0.0f || clip.w <= 0.0f) {
+				return true;
+			}
+			const float inverseW = 1.0f / clip.w;
+			const float x = (clip.x * inverseW * 0.5f + 0.5f) * (float)Width;
+			const float y = (0.5f - clip.y * inverseW * 0.5f) * (float)Height;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+			minZ = std::min(minZ, clip.z * inverseW);
+		}
+
+		// Every pixel the screen rectangle touches, not just the covered centers
+		if (minZ > 1.0f || maxX < 0.0f || maxY < 0.0f || minX >= (float)Width || minY >= (float)Height) {
+			return false;
+		}
+		const int32_t firstX = (int32_t)std::max(minX, 0.0f);
+		const int32_t firstY = (int32_t)std::max(minY, 0.0f);
+		const int32_t lastX = (int32_t)std::min(maxX, (float)(Width - 1));
+		const int32_t lastY = (int32_t)std::min(maxY, (float)(Height - 1));
+
+		for (int32_t blockY = firstY / VKE_OCCLUSION_BLOCK_SIZE; blockY <= lastY / VKE_OCCLUSION_BLOCK_SIZE; blockY++) {
+			for (int32_t blockX = firstX / VKE_OCCLUSION_BLOCK_SIZE; blockX <= lastX / VKE_OCCLUSION_BLOCK_SIZE; blockX++) {
+				// Behind everything in the block
+				if (minZ >= _blockDepth[blockY * BlockColumns + blockX]) {
+					continue;
+				}
+				const int32_t startX = std::max(firstX, blockX * VKE_OCCLUSION_BLOCK_SIZE);
+				const int32_t startY = std::max(firstY, blockY * VKE_OCCLUSION_BLOCK_SIZE);
+				const int32_t endX = std::min(lastX, blockX * VKE_OCCLUSION_BLOCK_SIZE + VKE_OCCLUSION_BLOCK_SIZE - 1);
+				const int32_t endY = std::min(lastY, blockY * VKE_OCCLUSION_BLOCK_SIZE + VKE_OCCLUSION_BLOCK_SIZE - 1);
+				for (int32_t y = startY; y <= endY; y++) {
+					const float* row = &_depth[y * Width];
+					for (int32_t x = startX; x <= endX; x++) {
+						if (minZ < row[x]) {
+							return true;
+						}
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	struct OcclusionCuller::TestContext
+	{
+		const OcclusionCuller* Culler;
+		const glm::vec3* Mins;
+		const glm::vec3* Maxes;
+		uint8_t* Visible;
+		std::atomic<uint32_t> VisibleCount;
+	};
+
+	void OcclusionCuller::TestBoxRange(uint32_t begin, uint32_t end, void* userData)
+	{
+		TestContext* context = (TestContext*)userData;
+		uint32_t visibleCount = 0;
+		for (uint32_t i = begin; i < end; i++) {
+			const bool visible = context->Culler->TestBox(context->Mins[i], context->Maxes[i]);
+			context->Visible[i] = visible ? 1 : 0;
+			visibleCount += visible ? 1 : 0;
+		}
+		context->VisibleCount.fetch_add(visibleCount, std::memory_order_relaxed);
+	}
+
+	uint32_t OcclusionCuller::TestBoxes(const glm::vec3* mins, const glm::vec3* maxes, uint32_t count, uint8_t* visible,
+		JobSystem* jobs) const
+	{
+		PROFILE_FUNCTION();
+
+		TestContext context;
+		context.Culler = this;
+		context.Mins = mins;
+		context.Maxes = maxes;
+		context.Visible = visible;
+		context.VisibleCount.store(0, std::memory_order_relaxed);
+		if (jobs != nullptr && count > TEST_BOXES_PER_JOB) {
+			jobs->ParallelFor(count, TestBoxRange, &context, TEST_BOXES_PER_JOB, "OcclusionTest");
+		}
+		else {
+			TestBoxRange(0, count, &context);
+		}
+		return context.VisibleCount.load(std::memory_order_relaxed);
+	}
+}
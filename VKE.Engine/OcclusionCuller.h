@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Simd.h"
+#include "vke_types.h"
+
+// Depth buffer resolution, independent of the swapchain. Multiples of the bin size.
+#ifndef VKE_OCCLUSION_WIDTH
+#define VKE_OCCLUSION_WIDTH 320
+#endif
+
+#ifndef VKE_OCCLUSION_HEIGHT
+#define VKE_OCCLUSION_HEIGHT 192
+#endif
+
+// Screen tiles, rasterized as one job each. Multiples of the block size.
+#ifndef VKE_OCCLUSION_BIN_WIDTH
+#define VKE_OCCLUSION_BIN_WIDTH 64
+#endif
+
+#ifndef VKE_OCCLUSION_BIN_HEIGHT
+#define VKE_OCCLUSION_BIN_HEIGHT 32
+#endif
+
+// Pixels per side of a block in the coarse level of the depth hierarchy
+#define VKE_OCCLUSION_BLOCK_SIZE 8
+
+namespace VKE
+{
+	class JobSystem;
+
+	struct OcclusionStats
+	{
+		uint32_t Occluders;
+		// Left after near plane clipping and screen rejection
+		uint32_t Triangles;
+		// Triangle references across all bins, above Triangles when triangles straddle bins
+		uint32_t BinnedTriangles;
+		float64_t RasterizeMs;
+	};
+
+	// Software depth rasterizer for rejecting hidden objects before their draws are submitted. Occluders
+	// are rasterized at low resolution into a depth buffer with a max-depth block level on top; occludee
+	// bounding boxes are then tested against it, block first and pixels only where the block can't decide.
+	//
+	// Triangles are binned into screen tiles as they are added, and Rasterize runs each tile as a job that
+	// owns its pixels, with SSE2 or AVX2 testing a row of 4 or 8 pixels at once. Both faces are
+	// rasterized, so occluders need not be closed or consistently wound. Depth uses Vulkan's 0 to 1 range
+	// and the renderer's flipped viewport.
+	//
+	// Begin, AddOccluder and Rasterize are for one thread. The tests may run concurrently after Rasterize.
+	class OcclusionCuller
+	{
+	public:
+		static constexpr uint32_t Width = VKE_OCCLUSION_WIDTH;
+		static constexpr uint32_t Height = VKE_OCCLUSION_HEIGHT;
+
+		OcclusionCuller();
+
+		// Starts a frame, dropping the previous frame's occluders
+		void Begin(const glm::mat4& viewProjection);
+		// Transforms, clips and bins the triangles. Pick large, simple meshes: every triangle costs.
+		void AddOccluder(const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+			const glm::mat4& world);
+		// Fills the depth buffer with the occluders added since Begin. jobs may be null.
+		void Rasterize(JobSystem* jobs = nullptr);
+
+		// World space bounds. False when the box is hidden behind the occluders or off screen; boxes that
+		// reach the near plane are always visible.
+		bool TestBox(const glm::vec3& min, const glm::vec3& max) const;
+		// Writes 1 to visible for the boxes TestBox would keep and returns how many there are. jobs may be null.
+		uint32_t TestBoxes(const glm::vec3* mins, const glm::vec3* maxes, uint32_t count, uint8_t* visible,
+			JobSystem* jobs = nullptr) const;
+
+		// Clamped to what the CPU supports; defaults to the best available
+		void SetSimdLevel(SimdLevel level);
+		SimdLevel GetSimdLevel() const { return _simdLevel; }
+
+		// Width * Height, row major, as of the last Rasterize
+		const float* GetDepth() const { return _depth.data(); }
+		const OcclusionStats& GetStats() const { return _stats; }
+
+		OcclusionCuller(const OcclusionCuller&) = delete;
+		OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+	private:
+		static constexpr uint32_t BinColumns = Width / VKE_OCCLUSION_BIN_WIDTH;
+		static constexpr uint32_t BinRows = Height / VKE_OCCLUSION_BIN_HEIGHT;
+		static constexpr uint32_t BlockColumns = Width / VKE_OCCLUSION_BLOCK_SIZE;
+		static constexpr uint32_t BlockRows = Height / VKE_OCCLUSION_BLOCK_SIZE;
+
+		// Set up once when binned, in pixels with the pixel centers at +0.5
+		struct Triangle
+		{
+			// Edge functions EdgeA * x + EdgeB * y + EdgeC, none negative inside
+			float EdgeA[3];
+			float EdgeB[3];
+			float EdgeC[3];
+			// Depth plane DepthA * x + DepthB * y + DepthC
+			float DepthA;
+			float DepthB;
+			float DepthC;
+			// Inclusive pixel bounds on screen
+			int32_t MinX, MinY, MaxX, MaxY;
+		};
+
+		// Clip space, before the near plane
+		void ClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+		void BinTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+
+		static void RasterizeBins(uint32_t begin, uint32_t end, void* userData);
+		void RasterizeBin(uint32_t bin);
+		// Rasterize the triangle into the inclusive pixel rectangle. The SIMD kernels round minX down to
+		// their width and may touch up to the next multiple of it, which never leaves the bin.
+		void RasterizeScalar(const Triangle& triangle, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY);
+		void RasterizeSSE2(const Triangle& triangle, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY);
+		void RasterizeAVX2(const Triangle& triangle, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY);
+
+		struct TestContext;
+		static void TestBoxRange(uint32_t begin, uint32_t end, void* userData);
+
+		glm::mat4 _viewProjection;
+		std::vector<Triangle> _triangles;
+		// Triangle indices per bin, in the order they were added
+		std::vector<uint32_t> _bins[BinColumns * BinRows];
+		// Reused by AddOccluder
+		std::vector<glm::vec4> _clipVertices;
+
+		std::vector<float> _depth;
+		// Farthest depth of each block
+		std::vector<float> _blockDepth;
+
+		SimdLevel _simdLevel;
+		OcclusionStats _stats;
+	};
+}
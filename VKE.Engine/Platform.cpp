@@ -1,6 +1,8 @@
 #include "Platform.h"
 #include "Engine.h"
 #include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -8,10 +10,24 @@
 
 #include "VulkanRenderer.h"
 
+#ifdef PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cstdio>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace VKE
 {
 	Platform::Platform(Engine* engine, const char* applicationName)
-		: _window(nullptr), _engine(engine)
+		: _window(nullptr), _engine(engine), _framebufferResized(false)
 	{
 		Logger::Trace("Init platform layer");
 
@@ -19,6 +35,8 @@ namespace VKE
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 		_window = glfwCreateWindow(1280, 720, applicationName, nullptr, nullptr);
 		glfwSetWindowUserPointer(_window, this);
+		glfwSetKeyCallback(_window, OnKey);
+		glfwSetFramebufferSizeCallback(_window, OnFramebufferResize);
 	}
 
 	Platform::~Platform()
@@ -38,26 +56,192 @@ namespace VKE
 		return extent;
 	}
 
+	bool Platform::ConsumeFramebufferResize()
+	{
+		const bool resized = _framebufferResized;
+		_framebufferResized = false;
+		return resized;
+	}
+
 	void Platform::GetRequiredExtensions(uint32_t* extensionCount, const char*** extensionNames)
 	{
 		*extensionNames = glfwGetRequiredInstanceExtensions(extensionCount);
 	}
 
+	bool Platform::ReplaceFileAtomic(const char* source, const char* destination)
+	{
+		// The source has to be on disk before the rename, or a crash can leave the destination renamed but empty.
+#ifdef PLATFORM_WINDOWS
+		HANDLE handle = CreateFileA(source, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		const bool flushed = FlushFileBuffers(handle) != 0;
+		CloseHandle(handle);
+		if (!flushed) {
+			return false;
+		}
+		return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		const int fd = open(source, O_WRONLY);
+		if (fd < 0) {
+			return false;
+		}
+		const bool flushed = fsync(fd) == 0;
+		close(fd);
+		if (!flushed) {
+			return false;
+		}
+		// rename() replaces the destination atomically on POSIX.
+		return rename(source, destination) == 0;
+#endif
+	}
+
+	bool Platform::MapFile(const char* path, MappedFile* file)
+	{
+		*file = MappedFile();
+#ifdef PLATFORM_WINDOWS
+		HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+			CloseHandle(handle);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			CloseHandle(handle);
+			return false;
+		}
+
+		const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data) {
+			CloseHandle(mapping);
+			CloseHandle(handle);
+			return false;
+		}
+
+		file->Data = data;
+		file->Size = (uint64_t)size.QuadPart;
+		file->FileHandle = handle;
+		file->MappingHandle = mapping;
+		return true;
+#else
+		const int fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return false;
+		}
+
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps the file alive on its own.
+		close(fd);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		file->Data = data;
+		file->Size = (uint64_t)info.st_size;
+		return true;
+#endif
+	}
+
+	void Platform::UnmapFile(MappedFile* file)
+	{
+		if (!file->Data) {
+			return;
+		}
+#ifdef PLATFORM_WINDOWS
+		UnmapViewOfFile(file->Data);
+		CloseHandle((HANDLE)file->MappingHandle);
+		CloseHandle((HANDLE)file->FileHandle);
+#else
+		munmap(const_cast<void*>(file->Data), (size_t)file->Size);
+#endif
+		*file = MappedFile();
+	}
+
+	bool Platform::PinCurrentThread(uint32_t core)
+	{
+#ifdef PLATFORM_WINDOWS
+		if (core >= 64) {
+			return false;
+		}
+		return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(PLATFORM_LINUX)
+		if (core >= CPU_SETSIZE) {
+			return false;
+		}
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		// macOS only takes affinity hints
+		return false;
+#endif
+	}
+
 
 	bool Platform::StartGameLoop() const
 	{
+		PROFILE_THREAD("Main");
+
+		float64_t lastTime = glfwGetTime();
 		while(!glfwWindowShouldClose(_window))
 		{
-			glfwPollEvents();
-			_engine->OnLoop(0.0f);
+			PROFILE_SCOPE("Frame");
+
+			const float64_t now = glfwGetTime();
+			const float32_t deltaTime = (float32_t)(now - lastTime);
+			lastTime = now;
+
+			{
+				PROFILE_SCOPE("glfwPollEvents");
+				glfwPollEvents();
+			}
+
+			// Nothing can be presented while minimized, so sleep until the window comes back
+			int width = 0;
+			int height = 0;
+			glfwGetFramebufferSize(_window, &width, &height);
+			if (width == 0 || height == 0) {
+				glfwWaitEvents();
+				continue;
+			}
+			_engine->OnLoop(deltaTime);
 		}
 
 		return true;
 	}
 
+	void Platform::OnKey(GLFWwindow* window, int key, int scancode, int action, int mods)
+	{
+#ifdef ENABLE_PROFILING
+		if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+			Profiler::WriteChromeTrace("vke_trace.json");
+		}
+#endif
+	}
+
+	void Platform::OnFramebufferResize(GLFWwindow* window, int width, int height)
+	{
+		Platform* platform = static_cast<Platform*>(glfwGetWindowUserPointer(window));
+		platform->_framebufferResized = true;
+	}
+
 	void Platform::CreateSurface(VkInstance instance, VkSurfaceKHR* surface) const
 	{
-		VK_CHECK(glfwCreateWindowSurface(instance, _window, nullptr, surface));
+		VK_CHECK(glfwCreateWindowSurface(instance, _window, VK_ALLOCATOR, surface));
 	}
 
 }
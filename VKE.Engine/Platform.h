@@ -8,6 +8,15 @@ struct GLFWwindow;
 
 namespace VKE {
 	class Engine;
+
+	// A read-only view of a whole file.
+	struct MappedFile
+	{
+		const void* Data = nullptr;
+		uint64_t Size = 0;
+		void* FileHandle = nullptr;
+		void* MappingHandle = nullptr;
+	};
 	
 	class Platform
 	{
@@ -17,15 +26,30 @@ namespace VKE {
 
 		GLFWwindow* GetWindow() const { return _window; }
 		Extent2D GetFramebufferExtent() const;
+		// True once after the framebuffer changed size
+		bool ConsumeFramebufferResize();
 
 		static void GetRequiredExtensions(uint32_t* extensionCount, const char*** extensionNames);
+
+		// Flushes source to disk, then atomically replaces destination with it (source is removed).
+		static bool ReplaceFileAtomic(const char* source, const char* destination);
+
+		static bool MapFile(const char* path, MappedFile* file);
+		static void UnmapFile(MappedFile* file);
+
+		// Restricts the calling thread to one logical core
+		static bool PinCurrentThread(uint32_t core);
 		
 		bool StartGameLoop() const;
 
 		void CreateSurface(VkInstance instance, VkSurfaceKHR* surface) const;
 
 	private:
+		static void OnKey(GLFWwindow* window, int key, int scancode, int action, int mods);
+		static void OnFramebufferResize(GLFWwindow* window, int width, int height);
+
 		GLFWwindow* _window;
 		Engine* _engine;
+		bool _framebufferResized;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace VKE
+{
+	// Thread buffers are registered once per thread and kept alive until exit so
+	// events from threads that already finished can still be exported.
+	static std::mutex s_registryMutex;
+	static std::vector<std::unique_ptr<ProfileThreadBuffer>> s_threadBuffers;
+
+	uint64_t Profiler::Now()
+	{
+		using Clock = std::chrono::steady_clock;
+		static const Clock::time_point epoch = Clock::now();
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+	}
+
+	ProfileThreadBuffer* Profiler::RegisterThread()
+	{
+		std::lock_guard<std::mutex> lock(s_registryMutex);
+		s_threadBuffers.push_back(std::make_unique<ProfileThreadBuffer>());
+		ProfileThreadBuffer* buffer = s_threadBuffers.back().get();
+		buffer->ThreadId = (uint32_t)s_threadBuffers.size();
+		snprintf(buffer->ThreadName, sizeof(buffer->ThreadName), "Thread %u", buffer->ThreadId);
+		return buffer;
+	}
+
+	void Profiler::SetThreadName(const char* name)
+	{
+		ProfileThreadBuffer* buffer = GetThreadBuffer();
+		snprintf(buffer->ThreadName, sizeof(buffer->ThreadName), "%s", name);
+	}
+
+	static void WriteJsonString(std::ofstream& file, const char* str)
+	{
+		file.put('"');
+		for (const char* c = str; *c; ++c) {
+			if (*c == '"' || *c == '\\') {
+				file.put('\\');
+			}
+			file.put(*c);
+		}
+		file.put('"');
+	}
+
+	bool Profiler::WriteChromeTrace(const char* filename)
+	{
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			Logger::Error("Unable to open profile trace file %s", filename);
+			return false;
+		}
+
+		std::vector<ProfileEvent> events;
+		uint64_t eventCount = 0;
+		char line[256];
+
+		file << "{\"traceEvents\":[\n";
+
+		std::lock_guard<std::mutex> lock(s_registryMutex);
+		for (auto& buffer : s_threadBuffers) {
+			// Copy the live window of the ring, then drop whatever the owning thread overwrote during the copy.
+			const uint64_t end = buffer->WriteIndex.load(std::memory_order_acquire);
+			const uint64_t begin = end > ProfileThreadBuffer::Capacity ? end - ProfileThreadBuffer::Capacity : 0;
+			events.clear();
+			for (uint64_t i = begin; i < end; ++i) {
+				events.push_back(buffer->Events[i & (ProfileThreadBuffer::Capacity - 1)]);
+			}
+			// The owner may be halfway through writing event endAfter, whose slot is the one of endAfter - Capacity,
+			// so that slot is dropped as well.
+			const uint64_t endAfter = buffer->WriteIndex.load(std::memory_order_acquire);
+			const uint64_t firstValid = endAfter >= ProfileThreadBuffer::Capacity ? endAfter - ProfileThreadBuffer::Capacity + 1 : 0;
+			const uint64_t skip = firstValid > begin ? std::min<uint64_t>(firstValid - begin, events.size()) : 0;
+
+			snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+				buffer->ThreadId == 1 ? "" : ",\n", buffer->ThreadId);
+			file << line;
+			WriteJsonString(file, buffer->ThreadName);
+			file << "}}";
+
+			for (uint64_t i = skip; i < events.size(); ++i) {
+				const ProfileEvent& event = events[i];
+				file << ",\n{\"name\":";
+				WriteJsonString(file, event.Name);
+				snprintf(line, sizeof(line), ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+					buffer->ThreadId, event.StartNs / 1000.0, (event.EndNs - event.StartNs) / 1000.0, event.Depth);
+				file << line;
+				eventCount++;
+			}
+		}
+
+		file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		file.close();
+
+		Logger::Info("Wrote %llu profile events to %s", (unsigned long long)eventCount, filename);
+		return true;
+	}
+}
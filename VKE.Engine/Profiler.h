@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "vke_defs.h"
+
+namespace VKE {
+	// A single completed scope, recorded when the scope closes.
+	struct ProfileEvent
+	{
+		const char* Name;
+		uint64_t StartNs;
+		uint64_t EndNs;
+		uint32_t Depth;
+	};
+
+	// Single-producer ring of events owned by one thread. The owning thread is the only writer;
+	// exporters read it without locking and discard anything that was overwritten mid-copy.
+	struct ProfileThreadBuffer
+	{
+		static constexpr uint32_t Capacity = 1 << 16;
+
+		ProfileEvent Events[Capacity];
+		std::atomic<uint64_t> WriteIndex{ 0 };
+		uint32_t ThreadId = 0;
+		uint32_t Depth = 0;
+		char ThreadName[32] = {};
+	};
+
+	class Profiler
+	{
+	public:
+		// Monotonic, high resolution time in nanoseconds.
+		static uint64_t Now();
+
+		static void SetThreadName(const char* name);
+
+		// Writes every event still held in the per-thread rings as Chrome trace JSON
+		// (load it in chrome://tracing or Perfetto).
+		static bool WriteChromeTrace(const char* filename);
+
+		static FORCEINLINE void BeginScope()
+		{
+			GetThreadBuffer()->Depth++;
+		}
+
+		static FORCEINLINE void EndScope(const char* name, uint64_t startNs)
+		{
+			ProfileThreadBuffer* buffer = GetThreadBuffer();
+			const uint64_t index = buffer->WriteIndex.load(std::memory_order_relaxed);
+			ProfileEvent& event = buffer->Events[index & (ProfileThreadBuffer::Capacity - 1)];
+			event.Name = name;
+			event.StartNs = startNs;
+			event.EndNs = Now();
+			event.Depth = --buffer->Depth;
+			buffer->WriteIndex.store(index + 1, std::memory_order_release);
+		}
+
+	private:
+		static FORCEINLINE ProfileThreadBuffer* GetThreadBuffer()
+		{
+			static thread_local ProfileThreadBuffer* buffer = nullptr;
+			if (!buffer) {
+				buffer = RegisterThread();
+			}
+			return buffer;
+		}
+
+		static ProfileThreadBuffer* RegisterThread();
+	};
+
+	class ProfileScope
+	{
+	public:
+		FORCEINLINE explicit ProfileScope(const char* name)
+			: _name(name)
+		{
+			Profiler::BeginScope();
+			_startNs = Profiler::Now();
+		}
+
+		FORCEINLINE ~ProfileScope()
+		{
+			Profiler::EndScope(_name, _startNs);
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+
+	private:
+		const char* _name;
+		uint64_t _startNs;
+	};
+}
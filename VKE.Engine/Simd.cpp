@@ -0,0 +1,83 @@
+#include "Simd.h"
+
+#ifdef VKE_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace VKE
+{
+#ifdef VKE_SIMD_X86
+	static void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4])
+	{
+#ifdef _MSC_VER
+		int values[4];
+		__cpuidex(values, (int)leaf, (int)subleaf);
+		for (uint32_t i = 0; i < 4; i++) {
+			registers[i] = (uint32_t)values[i];
+		}
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+
+	// Register state the OS saves on a context switch
+	static uint64_t ReadXcr0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t low, high;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((uint64_t)high << 32) | low;
+#endif
+	}
+
+	static SimdLevel DetectSimdLevel()
+	{
+		uint32_t registers[4];
+		Cpuid(0, 0, registers);
+		const uint32_t maxLeaf = registers[0];
+
+		Cpuid(1, 0, registers);
+		const bool sse2 = (registers[3] & (1u << 26)) != 0;
+		const bool fma = (registers[2] & (1u << 12)) != 0;
+		const bool osxsave = (registers[2] & (1u << 27)) != 0;
+		const bool avx = (registers[2] & (1u << 28)) != 0;
+		if (!sse2) {
+			return SimdLevel::Scalar;
+		}
+
+		// AVX needs the OS to preserve the XMM and YMM registers
+		if (!osxsave || !avx || !fma || maxLeaf < 7 || (ReadXcr0() & 0x6) != 0x6) {
+			return SimdLevel::SSE2;
+		}
+
+		Cpuid(7, 0, registers);
+		const bool avx2 = (registers[1] & (1u << 5)) != 0;
+		return avx2 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+	}
+#endif
+
+	SimdLevel GetSimdLevel()
+	{
+#ifdef VKE_SIMD_X86
+		static const SimdLevel level = DetectSimdLevel();
+		return level;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	const char* GetSimdLevelName(SimdLevel level)
+	{
+		switch (level) {
+		case SimdLevel::SSE2: return "SSE2";
+		case SimdLevel::AVX2: return "AVX2";
+		default: return "Scalar";
+		}
+	}
+}
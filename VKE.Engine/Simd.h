@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VKE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Marks a function that uses AVX2 and FMA intrinsics in a build that doesn't target them. Only call it
+// after GetSimdLevel() returned AVX2. MSVC accepts the intrinsics anywhere.
+#if defined(VKE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define VKE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define VKE_TARGET_AVX2
+#endif
+
+namespace VKE
+{
+	// SSE2 is the x64 baseline; AVX2 (with FMA) is picked at runtime. Other architectures are scalar only.
+	enum class SimdLevel : uint32_t
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	// Highest level both the CPU and the OS support, detected once
+	SimdLevel GetSimdLevel();
+	const char* GetSimdLevelName(SimdLevel level);
+}
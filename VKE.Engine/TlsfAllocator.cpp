@@ -0,0 +1,273 @@
+#include "TlsfAllocator.h"
+#include "vke_assert.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace VKE
+{
+	static uint32_t HighestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return (uint32_t)index;
+#else
+		return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+	}
+
+	static uint32_t LowestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return (uint32_t)index;
+#else
+		return (uint32_t)__builtin_ctzll(value);
+#endif
+	}
+
+	static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	TlsfAllocator::TlsfAllocator(uint64_t size)
+		: _size(size), _used(0), _allocationCount(0), _freeRangeCount(0), _flBitmap(0)
+	{
+		ASSERT_MSG(size > 0, "Empty TLSF range");
+		for (uint32_t fl = 0; fl < FL_COUNT; ++fl) {
+			_slBitmaps[fl] = 0;
+			for (uint32_t sl = 0; sl < SL_COUNT; ++sl) {
+				_heads[fl][sl] = INVALID_NODE;
+			}
+		}
+
+		const uint32_t node = CreateNode();
+		_nodes[node].Offset = 0;
+		_nodes[node].Size = size;
+		InsertFree(node);
+	}
+
+	bool TlsfAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t* offset, uint32_t* node)
+	{
+		ASSERT_MSG(size > 0, "Zero sized allocation");
+		ASSERT_MSG(alignment > 0 && (alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+
+		// The first fit for the size is usually aligned already; only fall back to reserving room for
+		// padding when it is not.
+		uint32_t found = FindFree(size);
+		if (found != INVALID_NODE && AlignUp(_nodes[found].Offset, alignment) + size > _nodes[found].Offset + _nodes[found].Size) {
+			found = alignment > 1 ? FindFree(size + alignment - 1) : INVALID_NODE;
+		}
+		if (found == INVALID_NODE) {
+			return false;
+		}
+
+		RemoveFree(found);
+
+		const uint64_t aligned = AlignUp(_nodes[found].Offset, alignment);
+		const uint64_t padding = aligned - _nodes[found].Offset;
+		if (padding > 0) {
+			const uint32_t before = CreateNode();
+			Node& pad = _nodes[before];
+			Node& block = _nodes[found];
+			pad.Offset = block.Offset;
+			pad.Size = padding;
+			pad.PrevPhysical = block.PrevPhysical;
+			pad.NextPhysical = found;
+			if (block.PrevPhysical != INVALID_NODE) {
+				_nodes[block.PrevPhysical].NextPhysical = before;
+			}
+			block.PrevPhysical = before;
+			block.Offset = aligned;
+			block.Size -= padding;
+			InsertFree(before);
+		}
+
+		if (_nodes[found].Size > size) {
+			const uint32_t after = CreateNode();
+			Node& rest = _nodes[after];
+			Node& block = _nodes[found];
+			rest.Offset = block.Offset + size;
+			rest.Size = block.Size - size;
+			rest.PrevPhysical = found;
+			rest.NextPhysical = block.NextPhysical;
+			if (block.NextPhysical != INVALID_NODE) {
+				_nodes[block.NextPhysical].PrevPhysical = after;
+			}
+			block.NextPhysical = after;
+			block.Size = size;
+			InsertFree(after);
+		}
+
+		_nodes[found].Free = false;
+		_used += size;
+		_allocationCount++;
+
+		*offset = aligned;
+		*node = found;
+		return true;
+	}
+
+	void TlsfAllocator::Free(uint32_t node)
+	{
+		ASSERT_MSG(node < _nodes.size() && !_nodes[node].Free, "Freeing an unknown or free TLSF node");
+		_used -= _nodes[node].Size;
+		_allocationCount--;
+
+		// Merge with free physical neighbours
+		const uint32_t prev = _nodes[node].PrevPhysical;
+		if (prev != INVALID_NODE && _nodes[prev].Free) {
+			RemoveFree(prev);
+			_nodes[prev].Size += _nodes[node].Size;
+			_nodes[prev].NextPhysical = _nodes[node].NextPhysical;
+			if (_nodes[node].NextPhysical != INVALID_NODE) {
+				_nodes[_nodes[node].NextPhysical].PrevPhysical = prev;
+			}
+			ReleaseNode(node);
+			node = prev;
+		}
+
+		const uint32_t next = _nodes[node].NextPhysical;
+		if (next != INVALID_NODE && _nodes[next].Free) {
+			RemoveFree(next);
+			_nodes[node].Size += _nodes[next].Size;
+			_nodes[node].NextPhysical = _nodes[next].NextPhysical;
+			if (_nodes[next].NextPhysical != INVALID_NODE) {
+				_nodes[_nodes[next].NextPhysical].PrevPhysical = node;
+			}
+			ReleaseNode(next);
+		}
+
+		InsertFree(node);
+	}
+
+	uint64_t TlsfAllocator::GetLargestFreeRange() const
+	{
+		if (_flBitmap == 0) {
+			return 0;
+		}
+
+		// Only the highest non-empty list can hold the largest range
+		const uint32_t fl = HighestBit(_flBitmap);
+		const uint32_t sl = HighestBit(_slBitmaps[fl]);
+		uint64_t largest = 0;
+		for (uint32_t node = _heads[fl][sl]; node != INVALID_NODE; node = _nodes[node].NextFree) {
+			if (_nodes[node].Size > largest) {
+				largest = _nodes[node].Size;
+			}
+		}
+		return largest;
+	}
+
+	void TlsfAllocator::Mapping(uint64_t size, uint32_t* fl, uint32_t* sl)
+	{
+		if (size < SL_COUNT) {
+			*fl = 0;
+			*sl = (uint32_t)size;
+			return;
+		}
+
+		const uint32_t bit = HighestBit(size);
+		*sl = (uint32_t)(size >> (bit - SL_BITS)) ^ SL_COUNT;
+		*fl = bit - SL_BITS + 1;
+	}
+
+	// Returns a free node of at least size bytes, or INVALID_NODE.
+	uint32_t TlsfAllocator::FindFree(uint64_t size) const
+	{
+		// Round up to the next list boundary so any node in the chosen list fits
+		if (size >= SL_COUNT) {
+			const uint64_t round = (1ull << (HighestBit(size) - SL_BITS)) - 1;
+			if (size > UINT64_MAX - round) {
+				return INVALID_NODE;
+			}
+			size += round;
+		}
+
+		uint32_t fl, sl;
+		Mapping(size, &fl, &sl);
+
+		uint32_t slMap = _slBitmaps[fl] & (~0u << sl);
+		if (slMap == 0) {
+			const uint64_t flMap = fl + 1 < 64 ? _flBitmap & (~0ull << (fl + 1)) : 0;
+			if (flMap == 0) {
+				return INVALID_NODE;
+			}
+			fl = LowestBit(flMap);
+			slMap = _slBitmaps[fl];
+		}
+		sl = LowestBit(slMap);
+		return _heads[fl][sl];
+	}
+
+	void TlsfAllocator::InsertFree(uint32_t node)
+	{
+		uint32_t fl, sl;
+		Mapping(_nodes[node].Size, &fl, &sl);
+
+		Node& n = _nodes[node];
+		n.Free = true;
+		n.PrevFree = INVALID_NODE;
+		n.NextFree = _heads[fl][sl];
+		if (n.NextFree != INVALID_NODE) {
+			_nodes[n.NextFree].PrevFree = node;
+		}
+		_heads[fl][sl] = node;
+		_slBitmaps[fl] |= 1u << sl;
+		_flBitmap |= 1ull << fl;
+		_freeRangeCount++;
+	}
+
+	void TlsfAllocator::RemoveFree(uint32_t node)
+	{
+		uint32_t fl, sl;
+		Mapping(_nodes[node].Size, &fl, &sl);
+
+		Node& n = _nodes[node];
+		if (n.PrevFree != INVALID_NODE) {
+			_nodes[n.PrevFree].NextFree = n.NextFree;
+		}
+		else {
+			_heads[fl][sl] = n.NextFree;
+		}
+		if (n.NextFree != INVALID_NODE) {
+			_nodes[n.NextFree].PrevFree = n.PrevFree;
+		}
+
+		if (_heads[fl][sl] == INVALID_NODE) {
+			_slBitmaps[fl] &= ~(1u << sl);
+			if (_slBitmaps[fl] == 0) {
+				_flBitmap &= ~(1ull << fl);
+			}
+		}
+		n.Free = false;
+		_freeRangeCount--;
+	}
+
+	uint32_t TlsfAllocator::CreateNode()
+	{
+		uint32_t node;
+		if (!_unusedNodes.empty()) {
+			node = _unusedNodes.back();
+			_unusedNodes.pop_back();
+		}
+		else {
+			node = (uint32_t)_nodes.size();
+			_nodes.emplace_back();
+		}
+
+		_nodes[node] = { 0, 0, INVALID_NODE, INVALID_NODE, INVALID_NODE, INVALID_NODE, false };
+		return node;
+	}
+
+	void TlsfAllocator::ReleaseNode(uint32_t node)
+	{
+		// Marked free so a stale handle trips the assert in Free
+		_nodes[node].Free = true;
+		_unusedNodes.push_back(node);
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace VKE
+{
+	// Two-level segregated fit allocator over an abstract range of offsets. It never touches the memory it
+	// manages, so it can sit on top of device memory. Allocation and free are O(1); neighbouring free
+	// ranges are merged immediately.
+	class TlsfAllocator
+	{
+	public:
+		static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+		explicit TlsfAllocator(uint64_t size);
+
+		// alignment must be a power of two. On success *offset is aligned and *node identifies the
+		// allocation for Free.
+		bool Allocate(uint64_t size, uint64_t alignment, uint64_t* offset, uint32_t* node);
+		void Free(uint32_t node);
+
+		uint64_t GetSize() const { return _size; }
+		uint64_t GetUsed() const { return _used; }
+		uint64_t GetFree() const { return _size - _used; }
+		uint32_t GetAllocationCount() const { return _allocationCount; }
+		uint32_t GetFreeRangeCount() const { return _freeRangeCount; }
+		uint64_t GetLargestFreeRange() const;
+		bool IsEmpty() const { return _allocationCount == 0; }
+
+	private:
+		static constexpr uint32_t SL_BITS = 5;
+		static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+		// Sizes below SL_COUNT all live in the first level
+		static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+		struct Node
+		{
+			uint64_t Offset;
+			uint64_t Size;
+			uint32_t PrevPhysical;
+			uint32_t NextPhysical;
+			uint32_t PrevFree;
+			uint32_t NextFree;
+			bool Free;
+		};
+
+		static void Mapping(uint64_t size, uint32_t* fl, uint32_t* sl);
+		uint32_t FindFree(uint64_t size) const;
+		void InsertFree(uint32_t node);
+		void RemoveFree(uint32_t node);
+		uint32_t CreateNode();
+		void ReleaseNode(uint32_t node);
+
+		uint64_t _size;
+		uint64_t _used;
+		uint32_t _allocationCount;
+		uint32_t _freeRangeCount;
+
+		uint64_t _flBitmap;
+		uint32_t _slBitmaps[FL_COUNT];
+		uint32_t _heads[FL_COUNT][SL_COUNT];
+
+		std::vector<Node> _nodes;
+		std::vector<uint32_t> _unusedNodes;
+	};
+}
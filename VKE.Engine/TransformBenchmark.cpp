@@ -0,0 +1,124 @@
+#include "TransformBenchmark.h"
+#include "BenchmarkUtils.h"
+#include "TransformSystem.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Logger.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace VKE
+{
+	// Share of nodes moved per frame in the incremental case
+	static constexpr uint32_t MOVED_NODES_PERCENT = 1;
+
+	// The path this replaces: a mat4 per node, composed and multiplied one at a time in creation order
+	struct NaiveTransform
+	{
+		glm::vec3 Position;
+		glm::quat Rotation;
+		glm::vec3 Scale;
+		int32_t Parent;
+		glm::mat4 World;
+	};
+
+	static void UpdateNaive(std::vector<NaiveTransform>& nodes)
+	{
+		for (NaiveTransform& node : nodes) {
+			const glm::mat4 local = glm::translate(glm::mat4(1.0f), node.Position) * glm::mat4_cast(node.Rotation) *
+				glm::scale(glm::mat4(1.0f), node.Scale);
+			node.World = node.Parent >= 0 ? nodes[node.Parent].World * local : local;
+		}
+	}
+
+	// Largest difference from the glm result, relative to the element's size
+	static float MaxError(const TransformSystem& system, const std::vector<TransformHandle>& handles, const std::vector<NaiveTransform>& nodes)
+	{
+		float maxError = 0.0f;
+		for (uint32_t i = 0; i < (uint32_t)nodes.size(); i++) {
+			const glm::mat4 world = system.GetWorld(handles[i]);
+			for (uint32_t column = 0; column < 4; column++) {
+				for (uint32_t row = 0; row < 4; row++) {
+					const float expected = nodes[i].World[column][row];
+					const float error = std::fabs(world[column][row] - expected) / std::max(1.0f, std::fabs(expected));
+					maxError = std::max(maxError, error);
+				}
+			}
+		}
+		return maxError;
+	}
+
+	void RunTransformBenchmark(uint32_t nodeCount)
+	{
+		nodeCount = std::max(nodeCount, 1u);
+
+		// A random forest: 1% roots, every other node under a random earlier one
+		std::vector<NaiveTransform> nodes(nodeCount);
+		const uint32_t rootCount = std::max(nodeCount / 100, 1u);
+		uint32_t seed = 0x9E3779B9u;
+		for (uint32_t i = 0; i < nodeCount; i++) {
+			NaiveTransform& node = nodes[i];
+			node.Position = glm::vec3(RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f));
+			node.Rotation = glm::normalize(glm::quat(RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f),
+				RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f)));
+			node.Scale = glm::vec3(RandomFloat(seed, 0.9f, 1.1f), RandomFloat(seed, 0.9f, 1.1f), RandomFloat(seed, 0.9f, 1.1f));
+			node.Parent = i < rootCount ? -1 : (int32_t)(NextRandom(seed) % i);
+		}
+
+		TransformSystem system;
+		std::vector<TransformHandle> handles(nodeCount);
+		for (uint32_t i = 0; i < nodeCount; i++) {
+			const NaiveTransform& node = nodes[i];
+			handles[i] = system.Create(node.Parent >= 0 ? handles[node.Parent] : INVALID_TRANSFORM);
+			system.SetLocal(handles[i], node.Position, node.Rotation, node.Scale);
+		}
+		system.Update();
+
+		JobSystem jobs;
+		const SimdLevel bestLevel = GetSimdLevel();
+		Logger::Info("Transform benchmark, %u nodes in %u levels, %s, %u workers, best of %u runs", nodeCount,
+			system.GetStats().Levels, GetSimdLevelName(bestLevel), jobs.GetWorkerCount(), BENCHMARK_REPEATS);
+
+		const float64_t naiveMs = BestOf([&]() { UpdateNaive(nodes); });
+		Logger::Info("  %-34s | %8.3f ms | %6.2fx", "glm mat4, one node at a time", naiveMs, 1.0);
+
+		// Every node dirty, as after loading a scene
+		auto dirtyAll = [&]() {
+			for (TransformHandle handle : handles) {
+				system.SetPosition(handle, system.GetPosition(handle));
+			}
+		};
+
+		char name[64];
+		for (uint32_t level = 0; level <= (uint32_t)bestLevel; level++) {
+			system.SetSimdLevel((SimdLevel)level);
+			const float64_t ms = BestOf(dirtyAll, [&]() { system.Update(); });
+			snprintf(name, sizeof(name), "SoA %s, full update", GetSimdLevelName((SimdLevel)level));
+			Logger::Info("  %-34s | %8.3f ms | %6.2fx | max error %.2e", name, ms, naiveMs / ms, MaxError(system, handles, nodes));
+		}
+
+		system.SetSimdLevel(bestLevel);
+		const float64_t parallelMs = BestOf(dirtyAll, [&]() { system.Update(&jobs); });
+		snprintf(name, sizeof(name), "SoA %s, full update, parallel", GetSimdLevelName(bestLevel));
+		Logger::Info("  %-34s | %8.3f ms | %6.2fx | max error %.2e", name, parallelMs, naiveMs / parallelMs, MaxError(system, handles, nodes));
+
+		// A few nodes touched per frame; only their subtrees are recomputed
+		const uint32_t movedCount = std::max(nodeCount * MOVED_NODES_PERCENT / 100, 1u);
+		auto moveSome = [&]() {
+			for (uint32_t i = 0; i < movedCount; i++) {
+				const TransformHandle handle = handles[NextRandom(seed) % nodeCount];
+				system.SetPosition(handle, system.GetPosition(handle));
+			}
+		};
+		const float64_t incrementalMs = BestOf(moveSome, [&]() { system.Update(&jobs); });
+		const TransformStats& stats = system.GetStats();
+		snprintf(name, sizeof(name), "SoA %s, %u%% moved, parallel", GetSimdLevelName(bestLevel), MOVED_NODES_PERCENT);
+		Logger::Info("  %-34s | %8.3f ms | %6.2fx | %u nodes updated, %u batches skipped", name, incrementalMs,
+			naiveMs / incrementalMs, stats.UpdatedNodes, stats.SkippedBatches);
+	}
+}
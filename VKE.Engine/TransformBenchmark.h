@@ -0,0 +1,11 @@
+#pragma once
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// Builds a random hierarchy of nodeCount transforms and logs the time to compute every world matrix with
+	// glm one node at a time against the TransformSystem at each SIMD level, single threaded and on the job
+	// system, plus an update where 1% of the nodes moved. Run from the command line with --bench-transforms [nodes].
+	void RunTransformBenchmark(uint32_t nodeCount = 100000);
+}
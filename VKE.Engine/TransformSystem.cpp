@@ -0,0 +1,547 @@
+#include "TransformSystem.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "vke_assert.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace VKE
+{
+	// Nodes per batch: one AVX2 register or two SSE2 registers per stream
+	static constexpr uint32_t BATCH_SIZE = 8;
+
+	TransformSystem::TransformSystem()
+		: _structureDirty(false), _simdLevel(VKE::GetSimdLevel()), _stats(), _levelBegin(0), _levelEnd(0),
+		_updatedNodes(0), _skippedBatches(0)
+	{
+		_levels.push_back(0);
+	}
+
+	// Hierarchy
+
+	TransformHandle TransformSystem::Create(TransformHandle parent)
+	{
+		ASSERT_MSG(parent == INVALID_TRANSFORM || IsValid(parent), "Invalid parent transform");
+
+		uint32_t slot;
+		if (!_freeSlots.empty()) {
+			slot = _freeSlots.back();
+			_freeSlots.pop_back();
+		}
+		else {
+			slot = (uint32_t)_nodes.size();
+			_nodes.push_back({ UINT32_MAX, NO_SLOT, 0, false });
+		}
+
+		// Appended in identity; Rebuild moves it to its level
+		Node& node = _nodes[slot];
+		node.Index = (uint32_t)_slots.size();
+		node.Parent = parent.Index;
+		node.Alive = true;
+		_slots.push_back(slot);
+		_parents.push_back(-1);
+		for (uint32_t element = 0; element < LocalElementCount; element++) {
+			const bool one = element == RotationW || element >= ScaleX;
+			_local[element].push_back(one ? 1.0f : 0.0f);
+		}
+		for (uint32_t element = 0; element < WorldElementCount; element++) {
+			_world[element].push_back(element % 5 == 0 ? 1.0f : 0.0f);
+		}
+		_dirty.push_back(1);
+		_changed.push_back(0);
+
+		_structureDirty = true;
+		return { slot, node.Generation };
+	}
+
+	void TransformSystem::Destroy(TransformHandle handle)
+	{
+		ASSERT_MSG(IsValid(handle), "Invalid transform");
+		// Descendants become unreachable and are freed with it by the next Rebuild
+		_nodes[handle.Index].Alive = false;
+		_structureDirty = true;
+	}
+
+	void TransformSystem::SetParent(TransformHandle handle, TransformHandle parent)
+	{
+		ASSERT_MSG(IsValid(handle), "Invalid transform");
+		ASSERT_MSG(parent == INVALID_TRANSFORM || IsValid(parent), "Invalid parent transform");
+		for (uint32_t ancestor = parent.Index; ancestor != NO_SLOT; ancestor = _nodes[ancestor].Parent) {
+			ASSERT_MSG(ancestor != handle.Index, "Transform parented to its own descendant");
+		}
+
+		Node& node = _nodes[handle.Index];
+		node.Parent = parent.Index;
+		_dirty[node.Index] = 1;
+		_structureDirty = true;
+	}
+
+	TransformHandle TransformSystem::GetParent(TransformHandle handle) const
+	{
+		ASSERT_MSG(IsValid(handle), "Invalid transform");
+		const uint32_t parent = _nodes[handle.Index].Parent;
+		return parent == NO_SLOT ? INVALID_TRANSFORM : TransformHandle{ parent, _nodes[parent].Generation };
+	}
+
+	bool TransformSystem::IsValid(TransformHandle handle) const
+	{
+		if (!IsCurrent(handle)) {
+			return false;
+		}
+		// A destroyed ancestor invalidates the whole subtree, even before Rebuild frees it
+		for (uint32_t ancestor = _nodes[handle.Index].Parent; ancestor != NO_SLOT; ancestor = _nodes[ancestor].Parent) {
+			if (!_nodes[ancestor].Alive) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool TransformSystem::IsCurrent(TransformHandle handle) const
+	{
+		return handle.Index < _nodes.size() && _nodes[handle.Index].Alive && _nodes[handle.Index].Generation == handle.Generation;
+	}
+
+	uint32_t TransformSystem::GetIndex(TransformHandle handle) const
+	{
+		ASSERT_MSG(IsCurrent(handle), "Invalid transform");
+		return _nodes[handle.Index].Index;
+	}
+
+	// Local transform
+
+	void TransformSystem::SetLocal(TransformHandle handle, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		const uint32_t index = GetIndex(handle);
+		_local[PositionX][index] = position.x;
+		_local[PositionY][index] = position.y;
+		_local[PositionZ][index] = position.z;
+		_local[RotationX][index] = rotation.x;
+		_local[RotationY][index] = rotation.y;
+		_local[RotationZ][index] = rotation.z;
+		_local[RotationW][index] = rotation.w;
+		_local[ScaleX][index] = scale.x;
+		_local[ScaleY][index] = scale.y;
+		_local[ScaleZ][index] = scale.z;
+		_dirty[index] = 1;
+	}
+
+	void TransformSystem::SetPosition(TransformHandle handle, const glm::vec3& position)
+	{
+		const uint32_t index = GetIndex(handle);
+		_local[PositionX][index] = position.x;
+		_local[PositionY][index] = position.y;
+		_local[PositionZ][index] = position.z;
+		_dirty[index] = 1;
+	}
+
+	void TransformSystem::SetRotation(TransformHandle handle, const glm::quat& rotation)
+	{
+		const uint32_t index = GetIndex(handle);
+		_local[RotationX][index] = rotation.x;
+		_local[RotationY][index] = rotation.y;
+		_local[RotationZ][index] = rotation.z;
+		_local[RotationW][index] = rotation.w;
+		_dirty[index] = 1;
+	}
+
+	void TransformSystem::SetScale(TransformHandle handle, const glm::vec3& scale)
+	{
+		const uint32_t index = GetIndex(handle);
+		_local[ScaleX][index] = scale.x;
+		_local[ScaleY][index] = scale.y;
+		_local[ScaleZ][index] = scale.z;
+		_dirty[index] = 1;
+	}
+
+	glm::vec3 TransformSystem::GetPosition(TransformHandle handle) const
+	{
+		const uint32_t index = GetIndex(handle);
+		return glm::vec3(_local[PositionX][index], _local[PositionY][index], _local[PositionZ][index]);
+	}
+
+	glm::quat TransformSystem::GetRotation(TransformHandle handle) const
+	{
+		const uint32_t index = GetIndex(handle);
+		return glm::quat(_local[RotationW][index], _local[RotationX][index], _local[RotationY][index], _local[RotationZ][index]);
+	}
+
+	glm::vec3 TransformSystem::GetScale(TransformHandle handle) const
+	{
+		const uint32_t index = GetIndex(handle);
+		return glm::vec3(_local[ScaleX][index], _local[ScaleY][index], _local[ScaleZ][index]);
+	}
+
+	glm::mat4 TransformSystem::GetWorld(TransformHandle handle) const
+	{
+		const uint32_t index = GetIndex(handle);
+		glm::mat4 world(1.0f);
+		for (uint32_t row = 0; row < 3; row++) {
+			for (uint32_t column = 0; column < 4; column++) {
+				world[column][row] = _world[row * 4 + column][index];
+			}
+		}
+		return world;
+	}
+
+	void TransformSystem::SetSimdLevel(SimdLevel level)
+	{
+		_simdLevel = std::min(level, VKE::GetSimdLevel());
+	}
+
+	// Sorting
+
+	void TransformSystem::Rebuild()
+	{
+		PROFILE_FUNCTION();
+
+		// Child lists, built backwards so siblings come out in slot order
+		const uint32_t slotCount = (uint32_t)_nodes.size();
+		_firstChild.assign(slotCount, NO_SLOT);
+		_nextSibling.assign(slotCount, NO_SLOT);
+		_order.clear();
+		for (uint32_t slot = slotCount; slot > 0; slot--) {
+			const Node& node = _nodes[slot - 1];
+			if (node.Alive && node.Parent != NO_SLOT) {
+				_nextSibling[slot - 1] = _firstChild[node.Parent];
+				_firstChild[node.Parent] = slot - 1;
+			}
+		}
+		for (uint32_t slot = 0; slot < slotCount; slot++) {
+			if (_nodes[slot].Alive && _nodes[slot].Parent == NO_SLOT) {
+				_order.push_back(slot);
+			}
+		}
+
+		// Breadth first from the roots gives level order with every family contiguous. Children of destroyed
+		// nodes are never reached.
+		_levels.clear();
+		_levels.push_back(0);
+		uint32_t levelEnd = (uint32_t)_order.size();
+		for (uint32_t i = 0; i < (uint32_t)_order.size(); i++) {
+			if (i == levelEnd) {
+				_levels.push_back(i);
+				levelEnd = (uint32_t)_order.size();
+			}
+			for (uint32_t child = _firstChild[_order[i]]; child != NO_SLOT; child = _nextSibling[child]) {
+				_order.push_back(child);
+			}
+		}
+		const uint32_t count = (uint32_t)_order.size();
+		if (count > 0) {
+			_levels.push_back(count);
+		}
+
+		// Everything in the streams but not reached is freed; its slot can be reused from now on, under a new
+		// generation so old handles stay invalid
+		for (uint32_t slot : _slots) {
+			_nodes[slot].Alive = false;
+		}
+		for (uint32_t slot : _order) {
+			_nodes[slot].Alive = true;
+		}
+		for (uint32_t slot : _slots) {
+			Node& node = _nodes[slot];
+			if (!node.Alive) {
+				node.Index = UINT32_MAX;
+				node.Parent = NO_SLOT;
+				node.Generation++;
+				_freeSlots.push_back(slot);
+			}
+		}
+
+		// Gather every stream into the new order, swapping with the scratch buffer so nothing reallocates
+		_scratch.resize(count);
+		for (uint32_t element = 0; element < LocalElementCount; element++) {
+			for (uint32_t i = 0; i < count; i++) {
+				_scratch[i] = _local[element][_nodes[_order[i]].Index];
+			}
+			std::swap(_local[element], _scratch);
+			_scratch.resize(count);
+		}
+		for (uint32_t element = 0; element < WorldElementCount; element++) {
+			for (uint32_t i = 0; i < count; i++) {
+				_scratch[i] = _world[element][_nodes[_order[i]].Index];
+			}
+			std::swap(_world[element], _scratch);
+			_scratch.resize(count);
+		}
+		_byteScratch.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			_byteScratch[i] = _dirty[_nodes[_order[i]].Index];
+		}
+		std::swap(_dirty, _byteScratch);
+
+		std::swap(_slots, _order);
+		for (uint32_t i = 0; i < count; i++) {
+			_nodes[_slots[i]].Index = i;
+		}
+		_parents.resize(count);
+		_changed.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			const uint32_t parent = _nodes[_slots[i]].Parent;
+			_parents[i] = parent == NO_SLOT ? -1 : (int32_t)_nodes[parent].Index;
+		}
+
+		_structureDirty = false;
+	}
+
+	// Update
+
+	void TransformSystem::Update(JobSystem* jobs)
+	{
+		PROFILE_FUNCTION();
+		const uint64_t startNs = Profiler::Now();
+
+		if (_structureDirty) {
+			Rebuild();
+		}
+
+		// Levels in order, so parents are always final before their children read them
+		_updatedNodes.store(0, std::memory_order_relaxed);
+		_skippedBatches.store(0, std::memory_order_relaxed);
+		const uint32_t levelCount = (uint32_t)_levels.size() - 1;
+		for (uint32_t level = 0; level < levelCount; level++) {
+			_levelBegin = _levels[level];
+			_levelEnd = _levels[level + 1];
+			const uint32_t nodeCount = _levelEnd - _levelBegin;
+			const uint32_t batchCount = (nodeCount + BATCH_SIZE - 1) / BATCH_SIZE;
+			if (jobs != nullptr && nodeCount >= VKE_TRANSFORM_PARALLEL_THRESHOLD) {
+				jobs->ParallelFor(batchCount, UpdateBatches, this, VKE_TRANSFORM_BATCHES_PER_JOB, "TransformLevel");
+			}
+			else {
+				UpdateBatches(0, batchCount, this);
+			}
+		}
+
+		_stats.Nodes = (uint32_t)_slots.size();
+		_stats.Levels = levelCount;
+		_stats.UpdatedNodes = _updatedNodes.load(std::memory_order_relaxed);
+		_stats.SkippedBatches = _skippedBatches.load(std::memory_order_relaxed);
+		_stats.UpdateMs = (float64_t)(Profiler::Now() - startNs) / 1e6;
+	}
+
+	void TransformSystem::UpdateBatches(uint32_t begin, uint32_t end, void* userData)
+	{
+		TransformSystem* system = (TransformSystem*)userData;
+		const int32_t* parents = system->_parents.data();
+		uint8_t* dirty = system->_dirty.data();
+		uint8_t* changed = system->_changed.data();
+		// Level 0 holds every root and nothing else
+		const bool hasParent = system->_levelBegin > 0;
+
+		uint32_t updatedNodes = 0;
+		uint32_t skippedBatches = 0;
+		for (uint32_t batch = begin; batch < end; batch++) {
+			const uint32_t first = system->_levelBegin + batch * BATCH_SIZE;
+			const uint32_t count = std::min(BATCH_SIZE, system->_levelEnd - first);
+
+			// A node changes if it was edited or its parent changed this Update
+			uint8_t anyChanged = 0;
+			for (uint32_t i = first; i < first + count; i++) {
+				const uint8_t nodeChanged = dirty[i] | (hasParent ? changed[parents[i]] : 0);
+				changed[i] = nodeChanged;
+				dirty[i] = 0;
+				anyChanged |= nodeChanged;
+			}
+			if (anyChanged == 0) {
+				skippedBatches++;
+				continue;
+			}
+
+			// Unchanged nodes in the batch are recomputed to the same result. The level's tail is done one at
+			// a time so no lane reads or writes past the level.
+			updatedNodes += count;
+			if (count < BATCH_SIZE) {
+				system->UpdateScalar(first, count, hasParent);
+			}
+			else if (system->_simdLevel == SimdLevel::AVX2) {
+				system->UpdateAVX2(first, hasParent);
+			}
+			else if (system->_simdLevel == SimdLevel::SSE2) {
+				system->UpdateSSE2(first, hasParent);
+				system->UpdateSSE2(first + 4, hasParent);
+			}
+			else {
+				system->UpdateScalar(first, count, hasParent);
+			}
+		}
+
+		system->_updatedNodes.fetch_add(updatedNodes, std::memory_order_relaxed);
+		system->_skippedBatches.fetch_add(skippedBatches, std::memory_order_relaxed);
+	}
+
+	// Kernels. All three compose T * R * S into the rows of a 3x4 matrix the same way, then multiply
+	// parent * local with the implied bottom row (0, 0, 0, 1).
+
+	void TransformSystem::UpdateScalar(uint32_t first, uint32_t count, bool hasParent)
+	{
+		for (uint32_t i = first; i < first + count; i++) {
+			const float x = _local[RotationX][i];
+			const float y = _local[RotationY][i];
+			const float z = _local[RotationZ][i];
+			const float w = _local[RotationW][i];
+			const float sx = _local[ScaleX][i];
+			const float sy = _local[ScaleY][i];
+			const float sz = _local[ScaleZ][i];
+
+			const float x2 = x + x, y2 = y + y, z2 = z + z;
+			const float xx = x * x2, yy = y * y2, zz = z * z2;
+			const float xy = x * y2, xz = x * z2, yz = y * z2;
+			const float wx = w * x2, wy = w * y2, wz = w * z2;
+
+			const float local[WorldElementCount] = {
+				(1.0f - (yy + zz)) * sx, (xy - wz) * sy, (xz + wy) * sz, _local[PositionX][i],
+				(xy + wz) * sx, (1.0f - (xx + zz)) * sy, (yz - wx) * sz, _local[PositionY][i],
+				(xz - wy) * sx, (yz + wx) * sy, (1.0f - (xx + yy)) * sz, _local[PositionZ][i]
+			};
+
+			if (!hasParent) {
+				for (uint32_t element = 0; element < WorldElementCount; element++) {
+					_world[element][i] = local[element];
+				}
+				continue;
+			}
+
+			const uint32_t parent = (uint32_t)_parents[i];
+			for (uint32_t row = 0; row < 3; row++) {
+				const float p0 = _world[row * 4 + 0][parent];
+				const float p1 = _world[row * 4 + 1][parent];
+				const float p2 = _world[row * 4 + 2][parent];
+				for (uint32_t column = 0; column < 4; column++) {
+					_world[row * 4 + column][i] = p0 * local[column] + p1 * local[4 + column] + p2 * local[8 + column];
+				}
+				_world[row * 4 + 3][i] += _world[row * 4 + 3][parent];
+			}
+		}
+	}
+
+	void TransformSystem::UpdateSSE2(uint32_t first, bool hasParent)
+	{
+#ifdef VKE_SIMD_X86
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 x = _mm_loadu_ps(&_local[RotationX][first]);
+		const __m128 y = _mm_loadu_ps(&_local[RotationY][first]);
+		const __m128 z = _mm_loadu_ps(&_local[RotationZ][first]);
+		const __m128 w = _mm_loadu_ps(&_local[RotationW][first]);
+		const __m128 sx = _mm_loadu_ps(&_local[ScaleX][first]);
+		const __m128 sy = _mm_loadu_ps(&_local[ScaleY][first]);
+		const __m128 sz = _mm_loadu_ps(&_local[ScaleZ][first]);
+
+		const __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+		const __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		const __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		const __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		const __m128 local[WorldElementCount] = {
+			_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+			_mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+			_mm_mul_ps(_mm_add_ps(xz, wy), sz),
+			_mm_loadu_ps(&_local[PositionX][first]),
+			_mm_mul_ps(_mm_add_ps(xy, wz), sx),
+			_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+			_mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+			_mm_loadu_ps(&_local[PositionY][first]),
+			_mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+			_mm_mul_ps(_mm_add_ps(yz, wx), sy),
+			_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+			_mm_loadu_ps(&_local[PositionZ][first])
+		};
+
+		if (!hasParent) {
+			for (uint32_t element = 0; element < WorldElementCount; element++) {
+				_mm_storeu_ps(&_world[element][first], local[element]);
+			}
+			return;
+		}
+
+		// SSE2 has no gather, so the parents' elements are loaded one lane at a time
+		const int32_t* parents = &_parents[first];
+		__m128 parent[WorldElementCount];
+		for (uint32_t element = 0; element < WorldElementCount; element++) {
+			const float* stream = _world[element].data();
+			parent[element] = _mm_set_ps(stream[parents[3]], stream[parents[2]], stream[parents[1]], stream[parents[0]]);
+		}
+
+		for (uint32_t row = 0; row < 3; row++) {
+			const __m128 p0 = parent[row * 4 + 0];
+			const __m128 p1 = parent[row * 4 + 1];
+			const __m128 p2 = parent[row * 4 + 2];
+			for (uint32_t column = 0; column < 4; column++) {
+				__m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, local[column]), _mm_mul_ps(p1, local[4 + column])),
+					_mm_mul_ps(p2, local[8 + column]));
+				if (column == 3) {
+					result = _mm_add_ps(result, parent[row * 4 + 3]);
+				}
+				_mm_storeu_ps(&_world[row * 4 + column][first], result);
+			}
+		}
+#else
+		UpdateScalar(first, 4, hasParent);
+#endif
+	}
+
+	VKE_TARGET_AVX2 void TransformSystem::UpdateAVX2(uint32_t first, bool hasParent)
+	{
+#ifdef VKE_SIMD_X86
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 x = _mm256_loadu_ps(&_local[RotationX][first]);
+		const __m256 y = _mm256_loadu_ps(&_local[RotationY][first]);
+		const __m256 z = _mm256_loadu_ps(&_local[RotationZ][first]);
+		const __m256 w = _mm256_loadu_ps(&_local[RotationW][first]);
+		const __m256 sx = _mm256_loadu_ps(&_local[ScaleX][first]);
+		const __m256 sy = _mm256_loadu_ps(&_local[ScaleY][first]);
+		const __m256 sz = _mm256_loadu_ps(&_local[ScaleZ][first]);
+
+		const __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+		const __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+		const __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+		const __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+		const __m256 local[WorldElementCount] = {
+			_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+			_mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+			_mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+			_mm256_loadu_ps(&_local[PositionX][first]),
+			_mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+			_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+			_mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+			_mm256_loadu_ps(&_local[PositionY][first]),
+			_mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+			_mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+			_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+			_mm256_loadu_ps(&_local[PositionZ][first])
+		};
+
+		if (!hasParent) {
+			for (uint32_t element = 0; element < WorldElementCount; element++) {
+				_mm256_storeu_ps(&_world[element][first], local[element]);
+			}
+			return;
+		}
+
+		const __m256i parents = _mm256_loadu_si256((const __m256i*)&_parents[first]);
+		__m256 parent[WorldElementCount];
+		for (uint32_t element = 0; element < WorldElementCount; element++) {
+			parent[element] = _mm256_i32gather_ps(_world[element].data(), parents, 4);
+		}
+
+		for (uint32_t row = 0; row < 3; row++) {
+			const __m256 p0 = parent[row * 4 + 0];
+			const __m256 p1 = parent[row * 4 + 1];
+			const __m256 p2 = parent[row * 4 + 2];
+			for (uint32_t column = 0; column < 4; column++) {
+				__m256 result = _mm256_fmadd_ps(p2, local[8 + column], _mm256_fmadd_ps(p1, local[4 + column], _mm256_mul_ps(p0, local[column])));
+				if (column == 3) {
+					result = _mm256_add_ps(result, parent[row * 4 + 3]);
+				}
+				_mm256_storeu_ps(&_world[row * 4 + column][first], result);
+			}
+		}
+#else
+		UpdateScalar(first, BATCH_SIZE, hasParent);
+#endif
+	}
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Simd.h"
+#include "vke_types.h"
+
+// Levels smaller than this are updated on the calling thread
+#ifndef VKE_TRANSFORM_PARALLEL_THRESHOLD
+#define VKE_TRANSFORM_PARALLEL_THRESHOLD 4096
+#endif
+
+// Batches of 8 nodes handed to one ParallelFor chunk
+#ifndef VKE_TRANSFORM_BATCHES_PER_JOB
+#define VKE_TRANSFORM_BATCHES_PER_JOB 64
+#endif
+
+namespace VKE
+{
+	class JobSystem;
+
+	// Slot in the system's node table, and the generation that slot had when the node was created. A
+	// destroyed node's handle stops matching as soon as the slot is reused.
+	struct TransformHandle
+	{
+		uint32_t Index;
+		uint32_t Generation;
+
+		bool operator==(const TransformHandle& other) const { return Index == other.Index && Generation == other.Generation; }
+		bool operator!=(const TransformHandle& other) const { return !(*this == other); }
+	};
+	constexpr TransformHandle INVALID_TRANSFORM = { UINT32_MAX, 0 };
+
+	struct TransformStats
+	{
+		uint32_t Nodes;
+		uint32_t Levels;
+		// Nodes whose world matrix was recomputed by the last Update, and 8-node batches it skipped
+		uint32_t UpdatedNodes;
+		uint32_t SkippedBatches;
+		float64_t UpdateMs;
+	};
+
+	// Scene hierarchy stored as structure-of-arrays, sorted so every depth level is one contiguous range
+	// with siblings next to each other. Update walks the levels in order and recomputes world matrices in
+	// batches of 8 with SSE2 or AVX2, skipping batches where neither a node nor any ancestor changed. World
+	// matrices are kept as the top 3x4 of the affine transform, one stream per element.
+	// Not thread safe; Update may spread a level across a JobSystem.
+	class TransformSystem
+	{
+	public:
+		TransformSystem();
+
+		TransformHandle Create(TransformHandle parent = INVALID_TRANSFORM);
+		// Destroys the node and everything below it
+		void Destroy(TransformHandle handle);
+		void SetParent(TransformHandle handle, TransformHandle parent);
+		TransformHandle GetParent(TransformHandle handle) const;
+		bool IsValid(TransformHandle handle) const;
+
+		// Local transform, relative to the parent
+		void SetLocal(TransformHandle handle, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+		void SetPosition(TransformHandle handle, const glm::vec3& position);
+		void SetRotation(TransformHandle handle, const glm::quat& rotation);
+		void SetScale(TransformHandle handle, const glm::vec3& scale);
+		glm::vec3 GetPosition(TransformHandle handle) const;
+		glm::quat GetRotation(TransformHandle handle) const;
+		glm::vec3 GetScale(TransformHandle handle) const;
+
+		// Recomputes the world matrices of every changed node. jobs may be null.
+		void Update(JobSystem* jobs = nullptr);
+		// As of the last Update
+		glm::mat4 GetWorld(TransformHandle handle) const;
+
+		// Clamped to what the CPU supports; defaults to the best available
+		void SetSimdLevel(SimdLevel level);
+		SimdLevel GetSimdLevel() const { return _simdLevel; }
+
+		uint32_t GetCount() const { return (uint32_t)_slots.size(); }
+		const TransformStats& GetStats() const { return _stats; }
+
+	private:
+		// Local streams
+		enum LocalElement : uint32_t
+		{
+			PositionX, PositionY, PositionZ,
+			RotationX, RotationY, RotationZ, RotationW,
+			ScaleX, ScaleY, ScaleZ,
+			LocalElementCount
+		};
+		// World streams, row * 4 + column of the 3x4 matrix
+		static constexpr uint32_t WorldElementCount = 12;
+
+		// Slot of nodes without a parent, and of the end of child lists
+		static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+		struct Node
+		{
+			// Into the sorted streams. New nodes are appended until the next Update sorts them in.
+			uint32_t Index;
+			uint32_t Parent;
+			// Bumped when Rebuild frees the slot
+			uint32_t Generation;
+			bool Alive;
+		};
+
+		// The node is alive and the handle's generation still matches its slot
+		bool IsCurrent(TransformHandle handle) const;
+		uint32_t GetIndex(TransformHandle handle) const;
+		void Rebuild();
+
+		static void UpdateBatches(uint32_t begin, uint32_t end, void* userData);
+		// Composes the local matrices of nodes [first, first + count) and multiplies them by their parents'
+		void UpdateScalar(uint32_t first, uint32_t count, bool hasParent);
+		void UpdateSSE2(uint32_t first, bool hasParent);
+		void UpdateAVX2(uint32_t first, bool hasParent);
+
+		// Indexed by slot
+		std::vector<Node> _nodes;
+		std::vector<uint32_t> _freeSlots;
+
+		// Indexed by sorted position
+		std::vector<uint32_t> _slots;
+		std::vector<int32_t> _parents;
+		std::vector<float> _local[LocalElementCount];
+		std::vector<float> _world[WorldElementCount];
+		std::vector<uint8_t> _dirty;
+		// Set during Update for nodes whose world matrix changed, so children know to follow
+		std::vector<uint8_t> _changed;
+
+		// Start of each level, plus the end of the last
+		std::vector<uint32_t> _levels;
+		bool _structureDirty;
+
+		// Reused by Rebuild
+		std::vector<uint32_t> _firstChild;
+		std::vector<uint32_t> _nextSibling;
+		std::vector<uint32_t> _order;
+		std::vector<float> _scratch;
+		std::vector<uint8_t> _byteScratch;
+
+		SimdLevel _simdLevel;
+		TransformStats _stats;
+
+		// The level Update is working on
+		uint32_t _levelBegin;
+		uint32_t _levelEnd;
+		std::atomic<uint32_t> _updatedNodes;
+		std::atomic<uint32_t> _skippedBatches;
+	};
+}
@@ -0,0 +1,235 @@
+#include "VulkanBindlessHeap.h"
+#include "VulkanRenderer.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+
+namespace VKE
+{
+	static constexpr VkDescriptorType BindlessDescriptorTypes[(uint32_t)VulkanBindlessType::Count] = {
+		VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_SAMPLER
+	};
+
+	static constexpr VkShaderStageFlags BindlessStages = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VulkanBindlessHeap::VulkanBindlessHeap(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight)
+		: _device(device), _framesInFlight(framesInFlight), _next(), _frameNumber(0)
+	{
+		PROFILE_FUNCTION();
+		// Array sizes, clamped to what the device allows for update-after-bind sets
+		VkPhysicalDeviceVulkan12Properties vulkan12Properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+		VkPhysicalDeviceProperties2 properties2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		properties2.pNext = &vulkan12Properties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+		_capacity[(uint32_t)VulkanBindlessType::SampledImage] = std::min<uint32_t>(VKE_BINDLESS_MAX_IMAGES,
+			std::min(vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages));
+		_capacity[(uint32_t)VulkanBindlessType::StorageBuffer] = std::min<uint32_t>(VKE_BINDLESS_MAX_BUFFERS,
+			std::min(vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers));
+		_capacity[(uint32_t)VulkanBindlessType::Sampler] = std::min<uint32_t>(VKE_BINDLESS_MAX_SAMPLERS,
+			std::min(vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers));
+		ASSERT_MSG(properties2.properties.limits.maxPushConstantsSize >= VKE_BINDLESS_PUSH_CONSTANT_SIZE, "Push constant range too large");
+
+		// Set layout. Partially bound: slots that were never written are fine as long as no shader reads them.
+		// Update unused while pending: new slots can be written while older frames are still executing.
+		VkDescriptorSetLayoutBinding bindings[(uint32_t)VulkanBindlessType::Count] = {};
+		VkDescriptorBindingFlags bindingFlags[(uint32_t)VulkanBindlessType::Count] = {};
+		VkDescriptorPoolSize poolSizes[(uint32_t)VulkanBindlessType::Count] = {};
+		for (uint32_t i = 0; i < (uint32_t)VulkanBindlessType::Count; i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = BindlessDescriptorTypes[i];
+			bindings[i].descriptorCount = _capacity[i];
+			bindings[i].stageFlags = BindlessStages;
+			bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+				VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+			poolSizes[i].type = BindlessDescriptorTypes[i];
+			poolSizes[i].descriptorCount = _capacity[i];
+		}
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+		bindingFlagsInfo.bindingCount = (uint32_t)VulkanBindlessType::Count;
+		bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = (uint32_t)VulkanBindlessType::Count;
+		layoutInfo.pBindings = bindings;
+		VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, VK_ALLOCATOR, &_setLayout));
+
+		// One set for the lifetime of the heap
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = (uint32_t)VulkanBindlessType::Count;
+		poolInfo.pPoolSizes = poolSizes;
+		VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, VK_ALLOCATOR, &_pool));
+
+		VkDescriptorSetAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocInfo.descriptorPool = _pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &_setLayout;
+		VK_CHECK(vkAllocateDescriptorSets(_device, &allocInfo, &_set));
+
+		// The one pipeline layout: set 0 is the heap, push constants carry the indices
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = BindlessStages;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = VKE_BINDLESS_PUSH_CONSTANT_SIZE;
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &_setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, VK_ALLOCATOR, &_pipelineLayout));
+
+		Logger::Info("Bindless heap: %u images, %u buffers, %u samplers", _capacity[0], _capacity[1], _capacity[2]);
+	}
+
+	VulkanBindlessHeap::~VulkanBindlessHeap()
+	{
+		vkDestroyPipelineLayout(_device, _pipelineLayout, VK_ALLOCATOR);
+		// Frees the set
+		vkDestroyDescriptorPool(_device, _pool, VK_ALLOCATOR);
+		vkDestroyDescriptorSetLayout(_device, _setLayout, VK_ALLOCATOR);
+	}
+
+	VulkanBindlessIndex VulkanBindlessHeap::AllocateSlot(VulkanBindlessType type)
+	{
+		std::vector<VulkanBindlessIndex>& freeList = _free[(uint32_t)type];
+		if (!freeList.empty()) {
+			const VulkanBindlessIndex index = freeList.back();
+			freeList.pop_back();
+			return index;
+		}
+		if (_next[(uint32_t)type] < _capacity[(uint32_t)type]) {
+			return _next[(uint32_t)type]++;
+		}
+		Logger::Error("Bindless heap is out of %s slots", type == VulkanBindlessType::SampledImage ? "image"
+			: type == VulkanBindlessType::StorageBuffer ? "buffer" : "sampler");
+		return UINT32_MAX;
+	}
+
+	VulkanBindlessIndex VulkanBindlessHeap::AddImage(VkImageView view, VkImageLayout layout)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const VulkanBindlessIndex index = AllocateSlot(VulkanBindlessType::SampledImage);
+		if (index == UINT32_MAX) {
+			return index;
+		}
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageView = view;
+		imageInfo.imageLayout = layout;
+
+		VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = _set;
+		write.dstBinding = (uint32_t)VulkanBindlessType::SampledImage;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+		return index;
+	}
+
+	VulkanBindlessIndex VulkanBindlessHeap::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const VulkanBindlessIndex index = AllocateSlot(VulkanBindlessType::StorageBuffer);
+		if (index == UINT32_MAX) {
+			return index;
+		}
+
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+
+		VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = _set;
+		write.dstBinding = (uint32_t)VulkanBindlessType::StorageBuffer;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+		return index;
+	}
+
+	VulkanBindlessIndex VulkanBindlessHeap::AddSampler(VkSampler sampler)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const VulkanBindlessIndex index = AllocateSlot(VulkanBindlessType::Sampler);
+		if (index == UINT32_MAX) {
+			return index;
+		}
+
+		VkDescriptorImageInfo samplerInfo = {};
+		samplerInfo.sampler = sampler;
+
+		VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = _set;
+		write.dstBinding = (uint32_t)VulkanBindlessType::Sampler;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		write.pImageInfo = &samplerInfo;
+		vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+		return index;
+	}
+
+	void VulkanBindlessHeap::Remove(VulkanBindlessType type, VulkanBindlessIndex index)
+	{
+		ASSERT_MSG(index < _capacity[(uint32_t)type], "Invalid bindless index");
+		// Frames in flight may still index the slot, so the descriptor stays until the slot is reused
+		std::lock_guard<std::mutex> lock(_mutex);
+		_retired.push_back({ type, index, _frameNumber });
+	}
+
+	void VulkanBindlessHeap::BeginFrame(uint64_t frameNumber)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_frameNumber = frameNumber;
+		for (size_t i = 0; i < _retired.size();) {
+			if (frameNumber >= _retired[i].FrameNumber + _framesInFlight) {
+				_free[(uint32_t)_retired[i].Type].push_back(_retired[i].Index);
+				_retired[i] = _retired.back();
+				_retired.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	void VulkanBindlessHeap::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const
+	{
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, _pipelineLayout, 0, 1, &_set, 0, nullptr);
+	}
+
+	void VulkanBindlessHeap::PushConstants(VkCommandBuffer commandBuffer, const void* data, uint32_t size, uint32_t offset) const
+	{
+		ASSERT_MSG(offset + size <= VKE_BINDLESS_PUSH_CONSTANT_SIZE, "Push constants out of range");
+		vkCmdPushConstants(commandBuffer, _pipelineLayout, BindlessStages, offset, size, data);
+	}
+
+	VulkanBindlessStats VulkanBindlessHeap::GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		VulkanBindlessStats stats;
+		for (uint32_t i = 0; i < (uint32_t)VulkanBindlessType::Count; i++) {
+			stats.Capacity[i] = _capacity[i];
+			stats.Used[i] = _next[i] - (uint32_t)_free[i].size();
+		}
+		for (auto& retired : _retired) {
+			stats.Used[(uint32_t)retired.Type]--;
+		}
+		return stats;
+	}
+}
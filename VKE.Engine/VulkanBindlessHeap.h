@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <vector>
+
+#include "vke_types.h"
+
+#ifndef VKE_BINDLESS_MAX_IMAGES
+#define VKE_BINDLESS_MAX_IMAGES 16384
+#endif
+
+#ifndef VKE_BINDLESS_MAX_BUFFERS
+#define VKE_BINDLESS_MAX_BUFFERS 8192
+#endif
+
+#ifndef VKE_BINDLESS_MAX_SAMPLERS
+#define VKE_BINDLESS_MAX_SAMPLERS 256
+#endif
+
+// The Vulkan minimum for maxPushConstantsSize
+#ifndef VKE_BINDLESS_PUSH_CONSTANT_SIZE
+#define VKE_BINDLESS_PUSH_CONSTANT_SIZE 128
+#endif
+
+namespace VKE
+{
+	// Slot in one of the heap's arrays, passed to shaders through push constants
+	typedef uint32_t VulkanBindlessIndex;
+
+	enum class VulkanBindlessType : uint32_t
+	{
+		// Binding 0: texture2D Textures[]
+		SampledImage,
+		// Binding 1: buffer Buffers[]
+		StorageBuffer,
+		// Binding 2: sampler Samplers[]
+		Sampler,
+		Count
+	};
+
+	struct VulkanBindlessStats
+	{
+		uint32_t Used[(uint32_t)VulkanBindlessType::Count];
+		uint32_t Capacity[(uint32_t)VulkanBindlessType::Count];
+	};
+
+	// Every texture, storage buffer and sampler lives in one update-after-bind descriptor set that is bound
+	// once per command buffer. Draws pick resources by index through push constants, so there are no
+	// per-draw descriptor sets and any draws can be batched together. All pipelines share one layout.
+	//
+	// Removed slots are reused only once no frame in flight can still index them. Thread safe.
+	class VulkanBindlessHeap
+	{
+	public:
+		VulkanBindlessHeap(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight);
+		~VulkanBindlessHeap();
+
+		// The image has to be in layout whenever a shader reads it. Returns UINT32_MAX when the array is full.
+		VulkanBindlessIndex AddImage(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VulkanBindlessIndex AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+		VulkanBindlessIndex AddSampler(VkSampler sampler);
+		// The resource itself can be destroyed once no frame in flight uses it
+		void Remove(VulkanBindlessType type, VulkanBindlessIndex index);
+
+		// Call once per frame after the frame's fence wait
+		void BeginFrame(uint64_t frameNumber);
+
+		// Once per command buffer and bind point; the set stays bound across pipeline changes
+		void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const;
+		void PushConstants(VkCommandBuffer commandBuffer, const void* data, uint32_t size, uint32_t offset = 0) const;
+
+		VkPipelineLayout GetPipelineLayout() const { return _pipelineLayout; }
+		VkDescriptorSetLayout GetSetLayout() const { return _setLayout; }
+		VulkanBindlessStats GetStats() const;
+
+	private:
+		struct RetiredSlot
+		{
+			VulkanBindlessType Type;
+			VulkanBindlessIndex Index;
+			uint64_t FrameNumber;
+		};
+
+		VulkanBindlessIndex AllocateSlot(VulkanBindlessType type);
+
+		VkDevice _device;
+		uint32_t _framesInFlight;
+		uint32_t _capacity[(uint32_t)VulkanBindlessType::Count];
+
+		VkDescriptorPool _pool;
+		VkDescriptorSetLayout _setLayout;
+		VkDescriptorSet _set;
+		VkPipelineLayout _pipelineLayout;
+
+		mutable std::mutex _mutex;
+		// Never used slots start at _next; freed ones go on the free list
+		uint32_t _next[(uint32_t)VulkanBindlessType::Count];
+		std::vector<VulkanBindlessIndex> _free[(uint32_t)VulkanBindlessType::Count];
+		std::vector<RetiredSlot> _retired;
+		uint64_t _frameNumber;
+	};
+}
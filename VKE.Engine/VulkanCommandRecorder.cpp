@@ -0,0 +1,108 @@
+#include "VulkanCommandRecorder.h"
+#include "VulkanRenderer.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+
+namespace VKE
+{
+	VulkanCommandRecorder::VulkanCommandRecorder(VkDevice device, uint32_t queueFamilyIndex, JobSystem* jobs, uint32_t framesInFlight)
+		: _device(device), _jobs(jobs), _workerCount(jobs->GetWorkerCount()), _maxChunks(0), _frameIndex(0),
+		_inheritance(nullptr), _callback(nullptr), _userData(nullptr), _itemCount(0), _chunkCount(0), _stats()
+	{
+		// Command pools are externally synchronized, so every worker gets its own for each frame in flight
+		_pools.resize((size_t)framesInFlight * _workerCount);
+		for (auto& pool : _pools) {
+			VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			poolInfo.queueFamilyIndex = queueFamilyIndex;
+			VK_CHECK(vkCreateCommandPool(_device, &poolInfo, VK_ALLOCATOR, &pool.Pool));
+			pool.Used = 0;
+		}
+	}
+
+	VulkanCommandRecorder::~VulkanCommandRecorder()
+	{
+		// Frees the pools' command buffers
+		for (auto& pool : _pools) {
+			vkDestroyCommandPool(_device, pool.Pool, VK_ALLOCATOR);
+		}
+	}
+
+	void VulkanCommandRecorder::BeginFrame(uint32_t frameIndex)
+	{
+		_frameIndex = frameIndex;
+		for (uint32_t i = 0; i < _workerCount; i++) {
+			ThreadPool& pool = _pools[(size_t)frameIndex * _workerCount + i];
+			if (pool.Used > 0) {
+				VK_CHECK(vkResetCommandPool(_device, pool.Pool, 0));
+				pool.Used = 0;
+			}
+		}
+	}
+
+	VkCommandBuffer VulkanCommandRecorder::AcquireBuffer(uint32_t workerIndex)
+	{
+		ThreadPool& pool = _pools[(size_t)_frameIndex * _workerCount + workerIndex];
+		if (pool.Used == pool.Buffers.size()) {
+			VkCommandBufferAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+			allocInfo.commandPool = pool.Pool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+			VkCommandBuffer buffer;
+			VK_CHECK(vkAllocateCommandBuffers(_device, &allocInfo, &buffer));
+			pool.Buffers.push_back(buffer);
+		}
+		return pool.Buffers[pool.Used++];
+	}
+
+	void VulkanCommandRecorder::RecordChunks(uint32_t begin, uint32_t end, void* userData)
+	{
+		VulkanCommandRecorder* recorder = (VulkanCommandRecorder*)userData;
+		const uint32_t workerIndex = JobSystem::GetCurrentWorker();
+		ASSERT_MSG(workerIndex < recorder->_workerCount, "Commands are recorded on job system workers only");
+
+		for (uint32_t chunk = begin; chunk < end; chunk++) {
+			// Chunk boundaries only depend on the item and chunk counts
+			const uint32_t firstItem = (uint32_t)((uint64_t)recorder->_itemCount * chunk / recorder->_chunkCount);
+			const uint32_t lastItem = (uint32_t)((uint64_t)recorder->_itemCount * (chunk + 1) / recorder->_chunkCount);
+
+			VkCommandBuffer commandBuffer = recorder->AcquireBuffer(workerIndex);
+			VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = recorder->_inheritance;
+			VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+			recorder->_callback(commandBuffer, firstItem, lastItem, recorder->_userData);
+			VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+			recorder->_chunkBuffers[chunk] = commandBuffer;
+		}
+	}
+
+	void VulkanCommandRecorder::Record(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount,
+		VulkanRecordCallback callback, void* userData)
+	{
+		PROFILE_FUNCTION();
+		const uint64_t startNs = Profiler::Now();
+
+		// One chunk per thread keeps the secondaries, and the state each one has to bind again, to a minimum
+		const uint32_t maxChunks = _maxChunks > 0 ? std::min(_maxChunks, _workerCount) : _workerCount;
+		_chunkCount = std::max(std::min(maxChunks, itemCount / VKE_RECORD_MIN_ITEMS_PER_THREAD), 1u);
+		_inheritance = &inheritance;
+		_callback = callback;
+		_userData = userData;
+		_itemCount = itemCount;
+		_chunkBuffers.resize(_chunkCount);
+
+		_jobs->ParallelFor(_chunkCount, RecordChunks, this, 1, "RecordCommands");
+		vkCmdExecuteCommands(primary, _chunkCount, _chunkBuffers.data());
+
+		_stats.Items = itemCount;
+		_stats.SecondaryBuffers = _chunkCount;
+		_stats.RecordMs = (float64_t)(Profiler::Now() - startNs) / 1e6;
+		_inheritance = nullptr;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "vke_types.h"
+
+// Below this many items per thread, splitting costs more than it saves
+#ifndef VKE_RECORD_MIN_ITEMS_PER_THREAD
+#define VKE_RECORD_MIN_ITEMS_PER_THREAD 64
+#endif
+
+namespace VKE
+{
+	class JobSystem;
+
+	// Records items [begin, end) into a secondary command buffer. Nothing is inherited from the primary
+	// except the render pass, so bind the pipeline, descriptor sets and dynamic state first.
+	typedef void (*VulkanRecordCallback)(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end, void* userData);
+
+	struct VulkanRecordStats
+	{
+		uint32_t Items;
+		uint32_t SecondaryBuffers;
+		float64_t RecordMs;
+	};
+
+	// Splits a draw list across the job system's workers. Each worker records secondary command buffers from
+	// its own pool for the current frame, and the calling thread executes them into the primary in item
+	// order, so the result does not depend on which worker ran what. Pools are reset once per frame and
+	// their command buffers reused; nothing is freed while running.
+	class VulkanCommandRecorder
+	{
+	public:
+		VulkanCommandRecorder(VkDevice device, uint32_t queueFamilyIndex, JobSystem* jobs, uint32_t framesInFlight);
+		~VulkanCommandRecorder();
+
+		// Call once per frame after the frame's fence wait
+		void BeginFrame(uint32_t frameIndex);
+
+		// Must be called from a job system worker, inside a subpass begun with secondary command buffer contents
+		void Record(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount,
+			VulkanRecordCallback callback, void* userData);
+
+		// Caps the secondary command buffers, and so the jobs, a single Record splits into; 0 allows one per
+		// worker. The chunks still run on whichever workers pick them up.
+		void SetMaxChunks(uint32_t maxChunks) { _maxChunks = maxChunks; }
+		const VulkanRecordStats& GetStats() const { return _stats; }
+
+	private:
+		struct ThreadPool
+		{
+			VkCommandPool Pool;
+			std::vector<VkCommandBuffer> Buffers;
+			uint32_t Used;
+		};
+
+		static void RecordChunks(uint32_t begin, uint32_t end, void* userData);
+		VkCommandBuffer AcquireBuffer(uint32_t workerIndex);
+
+		VkDevice _device;
+		JobSystem* _jobs;
+		uint32_t _workerCount;
+		uint32_t _maxChunks;
+		// [frame * workers + worker]
+		std::vector<ThreadPool> _pools;
+		uint32_t _frameIndex;
+
+		// State of the Record in progress
+		const VkCommandBufferInheritanceInfo* _inheritance;
+		VulkanRecordCallback _callback;
+		void* _userData;
+		uint32_t _itemCount;
+		uint32_t _chunkCount;
+		// One per chunk, in item order
+		std::vector<VkCommandBuffer> _chunkBuffers;
+
+		VulkanRecordStats _stats;
+	};
+}
@@ -0,0 +1,506 @@
+#include "VulkanGpuScene.h"
+#include "VulkanRenderer.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanUploadQueue.h"
+#include "VulkanBindlessHeap.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace VKE
+{
+	// Push constants of cull.comp.glsl
+	struct VulkanCullConstants
+	{
+		glm::vec4 Planes[6];
+		uint32_t InstanceCount;
+		uint32_t BoundsBuffer;
+		uint32_t MeshBuffer;
+		uint32_t DrawBuffer;
+		uint32_t CountBuffer;
+	};
+
+	// Push constants of main.vert.glsl and main.frag.glsl
+	struct VulkanDrawConstants
+	{
+		glm::mat4 ViewProjection;
+		uint32_t VertexBuffer;
+		uint32_t InstanceBuffer;
+		uint32_t TextureTable;
+		uint32_t TextureFeedback;
+		uint32_t TextureSampler;
+		uint32_t FrameNumber;
+	};
+
+	static_assert(sizeof(VulkanCullConstants) <= VKE_BINDLESS_PUSH_CONSTANT_SIZE, "Cull constants don't fit in push constants");
+	static_assert(sizeof(VulkanDrawConstants) <= VKE_BINDLESS_PUSH_CONSTANT_SIZE, "Draw constants don't fit in push constants");
+	static_assert(sizeof(VulkanGpuInstance) == 80 && sizeof(VulkanGpuBounds) == 32 && sizeof(VulkanGpuMesh) == 16,
+		"Scene structs must match their std430 layout in scene.glsl");
+
+	static const char* GetDrawPathName(VulkanGpuDrawPath path)
+	{
+		switch (path) {
+		case VulkanGpuDrawPath::IndirectCount: return "vkCmdDrawIndexedIndirectCount";
+		case VulkanGpuDrawPath::Indirect: return "vkCmdDrawIndexedIndirect";
+		default: return "vkCmdDrawIndexed per instance";
+		}
+	}
+
+	VulkanGpuScene::VulkanGpuScene(VkDevice device, VulkanMemoryAllocator* memory, VulkanUploadQueue* uploads, VulkanBindlessHeap* bindless,
+		VkPipelineCache pipelineCache, VkShaderModule cullModule, const VulkanDeviceCapabilities& capabilities, uint32_t framesInFlight)
+		: _device(device), _memory(memory), _uploads(uploads), _bindless(bindless), _framesInFlight(framesInFlight), _frameIndex(0),
+		_frameNumber(0), _path(VulkanGpuDrawPath::Direct), _cullModule(cullModule), _vertexCount(0), _indexCount(0), _meshTableCleared(false),
+		_instanceCount(0), _textureTable(UINT32_MAX), _textureFeedback(UINT32_MAX), _textureSampler(UINT32_MAX), _viewProjection(1.0f), _stats()
+	{
+		PROFILE_FUNCTION();
+
+		// Both GPU paths write firstInstance, and draw every instance with one multi-draw call
+		_maxDrawIndirectCount = capabilities.Properties.limits.maxDrawIndirectCount;
+		_supportsIndirect = capabilities.MultiDrawIndirect && capabilities.DrawIndirectFirstInstance;
+		_supportsIndirectCount = _supportsIndirect && capabilities.DrawIndirectCount;
+
+		// Geometry. The vertex shader pulls positions, so the vertex buffer is a storage buffer.
+		const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		_vertices = CreateBuffer(VKE_GPU_SCENE_MAX_VERTICES * sizeof(glm::vec3), storage);
+		_indices = CreateBuffer(VKE_GPU_SCENE_MAX_INDICES * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		_meshTable = CreateBuffer(VKE_GPU_SCENE_MAX_MESHES * sizeof(VulkanGpuMesh), storage);
+
+		// Instances
+		_instanceBuffer = CreateBuffer(VKE_GPU_SCENE_MAX_INSTANCES * sizeof(VulkanGpuInstance), storage);
+		_boundsBuffer = CreateBuffer(VKE_GPU_SCENE_MAX_INSTANCES * sizeof(VulkanGpuBounds), storage);
+		_instances.reserve(VKE_GPU_SCENE_MAX_INSTANCES);
+		_bounds.reserve(VKE_GPU_SCENE_MAX_INSTANCES);
+		_dirtyFlags.assign(VKE_GPU_SCENE_MAX_INSTANCES, false);
+
+		// Culling output
+		_draws = CreateBuffer(VKE_GPU_SCENE_MAX_INSTANCES * sizeof(VkDrawIndexedIndirectCommand), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		_drawCount = CreateBuffer(sizeof(uint32_t), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+		// Per frame: staging for changes, and where the draw count lands for the CPU. Coherent, so neither
+		// needs flushing or invalidating.
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = VKE_GPU_SCENE_UPDATE_BYTES * _framesInFlight;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		_staging = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::CpuToGpu);
+		bufferInfo.size = sizeof(uint32_t) * _framesInFlight;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		_readback = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::CpuToGpu);
+		if (!_staging || !_readback) {
+			Logger::Fatal("Unable to allocate the scene's staging memory");
+		}
+		memset(_readback->MappedData, 0, (size_t)bufferInfo.size);
+
+		// Culling pipelines, one per GPU path
+		const VkSpecializationMapEntry compactEntry = { 0, 0, sizeof(VkBool32) };
+		const VkBool32 compactValues[2] = { VK_TRUE, VK_FALSE };
+		for (uint32_t i = 0; i < 2; i++) {
+			VkSpecializationInfo specialization = {};
+			specialization.mapEntryCount = 1;
+			specialization.pMapEntries = &compactEntry;
+			specialization.dataSize = sizeof(VkBool32);
+			specialization.pData = &compactValues[i];
+
+			VkComputePipelineCreateInfo pipelineInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+			pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineInfo.stage.module = _cullModule;
+			pipelineInfo.stage.pName = "main";
+			pipelineInfo.stage.pSpecializationInfo = &specialization;
+			pipelineInfo.layout = _bindless->GetPipelineLayout();
+			VK_CHECK(vkCreateComputePipelines(_device, pipelineCache, 1, &pipelineInfo, VK_ALLOCATOR, &_cullPipelines[i]));
+		}
+
+		SetDrawPath(VulkanGpuDrawPath::IndirectCount);
+		SetViewProjection(_viewProjection);
+		_stats.VisibleInstances = UINT32_MAX;
+		Logger::Info("Scene: %u instance slots, %u vertices, %u indices, drawn with %s", VKE_GPU_SCENE_MAX_INSTANCES,
+			VKE_GPU_SCENE_MAX_VERTICES, VKE_GPU_SCENE_MAX_INDICES, GetDrawPathName(_path));
+	}
+
+	VulkanGpuScene::~VulkanGpuScene()
+	{
+		for (VkPipeline pipeline : _cullPipelines) {
+			vkDestroyPipeline(_device, pipeline, VK_ALLOCATOR);
+		}
+		vkDestroyShaderModule(_device, _cullModule, VK_ALLOCATOR);
+
+		_memory->Destroy(_readback);
+		_memory->Destroy(_staging);
+		DestroyBuffer(_drawCount);
+		DestroyBuffer(_draws);
+		DestroyBuffer(_boundsBuffer);
+		DestroyBuffer(_instanceBuffer);
+		DestroyBuffer(_meshTable);
+		DestroyBuffer(_indices);
+		DestroyBuffer(_vertices);
+	}
+
+	VulkanGpuScene::SceneBuffer VulkanGpuScene::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+	{
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		SceneBuffer buffer;
+		buffer.Allocation = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::GpuOnly);
+		if (!buffer.Allocation) {
+			Logger::Fatal("Unable to allocate %llu bytes for the scene", (unsigned long long)size);
+		}
+		// Index buffers are never read by shaders
+		buffer.Index = (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) ? _bindless->AddBuffer(buffer.Allocation->Buffer) : UINT32_MAX;
+		return buffer;
+	}
+
+	void VulkanGpuScene::DestroyBuffer(SceneBuffer& buffer)
+	{
+		if (buffer.Index != UINT32_MAX) {
+			_bindless->Remove(VulkanBindlessType::StorageBuffer, buffer.Index);
+		}
+		_memory->Destroy(buffer.Allocation);
+		buffer = { nullptr, UINT32_MAX };
+	}
+
+	VulkanMeshHandle VulkanGpuScene::AddMesh(const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount)
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(vertexCount > 0 && indexCount > 0, "Empty mesh");
+		if (_meshes.size() >= VKE_GPU_SCENE_MAX_MESHES || _vertexCount + vertexCount > VKE_GPU_SCENE_MAX_VERTICES ||
+			_indexCount + indexCount > VKE_GPU_SCENE_MAX_INDICES) {
+			Logger::Error("Scene geometry buffers are full, mesh with %u vertices not added", vertexCount);
+			return INVALID_MESH;
+		}
+
+		// Bounding sphere around the box center; not the tightest, but cheap and never too small
+		glm::vec3 min = positions[0];
+		glm::vec3 max = positions[0];
+		for (uint32_t i = 1; i < vertexCount; i++) {
+			min = glm::min(min, positions[i]);
+			max = glm::max(max, positions[i]);
+		}
+		const glm::vec3 center = (min + max) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			const glm::vec3 offset = positions[i] - center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+
+		MeshRecord mesh;
+		mesh.Gpu.IndexCount = indexCount;
+		mesh.Gpu.FirstIndex = _indexCount;
+		mesh.Gpu.VertexOffset = (int32_t)_vertexCount;
+		mesh.Gpu.Padding = 0;
+		mesh.Sphere = glm::vec4(center, std::sqrt(radiusSquared));
+		mesh.Ready = false;
+
+		const VulkanUploadTicket vertexTicket = _uploads->UploadBuffer(_vertices.Allocation->Buffer, _vertexCount * sizeof(glm::vec3), positions,
+			vertexCount * sizeof(glm::vec3), VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		const VulkanUploadTicket indexTicket = _uploads->UploadBuffer(_indices.Allocation->Buffer, _indexCount * sizeof(uint32_t), indices,
+			indexCount * sizeof(uint32_t), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+		mesh.Ticket = std::max(vertexTicket, indexTicket);
+		_vertexCount += vertexCount;
+		_indexCount += indexCount;
+
+		const VulkanMeshHandle handle = (VulkanMeshHandle)_meshes.size();
+		_meshes.push_back(mesh);
+		_pendingMeshes.push_back(handle);
+		_stats.MeshCount = (uint32_t)_meshes.size();
+		_stats.VertexCount = _vertexCount;
+		_stats.IndexCount = _indexCount;
+		return handle;
+	}
+
+	VulkanInstanceHandle VulkanGpuScene::AddInstance(VulkanMeshHandle mesh, const glm::mat4& transform, const glm::vec4& color,
+		VulkanTextureHandle texture)
+	{
+		ASSERT_MSG(mesh < _meshes.size(), "Invalid mesh");
+		VulkanInstanceHandle instance;
+		if (!_freeInstances.empty()) {
+			instance = _freeInstances.back();
+			_freeInstances.pop_back();
+		}
+		else if (_instanceCount < VKE_GPU_SCENE_MAX_INSTANCES) {
+			instance = _instanceCount++;
+			_instances.emplace_back();
+			_bounds.emplace_back();
+		}
+		else {
+			Logger::Error("Scene is out of instance slots");
+			return INVALID_INSTANCE;
+		}
+
+		_instances[instance].Color = color;
+		_instances[instance].Texture = texture;
+		_bounds[instance] = {};
+		_bounds[instance].Mesh = mesh;
+		SetTransform(instance, transform);
+		_stats.InstanceCount++;
+		return instance;
+	}
+
+	void VulkanGpuScene::RemoveInstance(VulkanInstanceHandle instance)
+	{
+		ASSERT_MSG(instance < _instanceCount && _bounds[instance].Mesh != INVALID_MESH, "Invalid instance");
+		// The slot stays in the buffers; culling skips it
+		_bounds[instance].Mesh = INVALID_MESH;
+		_freeInstances.push_back(instance);
+		MarkDirty(instance);
+		_stats.InstanceCount--;
+	}
+
+	void VulkanGpuScene::SetTransform(VulkanInstanceHandle instance, const glm::mat4& transform)
+	{
+		ASSERT_MSG(instance < _instanceCount && _bounds[instance].Mesh != INVALID_MESH, "Invalid instance");
+		for (uint32_t row = 0; row < 3; row++) {
+			_instances[instance].Rows[row] = glm::vec4(transform[0][row], transform[1][row], transform[2][row], transform[3][row]);
+		}
+		UpdateBounds(instance);
+		MarkDirty(instance);
+	}
+
+	void VulkanGpuScene::SetColor(VulkanInstanceHandle instance, const glm::vec4& color)
+	{
+		ASSERT_MSG(instance < _instanceCount && _bounds[instance].Mesh != INVALID_MESH, "Invalid instance");
+		_instances[instance].Color = color;
+		MarkDirty(instance);
+	}
+
+	void VulkanGpuScene::SetTextureBindings(uint32_t tableBuffer, uint32_t feedbackBuffer, uint32_t sampler)
+	{
+		_textureTable = tableBuffer;
+		_textureFeedback = feedbackBuffer;
+		_textureSampler = sampler;
+	}
+
+	void VulkanGpuScene::UpdateBounds(VulkanInstanceHandle instance)
+	{
+		const glm::vec4* rows = _instances[instance].Rows;
+		const glm::vec4 sphere = _meshes[_bounds[instance].Mesh].Sphere;
+		const glm::vec4 center(sphere.x, sphere.y, sphere.z, 1.0f);
+
+		float maxScaleSquared = 0.0f;
+		for (uint32_t axis = 0; axis < 3; axis++) {
+			const glm::vec3 column(rows[0][axis], rows[1][axis], rows[2][axis]);
+			maxScaleSquared = std::max(maxScaleSquared, glm::dot(column, column));
+		}
+		_bounds[instance].Sphere = glm::vec4(glm::dot(rows[0], center), glm::dot(rows[1], center), glm::dot(rows[2], center),
+			sphere.w * std::sqrt(maxScaleSquared));
+	}
+
+	void VulkanGpuScene::MarkDirty(VulkanInstanceHandle instance)
+	{
+		if (!_dirtyFlags[instance]) {
+			_dirtyFlags[instance] = true;
+			_dirty.push_back(instance);
+		}
+	}
+
+	void VulkanGpuScene::SetViewProjection(const glm::mat4& viewProjection)
+	{
+		_viewProjection = viewProjection;
+
+		// Gribb-Hartmann: each plane is a sum or difference of rows of the matrix. With a 0 to 1 depth range
+		// the near plane is the third row on its own.
+		const glm::vec4 rows[4] = {
+			glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]),
+			glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]),
+			glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]),
+			glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3])
+		};
+		_planes[0] = rows[3] + rows[0];
+		_planes[1] = rows[3] - rows[0];
+		_planes[2] = rows[3] + rows[1];
+		_planes[3] = rows[3] - rows[1];
+		_planes[4] = rows[2];
+		_planes[5] = rows[3] - rows[2];
+		for (glm::vec4& plane : _planes) {
+			const float length = glm::length(glm::vec3(plane));
+			plane = length > 0.0f ? plane / length : plane;
+		}
+	}
+
+	void VulkanGpuScene::SetDrawPath(VulkanGpuDrawPath path)
+	{
+		if (path == VulkanGpuDrawPath::IndirectCount && !_supportsIndirectCount) {
+			path = VulkanGpuDrawPath::Indirect;
+		}
+		if (path == VulkanGpuDrawPath::Indirect && !_supportsIndirect) {
+			path = VulkanGpuDrawPath::Direct;
+		}
+		_path = path;
+		_stats.Path = path;
+	}
+
+	uint32_t VulkanGpuScene::GetDrawItemCount() const
+	{
+		return _path == VulkanGpuDrawPath::Direct ? _instanceCount : 1;
+	}
+
+	void VulkanGpuScene::BeginFrame(uint32_t frameIndex)
+	{
+		_frameIndex = frameIndex;
+		_frameNumber++;
+		// Written by the last frame that used this index, whose fence has been waited on
+		_stats.VisibleInstances = _path == VulkanGpuDrawPath::Direct ? UINT32_MAX : ((const uint32_t*)_readback->MappedData)[frameIndex];
+	}
+
+	void VulkanGpuScene::RecordUpdates(VkCommandBuffer commandBuffer)
+	{
+		PROFILE_FUNCTION();
+
+		// Meshes join the table once their geometry has arrived. The upload queue's acquire for it was recorded
+		// earlier in this command buffer, since batches are handed over as soon as they complete.
+		uint8_t* staging = (uint8_t*)_staging->MappedData + _frameIndex * VKE_GPU_SCENE_UPDATE_BYTES;
+		const VkDeviceSize stagingBase = _frameIndex * VKE_GPU_SCENE_UPDATE_BYTES;
+		VkDeviceSize used = 0;
+		_meshCopies.clear();
+		for (size_t i = 0; i < _pendingMeshes.size();) {
+			const VulkanMeshHandle mesh = _pendingMeshes[i];
+			if (!_uploads->IsComplete(_meshes[mesh].Ticket) || used + sizeof(VulkanGpuMesh) > VKE_GPU_SCENE_UPDATE_BYTES) {
+				i++;
+				continue;
+			}
+			memcpy(staging + used, &_meshes[mesh].Gpu, sizeof(VulkanGpuMesh));
+			_meshCopies.push_back({ stagingBase + used, mesh * sizeof(VulkanGpuMesh), sizeof(VulkanGpuMesh) });
+			used += sizeof(VulkanGpuMesh);
+			_meshes[mesh].Ready = true;
+			_pendingMeshes[i] = _pendingMeshes.back();
+			_pendingMeshes.pop_back();
+		}
+
+		// Dirty instances in slot order, so neighbours merge into one copy region. What doesn't fit waits.
+		std::sort(_dirty.begin(), _dirty.end());
+		const VkDeviceSize instanceBytes = sizeof(VulkanGpuInstance) + sizeof(VulkanGpuBounds);
+		const size_t updateCount = std::min(_dirty.size(), (size_t)((VKE_GPU_SCENE_UPDATE_BYTES - used) / instanceBytes));
+		VulkanGpuInstance* stagedInstances = (VulkanGpuInstance*)(staging + used);
+		VulkanGpuBounds* stagedBounds = (VulkanGpuBounds*)(staging + used + updateCount * sizeof(VulkanGpuInstance));
+		const VkDeviceSize instanceBase = stagingBase + used;
+		const VkDeviceSize boundsBase = instanceBase + updateCount * sizeof(VulkanGpuInstance);
+		_instanceCopies.clear();
+		_boundsCopies.clear();
+		for (size_t i = 0; i < updateCount; i++) {
+			const VulkanInstanceHandle instance = _dirty[i];
+			stagedInstances[i] = _instances[instance];
+			stagedBounds[i] = _bounds[instance];
+			_dirtyFlags[instance] = false;
+			if (i > 0 && _dirty[i - 1] + 1 == instance) {
+				_instanceCopies.back().size += sizeof(VulkanGpuInstance);
+				_boundsCopies.back().size += sizeof(VulkanGpuBounds);
+				continue;
+			}
+			_instanceCopies.push_back({ instanceBase + i * sizeof(VulkanGpuInstance), instance * sizeof(VulkanGpuInstance), sizeof(VulkanGpuInstance) });
+			_boundsCopies.push_back({ boundsBase + i * sizeof(VulkanGpuBounds), instance * sizeof(VulkanGpuBounds), sizeof(VulkanGpuBounds) });
+		}
+		_dirty.erase(_dirty.begin(), _dirty.begin() + updateCount);
+		_stats.UpdatedInstances = (uint32_t)updateCount;
+
+		// Earlier frames on this queue may still be culling and drawing from what is overwritten next
+		VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		// Entries of meshes still uploading read as empty
+		if (!_meshTableCleared) {
+			vkCmdFillBuffer(commandBuffer, _meshTable.Allocation->Buffer, 0, VK_WHOLE_SIZE, 0);
+			VkMemoryBarrier clearBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			clearBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &clearBarrier,
+				0, nullptr, 0, nullptr);
+			_meshTableCleared = true;
+		}
+		const VkBuffer stagingBuffer = _staging->Buffer;
+		if (!_meshCopies.empty()) {
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, _meshTable.Allocation->Buffer, (uint32_t)_meshCopies.size(), _meshCopies.data());
+		}
+		if (!_instanceCopies.empty()) {
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, _instanceBuffer.Allocation->Buffer, (uint32_t)_instanceCopies.size(), _instanceCopies.data());
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, _boundsBuffer.Allocation->Buffer, (uint32_t)_boundsCopies.size(), _boundsCopies.data());
+		}
+		vkCmdFillBuffer(commandBuffer, _drawCount.Allocation->Buffer, 0, sizeof(uint32_t), 0);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void VulkanGpuScene::RecordCull(VkCommandBuffer commandBuffer)
+	{
+		PROFILE_FUNCTION();
+		if (_path == VulkanGpuDrawPath::Direct) {
+			return;
+		}
+
+		VulkanCullConstants constants;
+		memcpy(constants.Planes, _planes, sizeof(_planes));
+		constants.InstanceCount = _instanceCount;
+		constants.BoundsBuffer = _boundsBuffer.Index;
+		constants.MeshBuffer = _meshTable.Index;
+		constants.DrawBuffer = _draws.Index;
+		constants.CountBuffer = _drawCount.Index;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelines[_path == VulkanGpuDrawPath::IndirectCount ? 0 : 1]);
+		_bindless->PushConstants(commandBuffer, &constants, sizeof(constants));
+		if (_instanceCount > 0) {
+			vkCmdDispatch(commandBuffer, (_instanceCount + VKE_GPU_SCENE_CULL_GROUP_SIZE - 1) / VKE_GPU_SCENE_CULL_GROUP_SIZE, 1, 1);
+		}
+
+		// Commands to the indirect draws; the count also to the copy the CPU reads a few frames later
+		VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		const VkBufferCopy copy = { 0, _frameIndex * sizeof(uint32_t), sizeof(uint32_t) };
+		vkCmdCopyBuffer(commandBuffer, _drawCount.Allocation->Buffer, _readback->Buffer, 1, &copy);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void VulkanGpuScene::RecordDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)
+	{
+		VulkanDrawConstants constants;
+		constants.ViewProjection = _viewProjection;
+		constants.VertexBuffer = _vertices.Index;
+		constants.InstanceBuffer = _instanceBuffer.Index;
+		constants.TextureTable = _textureTable;
+		constants.TextureFeedback = _textureFeedback;
+		constants.TextureSampler = _textureSampler;
+		constants.FrameNumber = _frameNumber;
+		_bindless->PushConstants(commandBuffer, &constants, sizeof(constants));
+		vkCmdBindIndexBuffer(commandBuffer, _indices.Allocation->Buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		const uint32_t maxDraws = std::min(_instanceCount, _maxDrawIndirectCount);
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		switch (_path) {
+		case VulkanGpuDrawPath::IndirectCount:
+			if (maxDraws > 0) {
+				vkCmdDrawIndexedIndirectCount(commandBuffer, _draws.Allocation->Buffer, 0, _drawCount.Allocation->Buffer, 0, maxDraws, stride);
+			}
+			break;
+		case VulkanGpuDrawPath::Indirect:
+			if (maxDraws > 0) {
+				vkCmdDrawIndexedIndirect(commandBuffer, _draws.Allocation->Buffer, 0, maxDraws, stride);
+			}
+			break;
+		case VulkanGpuDrawPath::Direct:
+			// Workers may record ranges of this concurrently; nothing here writes
+			for (uint32_t instance = begin; instance < end; instance++) {
+				const uint32_t mesh = _bounds[instance].Mesh;
+				if (mesh != INVALID_MESH && _meshes[mesh].Ready) {
+					const VulkanGpuMesh& gpu = _meshes[mesh].Gpu;
+					vkCmdDrawIndexed(commandBuffer, gpu.IndexCount, 1, gpu.FirstIndex, gpu.VertexOffset, instance);
+				}
+			}
+			break;
+		}
+	}
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vke_types.h"
+#include "VulkanTextureStreamer.h"
+
+// Instance slots; the bounds, instance and indirect command buffers are sized for this many up front
+#ifndef VKE_GPU_SCENE_MAX_INSTANCES
+#define VKE_GPU_SCENE_MAX_INSTANCES 65536
+#endif
+
+// Shared geometry buffers every mesh is sub-allocated from
+#ifndef VKE_GPU_SCENE_MAX_VERTICES
+#define VKE_GPU_SCENE_MAX_VERTICES (1u << 20)
+#endif
+
+#ifndef VKE_GPU_SCENE_MAX_INDICES
+#define VKE_GPU_SCENE_MAX_INDICES (4u << 20)
+#endif
+
+#ifndef VKE_GPU_SCENE_MAX_MESHES
+#define VKE_GPU_SCENE_MAX_MESHES 4096
+#endif
+
+// Staging for instance changes, per frame in flight. Changes that don't fit carry over to the next frame.
+#ifndef VKE_GPU_SCENE_UPDATE_BYTES
+#define VKE_GPU_SCENE_UPDATE_BYTES (4ull * 1024 * 1024)
+#endif
+
+// Must match local_size_x in cull.comp.glsl
+#define VKE_GPU_SCENE_CULL_GROUP_SIZE 64
+
+namespace VKE
+{
+	class VulkanMemoryAllocator;
+	class VulkanUploadQueue;
+	class VulkanBindlessHeap;
+	struct VulkanAllocation;
+	struct VulkanDeviceCapabilities;
+
+	typedef uint32_t VulkanMeshHandle;
+	typedef uint32_t VulkanInstanceHandle;
+	constexpr VulkanMeshHandle INVALID_MESH = UINT32_MAX;
+	constexpr VulkanInstanceHandle INVALID_INSTANCE = UINT32_MAX;
+
+	// How the scene reaches the draw calls, fastest first. The best one the device supports is picked.
+	enum class VulkanGpuDrawPath : uint32_t
+	{
+		// Culling compacts the visible instances, one vkCmdDrawIndexedIndirectCount draws them (Vulkan 1.2)
+		IndirectCount,
+		// Culling zeroes the instance count of hidden instances in place, one multi-draw vkCmdDrawIndexedIndirect
+		Indirect,
+		// No GPU culling, one vkCmdDrawIndexed per instance recorded on the CPU
+		Direct
+	};
+
+	// Matches Instance in scene.glsl. The world transform is stored as the rows of a 3x4 matrix.
+	struct VulkanGpuInstance
+	{
+		glm::vec4 Rows[3];
+		glm::vec4 Color;
+		// Streamed texture, INVALID_TEXTURE for untextured instances
+		VulkanTextureHandle Texture;
+		uint32_t Padding[3];
+	};
+
+	// Matches Bounds in scene.glsl. Everything culling reads, kept apart from what only the vertex shader needs.
+	struct VulkanGpuBounds
+	{
+		// World space center and radius
+		glm::vec4 Sphere;
+		// INVALID_MESH for free slots
+		uint32_t Mesh;
+		uint32_t Padding[3];
+	};
+
+	// Matches Mesh in scene.glsl
+	struct VulkanGpuMesh
+	{
+		uint32_t IndexCount;
+		uint32_t FirstIndex;
+		int32_t VertexOffset;
+		uint32_t Padding;
+	};
+
+	struct VulkanGpuSceneStats
+	{
+		VulkanGpuDrawPath Path;
+		uint32_t MeshCount;
+		uint32_t InstanceCount;
+		uint32_t VertexCount;
+		uint32_t IndexCount;
+		// Instances copied to the GPU by the last RecordUpdates
+		uint32_t UpdatedInstances;
+		// Instances that passed culling, read back framesInFlight frames late. UINT32_MAX on the direct path.
+		uint32_t VisibleInstances;
+	};
+
+	// Draw data for GPU-driven rendering. Meshes share one index buffer and one vertex buffer that the vertex
+	// shader reads through the bindless heap, and instance transforms and bounds live in storage buffers.
+	// Each frame a compute pass tests every instance's bounding sphere against the frustum and writes the
+	// indirect commands, so recording the scene costs the CPU the same for ten instances or ten thousand.
+	//
+	// Meshes live as long as the scene. Instance changes are kept on the CPU and copied on the graphics queue
+	// by RecordUpdates, so frames still in flight never see a half-written buffer. Use from the render thread.
+	class VulkanGpuScene
+	{
+	public:
+		// cullModule is cull.comp.spv; the scene owns it from here
+		VulkanGpuScene(VkDevice device, VulkanMemoryAllocator* memory, VulkanUploadQueue* uploads, VulkanBindlessHeap* bindless,
+			VkPipelineCache pipelineCache, VkShaderModule cullModule, const VulkanDeviceCapabilities& capabilities, uint32_t framesInFlight);
+		~VulkanGpuScene();
+
+		// Positions only. The geometry goes through the upload queue; instances of the mesh are drawn once it has
+		// arrived. Returns INVALID_MESH when the shared buffers are full.
+		VulkanMeshHandle AddMesh(const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+
+		// Returns INVALID_INSTANCE when every slot is taken. The texture is multiplied with the color.
+		VulkanInstanceHandle AddInstance(VulkanMeshHandle mesh, const glm::mat4& transform, const glm::vec4& color,
+			VulkanTextureHandle texture = INVALID_TEXTURE);
+		void RemoveInstance(VulkanInstanceHandle instance);
+		// Affine transforms only; the bounding sphere grows with the largest axis scale
+		void SetTransform(VulkanInstanceHandle instance, const glm::mat4& transform);
+		void SetColor(VulkanInstanceHandle instance, const glm::vec4& color);
+
+		// Streaming table and feedback buffer of the texture streamer, and the bindless sampler textured
+		// instances are drawn with
+		void SetTextureBindings(uint32_t tableBuffer, uint32_t feedbackBuffer, uint32_t sampler);
+
+		// Culling happens against the frustum of this matrix, with Vulkan's 0 to 1 depth range
+		void SetViewProjection(const glm::mat4& viewProjection);
+
+		// Falls back to the best supported path at or below the requested one
+		void SetDrawPath(VulkanGpuDrawPath path);
+		VulkanGpuDrawPath GetDrawPath() const { return _path; }
+
+		// Call once per frame after the frame's fence wait
+		void BeginFrame(uint32_t frameIndex);
+		// Copies pending changes and resets the draw count. Record outside a render pass, before the cull pass.
+		void RecordUpdates(VkCommandBuffer commandBuffer);
+		// The cull dispatch, followed by the barrier that makes its commands visible to indirect draws
+		void RecordCull(VkCommandBuffer commandBuffer);
+		// Inside the render pass, with the bindless heap bound. The pipeline must be bound; viewport and scissor set.
+		// Draws through indirect commands on the GPU paths, in which case begin and end are ignored.
+		void RecordDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end);
+		// Items the main pass records: one on the GPU paths, one per instance slot on the direct path
+		uint32_t GetDrawItemCount() const;
+		// Changes or meshes that RecordUpdates has yet to copy
+		bool HasPendingChanges() const { return !_dirty.empty() || !_pendingMeshes.empty(); }
+
+		const VulkanGpuSceneStats& GetStats() const { return _stats; }
+
+		VulkanGpuScene(const VulkanGpuScene&) = delete;
+		VulkanGpuScene& operator=(const VulkanGpuScene&) = delete;
+
+	private:
+		struct MeshRecord
+		{
+			VulkanGpuMesh Gpu;
+			// Object space bounding sphere
+			glm::vec4 Sphere;
+			uint64_t Ticket;
+			bool Ready;
+		};
+
+		// Where a buffer sits in the bindless heap, and its allocation
+		struct SceneBuffer
+		{
+			VulkanAllocation* Allocation;
+			uint32_t Index;
+		};
+
+		SceneBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+		void DestroyBuffer(SceneBuffer& buffer);
+		void MarkDirty(VulkanInstanceHandle instance);
+		void UpdateBounds(VulkanInstanceHandle instance);
+
+		VkDevice _device;
+		VulkanMemoryAllocator* _memory;
+		VulkanUploadQueue* _uploads;
+		VulkanBindlessHeap* _bindless;
+		uint32_t _framesInFlight;
+		uint32_t _frameIndex;
+		// Counts BeginFrame calls; rotates which pixels write texture feedback
+		uint32_t _frameNumber;
+		uint32_t _maxDrawIndirectCount;
+		bool _supportsIndirectCount;
+		bool _supportsIndirect;
+		VulkanGpuDrawPath _path;
+
+		// One pipeline per GPU path: the compacting variant and the in-place one
+		VkShaderModule _cullModule;
+		VkPipeline _cullPipelines[2];
+
+		// Geometry
+		SceneBuffer _vertices;
+		SceneBuffer _indices;
+		SceneBuffer _meshTable;
+		uint32_t _vertexCount;
+		uint32_t _indexCount;
+		std::vector<MeshRecord> _meshes;
+		// Meshes whose table entry waits for their geometry upload
+		std::vector<VulkanMeshHandle> _pendingMeshes;
+		// Zeroed by the first RecordUpdates, so entries of meshes still uploading read as empty
+		bool _meshTableCleared;
+
+		// Instances. CPU copies are the source of truth; dirty slots are copied by RecordUpdates.
+		SceneBuffer _instanceBuffer;
+		SceneBuffer _boundsBuffer;
+		std::vector<VulkanGpuInstance> _instances;
+		std::vector<VulkanGpuBounds> _bounds;
+		std::vector<VulkanInstanceHandle> _freeInstances;
+		std::vector<VulkanInstanceHandle> _dirty;
+		std::vector<bool> _dirtyFlags;
+		// Slots in use are all below this
+		uint32_t _instanceCount;
+
+		// Passed to main.frag.glsl
+		uint32_t _textureTable;
+		uint32_t _textureFeedback;
+		uint32_t _textureSampler;
+
+		// Culling output: indirect commands and the count, plus a host-readable copy of the count per frame
+		SceneBuffer _draws;
+		SceneBuffer _drawCount;
+		VulkanAllocation* _staging;
+		VulkanAllocation* _readback;
+		std::vector<VkBufferCopy> _instanceCopies;
+		std::vector<VkBufferCopy> _boundsCopies;
+		std::vector<VkBufferCopy> _meshCopies;
+
+		glm::mat4 _viewProjection;
+		glm::vec4 _planes[6];
+
+		VulkanGpuSceneStats _stats;
+	};
+}
@@ -0,0 +1,569 @@
+#include "VulkanMemoryAllocator.h"
+#include "VulkanRenderer.h"
+#include "TlsfAllocator.h"
+#include "Allocators.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+
+namespace VKE
+{
+	struct VulkanMemoryBlock
+	{
+		VkDeviceMemory Memory;
+		VkDeviceSize Size;
+		uint32_t MemoryType;
+		bool Linear;
+		void* Mapped;
+		// Null for dedicated allocations
+		TlsfAllocator* Allocator;
+		// Live sub-allocations, walked by defragmentation
+		std::vector<VulkanAllocation*> Allocations;
+	};
+
+	VulkanMemoryAllocator::VulkanMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, bool memoryBudget,
+		VkDeviceSize blockSize)
+		: _physicalDevice(physicalDevice), _device(device), _memoryBudget(memoryBudget), _framesInFlight(framesInFlight), _blockSize(blockSize), _dedicatedCount(), _dedicatedBytes(),
+		_deviceAllocationCount(0), _frameNumber(0)
+	{
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		_bufferImageGranularity = properties.limits.bufferImageGranularity;
+		_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+		Logger::Info("Device memory allocator: %llu MB blocks, bufferImageGranularity %llu, maxMemoryAllocationCount %u",
+			(unsigned long long)(_blockSize >> 20), (unsigned long long)_bufferImageGranularity, _maxAllocationCount);
+	}
+
+	VulkanMemoryAllocator::~VulkanMemoryAllocator()
+	{
+		for (auto& retired : _retired) {
+			vkDestroyBuffer(_device, retired.Buffer, VK_ALLOCATOR);
+			retired.Block->Allocator->Free(retired.Node);
+		}
+		_retired.clear();
+
+		for (auto& pools : _pools) {
+			for (auto& pool : pools) {
+				for (VulkanMemoryBlock* block : pool.Blocks) {
+					if (!block->Allocations.empty()) {
+						Logger::Warn("Leaked %u allocations in a device memory block", (uint32_t)block->Allocations.size());
+					}
+					DestroyBlock(block);
+				}
+				pool.Blocks.clear();
+			}
+		}
+
+		if (_deviceAllocationCount > 0) {
+			Logger::Warn("Leaked %u dedicated device memory allocations", _deviceAllocationCount);
+		}
+	}
+
+	VulkanAllocation* VulkanMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VulkanMemoryUsage usage, bool linear, bool dedicated)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return AllocateLocked(requirements, usage, linear, dedicated, VK_NULL_HANDLE, VK_NULL_HANDLE);
+	}
+
+	void VulkanMemoryAllocator::Free(VulkanAllocation* allocation)
+	{
+		if (!allocation) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		FreeLocked(allocation);
+	}
+
+	VulkanAllocation* VulkanMemoryAllocator::CreateBuffer(const VkBufferCreateInfo& info, VulkanMemoryUsage usage, bool movable)
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(!movable || usage == VulkanMemoryUsage::GpuOnly, "Only device local buffers can be moved");
+		ASSERT_MSG(!movable || info.sharingMode == VK_SHARING_MODE_EXCLUSIVE, "Movable buffers must use exclusive sharing");
+
+		// Moves are copies, so movable buffers need to be both ends of a transfer
+		VkBufferCreateInfo createInfo = info;
+		if (movable) {
+			createInfo.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		}
+
+		VkBuffer buffer;
+		VK_CHECK(vkCreateBuffer(_device, &createInfo, VK_ALLOCATOR, &buffer));
+
+		VkBufferMemoryRequirementsInfo2 requirementsInfo = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2 };
+		requirementsInfo.buffer = buffer;
+		VkMemoryDedicatedRequirements dedicatedRequirements = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+		VkMemoryRequirements2 requirements = { VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+		requirements.pNext = &dedicatedRequirements;
+		vkGetBufferMemoryRequirements2(_device, &requirementsInfo, &requirements);
+		const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		VulkanAllocation* allocation = AllocateLocked(requirements.memoryRequirements, usage, true, dedicated, buffer, VK_NULL_HANDLE);
+		if (!allocation) {
+			vkDestroyBuffer(_device, buffer, VK_ALLOCATOR);
+			return nullptr;
+		}
+
+		VK_CHECK(vkBindBufferMemory(_device, buffer, allocation->Memory, allocation->Offset));
+		allocation->Buffer = buffer;
+		// Dedicated memory is never shared, so there is nothing to gain from moving it
+		allocation->Movable = movable && allocation->Block->Allocator != nullptr;
+		allocation->BufferInfo = createInfo;
+		allocation->BufferInfo.pNext = nullptr;
+		allocation->BufferInfo.queueFamilyIndexCount = 0;
+		allocation->BufferInfo.pQueueFamilyIndices = nullptr;
+		return allocation;
+	}
+
+	VulkanAllocation* VulkanMemoryAllocator::CreateImage(const VkImageCreateInfo& info, VulkanMemoryUsage usage, bool dedicated)
+	{
+		PROFILE_FUNCTION();
+
+		VkImage image;
+		VK_CHECK(vkCreateImage(_device, &info, VK_ALLOCATOR, &image));
+
+		VkImageMemoryRequirementsInfo2 requirementsInfo = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2 };
+		requirementsInfo.image = image;
+		VkMemoryDedicatedRequirements dedicatedRequirements = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+		VkMemoryRequirements2 requirements = { VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+		requirements.pNext = &dedicatedRequirements;
+		vkGetImageMemoryRequirements2(_device, &requirementsInfo, &requirements);
+		dedicated = dedicated || dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		const bool linear = info.tiling == VK_IMAGE_TILING_LINEAR;
+		VulkanAllocation* allocation = AllocateLocked(requirements.memoryRequirements, usage, linear, dedicated, VK_NULL_HANDLE, image);
+		if (!allocation) {
+			vkDestroyImage(_device, image, VK_ALLOCATOR);
+			return nullptr;
+		}
+
+		VK_CHECK(vkBindImageMemory(_device, image, allocation->Memory, allocation->Offset));
+		allocation->Image = image;
+		return allocation;
+	}
+
+	void VulkanMemoryAllocator::Destroy(VulkanAllocation* allocation)
+	{
+		if (!allocation) {
+			return;
+		}
+
+		if (allocation->Buffer) {
+			vkDestroyBuffer(_device, allocation->Buffer, VK_ALLOCATOR);
+		}
+		if (allocation->Image) {
+			vkDestroyImage(_device, allocation->Image, VK_ALLOCATOR);
+		}
+		Free(allocation);
+	}
+
+	void VulkanMemoryAllocator::BeginFrame(uint64_t frameNumber)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_frameNumber = frameNumber;
+
+		for (size_t i = 0; i < _retired.size();) {
+			RetiredRange retired = _retired[i];
+			if (frameNumber >= retired.FrameNumber + _framesInFlight) {
+				vkDestroyBuffer(_device, retired.Buffer, VK_ALLOCATOR);
+				retired.Block->Allocator->Free(retired.Node);
+				_retired[i] = _retired.back();
+				_retired.pop_back();
+				ReleaseIfEmpty(retired.Block);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	uint32_t VulkanMemoryAllocator::Defragment(VkCommandBuffer commandBuffer, VkDeviceSize maxBytes)
+	{
+		PROFILE_FUNCTION();
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		VkDeviceSize movedBytes = 0;
+		uint32_t moveCount = 0;
+		for (auto& pools : _pools) {
+			for (auto& pool : pools) {
+				if (pool.Blocks.size() < 2 || movedBytes >= maxBytes) {
+					continue;
+				}
+
+				// Drain the emptiest block into the others so it can be released
+				VulkanMemoryBlock* source = nullptr;
+				for (VulkanMemoryBlock* block : pool.Blocks) {
+					if (!block->Allocations.empty() && (!source || block->Allocator->GetUsed() < source->Allocator->GetUsed())) {
+						source = block;
+					}
+				}
+				if (!source) {
+					continue;
+				}
+
+				VkDeviceSize freeElsewhere = 0;
+				for (VulkanMemoryBlock* block : pool.Blocks) {
+					if (block != source) {
+						freeElsewhere += block->Allocator->GetFree();
+					}
+				}
+				if (freeElsewhere < source->Allocator->GetUsed()) {
+					continue;
+				}
+
+				// Moves edit the block's list, so walk a copy
+				ScratchScope scratch;
+				ArenaVector<VulkanAllocation*> candidates(source->Allocations.begin(), source->Allocations.end(),
+					ArenaAllocator<VulkanAllocation*>(scratch.GetArena()));
+				for (VulkanAllocation* allocation : candidates) {
+					if (movedBytes >= maxBytes) {
+						break;
+					}
+					if (!allocation->Movable) {
+						continue;
+					}
+
+					VulkanMemoryBlock* target;
+					uint32_t node;
+					VkDeviceSize offset;
+					if (!AllocateFromPool(pool, allocation->Size, allocation->Alignment, source, &target, &node, &offset)) {
+						break;
+					}
+
+					VkBuffer buffer;
+					VK_CHECK(vkCreateBuffer(_device, &allocation->BufferInfo, VK_ALLOCATOR, &buffer));
+					VkMemoryRequirements requirements;
+					vkGetBufferMemoryRequirements(_device, buffer, &requirements);
+					ASSERT_MSG(requirements.size <= allocation->Size && (offset % requirements.alignment) == 0, "Moved buffer no longer fits its range");
+					VK_CHECK(vkBindBufferMemory(_device, buffer, target->Memory, offset));
+
+					if (moveCount == 0) {
+						// Earlier work, including frames still in flight, must finish writing before we read
+						VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+						barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+						barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+						vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+							1, &barrier, 0, nullptr, 0, nullptr);
+					}
+
+					VkBufferCopy region = {};
+					region.size = allocation->BufferInfo.size;
+					vkCmdCopyBuffer(commandBuffer, allocation->Buffer, buffer, 1, &region);
+
+					// Frames in flight may still use the old buffer, so its range is released later
+					_retired.push_back({ allocation->Buffer, allocation->Block, allocation->Node, _frameNumber });
+					Unplace(allocation);
+					Place(allocation, target, node, offset);
+					allocation->Buffer = buffer;
+
+					movedBytes += allocation->Size;
+					moveCount++;
+				}
+			}
+		}
+
+		if (moveCount > 0) {
+			VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				1, &barrier, 0, nullptr, 0, nullptr);
+			Logger::Trace("Defragmentation moved %u buffers (%llu bytes)", moveCount, (unsigned long long)movedBytes);
+		}
+		return moveCount;
+	}
+
+	VulkanHeapStats VulkanMemoryAllocator::GetHeapStats(uint32_t heapIndex) const
+	{
+		ASSERT_MSG(heapIndex < _memoryProperties.memoryHeapCount, "Heap index out of range");
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		VulkanHeapStats stats = {};
+		stats.HeapSize = _memoryProperties.memoryHeaps[heapIndex].size;
+		stats.DeviceLocal = (_memoryProperties.memoryHeaps[heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		stats.DedicatedCount = _dedicatedCount[heapIndex];
+		stats.DedicatedBytes = _dedicatedBytes[heapIndex];
+
+		VkDeviceSize freeBytes = 0;
+		for (uint32_t type = 0; type < _memoryProperties.memoryTypeCount; ++type) {
+			if (_memoryProperties.memoryTypes[type].heapIndex != heapIndex) {
+				continue;
+			}
+
+			for (auto& pool : _pools[type]) {
+				for (VulkanMemoryBlock* block : pool.Blocks) {
+					stats.BlockCount++;
+					stats.BlockBytes += block->Size;
+					stats.AllocationCount += (uint32_t)block->Allocations.size();
+					stats.AllocatedBytes += block->Allocator->GetUsed();
+					stats.FreeRangeCount += block->Allocator->GetFreeRangeCount();
+					stats.LargestFreeRange = std::max(stats.LargestFreeRange, (VkDeviceSize)block->Allocator->GetLargestFreeRange());
+					freeBytes += block->Allocator->GetFree();
+				}
+			}
+		}
+
+		stats.Fragmentation = freeBytes > 0 ? 1.0f - (float32_t)((float64_t)stats.LargestFreeRange / (float64_t)freeBytes) : 0.0f;
+
+		if (_memoryBudget) {
+			// Covers every allocation in the process, including other APIs and the driver's own
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+			VkPhysicalDeviceMemoryProperties2 properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+			properties.pNext = &budget;
+			vkGetPhysicalDeviceMemoryProperties2(_physicalDevice, &properties);
+			stats.Budget = budget.heapBudget[heapIndex];
+			stats.Usage = budget.heapUsage[heapIndex];
+		}
+		else {
+			stats.Budget = stats.HeapSize / 10 * 8;
+			stats.Usage = stats.BlockBytes + stats.DedicatedBytes;
+		}
+		return stats;
+	}
+
+	uint32_t VulkanMemoryAllocator::GetDeviceAllocationCount() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _deviceAllocationCount;
+	}
+
+	bool VulkanMemoryAllocator::FindMemoryType(uint32_t typeBits, VulkanMemoryUsage usage, uint32_t* memoryType) const
+	{
+		VkMemoryPropertyFlags required = 0;
+		VkMemoryPropertyFlags preferred = 0;
+		switch (usage) {
+		case VulkanMemoryUsage::GpuOnly:
+			required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			break;
+		case VulkanMemoryUsage::CpuToGpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			break;
+		case VulkanMemoryUsage::GpuToCpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		case VulkanMemoryUsage::GpuLazy:
+			required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			preferred = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			break;
+		}
+
+		// Types are ordered by the driver from best to worst for equal properties, so take the first match
+		for (VkMemoryPropertyFlags flags : { required | preferred, required }) {
+			for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; ++i) {
+				if ((typeBits & (1u << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags) {
+					*memoryType = i;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool VulkanMemoryAllocator::SupportsLazyMemory() const
+	{
+		for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; ++i) {
+			if (_memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	VkDeviceSize VulkanMemoryAllocator::GetBlockSize(uint32_t memoryType) const
+	{
+		// Small heaps (e.g. the 256 MB host visible window into VRAM) get proportionally smaller blocks
+		const VkDeviceSize heapSize = _memoryProperties.memoryHeaps[_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+		if (heapSize <= 1024ull * 1024 * 1024) {
+			return std::min(_blockSize, heapSize / 8);
+		}
+		return _blockSize;
+	}
+
+	VulkanMemoryAllocator::Pool& VulkanMemoryAllocator::GetPool(uint32_t memoryType, bool linear)
+	{
+		return _pools[memoryType][_bufferImageGranularity > 1 && linear ? 1 : 0];
+	}
+
+	VulkanAllocation* VulkanMemoryAllocator::AllocateLocked(const VkMemoryRequirements& requirements, VulkanMemoryUsage usage, bool linear,
+		bool dedicated, VkBuffer buffer, VkImage image)
+	{
+		uint32_t memoryType;
+		if (!FindMemoryType(requirements.memoryTypeBits, usage, &memoryType)) {
+			Logger::Error("No memory type matches usage %u (type bits 0x%x)", (uint32_t)usage, requirements.memoryTypeBits);
+			return nullptr;
+		}
+
+		const VkDeviceSize blockSize = GetBlockSize(memoryType);
+		if (requirements.size > blockSize / 2) {
+			dedicated = true;
+		}
+
+		VulkanAllocation* allocation = new VulkanAllocation();
+		allocation->Size = requirements.size;
+		allocation->Alignment = requirements.alignment;
+		allocation->MemoryType = memoryType;
+		allocation->Node = TlsfAllocator::INVALID_NODE;
+
+		if (dedicated) {
+			VkMemoryDedicatedAllocateInfo dedicatedInfo = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO };
+			dedicatedInfo.buffer = buffer;
+			dedicatedInfo.image = image;
+			VulkanMemoryBlock* block = CreateBlock(memoryType, requirements.size, linear, false,
+				(buffer || image) ? &dedicatedInfo : nullptr);
+			if (!block) {
+				delete allocation;
+				return nullptr;
+			}
+
+			allocation->Memory = block->Memory;
+			allocation->Offset = 0;
+			allocation->MappedData = block->Mapped;
+			allocation->Block = block;
+
+			const uint32_t heap = _memoryProperties.memoryTypes[memoryType].heapIndex;
+			_dedicatedCount[heap]++;
+			_dedicatedBytes[heap] += requirements.size;
+			return allocation;
+		}
+
+		Pool& pool = GetPool(memoryType, linear);
+		VulkanMemoryBlock* block;
+		uint32_t node;
+		VkDeviceSize offset;
+		if (!AllocateFromPool(pool, requirements.size, requirements.alignment, nullptr, &block, &node, &offset)) {
+			block = CreateBlock(memoryType, blockSize, linear, true, nullptr);
+			if (!block) {
+				delete allocation;
+				return nullptr;
+			}
+			pool.Blocks.push_back(block);
+
+			const bool allocated = block->Allocator->Allocate(requirements.size, requirements.alignment, &offset, &node);
+			ASSERT_MSG(allocated, "A fresh block could not satisfy an allocation of at most half its size");
+		}
+
+		Place(allocation, block, node, offset);
+		return allocation;
+	}
+
+	void VulkanMemoryAllocator::FreeLocked(VulkanAllocation* allocation)
+	{
+		VulkanMemoryBlock* block = allocation->Block;
+		if (!block->Allocator) {
+			const uint32_t heap = _memoryProperties.memoryTypes[block->MemoryType].heapIndex;
+			_dedicatedCount[heap]--;
+			_dedicatedBytes[heap] -= allocation->Size;
+			DestroyBlock(block);
+		}
+		else {
+			Unplace(allocation);
+			block->Allocator->Free(allocation->Node);
+			ReleaseIfEmpty(block);
+		}
+		delete allocation;
+	}
+
+	bool VulkanMemoryAllocator::AllocateFromPool(Pool& pool, VkDeviceSize size, VkDeviceSize alignment, const VulkanMemoryBlock* exclude,
+		VulkanMemoryBlock** block, uint32_t* node, VkDeviceSize* offset)
+	{
+		for (VulkanMemoryBlock* candidate : pool.Blocks) {
+			if (candidate != exclude && candidate->Allocator->Allocate(size, alignment, offset, node)) {
+				*block = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void VulkanMemoryAllocator::Place(VulkanAllocation* allocation, VulkanMemoryBlock* block, uint32_t node, VkDeviceSize offset)
+	{
+		allocation->Memory = block->Memory;
+		allocation->Offset = offset;
+		allocation->MappedData = block->Mapped ? static_cast<uint8_t*>(block->Mapped) + offset : nullptr;
+		allocation->Block = block;
+		allocation->Node = node;
+		allocation->Slot = (uint32_t)block->Allocations.size();
+		block->Allocations.push_back(allocation);
+	}
+
+	void VulkanMemoryAllocator::Unplace(VulkanAllocation* allocation)
+	{
+		auto& allocations = allocation->Block->Allocations;
+		VulkanAllocation* last = allocations.back();
+		allocations[allocation->Slot] = last;
+		last->Slot = allocation->Slot;
+		allocations.pop_back();
+	}
+
+	VulkanMemoryBlock* VulkanMemoryAllocator::CreateBlock(uint32_t memoryType, VkDeviceSize size, bool linear, bool shared,
+		const VkMemoryDedicatedAllocateInfo* dedicatedInfo)
+	{
+		PROFILE_FUNCTION();
+		if (_deviceAllocationCount >= _maxAllocationCount) {
+			Logger::Error("Reached maxMemoryAllocationCount (%u)", _maxAllocationCount);
+			return nullptr;
+		}
+
+		VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		allocInfo.pNext = dedicatedInfo;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+		VkDeviceMemory memory;
+		const VkResult result = vkAllocateMemory(_device, &allocInfo, VK_ALLOCATOR, &memory);
+		if (result != VK_SUCCESS) {
+			Logger::Error("vkAllocateMemory of %llu bytes from type %u failed (%d)", (unsigned long long)size, memoryType, (int32_t)result);
+			return nullptr;
+		}
+
+		VulkanMemoryBlock* block = new VulkanMemoryBlock();
+		block->Memory = memory;
+		block->Size = size;
+		block->MemoryType = memoryType;
+		block->Linear = linear;
+		block->Mapped = nullptr;
+		block->Allocator = shared ? new TlsfAllocator(size) : nullptr;
+
+		if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			VK_CHECK(vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, &block->Mapped));
+		}
+
+		_deviceAllocationCount++;
+		return block;
+	}
+
+	void VulkanMemoryAllocator::DestroyBlock(VulkanMemoryBlock* block)
+	{
+		if (block->Mapped) {
+			vkUnmapMemory(_device, block->Memory);
+		}
+		vkFreeMemory(_device, block->Memory, VK_ALLOCATOR);
+		delete block->Allocator;
+		delete block;
+		_deviceAllocationCount--;
+	}
+
+	// Keeps one empty block per pool around so a single allocation bouncing across a boundary
+	// doesn't allocate and free device memory every frame.
+	void VulkanMemoryAllocator::ReleaseIfEmpty(VulkanMemoryBlock* block)
+	{
+		if (!block->Allocator->IsEmpty()) {
+			return;
+		}
+
+		Pool& pool = GetPool(block->MemoryType, block->Linear);
+		if (pool.Blocks.size() < 2) {
+			return;
+		}
+
+		pool.Blocks.erase(std::find(pool.Blocks.begin(), pool.Blocks.end(), block));
+		DestroyBlock(block);
+	}
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <vector>
+
+#include "vke_types.h"
+
+#ifndef VKE_DEFAULT_MEMORY_BLOCK_SIZE
+#define VKE_DEFAULT_MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+#endif
+
+#ifndef VKE_DEFRAG_BYTES_PER_FRAME
+#define VKE_DEFRAG_BYTES_PER_FRAME (8ull * 1024 * 1024)
+#endif
+
+namespace VKE
+{
+	struct VulkanMemoryBlock;
+
+	enum class VulkanMemoryUsage : uint32_t
+	{
+		// Device local, never mapped
+		GpuOnly,
+		// Host visible and coherent, persistently mapped. Uploads and per-frame data.
+		CpuToGpu,
+		// Host visible, cached where possible, persistently mapped. Readback.
+		GpuToCpu,
+		// Lazily allocated where the device has it (tile-based GPUs), so transient attachments that never
+		// leave tile memory cost nothing. Falls back to GpuOnly.
+		GpuLazy
+	};
+
+	struct VulkanAllocation
+	{
+		VkDeviceMemory Memory;
+		VkDeviceSize Offset;
+		VkDeviceSize Size;
+		VkDeviceSize Alignment;
+		// Points at Offset for host visible memory, which stays mapped for the lifetime of its block
+		void* MappedData;
+		uint32_t MemoryType;
+		// Set for resources created through the allocator. Defragmentation can move a movable buffer
+		// and replace Buffer, so read it when recording instead of caching it.
+		VkBuffer Buffer;
+		VkImage Image;
+
+		// Internal
+		VulkanMemoryBlock* Block;
+		uint32_t Node;
+		uint32_t Slot;
+		bool Movable;
+		VkBufferCreateInfo BufferInfo;
+	};
+
+	struct VulkanHeapStats
+	{
+		VkDeviceSize HeapSize;
+		bool DeviceLocal;
+		uint32_t BlockCount;
+		VkDeviceSize BlockBytes;
+		// Sub-allocations only; dedicated allocations are counted separately
+		uint32_t AllocationCount;
+		VkDeviceSize AllocatedBytes;
+		uint32_t DedicatedCount;
+		VkDeviceSize DedicatedBytes;
+		uint32_t FreeRangeCount;
+		VkDeviceSize LargestFreeRange;
+		// 0 when the free space in blocks is one range, approaching 1 as it splinters
+		float32_t Fragmentation;
+		// What the process may use of the heap and uses now, from VK_EXT_memory_budget. Without it, 80% of
+		// the heap and this allocator's own blocks.
+		VkDeviceSize Budget;
+		VkDeviceSize Usage;
+	};
+
+	// Sub-allocates device memory from large blocks per memory type, each managed by a TLSF allocator,
+	// so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+	class VulkanMemoryAllocator
+	{
+	public:
+		// memoryBudget: VK_EXT_memory_budget is enabled on the device
+		VulkanMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, bool memoryBudget,
+			VkDeviceSize blockSize = VKE_DEFAULT_MEMORY_BLOCK_SIZE);
+		~VulkanMemoryAllocator();
+
+		// linear is true for buffers and linear images. Linear and optimal resources never share a block,
+		// so neighbours can't violate bufferImageGranularity. Requests too big to share a block, or with
+		// dedicated set, get their own vkAllocateMemory. Returns nullptr when out of memory.
+		VulkanAllocation* Allocate(const VkMemoryRequirements& requirements, VulkanMemoryUsage usage, bool linear, bool dedicated = false);
+		void Free(VulkanAllocation* allocation);
+
+		// Creates the resource, allocates and binds its memory. Movable buffers must be GpuOnly.
+		VulkanAllocation* CreateBuffer(const VkBufferCreateInfo& info, VulkanMemoryUsage usage, bool movable = false);
+		VulkanAllocation* CreateImage(const VkImageCreateInfo& info, VulkanMemoryUsage usage, bool dedicated = false);
+		// Destroys the resource and frees its memory. The GPU must be done with it.
+		void Destroy(VulkanAllocation* allocation);
+
+		// Call once per frame after the frame's fence wait. Releases ranges vacated by defragmentation
+		// once no frame in flight can still read them.
+		void BeginFrame(uint64_t frameNumber);
+
+		// Incremental defragmentation: moves up to maxBytes of movable buffers out of the emptiest block of
+		// each pool, recording the copies into commandBuffer. Call outside a render pass, before anything
+		// that uses the moved buffers is recorded. Returns the number of buffers moved.
+		uint32_t Defragment(VkCommandBuffer commandBuffer, VkDeviceSize maxBytes = VKE_DEFRAG_BYTES_PER_FRAME);
+
+		// True if some memory type is lazily allocated
+		bool SupportsLazyMemory() const;
+
+		uint32_t GetHeapCount() const { return _memoryProperties.memoryHeapCount; }
+		VulkanHeapStats GetHeapStats(uint32_t heapIndex) const;
+		uint32_t GetDeviceAllocationCount() const;
+
+	private:
+		struct Pool
+		{
+			std::vector<VulkanMemoryBlock*> Blocks;
+		};
+
+		struct RetiredRange
+		{
+			VkBuffer Buffer;
+			VulkanMemoryBlock* Block;
+			uint32_t Node;
+			uint64_t FrameNumber;
+		};
+
+		bool FindMemoryType(uint32_t typeBits, VulkanMemoryUsage usage, uint32_t* memoryType) const;
+		VkDeviceSize GetBlockSize(uint32_t memoryType) const;
+		Pool& GetPool(uint32_t memoryType, bool linear);
+
+		VulkanAllocation* AllocateLocked(const VkMemoryRequirements& requirements, VulkanMemoryUsage usage, bool linear, bool dedicated,
+			VkBuffer buffer, VkImage image);
+		void FreeLocked(VulkanAllocation* allocation);
+		bool AllocateFromPool(Pool& pool, VkDeviceSize size, VkDeviceSize alignment, const VulkanMemoryBlock* exclude,
+			VulkanMemoryBlock** block, uint32_t* node, VkDeviceSize* offset);
+		void Place(VulkanAllocation* allocation, VulkanMemoryBlock* block, uint32_t node, VkDeviceSize offset);
+		void Unplace(VulkanAllocation* allocation);
+
+		VulkanMemoryBlock* CreateBlock(uint32_t memoryType, VkDeviceSize size, bool linear, bool shared,
+			const VkMemoryDedicatedAllocateInfo* dedicatedInfo);
+		void DestroyBlock(VulkanMemoryBlock* block);
+		void ReleaseIfEmpty(VulkanMemoryBlock* block);
+
+		VkPhysicalDevice _physicalDevice;
+		VkDevice _device;
+		bool _memoryBudget;
+		uint32_t _framesInFlight;
+		VkDeviceSize _blockSize;
+		VkDeviceSize _bufferImageGranularity;
+		uint32_t _maxAllocationCount;
+		VkPhysicalDeviceMemoryProperties _memoryProperties;
+
+		mutable std::mutex _mutex;
+		// [memory type][linear]. Both kinds share index 0 when bufferImageGranularity is 1.
+		Pool _pools[VK_MAX_MEMORY_TYPES][2];
+		uint32_t _dedicatedCount[VK_MAX_MEMORY_HEAPS];
+		VkDeviceSize _dedicatedBytes[VK_MAX_MEMORY_HEAPS];
+		uint32_t _deviceAllocationCount;
+
+		std::vector<RetiredRange> _retired;
+		uint64_t _frameNumber;
+	};
+}
@@ -0,0 +1,133 @@
+#include "VulkanPipelineCache.h"
+#include "VulkanRenderer.h"
+#include "Platform.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace VKE
+{
+	VulkanPipelineCache::VulkanPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const char* filename)
+		: _device(device), _filename(filename), _cache(VK_NULL_HANDLE), _warm(false), _loadTimeMs(0.0)
+	{
+		PROFILE_FUNCTION();
+		const auto start = std::chrono::steady_clock::now();
+
+		vkGetPhysicalDeviceProperties(physicalDevice, &_deviceProperties);
+
+		std::vector<char> data;
+		std::ifstream file(_filename, std::ios::ate | std::ios::binary);
+		if (file.is_open()) {
+			data.resize((uint64_t)file.tellg());
+			file.seekg(0);
+			file.read(data.data(), data.size());
+			file.close();
+
+			if (!ValidateHeader(data.data(), data.size())) {
+				data.clear();
+			}
+		}
+		else {
+			Logger::Info("No pipeline cache found at %s, starting cold", _filename);
+		}
+
+		VkPipelineCacheCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+		createInfo.initialDataSize = data.size();
+		createInfo.pInitialData = data.empty() ? nullptr : data.data();
+		VkResult result = vkCreatePipelineCache(_device, &createInfo, VK_ALLOCATOR, &_cache);
+		if (result != VK_SUCCESS && !data.empty()) {
+			// The driver rejected data that passed our checks; fall back to an empty cache.
+			Logger::Warn("Driver rejected pipeline cache data, starting cold");
+			createInfo.initialDataSize = 0;
+			createInfo.pInitialData = nullptr;
+			data.clear();
+			result = vkCreatePipelineCache(_device, &createInfo, VK_ALLOCATOR, &_cache);
+		}
+		VK_CHECK(result);
+
+		_warm = !data.empty();
+		_loadTimeMs = std::chrono::duration<float64_t, std::milli>(std::chrono::steady_clock::now() - start).count();
+		Logger::Info("Pipeline cache ready (%s, %llu bytes, %.2f ms)", _warm ? "warm" : "cold", (unsigned long long)data.size(), _loadTimeMs);
+	}
+
+	VulkanPipelineCache::~VulkanPipelineCache()
+	{
+		Save();
+		vkDestroyPipelineCache(_device, _cache, VK_ALLOCATOR);
+	}
+
+	bool VulkanPipelineCache::ValidateHeader(const char* data, uint64_t size) const
+	{
+		// Layout of VkPipelineCacheHeaderVersionOne. Read field by field, the file is not guaranteed to be aligned.
+		constexpr uint64_t headerSize = 16 + VK_UUID_SIZE;
+		if (size < headerSize) {
+			Logger::Warn("Discarding pipeline cache %s: file too small", _filename);
+			return false;
+		}
+
+		uint32_t storedHeaderSize, headerVersion, vendorID, deviceID;
+		uint8_t uuid[VK_UUID_SIZE];
+		memcpy(&storedHeaderSize, data + 0, 4);
+		memcpy(&headerVersion, data + 4, 4);
+		memcpy(&vendorID, data + 8, 4);
+		memcpy(&deviceID, data + 12, 4);
+		memcpy(uuid, data + 16, VK_UUID_SIZE);
+
+		if (storedHeaderSize < headerSize || storedHeaderSize > size || headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+			Logger::Warn("Discarding pipeline cache %s: unknown header", _filename);
+			return false;
+		}
+
+		if (vendorID != _deviceProperties.vendorID || deviceID != _deviceProperties.deviceID) {
+			Logger::Info("Discarding pipeline cache %s: built for device %04x:%04x, running on %04x:%04x", _filename,
+				vendorID, deviceID, _deviceProperties.vendorID, _deviceProperties.deviceID);
+			return false;
+		}
+
+		// The UUID changes with the driver version.
+		if (memcmp(uuid, _deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			Logger::Info("Discarding pipeline cache %s: driver changed", _filename);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool VulkanPipelineCache::Save() const
+	{
+		PROFILE_FUNCTION();
+
+		size_t size = 0;
+		VK_CHECK(vkGetPipelineCacheData(_device, _cache, &size, nullptr));
+		std::vector<char> data(size);
+		VK_CHECK(vkGetPipelineCacheData(_device, _cache, &size, data.data()));
+
+		// Write next to the destination, then swap it in so a crash never leaves a truncated cache.
+		const std::string tempFilename = std::string(_filename) + ".tmp";
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			Logger::Error("Unable to write pipeline cache %s", tempFilename.c_str());
+			return false;
+		}
+		file.write(data.data(), size);
+		file.close();
+		if (file.fail()) {
+			Logger::Error("Failed writing pipeline cache %s", tempFilename.c_str());
+			return false;
+		}
+
+		if (!Platform::ReplaceFileAtomic(tempFilename.c_str(), _filename)) {
+			Logger::Error("Unable to replace pipeline cache %s", _filename);
+			return false;
+		}
+
+		Logger::Info("Saved pipeline cache (%llu bytes) to %s", (unsigned long long)size, _filename);
+		return true;
+	}
+}
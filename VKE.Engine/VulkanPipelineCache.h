@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	// VkPipelineCache persisted to disk between runs. The file is only used if its header matches
+	// the physical device it is loaded on, and it is replaced atomically when saved.
+	class VulkanPipelineCache
+	{
+	public:
+		VulkanPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const char* filename);
+		~VulkanPipelineCache();
+
+		VkPipelineCache GetHandle() const { return _cache; }
+
+		// True if valid data from a previous run was loaded.
+		bool IsWarm() const { return _warm; }
+		float64_t GetLoadTimeMs() const { return _loadTimeMs; }
+
+		bool Save() const;
+
+	private:
+		bool ValidateHeader(const char* data, uint64_t size) const;
+
+		VkDevice _device;
+		VkPhysicalDeviceProperties _deviceProperties;
+		const char* _filename;
+		VkPipelineCache _cache;
+		bool _warm;
+		float64_t _loadTimeMs;
+	};
+}
@@ -0,0 +1,676 @@
+#include "VulkanPipelineState.h"
+#include "VulkanRenderer.h"
+#include "Logger.h"
+#include "vke_hash.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <cstring>
+
+namespace VKE
+{
+	// Fixed-function state for one description, shared by the monolithic and library paths.
+	// Holds pointers into itself, so it is built in place and never copied.
+	struct VulkanPipelineStateBlocks
+	{
+		VkPipelineShaderStageCreateInfo Stages[VulkanPipelineDesc::MaxStages];
+		VkPipelineVertexInputStateCreateInfo VertexInput;
+		VkPipelineInputAssemblyStateCreateInfo InputAssembly;
+		VkPipelineViewportStateCreateInfo ViewportState;
+		VkPipelineRasterizationStateCreateInfo Rasterizer;
+		VkPipelineMultisampleStateCreateInfo Multisample;
+		VkPipelineDepthStencilStateCreateInfo DepthStencil;
+		VkPipelineColorBlendAttachmentState ColorBlendAttachment;
+		VkPipelineColorBlendStateCreateInfo ColorBlend;
+		VkDynamicState DynamicStates[2];
+		VkPipelineDynamicStateCreateInfo DynamicState;
+
+		explicit VulkanPipelineStateBlocks(const VulkanPipelineDesc& desc)
+		{
+			// Shader stages
+			for (uint32_t i = 0; i < desc.StageCount; ++i) {
+				Stages[i] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+				Stages[i].stage = desc.Stages[i].Stage;
+				Stages[i].module = desc.Stages[i].Module;
+				Stages[i].pName = "main";
+				Stages[i].pSpecializationInfo = desc.Stages[i].Specialization;
+			}
+
+			// Vertex input
+			VertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+			VertexInput.vertexBindingDescriptionCount = desc.VertexLayout.BindingCount;
+			VertexInput.pVertexBindingDescriptions = desc.VertexLayout.Bindings;
+			VertexInput.vertexAttributeDescriptionCount = desc.VertexLayout.AttributeCount;
+			VertexInput.pVertexAttributeDescriptions = desc.VertexLayout.Attributes;
+
+			// Input assembly
+			InputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+			InputAssembly.topology = desc.Topology;
+			InputAssembly.primitiveRestartEnable = VK_FALSE;
+
+			// Viewport state, the actual viewport and scissor are set at record time
+			ViewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+			ViewportState.viewportCount = 1;
+			ViewportState.scissorCount = 1;
+
+			// Rasterizer
+			Rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+			Rasterizer.depthClampEnable = VK_FALSE;
+			Rasterizer.rasterizerDiscardEnable = VK_FALSE;
+			Rasterizer.polygonMode = desc.PolygonMode;
+			Rasterizer.lineWidth = 1.0f;
+			Rasterizer.cullMode = desc.CullMode;
+			Rasterizer.frontFace = desc.FrontFace;
+			Rasterizer.depthBiasEnable = VK_FALSE;
+
+			// Multisampling
+			Multisample = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+			Multisample.sampleShadingEnable = VK_FALSE;
+			Multisample.rasterizationSamples = desc.Samples;
+			Multisample.minSampleShading = 1.0f;
+
+			// Depth and stencil
+			DepthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+			DepthStencil.depthTestEnable = desc.DepthTest ? VK_TRUE : VK_FALSE;
+			DepthStencil.depthWriteEnable = desc.DepthWrite ? VK_TRUE : VK_FALSE;
+			DepthStencil.depthCompareOp = desc.DepthCompareOp;
+			DepthStencil.depthBoundsTestEnable = VK_FALSE;
+			DepthStencil.stencilTestEnable = VK_FALSE;
+
+			// Color attachment
+			ColorBlendAttachment = {};
+			ColorBlendAttachment.blendEnable = desc.BlendEnable ? VK_TRUE : VK_FALSE;
+			ColorBlendAttachment.srcColorBlendFactor = desc.SrcColorBlendFactor;
+			ColorBlendAttachment.dstColorBlendFactor = desc.DstColorBlendFactor;
+			ColorBlendAttachment.colorBlendOp = desc.ColorBlendOp;
+			ColorBlendAttachment.srcAlphaBlendFactor = desc.SrcAlphaBlendFactor;
+			ColorBlendAttachment.dstAlphaBlendFactor = desc.DstAlphaBlendFactor;
+			ColorBlendAttachment.alphaBlendOp = desc.AlphaBlendOp;
+			ColorBlendAttachment.colorWriteMask = desc.ColorWriteMask;
+
+			ColorBlend = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+			ColorBlend.logicOpEnable = VK_FALSE;
+			ColorBlend.logicOp = VK_LOGIC_OP_COPY;
+			ColorBlend.attachmentCount = 1;
+			ColorBlend.pAttachments = &ColorBlendAttachment;
+
+			// Dynamic state
+			DynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+			DynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+			DynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+			DynamicState.dynamicStateCount = 2;
+			DynamicState.pDynamicStates = DynamicStates;
+		}
+
+		VulkanPipelineStateBlocks(const VulkanPipelineStateBlocks&) = delete;
+		VulkanPipelineStateBlocks& operator=(const VulkanPipelineStateBlocks&) = delete;
+	};
+
+	uint64_t VulkanPipelineDesc::Hash() const
+	{
+		uint64_t hash = HASH_SEED;
+		hash = HashValue(hash, StageCount);
+		for (uint32_t i = 0; i < StageCount; ++i) {
+			hash = HashValue(hash, Stages[i].Stage);
+			hash = HashValue(hash, Stages[i].Module);
+			hash = HashValue(hash, Stages[i].Specialization);
+		}
+
+		hash = HashValue(hash, VertexLayout.BindingCount);
+		hash = HashBytes(VertexLayout.Bindings, sizeof(VkVertexInputBindingDescription) * VertexLayout.BindingCount, hash);
+		hash = HashValue(hash, VertexLayout.AttributeCount);
+		hash = HashBytes(VertexLayout.Attributes, sizeof(VkVertexInputAttributeDescription) * VertexLayout.AttributeCount, hash);
+		hash = HashValue(hash, Topology);
+
+		hash = HashValue(hash, PolygonMode);
+		hash = HashValue(hash, CullMode);
+		hash = HashValue(hash, FrontFace);
+		hash = HashValue(hash, Samples);
+
+		hash = HashValue(hash, DepthTest);
+		hash = HashValue(hash, DepthWrite);
+		hash = HashValue(hash, DepthCompareOp);
+
+		hash = HashValue(hash, BlendEnable);
+		hash = HashValue(hash, SrcColorBlendFactor);
+		hash = HashValue(hash, DstColorBlendFactor);
+		hash = HashValue(hash, ColorBlendOp);
+		hash = HashValue(hash, SrcAlphaBlendFactor);
+		hash = HashValue(hash, DstAlphaBlendFactor);
+		hash = HashValue(hash, AlphaBlendOp);
+		hash = HashValue(hash, ColorWriteMask);
+
+		hash = HashValue(hash, Layout);
+		hash = HashValue(hash, RenderPass);
+		hash = HashValue(hash, Subpass);
+		return hash;
+	}
+
+	bool VulkanPipelineDesc::operator==(const VulkanPipelineDesc& other) const
+	{
+		if (StageCount != other.StageCount ||
+			VertexLayout.BindingCount != other.VertexLayout.BindingCount ||
+			VertexLayout.AttributeCount != other.VertexLayout.AttributeCount) {
+			return false;
+		}
+
+		for (uint32_t i = 0; i < StageCount; ++i) {
+			if (Stages[i].Stage != other.Stages[i].Stage || Stages[i].Module != other.Stages[i].Module ||
+				Stages[i].Specialization != other.Stages[i].Specialization) {
+				return false;
+			}
+		}
+
+		if (memcmp(VertexLayout.Bindings, other.VertexLayout.Bindings, sizeof(VkVertexInputBindingDescription) * VertexLayout.BindingCount) != 0 ||
+			memcmp(VertexLayout.Attributes, other.VertexLayout.Attributes, sizeof(VkVertexInputAttributeDescription) * VertexLayout.AttributeCount) != 0) {
+			return false;
+		}
+
+		return Topology == other.Topology &&
+			PolygonMode == other.PolygonMode &&
+			CullMode == other.CullMode &&
+			FrontFace == other.FrontFace &&
+			Samples == other.Samples &&
+			DepthTest == other.DepthTest &&
+			DepthWrite == other.DepthWrite &&
+			DepthCompareOp == other.DepthCompareOp &&
+			BlendEnable == other.BlendEnable &&
+			SrcColorBlendFactor == other.SrcColorBlendFactor &&
+			DstColorBlendFactor == other.DstColorBlendFactor &&
+			ColorBlendOp == other.ColorBlendOp &&
+			SrcAlphaBlendFactor == other.SrcAlphaBlendFactor &&
+			DstAlphaBlendFactor == other.DstAlphaBlendFactor &&
+			AlphaBlendOp == other.AlphaBlendOp &&
+			ColorWriteMask == other.ColorWriteMask &&
+			Layout == other.Layout &&
+			RenderPass == other.RenderPass &&
+			Subpass == other.Subpass;
+	}
+
+	VulkanPipelineStateCache::VulkanPipelineStateCache(VkDevice device, VkPipelineCache pipelineCache, uint32_t workerCount,
+		bool graphicsPipelineLibrary, uint32_t framesInFlight)
+		: _device(device), _pipelineCache(pipelineCache), _fallback(nullptr), _graphicsPipelineLibrary(graphicsPipelineLibrary),
+		_framesInFlight(framesInFlight), _frameNumber(0), _inFlight(0), _running(true),
+		_hits(0), _misses(0), _fallbacksUsed(0), _compiled(0), _failed(0), _librariesCompiled(0), _fastLinked(0), _optimizedLinked(0)
+	{
+		ASSERT_MSG(workerCount > 0, "Pipeline compilation needs at least one worker");
+		for (uint32_t i = 0; i < workerCount; ++i) {
+			_workers.emplace_back([this]() { WorkerLoop(); });
+		}
+
+		Logger::Info("Pipeline state cache using %s compilation on %u workers",
+			_graphicsPipelineLibrary ? "graphics pipeline library" : "monolithic", workerCount);
+	}
+
+	VulkanPipelineStateCache::~VulkanPipelineStateCache()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			_running = false;
+			_queue.clear();
+		}
+		_queueCondition.notify_all();
+		for (auto& worker : _workers) {
+			worker.join();
+		}
+
+		for (auto& retired : _retired) {
+			vkDestroyPipeline(_device, retired.Pipeline, VK_ALLOCATOR);
+		}
+		_retired.clear();
+
+		for (auto& pair : _entries) {
+			vkDestroyPipeline(_device, pair.second->Pipeline.load(), VK_ALLOCATOR);
+			delete pair.second;
+		}
+		_entries.clear();
+
+		for (auto& libraries : _libraries) {
+			for (auto& pair : libraries) {
+				vkDestroyPipeline(_device, pair.second->Pipeline.load(), VK_ALLOCATOR);
+				delete pair.second;
+			}
+			libraries.clear();
+		}
+	}
+
+	void VulkanPipelineStateCache::SetFallback(const VulkanPipelineDesc& desc)
+	{
+		const VkPipeline pipeline = GetPipelineBlocking(desc);
+		ASSERT_MSG(pipeline != VK_NULL_HANDLE, "Fallback pipeline failed to compile");
+
+		// Keep the entry rather than the handle: a fast-linked fallback is swapped for its optimized link later
+		bool created;
+		_fallback = FindOrCreate(desc, &created);
+	}
+
+	VkPipeline VulkanPipelineStateCache::GetFallback() const
+	{
+		return _fallback ? _fallback->Pipeline.load(std::memory_order_acquire) : VK_NULL_HANDLE;
+	}
+
+	VulkanPipelineStateCache::Entry* VulkanPipelineStateCache::FindOrCreate(const VulkanPipelineDesc& desc, bool* created)
+	{
+		const uint64_t hash = desc.Hash();
+
+		std::lock_guard<std::mutex> lock(_entriesMutex);
+		auto range = _entries.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second->Desc == desc) {
+				*created = false;
+				return it->second;
+			}
+		}
+
+		Entry* entry = new Entry();
+		entry->Desc = desc;
+		_entries.emplace(hash, entry);
+		*created = true;
+		return entry;
+	}
+
+	void VulkanPipelineStateCache::Enqueue(Entry* entry, bool optimizeLink)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			_queue.push_back({ entry, optimizeLink });
+		}
+		_queueCondition.notify_one();
+	}
+
+	VkPipeline VulkanPipelineStateCache::GetPipeline(const VulkanPipelineDesc& desc)
+	{
+		bool created;
+		Entry* entry = FindOrCreate(desc, &created);
+
+		if (created) {
+			_misses++;
+
+			// Every part already compiled for other pipelines: a fast link is cheap enough to do right here.
+			if (_graphicsPipelineLibrary && TryGatherLibraries(desc, entry->Libraries)) {
+				VkPipeline pipeline = VK_NULL_HANDLE;
+				if (Link(desc, entry->Libraries, false, &pipeline) == VK_SUCCESS) {
+					_fastLinked++;
+					_compiled++;
+					Publish(entry, pipeline);
+					Enqueue(entry, true);
+					return pipeline;
+				}
+			}
+
+			Enqueue(entry, false);
+		}
+
+		if (entry->State.load(std::memory_order_acquire) == EntryState::Ready) {
+			if (!created) {
+				_hits++;
+			}
+			return entry->Pipeline.load(std::memory_order_acquire);
+		}
+
+		_fallbacksUsed++;
+		return GetFallback();
+	}
+
+	VkPipeline VulkanPipelineStateCache::GetPipelineBlocking(const VulkanPipelineDesc& desc)
+	{
+		bool created;
+		Entry* entry = FindOrCreate(desc, &created);
+
+		if (created) {
+			_misses++;
+			BuildEntry(entry);
+		}
+		else {
+			// Already queued on a worker; wait for it rather than compiling twice.
+			while (entry->State.load(std::memory_order_acquire) == EntryState::Queued) {
+				std::this_thread::yield();
+			}
+			_hits++;
+		}
+
+		return entry->State.load() == EntryState::Ready ? entry->Pipeline.load() : GetFallback();
+	}
+
+	void VulkanPipelineStateCache::Publish(Entry* entry, VkPipeline pipeline)
+	{
+		entry->Pipeline.store(pipeline, std::memory_order_release);
+		entry->State.store(EntryState::Ready, std::memory_order_release);
+	}
+
+	void VulkanPipelineStateCache::BuildEntry(Entry* entry)
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkResult result;
+
+		if (_graphicsPipelineLibrary) {
+			bool librariesReady = true;
+			for (uint32_t part = 0; part < (uint32_t)LibraryPart::Count; ++part) {
+				entry->Libraries[part] = GetOrCompileLibrary(entry->Desc, (LibraryPart)part);
+				librariesReady &= entry->Libraries[part] != VK_NULL_HANDLE;
+			}
+
+			result = librariesReady ? Link(entry->Desc, entry->Libraries, false, &pipeline) : VK_ERROR_UNKNOWN;
+			if (result == VK_SUCCESS) {
+				_fastLinked++;
+				Publish(entry, pipeline);
+				_compiled++;
+				Enqueue(entry, true);
+				return;
+			}
+		}
+		else {
+			result = Compile(entry->Desc, &pipeline);
+			if (result == VK_SUCCESS) {
+				Publish(entry, pipeline);
+				_compiled++;
+				return;
+			}
+		}
+
+		Logger::Error("Pipeline %016llx failed to compile (%d), keeping the fallback", (unsigned long long)entry->Desc.Hash(), result);
+		entry->State.store(EntryState::Failed, std::memory_order_release);
+		_failed++;
+	}
+
+	void VulkanPipelineStateCache::BeginFrame(uint64_t frameNumber)
+	{
+		_frameNumber.store(frameNumber, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(_retiredMutex);
+		for (size_t i = 0; i < _retired.size();) {
+			if (frameNumber >= _retired[i].FrameNumber + _framesInFlight) {
+				vkDestroyPipeline(_device, _retired[i].Pipeline, VK_ALLOCATOR);
+				_retired[i] = _retired.back();
+				_retired.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	void VulkanPipelineStateCache::WaitIdle()
+	{
+		std::unique_lock<std::mutex> lock(_queueMutex);
+		_idleCondition.wait(lock, [this]() { return _queue.empty() && _inFlight == 0; });
+	}
+
+	VulkanPipelineStateStats VulkanPipelineStateCache::GetStats() const
+	{
+		VulkanPipelineStateStats stats;
+		stats.Hits = _hits.load();
+		stats.Misses = _misses.load();
+		stats.FallbacksUsed = _fallbacksUsed.load();
+		stats.Compiled = _compiled.load();
+		stats.Failed = _failed.load();
+		stats.Pending = (uint32_t)(stats.Misses - stats.Compiled - stats.Failed);
+		stats.LibrariesCompiled = _librariesCompiled.load();
+		stats.FastLinked = _fastLinked.load();
+		stats.OptimizedLinked = _optimizedLinked.load();
+		return stats;
+	}
+
+	void VulkanPipelineStateCache::WorkerLoop()
+	{
+		PROFILE_THREAD("PipelineCompiler");
+		MEMORY_THREAD(Renderer);
+
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(_queueMutex);
+				_queueCondition.wait(lock, [this]() { return !_queue.empty() || !_running; });
+				if (!_running) {
+					return;
+				}
+				job = _queue.front();
+				_queue.pop_front();
+				_inFlight++;
+			}
+
+			if (job.OptimizeLink) {
+				// Replace the fast-linked pipeline with a link-time optimized one. The old pipeline may
+				// still be referenced by frames in flight, so it is retired rather than destroyed.
+				VkPipeline optimized = VK_NULL_HANDLE;
+				if (Link(job.Target->Desc, job.Target->Libraries, true, &optimized) == VK_SUCCESS) {
+					VkPipeline previous = job.Target->Pipeline.exchange(optimized, std::memory_order_acq_rel);
+					job.Target->Optimized.store(true, std::memory_order_release);
+					_optimizedLinked++;
+
+					std::lock_guard<std::mutex> lock(_retiredMutex);
+					_retired.push_back({ previous, _frameNumber.load(std::memory_order_relaxed) });
+				}
+			}
+			else {
+				BuildEntry(job.Target);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_queueMutex);
+				_inFlight--;
+			}
+			_idleCondition.notify_all();
+		}
+	}
+
+	VkResult VulkanPipelineStateCache::Compile(const VulkanPipelineDesc& desc, VkPipeline* pipeline) const
+	{
+		PROFILE_FUNCTION();
+
+		VulkanPipelineStateBlocks blocks(desc);
+
+		// Pipeline create
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.stageCount = desc.StageCount;
+		pipelineCreateInfo.pStages = blocks.Stages;
+		pipelineCreateInfo.pVertexInputState = &blocks.VertexInput;
+		pipelineCreateInfo.pInputAssemblyState = &blocks.InputAssembly;
+		pipelineCreateInfo.pViewportState = &blocks.ViewportState;
+		pipelineCreateInfo.pRasterizationState = &blocks.Rasterizer;
+		pipelineCreateInfo.pMultisampleState = &blocks.Multisample;
+		pipelineCreateInfo.pDepthStencilState = &blocks.DepthStencil;
+		pipelineCreateInfo.pColorBlendState = &blocks.ColorBlend;
+		pipelineCreateInfo.pDynamicState = &blocks.DynamicState;
+		pipelineCreateInfo.layout = desc.Layout;
+		pipelineCreateInfo.renderPass = desc.RenderPass;
+		pipelineCreateInfo.subpass = desc.Subpass;
+		pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineCreateInfo.basePipelineIndex = -1;
+
+		// VkPipelineCache is internally synchronized, so workers can share it.
+		return vkCreateGraphicsPipelines(_device, _pipelineCache, 1, &pipelineCreateInfo, VK_ALLOCATOR, pipeline);
+	}
+
+	VulkanPipelineDesc VulkanPipelineStateCache::GetLibraryKey(const VulkanPipelineDesc& desc, LibraryPart part)
+	{
+		VulkanPipelineDesc key;
+		switch (part)
+		{
+		case LibraryPart::VertexInput:
+			key.VertexLayout = desc.VertexLayout;
+			key.Topology = desc.Topology;
+			break;
+		case LibraryPart::PreRasterization:
+			for (uint32_t i = 0; i < desc.StageCount; ++i) {
+				if (desc.Stages[i].Stage != VK_SHADER_STAGE_FRAGMENT_BIT) {
+					key.Stages[key.StageCount++] = desc.Stages[i];
+				}
+			}
+			key.PolygonMode = desc.PolygonMode;
+			key.CullMode = desc.CullMode;
+			key.FrontFace = desc.FrontFace;
+			key.Layout = desc.Layout;
+			key.RenderPass = desc.RenderPass;
+			key.Subpass = desc.Subpass;
+			break;
+		case LibraryPart::FragmentShader:
+			for (uint32_t i = 0; i < desc.StageCount; ++i) {
+				if (desc.Stages[i].Stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+					key.Stages[key.StageCount++] = desc.Stages[i];
+				}
+			}
+			key.DepthTest = desc.DepthTest;
+			key.DepthWrite = desc.DepthWrite;
+			key.DepthCompareOp = desc.DepthCompareOp;
+			key.Samples = desc.Samples;
+			key.Layout = desc.Layout;
+			key.RenderPass = desc.RenderPass;
+			key.Subpass = desc.Subpass;
+			break;
+		case LibraryPart::FragmentOutput:
+		default:
+			key.BlendEnable = desc.BlendEnable;
+			key.SrcColorBlendFactor = desc.SrcColorBlendFactor;
+			key.DstColorBlendFactor = desc.DstColorBlendFactor;
+			key.ColorBlendOp = desc.ColorBlendOp;
+			key.SrcAlphaBlendFactor = desc.SrcAlphaBlendFactor;
+			key.DstAlphaBlendFactor = desc.DstAlphaBlendFactor;
+			key.AlphaBlendOp = desc.AlphaBlendOp;
+			key.ColorWriteMask = desc.ColorWriteMask;
+			key.Samples = desc.Samples;
+			key.RenderPass = desc.RenderPass;
+			key.Subpass = desc.Subpass;
+			break;
+		}
+		return key;
+	}
+
+	VulkanPipelineStateCache::Library* VulkanPipelineStateCache::FindOrCreateLibrary(const VulkanPipelineDesc& desc, LibraryPart part)
+	{
+		const VulkanPipelineDesc key = GetLibraryKey(desc, part);
+		const uint64_t hash = key.Hash();
+
+		std::lock_guard<std::mutex> lock(_entriesMutex);
+		auto& libraries = _libraries[(uint32_t)part];
+		auto range = libraries.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second->Key == key) {
+				return it->second;
+			}
+		}
+
+		Library* library = new Library();
+		library->Key = key;
+		libraries.emplace(hash, library);
+		return library;
+	}
+
+	VkPipeline VulkanPipelineStateCache::GetOrCompileLibrary(const VulkanPipelineDesc& desc, LibraryPart part)
+	{
+		Library* library = FindOrCreateLibrary(desc, part);
+		std::call_once(library->Once, [&]() {
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			if (CompileLibrary(desc, part, &pipeline) == VK_SUCCESS) {
+				library->Pipeline.store(pipeline, std::memory_order_release);
+				_librariesCompiled++;
+			}
+		});
+		return library->Pipeline.load(std::memory_order_acquire);
+	}
+
+	bool VulkanPipelineStateCache::TryGatherLibraries(const VulkanPipelineDesc& desc, VkPipeline* libraries)
+	{
+		for (uint32_t part = 0; part < (uint32_t)LibraryPart::Count; ++part) {
+			libraries[part] = FindOrCreateLibrary(desc, (LibraryPart)part)->Pipeline.load(std::memory_order_acquire);
+			if (libraries[part] == VK_NULL_HANDLE) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	VkResult VulkanPipelineStateCache::CompileLibrary(const VulkanPipelineDesc& desc, LibraryPart part, VkPipeline* pipeline) const
+	{
+		PROFILE_FUNCTION();
+
+		VulkanPipelineStateBlocks blocks(desc);
+
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.pNext = &libraryInfo;
+		// Keep link-time optimization info so the background link can produce a fully optimized pipeline.
+		pipelineCreateInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineCreateInfo.basePipelineIndex = -1;
+
+		switch (part)
+		{
+		case LibraryPart::VertexInput:
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+			pipelineCreateInfo.pVertexInputState = &blocks.VertexInput;
+			pipelineCreateInfo.pInputAssemblyState = &blocks.InputAssembly;
+			break;
+		case LibraryPart::PreRasterization:
+		{
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+			uint32_t stageCount = 0;
+			VkPipelineShaderStageCreateInfo stages[VulkanPipelineDesc::MaxStages];
+			for (uint32_t i = 0; i < desc.StageCount; ++i) {
+				if (blocks.Stages[i].stage != VK_SHADER_STAGE_FRAGMENT_BIT) {
+					stages[stageCount++] = blocks.Stages[i];
+				}
+			}
+			pipelineCreateInfo.stageCount = stageCount;
+			pipelineCreateInfo.pStages = stages;
+			pipelineCreateInfo.pViewportState = &blocks.ViewportState;
+			pipelineCreateInfo.pRasterizationState = &blocks.Rasterizer;
+			pipelineCreateInfo.pDynamicState = &blocks.DynamicState;
+			pipelineCreateInfo.layout = desc.Layout;
+			pipelineCreateInfo.renderPass = desc.RenderPass;
+			pipelineCreateInfo.subpass = desc.Subpass;
+			return vkCreateGraphicsPipelines(_device, _pipelineCache, 1, &pipelineCreateInfo, VK_ALLOCATOR, pipeline);
+		}
+		case LibraryPart::FragmentShader:
+		{
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+			uint32_t stageCount = 0;
+			VkPipelineShaderStageCreateInfo stages[VulkanPipelineDesc::MaxStages];
+			for (uint32_t i = 0; i < desc.StageCount; ++i) {
+				if (blocks.Stages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+					stages[stageCount++] = blocks.Stages[i];
+				}
+			}
+			pipelineCreateInfo.stageCount = stageCount;
+			pipelineCreateInfo.pStages = stages;
+			pipelineCreateInfo.pMultisampleState = &blocks.Multisample;
+			pipelineCreateInfo.pDepthStencilState = &blocks.DepthStencil;
+			pipelineCreateInfo.layout = desc.Layout;
+			pipelineCreateInfo.renderPass = desc.RenderPass;
+			pipelineCreateInfo.subpass = desc.Subpass;
+			return vkCreateGraphicsPipelines(_device, _pipelineCache, 1, &pipelineCreateInfo, VK_ALLOCATOR, pipeline);
+		}
+		case LibraryPart::FragmentOutput:
+		default:
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+			pipelineCreateInfo.pMultisampleState = &blocks.Multisample;
+			pipelineCreateInfo.pColorBlendState = &blocks.ColorBlend;
+			pipelineCreateInfo.renderPass = desc.RenderPass;
+			pipelineCreateInfo.subpass = desc.Subpass;
+			break;
+		}
+
+		return vkCreateGraphicsPipelines(_device, _pipelineCache, 1, &pipelineCreateInfo, VK_ALLOCATOR, pipeline);
+	}
+
+	VkResult VulkanPipelineStateCache::Link(const VulkanPipelineDesc& desc, const VkPipeline* libraries, bool optimize, VkPipeline* pipeline) const
+	{
+		PROFILE_SCOPE(optimize ? "LinkPipelineOptimized" : "LinkPipelineFast");
+
+		VkPipelineLibraryCreateInfoKHR linkInfo = { VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+		linkInfo.libraryCount = (uint32_t)LibraryPart::Count;
+		linkInfo.pLibraries = libraries;
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineCreateInfo.pNext = &linkInfo;
+		pipelineCreateInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+		pipelineCreateInfo.layout = desc.Layout;
+		pipelineCreateInfo.renderPass = desc.RenderPass;
+		pipelineCreateInfo.subpass = desc.Subpass;
+		pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineCreateInfo.basePipelineIndex = -1;
+
+		return vkCreateGraphicsPipelines(_device, _pipelineCache, 1, &pipelineCreateInfo, VK_ALLOCATOR, pipeline);
+	}
+}
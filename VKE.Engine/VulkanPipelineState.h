@@ -0,0 +1,224 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	struct VulkanShaderStageDesc
+	{
+		VkShaderStageFlagBits Stage;
+		VkShaderModule Module;
+		// Owned by a VulkanShaderVariant; compared by address since variants are deduplicated.
+		const VkSpecializationInfo* Specialization;
+	};
+
+	struct VulkanVertexLayout
+	{
+		static constexpr uint32_t MaxBindings = 4;
+		static constexpr uint32_t MaxAttributes = 16;
+
+		uint32_t BindingCount = 0;
+		VkVertexInputBindingDescription Bindings[MaxBindings] = {};
+		uint32_t AttributeCount = 0;
+		VkVertexInputAttributeDescription Attributes[MaxAttributes] = {};
+	};
+
+	// Everything that goes into a graphics pipeline. Viewport and scissor are always dynamic
+	// and therefore not part of the description.
+	struct VulkanPipelineDesc
+	{
+		static constexpr uint32_t MaxStages = 4;
+
+		// Shader stages
+		uint32_t StageCount = 0;
+		VulkanShaderStageDesc Stages[MaxStages] = {};
+
+		// Vertex input
+		VulkanVertexLayout VertexLayout;
+		VkPrimitiveTopology Topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		// Rasterizer
+		VkPolygonMode PolygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags CullMode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace FrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		VkSampleCountFlagBits Samples = VK_SAMPLE_COUNT_1_BIT;
+
+		// Depth
+		bool DepthTest = true;
+		bool DepthWrite = true;
+		VkCompareOp DepthCompareOp = VK_COMPARE_OP_LESS;
+
+		// Blend (single color attachment)
+		bool BlendEnable = false;
+		VkBlendFactor SrcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		VkBlendFactor DstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+		VkBlendOp ColorBlendOp = VK_BLEND_OP_ADD;
+		VkBlendFactor SrcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		VkBlendFactor DstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		VkBlendOp AlphaBlendOp = VK_BLEND_OP_ADD;
+		VkColorComponentFlags ColorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+			VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+		// Compatibility
+		VkPipelineLayout Layout = VK_NULL_HANDLE;
+		VkRenderPass RenderPass = VK_NULL_HANDLE;
+		uint32_t Subpass = 0;
+
+		uint64_t Hash() const;
+		bool operator==(const VulkanPipelineDesc& other) const;
+	};
+
+	struct VulkanPipelineStateStats
+	{
+		uint64_t Hits;
+		uint64_t Misses;
+		uint64_t FallbacksUsed;
+		uint64_t Compiled;
+		uint64_t Failed;
+		uint32_t Pending;
+		// Graphics pipeline library path only
+		uint64_t LibrariesCompiled;
+		uint64_t FastLinked;
+		uint64_t OptimizedLinked;
+	};
+
+	// Pipelines keyed by a hash of their full description. Lookups never block: a miss queues the
+	// pipeline on a worker thread and returns the fallback pipeline until the compile finishes.
+	//
+	// With VK_EXT_graphics_pipeline_library the pipeline is split into vertex-input, pre-rasterization,
+	// fragment-shader and fragment-output libraries that are cached and shared between pipelines. Once
+	// all four exist a pipeline is fast-linked on the spot, and an optimized link replaces it later
+	// from the background. Without the extension every pipeline is compiled monolithically.
+	class VulkanPipelineStateCache
+	{
+	public:
+		VulkanPipelineStateCache(VkDevice device, VkPipelineCache pipelineCache, uint32_t workerCount,
+			bool graphicsPipelineLibrary, uint32_t framesInFlight);
+		~VulkanPipelineStateCache();
+
+		// Compiles the fallback synchronously. It must be compatible with every render pass/layout it stands in for.
+		void SetFallback(const VulkanPipelineDesc& desc);
+
+		VkPipeline GetPipeline(const VulkanPipelineDesc& desc);
+
+		// Compiles on the calling thread if needed. For startup and tools only.
+		VkPipeline GetPipelineBlocking(const VulkanPipelineDesc& desc);
+
+		// Call once per frame after the frame's fence wait. Destroys pipelines replaced by an optimized
+		// link once no frame in flight can still reference them.
+		void BeginFrame(uint64_t frameNumber);
+
+		// Blocks until every queued compile has finished.
+		void WaitIdle();
+
+		bool UsesPipelineLibraries() const { return _graphicsPipelineLibrary; }
+		VulkanPipelineStateStats GetStats() const;
+
+	private:
+		enum class EntryState : uint32_t
+		{
+			Queued,
+			Ready,
+			Failed
+		};
+
+		enum class LibraryPart : uint32_t
+		{
+			VertexInput,
+			PreRasterization,
+			FragmentShader,
+			FragmentOutput,
+			Count
+		};
+
+		struct Entry
+		{
+			VulkanPipelineDesc Desc;
+			std::atomic<VkPipeline> Pipeline{ VK_NULL_HANDLE };
+			std::atomic<EntryState> State{ EntryState::Queued };
+			std::atomic<bool> Optimized{ false };
+			VkPipeline Libraries[(uint32_t)LibraryPart::Count] = {};
+		};
+
+		// Libraries are shared by every pipeline with matching partial state.
+		struct Library
+		{
+			// The partial state, see GetLibraryKey
+			VulkanPipelineDesc Key;
+			std::once_flag Once;
+			std::atomic<VkPipeline> Pipeline{ VK_NULL_HANDLE };
+		};
+
+		struct Job
+		{
+			Entry* Target;
+			bool OptimizeLink;
+		};
+
+		struct RetiredPipeline
+		{
+			VkPipeline Pipeline;
+			uint64_t FrameNumber;
+		};
+
+		Entry* FindOrCreate(const VulkanPipelineDesc& desc, bool* created);
+		void Enqueue(Entry* entry, bool optimizeLink);
+		void BuildEntry(Entry* entry);
+		VkResult Compile(const VulkanPipelineDesc& desc, VkPipeline* pipeline) const;
+
+		// Graphics pipeline library path
+		// Just the state the part is built from, everything else at its defaults
+		static VulkanPipelineDesc GetLibraryKey(const VulkanPipelineDesc& desc, LibraryPart part);
+		Library* FindOrCreateLibrary(const VulkanPipelineDesc& desc, LibraryPart part);
+		VkPipeline GetOrCompileLibrary(const VulkanPipelineDesc& desc, LibraryPart part);
+		VkResult CompileLibrary(const VulkanPipelineDesc& desc, LibraryPart part, VkPipeline* pipeline) const;
+		bool TryGatherLibraries(const VulkanPipelineDesc& desc, VkPipeline* libraries);
+		VkResult Link(const VulkanPipelineDesc& desc, const VkPipeline* libraries, bool optimize, VkPipeline* pipeline) const;
+		void Publish(Entry* entry, VkPipeline pipeline);
+
+		void WorkerLoop();
+		VkPipeline GetFallback() const;
+
+		VkDevice _device;
+		VkPipelineCache _pipelineCache;
+		// Entry of the fallback, whose handle changes when its optimized link replaces the fast link
+		Entry* _fallback;
+		bool _graphicsPipelineLibrary;
+		uint32_t _framesInFlight;
+
+		mutable std::mutex _entriesMutex;
+		std::unordered_multimap<uint64_t, Entry*> _entries;
+		std::unordered_multimap<uint64_t, Library*> _libraries[(uint32_t)LibraryPart::Count];
+
+		std::mutex _retiredMutex;
+		std::vector<RetiredPipeline> _retired;
+		std::atomic<uint64_t> _frameNumber;
+
+		std::mutex _queueMutex;
+		std::condition_variable _queueCondition;
+		std::condition_variable _idleCondition;
+		std::deque<Job> _queue;
+		uint32_t _inFlight;
+		bool _running;
+		std::vector<std::thread> _workers;
+
+		std::atomic<uint64_t> _hits;
+		std::atomic<uint64_t> _misses;
+		std::atomic<uint64_t> _fallbacksUsed;
+		std::atomic<uint64_t> _compiled;
+		std::atomic<uint64_t> _failed;
+		std::atomic<uint64_t> _librariesCompiled;
+		std::atomic<uint64_t> _fastLinked;
+		std::atomic<uint64_t> _optimizedLinked;
+	};
+}
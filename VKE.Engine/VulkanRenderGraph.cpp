@@ -0,0 +1,1093 @@
+#include "VulkanRenderGraph.h"
+#include "VulkanRenderer.h"
+#include "VulkanMemoryAllocator.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+
+namespace VKE
+{
+	struct VulkanGraphAccessInfo
+	{
+		VkPipelineStageFlags Stages;
+		VkAccessFlags Access;
+		// The part of Access a later user has to wait for
+		VkAccessFlags WriteAccess;
+		VkImageLayout Layout;
+		VkImageUsageFlags Usage;
+		bool Write;
+		bool Attachment;
+	};
+
+	static bool IsDepthFormat(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static bool HasStencil(VkFormat format)
+	{
+		return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	}
+
+	static VkImageAspectFlags GetAspect(VkFormat format)
+	{
+		if (!IsDepthFormat(format)) {
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+		return HasStencil(format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+
+	static VulkanGraphAccessInfo GetAccessInfo(VulkanGraphAccess access, VulkanGraphPassType type, VkFormat format)
+	{
+		const bool depth = IsDepthFormat(format);
+		const VkPipelineStageFlags shaderStage = type == VulkanGraphPassType::Compute
+			? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+			: VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		const VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		const VkImageLayout readOnlyLayout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VulkanGraphAccessInfo info = {};
+		switch (access) {
+		case VulkanGraphAccess::ColorWrite:
+			info.Stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			info.Access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			info.WriteAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			info.Layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			info.Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+			info.Write = true;
+			info.Attachment = true;
+			break;
+		case VulkanGraphAccess::DepthWrite:
+			info.Stages = depthStages;
+			info.Access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			info.WriteAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			info.Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			info.Usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			info.Write = true;
+			info.Attachment = true;
+			break;
+		case VulkanGraphAccess::DepthRead:
+			info.Stages = depthStages;
+			info.Access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+			info.Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			info.Usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			info.Attachment = true;
+			break;
+		case VulkanGraphAccess::InputAttachment:
+			info.Stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			info.Access = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+			info.Layout = readOnlyLayout;
+			info.Usage = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+			info.Attachment = true;
+			break;
+		case VulkanGraphAccess::Sampled:
+			info.Stages = shaderStage;
+			info.Access = VK_ACCESS_SHADER_READ_BIT;
+			info.Layout = readOnlyLayout;
+			info.Usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+			break;
+		case VulkanGraphAccess::StorageRead:
+			info.Stages = shaderStage;
+			info.Access = VK_ACCESS_SHADER_READ_BIT;
+			info.Layout = VK_IMAGE_LAYOUT_GENERAL;
+			info.Usage = VK_IMAGE_USAGE_STORAGE_BIT;
+			break;
+		case VulkanGraphAccess::StorageWrite:
+			info.Stages = shaderStage;
+			info.Access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			info.WriteAccess = VK_ACCESS_SHADER_WRITE_BIT;
+			info.Layout = VK_IMAGE_LAYOUT_GENERAL;
+			info.Usage = VK_IMAGE_USAGE_STORAGE_BIT;
+			info.Write = true;
+			break;
+		}
+		return info;
+	}
+
+	static bool IsShaderResource(VulkanGraphAccess access)
+	{
+		return access == VulkanGraphAccess::Sampled || access == VulkanGraphAccess::StorageRead || access == VulkanGraphAccess::StorageWrite;
+	}
+
+	VulkanRenderGraph::VulkanRenderGraph(VkDevice device, VulkanMemoryAllocator* memory, uint32_t framesInFlight)
+		: _device(device), _memory(memory), _framesInFlight(framesInFlight), _compiled(false), _finalSrcStages(0),
+		_executingFramebuffer(VK_NULL_HANDLE), _extent({ 0, 0 }), _stats()
+	{
+	}
+
+	VulkanRenderGraph::~VulkanRenderGraph()
+	{
+		// The device is idle by now
+		RetireSized(0);
+		for (auto& retired : _retired) {
+			DestroyRetired(retired);
+		}
+		for (auto& step : _steps) {
+			if (step.RenderPass) {
+				vkDestroyRenderPass(_device, step.RenderPass, VK_ALLOCATOR);
+			}
+		}
+	}
+
+	VulkanGraphResource VulkanRenderGraph::CreateImage(const char* name, const VulkanGraphImageDesc& desc)
+	{
+		ASSERT_MSG(!_compiled, "The render graph can't change after Compile");
+		Resource resource = {};
+		resource.Name = name;
+		resource.Desc = desc;
+		resource.Slot = -1;
+		resource.PreviousAlias = -1;
+		_resources.push_back(resource);
+		return (VulkanGraphResource)(_resources.size() - 1);
+	}
+
+	VulkanGraphResource VulkanRenderGraph::ImportImage(const char* name, VkFormat format, VkImageLayout initialLayout, VkImageLayout finalLayout,
+		VkPipelineStageFlags stage)
+	{
+		ASSERT_MSG(!_compiled, "The render graph can't change after Compile");
+		Resource resource = {};
+		resource.Name = name;
+		resource.Desc = { format, { 0, 0 }, VK_SAMPLE_COUNT_1_BIT };
+		resource.Imported = true;
+		resource.InitialLayout = initialLayout;
+		resource.FinalLayout = finalLayout;
+		resource.ImportStage = stage;
+		resource.Slot = -1;
+		resource.PreviousAlias = -1;
+		_resources.push_back(resource);
+		return (VulkanGraphResource)(_resources.size() - 1);
+	}
+
+	void VulkanRenderGraph::MarkOutput(VulkanGraphResource resource)
+	{
+		_resources[resource].Output = true;
+	}
+
+	VulkanGraphPass VulkanRenderGraph::AddPass(const char* name, VulkanGraphPassType type, VulkanGraphPassCallback callback, void* userData)
+	{
+		ASSERT_MSG(!_compiled, "The render graph can't change after Compile");
+		Pass pass = {};
+		pass.Name = name;
+		pass.Type = type;
+		pass.Callback = callback;
+		pass.UserData = userData;
+		_passes.push_back(pass);
+		return (VulkanGraphPass)(_passes.size() - 1);
+	}
+
+	void VulkanRenderGraph::Use(VulkanGraphPass pass, VulkanGraphResource resource, VulkanGraphAccess access, bool clear, const VkClearValue& clearValue)
+	{
+		ASSERT_MSG(!_compiled, "The render graph can't change after Compile");
+		ASSERT_MSG(_passes[pass].Type == VulkanGraphPassType::Graphics || IsShaderResource(access),
+			"Compute passes can only use shader resources");
+		_passes[pass].Accesses.push_back({ resource, access, clear, clearValue });
+	}
+
+	void VulkanRenderGraph::SetSideEffects(VulkanGraphPass pass)
+	{
+		_passes[pass].SideEffects = true;
+	}
+
+	void VulkanRenderGraph::SetSecondaryCommandBuffers(VulkanGraphPass pass)
+	{
+		ASSERT_MSG(_passes[pass].Type == VulkanGraphPassType::Graphics, "Only graphics passes run inside a render pass");
+		_passes[pass].Secondary = true;
+	}
+
+	void VulkanRenderGraph::Compile()
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(!_compiled, "The render graph is already compiled");
+		Cull();
+		BuildSteps();
+		ComputeLifetimes();
+		ComputeBarriers(true);
+		_compiled = true;
+
+		_stats.PassCount = (uint32_t)_passes.size();
+		_stats.RenderPassCount = 0;
+		for (auto& step : _steps) {
+			_stats.RenderPassCount += step.Graphics ? 1 : 0;
+		}
+	}
+
+	void VulkanRenderGraph::Cull()
+	{
+		// Walk backwards from the outputs: a pass survives if something downstream reads what it writes
+		std::vector<bool> needed(_resources.size());
+		for (size_t i = 0; i < _resources.size(); i++) {
+			needed[i] = _resources[i].Imported || _resources[i].Output;
+		}
+
+		_stats.CulledPasses = 0;
+		for (size_t i = _passes.size(); i-- > 0;) {
+			Pass& pass = _passes[i];
+			bool keep = pass.SideEffects;
+			for (auto& access : pass.Accesses) {
+				const VulkanGraphAccessInfo info = GetAccessInfo(access.Type, pass.Type, _resources[access.Resource].Desc.Format);
+				keep |= info.Write && needed[access.Resource];
+			}
+			pass.Culled = !keep;
+			if (!keep) {
+				_stats.CulledPasses++;
+				continue;
+			}
+
+			// A cleared attachment doesn't depend on earlier writers. Everything else the pass touches does.
+			for (auto& access : pass.Accesses) {
+				if (access.Clear) {
+					needed[access.Resource] = false;
+				}
+			}
+			for (auto& access : pass.Accesses) {
+				if (!access.Clear) {
+					needed[access.Resource] = true;
+				}
+			}
+		}
+	}
+
+	bool VulkanRenderGraph::CanMerge(const Step& step, const Pass& pass) const
+	{
+		if (!step.Graphics || pass.Type != VulkanGraphPassType::Graphics) {
+			return false;
+		}
+
+		// Subpasses share the framebuffer, so every attachment has to match in size and sample count
+		const Pass& first = _passes[step.Passes[0]];
+		const Resource* reference = nullptr;
+		for (auto& access : first.Accesses) {
+			if (!IsShaderResource(access.Type)) {
+				reference = &_resources[access.Resource];
+				break;
+			}
+		}
+		if (!reference) {
+			return false;
+		}
+
+		bool hasAttachment = false;
+		for (auto& access : pass.Accesses) {
+			const Resource& resource = _resources[access.Resource];
+			if (!IsShaderResource(access.Type)) {
+				hasAttachment = true;
+				if (resource.Desc.Extent.width != reference->Desc.Extent.width ||
+					resource.Desc.Extent.height != reference->Desc.Extent.height ||
+					resource.Desc.Samples != reference->Desc.Samples) {
+					return false;
+				}
+			}
+
+			// Anything passed between the subpasses has to stay an attachment; sampling a result needs the
+			// render pass to end first.
+			for (auto index : step.Passes) {
+				for (auto& other : _passes[index].Accesses) {
+					if (other.Resource == access.Resource && (IsShaderResource(access.Type) || IsShaderResource(other.Type))) {
+						return false;
+					}
+				}
+			}
+		}
+		return hasAttachment;
+	}
+
+	void VulkanRenderGraph::BuildSteps()
+	{
+		_steps.clear();
+		for (size_t i = 0; i < _passes.size(); i++) {
+			Pass& pass = _passes[i];
+			if (pass.Culled) {
+				continue;
+			}
+
+			if (_steps.empty() || !CanMerge(_steps.back(), pass)) {
+				Step step = {};
+				step.Graphics = pass.Type == VulkanGraphPassType::Graphics;
+				_steps.push_back(step);
+			}
+			Step& step = _steps.back();
+			pass.Step = (uint32_t)(_steps.size() - 1);
+			pass.Subpass = (uint32_t)step.Passes.size();
+			step.Passes.push_back((VulkanGraphPass)i);
+		}
+	}
+
+	void VulkanRenderGraph::ComputeLifetimes()
+	{
+		for (auto& resource : _resources) {
+			resource.Used = false;
+			resource.Usage = 0;
+			resource.Stages = 0;
+			resource.Writes = 0;
+		}
+
+		for (uint32_t s = 0; s < _steps.size(); s++) {
+			for (auto index : _steps[s].Passes) {
+				const Pass& pass = _passes[index];
+				for (auto& access : pass.Accesses) {
+					Resource& resource = _resources[access.Resource];
+					const VulkanGraphAccessInfo info = GetAccessInfo(access.Type, pass.Type, resource.Desc.Format);
+					if (!resource.Used) {
+						resource.FirstStep = s;
+					}
+					resource.Used = true;
+					resource.LastStep = s;
+					resource.Usage |= info.Usage;
+					resource.Stages |= info.Stages;
+					resource.Writes |= info.WriteAccess;
+				}
+			}
+		}
+
+		// Attachments that live and die inside one render pass never need to reach memory, so tile-based
+		// GPUs can keep them entirely on chip
+		const bool lazyMemory = _memory->SupportsLazyMemory();
+		for (auto& resource : _resources) {
+			resource.Lazy = false;
+			if (!lazyMemory || resource.Imported || resource.Output || !resource.Used ||
+				resource.FirstStep != resource.LastStep || !_steps[resource.FirstStep].Graphics) {
+				continue;
+			}
+			const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+				VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+			if ((resource.Usage & ~attachmentUsage) == 0) {
+				resource.Lazy = true;
+				resource.Usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			}
+		}
+	}
+
+	// What the frame has done to a resource so far, while barriers are being worked out
+	struct VulkanGraphResourceState
+	{
+		bool Touched;
+		bool HasContents;
+		VkImageLayout Layout;
+		VkPipelineStageFlags WriteStages;
+		VkAccessFlags WriteAccess;
+		// Reads since the last write
+		VkPipelineStageFlags ReadStages;
+		// Where the last write has already been made visible
+		VkPipelineStageFlags VisibleStages;
+		VkAccessFlags VisibleAccess;
+	};
+
+	void VulkanRenderGraph::ComputeBarriers(bool createRenderPasses)
+	{
+		std::vector<VulkanGraphResourceState> states(_resources.size());
+		for (size_t i = 0; i < _resources.size(); i++) {
+			states[i] = {};
+			states[i].Layout = _resources[i].Imported ? _resources[i].InitialLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+			states[i].HasContents = _resources[i].Imported && _resources[i].InitialLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+
+		_stats.BarrierCount = 0;
+		for (uint32_t s = 0; s < _steps.size(); s++) {
+			Step& step = _steps[s];
+			step.Barriers.clear();
+			step.SrcStages = 0;
+			step.DstStages = 0;
+
+			// The first use in the step decides the barrier; later subpasses are ordered by subpass dependencies
+			std::vector<VulkanGraphResource> seen;
+			for (auto index : step.Passes) {
+				const Pass& pass = _passes[index];
+				for (size_t a = 0; a < pass.Accesses.size(); a++) {
+					const Access& access = pass.Accesses[a];
+					if (std::find(seen.begin(), seen.end(), access.Resource) != seen.end()) {
+						continue;
+					}
+					seen.push_back(access.Resource);
+
+					const Resource& resource = _resources[access.Resource];
+					VulkanGraphAccessInfo need = GetAccessInfo(access.Type, pass.Type, resource.Desc.Format);
+					bool discard = access.Clear;
+					// A pass may use the same image more than once, e.g. storage read and write
+					for (size_t b = a + 1; b < pass.Accesses.size(); b++) {
+						if (pass.Accesses[b].Resource == access.Resource) {
+							const VulkanGraphAccessInfo other = GetAccessInfo(pass.Accesses[b].Type, pass.Type, resource.Desc.Format);
+							ASSERT_MSG(other.Layout == need.Layout, "A pass uses an image in two layouts");
+							need.Stages |= other.Stages;
+							need.Access |= other.Access;
+							need.Write |= other.Write;
+							discard = false;
+						}
+					}
+
+					VulkanGraphResourceState& state = states[access.Resource];
+					Barrier barrier = { access.Resource, 0, need.Access, state.Layout, need.Layout };
+					VkPipelineStageFlags srcStages = 0;
+					bool emit = false;
+
+					if (!state.Touched && !resource.Imported) {
+						// Memory was last used by whichever image aliased it before, possibly in the previous frame
+						const Resource& previous = _resources[resource.PreviousAlias >= 0 ? resource.PreviousAlias : access.Resource];
+						srcStages = previous.Stages;
+						barrier.SrcAccess = previous.Writes;
+						barrier.OldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+						emit = true;
+					}
+					else if (!state.Touched) {
+						// Ordered after the import stage, e.g. the swapchain semaphore wait
+						srcStages = resource.ImportStage;
+						emit = state.Layout != need.Layout;
+					}
+					else {
+						const bool layoutChange = state.Layout != need.Layout;
+						const bool visible = (need.Stages & ~state.VisibleStages) == 0 && (need.Access & ~state.VisibleAccess) == 0;
+						if (need.Write || layoutChange) {
+							srcStages = state.WriteStages | state.ReadStages;
+							barrier.SrcAccess = state.WriteAccess;
+							emit = srcStages != 0 || layoutChange;
+						}
+						else if (state.WriteStages != 0 && !visible) {
+							srcStages = state.WriteStages;
+							barrier.SrcAccess = state.WriteAccess;
+							emit = true;
+						}
+					}
+
+					if (emit) {
+						if (discard || !state.HasContents) {
+							barrier.OldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+						}
+						step.Barriers.push_back(barrier);
+						step.SrcStages |= srcStages != 0 ? srcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+						step.DstStages |= need.Stages;
+						state.VisibleStages |= need.Stages;
+						state.VisibleAccess |= need.Access;
+					}
+					state.Touched = true;
+					state.Layout = need.Layout;
+				}
+			}
+			_stats.BarrierCount += (uint32_t)step.Barriers.size();
+
+			if (step.Graphics && createRenderPasses) {
+				CreateRenderPass(s, states);
+			}
+
+			// Advance the state past the step
+			for (auto index : step.Passes) {
+				const Pass& pass = _passes[index];
+				for (auto& access : pass.Accesses) {
+					VulkanGraphResourceState& state = states[access.Resource];
+					const VulkanGraphAccessInfo info = GetAccessInfo(access.Type, pass.Type, _resources[access.Resource].Desc.Format);
+					if (info.Write) {
+						state.WriteStages = info.Stages;
+						state.WriteAccess = info.WriteAccess;
+						state.ReadStages = 0;
+						state.VisibleStages = 0;
+						state.VisibleAccess = 0;
+						state.HasContents = true;
+					}
+					else {
+						state.ReadStages |= info.Stages;
+					}
+					state.Layout = info.Layout;
+				}
+			}
+			if (step.Graphics) {
+				for (size_t i = 0; i < step.Attachments.size(); i++) {
+					states[step.Attachments[i]].Layout = step.FinalLayouts[i];
+				}
+			}
+		}
+
+		// Hand imported images back in the layout their owner expects
+		_finalBarriers.clear();
+		_finalSrcStages = 0;
+		for (size_t i = 0; i < _resources.size(); i++) {
+			const Resource& resource = _resources[i];
+			const VulkanGraphResourceState& state = states[i];
+			if (!resource.Imported || !state.Touched || state.Layout == resource.FinalLayout) {
+				continue;
+			}
+			_finalBarriers.push_back({ (VulkanGraphResource)i, state.WriteAccess, 0, state.Layout, resource.FinalLayout });
+			_finalSrcStages |= state.WriteStages | state.ReadStages;
+		}
+		if (!_finalBarriers.empty() && _finalSrcStages == 0) {
+			_finalSrcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		}
+		_stats.BarrierCount += (uint32_t)_finalBarriers.size();
+	}
+
+	void VulkanRenderGraph::CreateRenderPass(uint32_t stepIndex, const std::vector<VulkanGraphResourceState>& states)
+	{
+		Step& step = _steps[stepIndex];
+		const uint32_t subpassCount = (uint32_t)step.Passes.size();
+
+		// Attachments in order of first use
+		step.Attachments.clear();
+		for (auto index : step.Passes) {
+			for (auto& access : _passes[index].Accesses) {
+				if (!IsShaderResource(access.Type) &&
+					std::find(step.Attachments.begin(), step.Attachments.end(), access.Resource) == step.Attachments.end()) {
+					step.Attachments.push_back(access.Resource);
+				}
+			}
+		}
+
+		const uint32_t attachmentCount = (uint32_t)step.Attachments.size();
+		std::vector<VkAttachmentDescription> descriptions(attachmentCount);
+		step.ClearValues.assign(attachmentCount, VkClearValue());
+		step.FinalLayouts.assign(attachmentCount, VK_IMAGE_LAYOUT_UNDEFINED);
+
+		// Attachment index per subpass, -1 where the subpass doesn't use it
+		std::vector<int32_t> used(subpassCount * attachmentCount, -1);
+		for (uint32_t a = 0; a < attachmentCount; a++) {
+			const VulkanGraphResource index = step.Attachments[a];
+			const Resource& resource = _resources[index];
+
+			const Access* first = nullptr;
+			VulkanGraphAccessInfo firstInfo = {};
+			VulkanGraphAccessInfo lastInfo = {};
+			for (uint32_t p = 0; p < subpassCount; p++) {
+				const Pass& pass = _passes[step.Passes[p]];
+				for (auto& access : pass.Accesses) {
+					if (access.Resource != index) {
+						continue;
+					}
+					const VulkanGraphAccessInfo info = GetAccessInfo(access.Type, pass.Type, resource.Desc.Format);
+					if (!first) {
+						first = &access;
+						firstInfo = info;
+					}
+					lastInfo = info;
+					used[p * attachmentCount + a] = (int32_t)a;
+				}
+			}
+
+			// Load only what an earlier step left behind, store only what a later one (or the owner) reads
+			VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			if (first->Clear) {
+				loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+				step.ClearValues[a] = first->ClearValue;
+			}
+			else if (states[index].HasContents) {
+				loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			}
+			const bool keep = resource.Imported || resource.Output || resource.LastStep > stepIndex;
+			const VkAttachmentStoreOp storeOp = keep ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+			// Imported images whose last use is here leave the render pass in their final layout, which saves a barrier
+			const bool lastUse = resource.Imported && resource.LastStep == stepIndex;
+			step.FinalLayouts[a] = lastUse ? resource.FinalLayout : lastInfo.Layout;
+
+			VkAttachmentDescription& description = descriptions[a];
+			description.format = resource.Desc.Format;
+			description.samples = resource.Desc.Samples;
+			description.loadOp = loadOp;
+			description.storeOp = storeOp;
+			description.stencilLoadOp = HasStencil(resource.Desc.Format) ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			description.stencilStoreOp = HasStencil(resource.Desc.Format) ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			// The barrier in front of the render pass already did the transition
+			description.initialLayout = firstInfo.Layout;
+			description.finalLayout = step.FinalLayouts[a];
+		}
+
+		// Subpasses. References are sized up front so the pointers stay put.
+		std::vector<VkSubpassDescription> subpasses(subpassCount);
+		std::vector<VkAttachmentReference> colorReferences;
+		std::vector<VkAttachmentReference> inputReferences;
+		std::vector<VkAttachmentReference> depthReferences(subpassCount);
+		std::vector<uint32_t> preserved;
+		colorReferences.reserve(subpassCount * attachmentCount);
+		inputReferences.reserve(subpassCount * attachmentCount);
+		preserved.reserve(subpassCount * attachmentCount);
+
+		for (uint32_t p = 0; p < subpassCount; p++) {
+			const Pass& pass = _passes[step.Passes[p]];
+			VkSubpassDescription& subpass = subpasses[p];
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+			subpass.pColorAttachments = colorReferences.data() + colorReferences.size();
+			subpass.pInputAttachments = inputReferences.data() + inputReferences.size();
+			for (auto& access : pass.Accesses) {
+				if (IsShaderResource(access.Type)) {
+					continue;
+				}
+				const uint32_t attachment = (uint32_t)(std::find(step.Attachments.begin(), step.Attachments.end(), access.Resource) - step.Attachments.begin());
+				const VulkanGraphAccessInfo info = GetAccessInfo(access.Type, pass.Type, _resources[access.Resource].Desc.Format);
+				switch (access.Type) {
+				case VulkanGraphAccess::ColorWrite:
+					colorReferences.push_back({ attachment, info.Layout });
+					subpass.colorAttachmentCount++;
+					break;
+				case VulkanGraphAccess::DepthWrite:
+				case VulkanGraphAccess::DepthRead:
+					ASSERT_MSG(!subpass.pDepthStencilAttachment, "A pass can only have one depth attachment");
+					depthReferences[p] = { attachment, info.Layout };
+					subpass.pDepthStencilAttachment = &depthReferences[p];
+					break;
+				case VulkanGraphAccess::InputAttachment:
+					inputReferences.push_back({ attachment, info.Layout });
+					subpass.inputAttachmentCount++;
+					break;
+				default:
+					break;
+				}
+			}
+
+			// Attachments used before and after this subpass have to survive it
+			subpass.pPreserveAttachments = preserved.data() + preserved.size();
+			for (uint32_t a = 0; a < attachmentCount; a++) {
+				if (used[p * attachmentCount + a] >= 0) {
+					continue;
+				}
+				bool before = false;
+				bool after = false;
+				for (uint32_t q = 0; q < subpassCount; q++) {
+					before |= q < p && used[q * attachmentCount + a] >= 0;
+					after |= q > p && used[q * attachmentCount + a] >= 0;
+				}
+				if (before && after) {
+					preserved.push_back(a);
+					subpass.preserveAttachmentCount++;
+				}
+			}
+		}
+
+		// Dependencies between subpasses that hand an attachment over. Everything at the edges of the render
+		// pass is covered by the step's barriers.
+		std::vector<VkSubpassDependency> dependencies;
+		for (uint32_t p = 1; p < subpassCount; p++) {
+			const Pass& pass = _passes[step.Passes[p]];
+			for (auto& access : pass.Accesses) {
+				const VulkanGraphAccessInfo info = GetAccessInfo(access.Type, pass.Type, _resources[access.Resource].Desc.Format);
+				// Latest earlier subpass touching the same attachment
+				for (uint32_t q = p; q-- > 0;) {
+					const Pass& previous = _passes[step.Passes[q]];
+					bool found = false;
+					VulkanGraphAccessInfo previousInfo = {};
+					for (auto& other : previous.Accesses) {
+						if (other.Resource == access.Resource) {
+							const VulkanGraphAccessInfo otherInfo = GetAccessInfo(other.Type, previous.Type, _resources[other.Resource].Desc.Format);
+							previousInfo.Stages |= otherInfo.Stages;
+							previousInfo.WriteAccess |= otherInfo.WriteAccess;
+							previousInfo.Write |= otherInfo.Write;
+							previousInfo.Layout = otherInfo.Layout;
+							found = true;
+						}
+					}
+					if (!found) {
+						continue;
+					}
+
+					if (info.Write || previousInfo.Write || info.Layout != previousInfo.Layout) {
+						VkSubpassDependency* dependency = nullptr;
+						for (auto& existing : dependencies) {
+							if (existing.srcSubpass == q && existing.dstSubpass == p) {
+								dependency = &existing;
+							}
+						}
+						if (!dependency) {
+							dependencies.push_back({ q, p, 0, 0, 0, 0, VK_DEPENDENCY_BY_REGION_BIT });
+							dependency = &dependencies.back();
+						}
+						dependency->srcStageMask |= previousInfo.Stages;
+						dependency->srcAccessMask |= previousInfo.WriteAccess;
+						dependency->dstStageMask |= info.Stages;
+						dependency->dstAccessMask |= info.Access;
+					}
+					break;
+				}
+			}
+		}
+
+		VkRenderPassCreateInfo renderPassCreateInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		renderPassCreateInfo.attachmentCount = attachmentCount;
+		renderPassCreateInfo.pAttachments = descriptions.data();
+		renderPassCreateInfo.subpassCount = subpassCount;
+		renderPassCreateInfo.pSubpasses = subpasses.data();
+		renderPassCreateInfo.dependencyCount = (uint32_t)dependencies.size();
+		renderPassCreateInfo.pDependencies = dependencies.data();
+		VK_CHECK(vkCreateRenderPass(_device, &renderPassCreateInfo, VK_ALLOCATOR, &step.RenderPass));
+	}
+
+	VkExtent2D VulkanRenderGraph::GetImageExtent(const Resource& resource) const
+	{
+		if (resource.Desc.Extent.width == 0 || resource.Desc.Extent.height == 0) {
+			return _extent;
+		}
+		return resource.Desc.Extent;
+	}
+
+	void VulkanRenderGraph::AssignSlots()
+	{
+		// Largest first, each into the first slot whose images are all dead while it is alive
+		std::vector<VulkanGraphResource> order;
+		for (size_t i = 0; i < _resources.size(); i++) {
+			if (_resources[i].Image) {
+				order.push_back((VulkanGraphResource)i);
+			}
+		}
+		std::sort(order.begin(), order.end(), [this](VulkanGraphResource a, VulkanGraphResource b) {
+			return _resources[a].Requirements.size > _resources[b].Requirements.size;
+		});
+
+		_slots.clear();
+		for (auto index : order) {
+			Resource& resource = _resources[index];
+			int32_t slotIndex = -1;
+			// Lazily allocated memory is never shared, there is nothing to save
+			for (size_t s = 0; s < _slots.size() && !resource.Lazy; s++) {
+				Slot& slot = _slots[s];
+				if (_resources[slot.Resources[0]].Lazy || (slot.Requirements.memoryTypeBits & resource.Requirements.memoryTypeBits) == 0) {
+					continue;
+				}
+				bool overlaps = false;
+				for (auto other : slot.Resources) {
+					overlaps |= !(_resources[other].LastStep < resource.FirstStep || resource.LastStep < _resources[other].FirstStep);
+				}
+				if (!overlaps) {
+					slotIndex = (int32_t)s;
+					break;
+				}
+			}
+
+			if (slotIndex < 0) {
+				Slot slot = {};
+				slot.Requirements = resource.Requirements;
+				_slots.push_back(slot);
+				slotIndex = (int32_t)(_slots.size() - 1);
+			}
+			Slot& slot = _slots[slotIndex];
+			slot.Resources.push_back(index);
+			slot.Requirements.size = std::max(slot.Requirements.size, resource.Requirements.size);
+			slot.Requirements.alignment = std::max(slot.Requirements.alignment, resource.Requirements.alignment);
+			slot.Requirements.memoryTypeBits &= resource.Requirements.memoryTypeBits;
+			resource.Slot = slotIndex;
+		}
+
+		// Each image waits for the one before it in its slot; the first waits for the last, from the previous frame
+		for (auto& slot : _slots) {
+			std::sort(slot.Resources.begin(), slot.Resources.end(), [this](VulkanGraphResource a, VulkanGraphResource b) {
+				return _resources[a].FirstStep < _resources[b].FirstStep;
+			});
+			for (size_t i = 0; i < slot.Resources.size(); i++) {
+				_resources[slot.Resources[i]].PreviousAlias = (int32_t)slot.Resources[(i + slot.Resources.size() - 1) % slot.Resources.size()];
+			}
+		}
+	}
+
+	void VulkanRenderGraph::SetImportedImages(VulkanGraphResource resource, const VkImage* images, const VkImageView* views, uint32_t count)
+	{
+		ASSERT_MSG(_resources[resource].Imported, "Only imported images can be set");
+		_resources[resource].ImportedImages.assign(images, images + count);
+		_resources[resource].ImportedViews.assign(views, views + count);
+	}
+
+	void VulkanRenderGraph::Resize(VkExtent2D extent, uint64_t frameNumber)
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(_compiled, "Compile the render graph before sizing it");
+		RetireSized(frameNumber);
+		_extent = extent;
+
+		// Transient images
+		_stats.TransientCount = 0;
+		_stats.LazyCount = 0;
+		_stats.TransientBytes = 0;
+		for (auto& resource : _resources) {
+			if (resource.Imported || !resource.Used) {
+				continue;
+			}
+			const VkExtent2D imageExtent = GetImageExtent(resource);
+			VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = resource.Desc.Format;
+			imageInfo.extent = { imageExtent.width, imageExtent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = resource.Desc.Samples;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = resource.Usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK(vkCreateImage(_device, &imageInfo, VK_ALLOCATOR, &resource.Image));
+			vkGetImageMemoryRequirements(_device, resource.Image, &resource.Requirements);
+
+			_stats.TransientCount++;
+			_stats.LazyCount += resource.Lazy ? 1 : 0;
+			_stats.TransientBytes += resource.Requirements.size;
+		}
+
+		// Memory, shared between images with disjoint lifetimes
+		AssignSlots();
+		_stats.AllocatedBytes = 0;
+		for (auto& slot : _slots) {
+			const bool lazy = _resources[slot.Resources[0]].Lazy;
+			// Render targets get their own memory rather than punching holes in shared blocks
+			slot.Allocation = _memory->Allocate(slot.Requirements, lazy ? VulkanMemoryUsage::GpuLazy : VulkanMemoryUsage::GpuOnly, false, true);
+			if (!slot.Allocation) {
+				Logger::Fatal("Unable to allocate %llu bytes for render graph images", (unsigned long long)slot.Requirements.size);
+				return;
+			}
+			if (!lazy) {
+				_stats.AllocatedBytes += slot.Requirements.size;
+			}
+			for (auto index : slot.Resources) {
+				VK_CHECK(vkBindImageMemory(_device, _resources[index].Image, slot.Allocation->Memory, slot.Allocation->Offset));
+			}
+		}
+
+		for (auto& resource : _resources) {
+			if (!resource.Image) {
+				continue;
+			}
+			VkImageViewCreateInfo viewInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+			viewInfo.image = resource.Image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.Desc.Format;
+			// Sampling a depth/stencil image goes through one aspect
+			viewInfo.subresourceRange.aspectMask = (resource.Usage & VK_IMAGE_USAGE_SAMPLED_BIT) && IsDepthFormat(resource.Desc.Format)
+				? (VkImageAspectFlags)VK_IMAGE_ASPECT_DEPTH_BIT
+				: GetAspect(resource.Desc.Format);
+			viewInfo.subresourceRange.baseMipLevel = 0;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount = 1;
+			VK_CHECK(vkCreateImageView(_device, &viewInfo, VK_ALLOCATOR, &resource.View));
+		}
+
+		// Aliasing changes who waits for whom
+		ComputeBarriers(false);
+
+		// Framebuffers, one per imported image when a render pass draws to one
+		for (auto& step : _steps) {
+			if (!step.Graphics) {
+				continue;
+			}
+			step.Extent = GetImageExtent(_resources[step.Attachments[0]]);
+			uint32_t framebufferCount = 1;
+			for (auto index : step.Attachments) {
+				if (_resources[index].Imported) {
+					ASSERT_MSG(!_resources[index].ImportedViews.empty(), "Imported image was never set");
+					framebufferCount = std::max(framebufferCount, (uint32_t)_resources[index].ImportedViews.size());
+				}
+			}
+
+			std::vector<VkImageView> views(step.Attachments.size());
+			step.Framebuffers.resize(framebufferCount);
+			for (uint32_t i = 0; i < framebufferCount; i++) {
+				for (size_t a = 0; a < step.Attachments.size(); a++) {
+					const Resource& resource = _resources[step.Attachments[a]];
+					views[a] = resource.Imported ? resource.ImportedViews[i % resource.ImportedViews.size()] : resource.View;
+				}
+
+				VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+				framebufferInfo.renderPass = step.RenderPass;
+				framebufferInfo.attachmentCount = (uint32_t)views.size();
+				framebufferInfo.pAttachments = views.data();
+				framebufferInfo.width = step.Extent.width;
+				framebufferInfo.height = step.Extent.height;
+				framebufferInfo.layers = 1;
+				VK_CHECK(vkCreateFramebuffer(_device, &framebufferInfo, VK_ALLOCATOR, &step.Framebuffers[i]));
+			}
+		}
+	}
+
+	void VulkanRenderGraph::RetireSized(uint64_t frameNumber)
+	{
+		Retired retired;
+		retired.FrameNumber = frameNumber;
+		for (auto& step : _steps) {
+			retired.Framebuffers.insert(retired.Framebuffers.end(), step.Framebuffers.begin(), step.Framebuffers.end());
+			step.Framebuffers.clear();
+		}
+		for (auto& resource : _resources) {
+			if (resource.Image) {
+				retired.Views.push_back(resource.View);
+				retired.Images.push_back(resource.Image);
+				resource.View = VK_NULL_HANDLE;
+				resource.Image = VK_NULL_HANDLE;
+			}
+			resource.Slot = -1;
+			resource.PreviousAlias = -1;
+		}
+		for (auto& slot : _slots) {
+			retired.Allocations.push_back(slot.Allocation);
+		}
+		_slots.clear();
+
+		if (!retired.Framebuffers.empty() || !retired.Images.empty()) {
+			_retired.push_back(std::move(retired));
+		}
+	}
+
+	void VulkanRenderGraph::DestroyRetired(Retired& retired)
+	{
+		for (auto framebuffer : retired.Framebuffers) {
+			vkDestroyFramebuffer(_device, framebuffer, VK_ALLOCATOR);
+		}
+		for (auto view : retired.Views) {
+			vkDestroyImageView(_device, view, VK_ALLOCATOR);
+		}
+		for (auto image : retired.Images) {
+			vkDestroyImage(_device, image, VK_ALLOCATOR);
+		}
+		for (auto allocation : retired.Allocations) {
+			_memory->Free(allocation);
+		}
+	}
+
+	void VulkanRenderGraph::BeginFrame(uint64_t frameNumber)
+	{
+		for (size_t i = 0; i < _retired.size();) {
+			if (frameNumber >= _retired[i].FrameNumber + _framesInFlight) {
+				DestroyRetired(_retired[i]);
+				_retired[i] = std::move(_retired.back());
+				_retired.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	void VulkanRenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, VkPipelineStageFlags srcStages,
+		VkPipelineStageFlags dstStages, uint32_t importIndex)
+	{
+		if (barriers.empty()) {
+			return;
+		}
+
+		_imageBarriers.clear();
+		for (auto& barrier : barriers) {
+			const Resource& resource = _resources[barrier.Resource];
+			VkImageMemoryBarrier imageBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			imageBarrier.srcAccessMask = barrier.SrcAccess;
+			imageBarrier.dstAccessMask = barrier.DstAccess;
+			imageBarrier.oldLayout = barrier.OldLayout;
+			imageBarrier.newLayout = barrier.NewLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.Imported ? resource.ImportedImages[importIndex % resource.ImportedImages.size()] : resource.Image;
+			imageBarrier.subresourceRange.aspectMask = GetAspect(resource.Desc.Format);
+			imageBarrier.subresourceRange.baseMipLevel = 0;
+			imageBarrier.subresourceRange.levelCount = 1;
+			imageBarrier.subresourceRange.baseArrayLayer = 0;
+			imageBarrier.subresourceRange.layerCount = 1;
+			_imageBarriers.push_back(imageBarrier);
+		}
+		vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr,
+			(uint32_t)_imageBarriers.size(), _imageBarriers.data());
+	}
+
+	void VulkanRenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t importIndex)
+	{
+		PROFILE_FUNCTION();
+		for (auto& step : _steps) {
+			RecordBarriers(commandBuffer, step.Barriers, step.SrcStages, step.DstStages, importIndex);
+
+			if (!step.Graphics) {
+				const Pass& pass = _passes[step.Passes[0]];
+				pass.Callback(commandBuffer, pass.UserData);
+				continue;
+			}
+
+			VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+			renderPassInfo.renderPass = step.RenderPass;
+			renderPassInfo.framebuffer = step.Framebuffers[importIndex % step.Framebuffers.size()];
+			_executingFramebuffer = renderPassInfo.framebuffer;
+			renderPassInfo.renderArea.offset = { 0, 0 };
+			renderPassInfo.renderArea.extent = step.Extent;
+			renderPassInfo.clearValueCount = (uint32_t)step.ClearValues.size();
+			renderPassInfo.pClearValues = step.ClearValues.data();
+			for (size_t i = 0; i < step.Passes.size(); i++) {
+				const Pass& pass = _passes[step.Passes[i]];
+				const VkSubpassContents contents = pass.Secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+				if (i == 0) {
+					vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+				}
+				else {
+					vkCmdNextSubpass(commandBuffer, contents);
+				}
+				pass.Callback(commandBuffer, pass.UserData);
+			}
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		_executingFramebuffer = VK_NULL_HANDLE;
+
+		RecordBarriers(commandBuffer, _finalBarriers, _finalSrcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, importIndex);
+	}
+
+	VkRenderPass VulkanRenderGraph::GetRenderPass(VulkanGraphPass pass) const
+	{
+		ASSERT_MSG(_compiled && !_passes[pass].Culled, "Pass has no render pass");
+		return _steps[_passes[pass].Step].RenderPass;
+	}
+
+	VkCommandBufferInheritanceInfo VulkanRenderGraph::GetInheritance(VulkanGraphPass pass) const
+	{
+		ASSERT_MSG(_executingFramebuffer != VK_NULL_HANDLE, "Inheritance is only known while the pass is recorded");
+		VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		inheritance.renderPass = GetRenderPass(pass);
+		inheritance.subpass = _passes[pass].Subpass;
+		inheritance.framebuffer = _executingFramebuffer;
+		return inheritance;
+	}
+
+	void VulkanRenderGraph::Dump() const
+	{
+		Logger::Info("Render graph: %u passes, %u culled, %u render passes, %u barriers",
+			_stats.PassCount, _stats.CulledPasses, _stats.RenderPassCount, _stats.BarrierCount);
+
+		for (size_t s = 0; s < _steps.size(); s++) {
+			const Step& step = _steps[s];
+			for (auto& barrier : step.Barriers) {
+				Logger::Info("  [%u] barrier %s: layout %d -> %d", (uint32_t)s, _resources[barrier.Resource].Name.c_str(),
+					(int32_t)barrier.OldLayout, (int32_t)barrier.NewLayout);
+			}
+			for (size_t p = 0; p < step.Passes.size(); p++) {
+				const Pass& pass = _passes[step.Passes[p]];
+				if (step.Graphics) {
+					Logger::Info("  [%u] render pass, subpass %u: %s%s", (uint32_t)s, (uint32_t)p, pass.Name.c_str(),
+						pass.Secondary ? " (secondary command buffers)" : "");
+				}
+				else {
+					Logger::Info("  [%u] compute: %s", (uint32_t)s, pass.Name.c_str());
+				}
+			}
+		}
+		for (auto& barrier : _finalBarriers) {
+			Logger::Info("  [end] barrier %s: layout %d -> %d", _resources[barrier.Resource].Name.c_str(),
+				(int32_t)barrier.OldLayout, (int32_t)barrier.NewLayout);
+		}
+		for (auto& pass : _passes) {
+			if (pass.Culled) {
+				Logger::Info("  culled: %s", pass.Name.c_str());
+			}
+		}
+
+		for (auto& resource : _resources) {
+			if (!resource.Used) {
+				Logger::Info("  %s: unused", resource.Name.c_str());
+			}
+			else if (resource.Imported) {
+				Logger::Info("  %s: imported, steps %u-%u", resource.Name.c_str(), resource.FirstStep, resource.LastStep);
+			}
+			else {
+				Logger::Info("  %s: steps %u-%u, %llu KB, slot %d%s", resource.Name.c_str(), resource.FirstStep, resource.LastStep,
+					(unsigned long long)(resource.Requirements.size / 1024), resource.Slot, resource.Lazy ? ", lazily allocated" : "");
+			}
+		}
+
+		const float64_t mb = 1024.0 * 1024.0;
+		Logger::Info("Render graph memory: %.1f MB of transient images in %.1f MB, %.1f MB saved by aliasing and lazy allocation (%u lazy)",
+			_stats.TransientBytes / mb, _stats.AllocatedBytes / mb, (_stats.TransientBytes - _stats.AllocatedBytes) / mb, _stats.LazyCount);
+	}
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "vke_types.h"
+
+namespace VKE
+{
+	class VulkanMemoryAllocator;
+	struct VulkanAllocation;
+	struct VulkanGraphResourceState;
+
+	typedef uint32_t VulkanGraphResource;
+	typedef uint32_t VulkanGraphPass;
+	typedef void (*VulkanGraphPassCallback)(VkCommandBuffer commandBuffer, void* userData);
+
+	enum class VulkanGraphPassType : uint32_t
+	{
+		// Runs inside a render pass, possibly as a subpass of a merged one
+		Graphics,
+		Compute
+	};
+
+	enum class VulkanGraphAccess : uint32_t
+	{
+		ColorWrite,
+		DepthWrite,
+		// Depth test without writes
+		DepthRead,
+		// Read at the same pixel in a later subpass. Lets the pass merge with the writer.
+		InputAttachment,
+		Sampled,
+		StorageRead,
+		StorageWrite
+	};
+
+	struct VulkanGraphImageDesc
+	{
+		VkFormat Format;
+		// {0, 0} follows the extent passed to Resize
+		VkExtent2D Extent;
+		VkSampleCountFlagBits Samples;
+	};
+
+	struct VulkanGraphStats
+	{
+		uint32_t PassCount;
+		uint32_t CulledPasses;
+		uint32_t RenderPassCount;
+		uint32_t BarrierCount;
+		uint32_t TransientCount;
+		uint32_t LazyCount;
+		// What the transient images would need without aliasing, and what they got. Lazily allocated
+		// memory is left out of AllocatedBytes since it is only committed if the tiles spill.
+		VkDeviceSize TransientBytes;
+		VkDeviceSize AllocatedBytes;
+	};
+
+	// A frame described as passes that declare what they read and write. Compile() drops passes nothing
+	// depends on, merges neighbouring graphics passes that only talk through attachments into subpasses of
+	// one render pass, and works out every barrier and layout transition up front. Resize() creates the
+	// transient images, aliasing the memory of those whose lifetimes don't overlap, and putting
+	// attachments that never leave a render pass in lazily allocated memory where the device has it.
+	//
+	// Passes run in declaration order, so declare writers before readers. The graph is built once and
+	// executed every frame; only Resize has to run again when the swapchain changes.
+	class VulkanRenderGraph
+	{
+	public:
+		VulkanRenderGraph(VkDevice device, VulkanMemoryAllocator* memory, uint32_t framesInFlight);
+		~VulkanRenderGraph();
+
+		// Declaration
+		VulkanGraphResource CreateImage(const char* name, const VulkanGraphImageDesc& desc);
+		// An image owned elsewhere, e.g. the swapchain. It is always kept alive by culling, and it is left in
+		// finalLayout at the end of the frame. stage is where the previous user (or the semaphore wait) left it.
+		VulkanGraphResource ImportImage(const char* name, VkFormat format, VkImageLayout initialLayout, VkImageLayout finalLayout,
+			VkPipelineStageFlags stage);
+		// Keeps a transient image and its writers alive, e.g. for readback or debug views
+		void MarkOutput(VulkanGraphResource resource);
+
+		VulkanGraphPass AddPass(const char* name, VulkanGraphPassType type, VulkanGraphPassCallback callback, void* userData);
+		// clear only applies to attachment writes; without it the previous contents are loaded.
+		void Use(VulkanGraphPass pass, VulkanGraphResource resource, VulkanGraphAccess access, bool clear = false,
+			const VkClearValue& clearValue = {});
+		// Never culled
+		void SetSideEffects(VulkanGraphPass pass);
+		// The graphics pass only executes secondary command buffers, e.g. ones recorded on worker threads
+		void SetSecondaryCommandBuffers(VulkanGraphPass pass);
+
+		void Compile();
+
+		// One image per swapchain image; Execute picks one by index. The views must outlive the next Resize.
+		void SetImportedImages(VulkanGraphResource resource, const VkImage* images, const VkImageView* views, uint32_t count);
+		// (Re)creates transient images and framebuffers. Resources of the previous size are kept until no
+		// frame in flight can use them, so this never waits for the device.
+		void Resize(VkExtent2D extent, uint64_t frameNumber);
+
+		// Call once per frame after the frame's fence wait
+		void BeginFrame(uint64_t frameNumber);
+		void Execute(VkCommandBuffer commandBuffer, uint32_t importIndex);
+
+		VkRenderPass GetRenderPass(VulkanGraphPass pass) const;
+		uint32_t GetSubpass(VulkanGraphPass pass) const { return _passes[pass].Subpass; }
+		// What secondary command buffers of the pass inherit. Only valid while Execute records the pass.
+		VkCommandBufferInheritanceInfo GetInheritance(VulkanGraphPass pass) const;
+		VkExtent2D GetExtent() const { return _extent; }
+		const VulkanGraphStats& GetStats() const { return _stats; }
+
+		// Logs the compiled graph: steps, subpasses, barriers, resource lifetimes and memory saved by aliasing
+		void Dump() const;
+
+	private:
+		struct Access
+		{
+			VulkanGraphResource Resource;
+			VulkanGraphAccess Type;
+			bool Clear;
+			VkClearValue ClearValue;
+		};
+
+		struct Pass
+		{
+			std::string Name;
+			VulkanGraphPassType Type;
+			VulkanGraphPassCallback Callback;
+			void* UserData;
+			std::vector<Access> Accesses;
+			bool SideEffects;
+			bool Secondary;
+			bool Culled;
+			uint32_t Step;
+			uint32_t Subpass;
+		};
+
+		struct Resource
+		{
+			std::string Name;
+			VulkanGraphImageDesc Desc;
+			bool Imported;
+			bool Output;
+			VkImageLayout InitialLayout;
+			VkImageLayout FinalLayout;
+			VkPipelineStageFlags ImportStage;
+			std::vector<VkImage> ImportedImages;
+			std::vector<VkImageView> ImportedViews;
+
+			// Compiled
+			VkImageUsageFlags Usage;
+			bool Used;
+			bool Lazy;
+			uint32_t FirstStep;
+			uint32_t LastStep;
+			// Every stage and write access over the frame; what the next user of the memory waits for
+			VkPipelineStageFlags Stages;
+			VkAccessFlags Writes;
+			// Resource that used the same memory before this one, possibly in the previous frame
+			int32_t PreviousAlias;
+
+			// Sized
+			VkImage Image;
+			VkImageView View;
+			VkMemoryRequirements Requirements;
+			int32_t Slot;
+		};
+
+		struct Barrier
+		{
+			VulkanGraphResource Resource;
+			VkAccessFlags SrcAccess;
+			VkAccessFlags DstAccess;
+			VkImageLayout OldLayout;
+			VkImageLayout NewLayout;
+		};
+
+		// One render pass, or one compute pass, with the barriers recorded in front of it
+		struct Step
+		{
+			std::vector<VulkanGraphPass> Passes;
+			bool Graphics;
+			std::vector<Barrier> Barriers;
+			VkPipelineStageFlags SrcStages;
+			VkPipelineStageFlags DstStages;
+
+			VkRenderPass RenderPass;
+			std::vector<VulkanGraphResource> Attachments;
+			std::vector<VkImageLayout> FinalLayouts;
+			std::vector<VkClearValue> ClearValues;
+			std::vector<VkFramebuffer> Framebuffers;
+			VkExtent2D Extent;
+		};
+
+		// Memory shared by transient images with disjoint lifetimes
+		struct Slot
+		{
+			std::vector<VulkanGraphResource> Resources;
+			VkMemoryRequirements Requirements;
+			VulkanAllocation* Allocation;
+		};
+
+		struct Retired
+		{
+			std::vector<VkFramebuffer> Framebuffers;
+			std::vector<VkImageView> Views;
+			std::vector<VkImage> Images;
+			std::vector<VulkanAllocation*> Allocations;
+			uint64_t FrameNumber;
+		};
+
+		void Cull();
+		void BuildSteps();
+		bool CanMerge(const Step& step, const Pass& pass) const;
+		void ComputeLifetimes();
+		// Render passes only depend on the graph, the barriers also on how memory is aliased
+		void ComputeBarriers(bool createRenderPasses);
+		void CreateRenderPass(uint32_t stepIndex, const std::vector<VulkanGraphResourceState>& states);
+		void AssignSlots();
+		VkExtent2D GetImageExtent(const Resource& resource) const;
+		void RetireSized(uint64_t frameNumber);
+		void DestroyRetired(Retired& retired);
+		void RecordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, VkPipelineStageFlags srcStages,
+			VkPipelineStageFlags dstStages, uint32_t importIndex);
+
+		VkDevice _device;
+		VulkanMemoryAllocator* _memory;
+		uint32_t _framesInFlight;
+		bool _compiled;
+
+		std::vector<Pass> _passes;
+		std::vector<Resource> _resources;
+		std::vector<Step> _steps;
+		std::vector<Slot> _slots;
+		// Transitions of imported images to their final layouts, after the last step
+		std::vector<Barrier> _finalBarriers;
+		VkPipelineStageFlags _finalSrcStages;
+		// Reused every frame
+		std::vector<VkImageMemoryBarrier> _imageBarriers;
+		// Of the render pass Execute is recording
+		VkFramebuffer _executingFramebuffer;
+
+		VkExtent2D _extent;
+		std::vector<Retired> _retired;
+		VulkanGraphStats _stats;
+	};
+}
@@ -2,13 +2,33 @@
 
 #include "Platform.h"
 #include "Logger.h"
+#include "AssetArchive.h"
+#include "AsyncIO.h"
 
 #include "VulkanRenderer.h"
-
+#include "VulkanPipelineCache.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanPipelineState.h"
+#include "VulkanShader.h"
+#include "VulkanUploadQueue.h"
+#include "VulkanBindlessHeap.h"
+#include "VulkanCommandRecorder.h"
+#include "VulkanGpuScene.h"
+#include "VulkanTextureStreamer.h"
+#include "JobSystem.h"
+#include "Allocators.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
 #include <vector>
-#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <thread>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 namespace VKE
 {	
@@ -21,27 +41,30 @@ namespace VKE
 		switch(messageSeverity)
 		{
 		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-			Logger::Warn(pCallbackData->pMessage);
+			Logger::Warn("%s", pCallbackData->pMessage);
 			break;
 		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-			Logger::Info(pCallbackData->pMessage);
+			Logger::Info("%s", pCallbackData->pMessage);
 			break;
 		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-			Logger::Trace(pCallbackData->pMessage);
+			Logger::Trace("%s", pCallbackData->pMessage);
 			break;
 		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
 		default:
-			Logger::Error(pCallbackData->pMessage);
+			Logger::Error("%s", pCallbackData->pMessage);
 			break;
 		}
 
 		return VK_FALSE;
 	}
 	
-	VulkanRenderer::VulkanRenderer(Platform* platform)
-		: _platform(platform), _physicalDevice(nullptr), _device(nullptr)
+	VulkanRenderer::VulkanRenderer(Platform* platform, AssetArchive* assets, AsyncIO* io, JobSystem* jobs, uint32_t framesInFlight,
+		const char* deviceOverride)
+		: _platform(platform), _assets(assets), _io(io), _jobs(jobs), _physicalDevice(nullptr), _device(nullptr), _framesInFlight(framesInFlight)
 	{
+		PROFILE_FUNCTION();
 		Logger::Trace("VulkanRenderer()");
+		const auto startupStart = std::chrono::steady_clock::now();
 
 		VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
 		appInfo.apiVersion = VK_API_VERSION_1_2;
@@ -100,7 +123,7 @@ namespace VKE
 		instanceCreateInfo.ppEnabledLayerNames = requiredValidationLayers.data();
 
 		// Create instance
-		VK_CHECK(vkCreateInstance(&instanceCreateInfo, nullptr, &_instance));
+		VK_CHECK(vkCreateInstance(&instanceCreateInfo, VK_ALLOCATOR, &_instance));
 
 		// Debugger
 		VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = { VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT };
@@ -111,70 +134,204 @@ namespace VKE
 
 		const auto fn = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(_instance, "vkCreateDebugUtilsMessengerEXT"));
 		ASSERT_MSG(fn, "Failed to create debug messenger");
-		fn(_instance, &debugCreateInfo, nullptr, &_debugMessenger);
+		fn(_instance, &debugCreateInfo, VK_ALLOCATOR, &_debugMessenger);
 
 		// Surface
 		_platform->CreateSurface(_instance, &_surface);
 
 		// Physical device
-		_physicalDevice = SelectPhysicalDevice();
+		_capabilities = SelectPhysicalDevice(deviceOverride);
+		_physicalDevice = _capabilities.PhysicalDevice;
 
 		// Logical device
 		CreateLogicalDevice(requiredValidationLayers);
 
+		_memory = new VulkanMemoryAllocator(_physicalDevice, _device, _framesInFlight, _capabilities.MemoryBudget);
+		_uploads = new VulkanUploadQueue(_device, _memory, _transferQueue, (uint32_t)_transferQueueIndex, (uint32_t)_graphicsQueueIndex);
+		_bindless = new VulkanBindlessHeap(_physicalDevice, _device, _framesInFlight);
+		_textures = new VulkanTextureStreamer(_device, _memory, _uploads, _bindless, _capabilities.FragmentStoresAndAtomics, _framesInFlight);
+
+		// Pipeline cache from the previous run, if it was built on this device and driver
+		_pipelineCache = new VulkanPipelineCache(_device, _physicalDevice, "pipeline_cache.bin");
+
 		// Create the basic shader
-		CreateShader("main");
+		_mainShader = CreateShader("main");
+		_mainShader->DeclareBool("ENABLE_BANDING", 0, false);
+		_mainShader->DeclareInt("BAND_COUNT", 1, 8);
+		_mainShader->DeclareFloat("INTENSITY", 2, 1.0f);
 
-		CreateSwapchain();
+		CreateSwapchain(VK_NULL_HANDLE);
 		CreateSwapchainImagesAndViews();
-		CreateRenderPass();
+		CreateScene();
+		CreateRenderGraph();
+		CreateGraphicsPipeline();
+		CreateFrames();
+		_recorder = new VulkanCommandRecorder(_device, (uint32_t)_graphicsQueueIndex, _jobs, _framesInFlight);
+
+		const float64_t startupMs = std::chrono::duration<float64_t, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+		Logger::Info("Renderer startup took %.2f ms (%s pipeline cache)", startupMs, _pipelineCache->IsWarm() ? "warm" : "cold");
 	}
 
 	VulkanRenderer::~VulkanRenderer()
 	{
+		// Let every frame in flight retire before tearing anything down.
+		vkDeviceWaitIdle(_device);
+
+		DestroyFrames();
+		delete _recorder;
+		DestroyRetiredSwapchains(true);
+		delete _scene;
+		delete _textures;
+
+		// Pipeline workers may still be compiling against the graph's render passes
+		delete _pipelineStates;
+		delete _graph;
+		delete _bindless;
+		vkDestroySampler(_device, _demoSampler, VK_ALLOCATOR);
+		delete _pipelineCache;
+
+		for (auto view : _swapchainImageViews) {
+			vkDestroyImageView(_device, view, VK_ALLOCATOR);
+		}
+		vkDestroySwapchainKHR(_device, _swapchain, VK_ALLOCATOR);
+
+		delete _mainShader;
+		delete _uploads;
+		delete _memory;
+
+		vkDestroyDevice(_device, VK_ALLOCATOR);
+		vkDestroySurfaceKHR(_instance, _surface, VK_ALLOCATOR);
+
 		if(_debugMessenger)
 		{
 			const auto fn = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(
 				_instance, "vkDestroyDebugUtilsMessengerEXT"));
-			fn(_instance, _debugMessenger, nullptr);
+			fn(_instance, _debugMessenger, VK_ALLOCATOR);
+		}
+		vkDestroyInstance(_instance, VK_ALLOCATOR);
+	}
+
+	// Device type dominates: any discrete GPU beats any integrated one. Within a type, more VRAM, a better
+	// queue layout and the optional features break the tie.
+	static uint64_t ScoreDevice(const VulkanDeviceCapabilities& capabilities)
+	{
+		uint64_t score = 0;
+		switch (capabilities.Properties.deviceType) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 100000; break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 10000; break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 5000; break;
+		default: break;
+		}
+
+		// One point per 64 MB of VRAM
+		score += capabilities.DeviceLocalBytes / (64ull * 1024 * 1024);
+
+		if (capabilities.GraphicsQueueIndex == capabilities.PresentationQueueIndex) {
+			score += 100;
+		}
+		if (capabilities.DedicatedTransferQueue) {
+			score += 500;
 		}
-		vkDestroyInstance(_instance, nullptr);
+		if (capabilities.AsyncCompute) {
+			score += 250;
+		}
+
+		const bool features[] = {
+			capabilities.DescriptorIndexing,
+			capabilities.DrawIndirectCount,
+			capabilities.DrawIndirectFirstInstance,
+			capabilities.BufferDeviceAddress,
+			capabilities.GraphicsPipelineLibrary,
+			capabilities.MultiDrawIndirect
+		};
+		for (bool feature : features) {
+			if (feature) {
+				score += 500;
+			}
+		}
+		return score;
 	}
 
-	VkPhysicalDevice VulkanRenderer::SelectPhysicalDevice() const
+	VulkanDeviceCapabilities VulkanRenderer::SelectPhysicalDevice(const char* deviceOverride) const
 	{
+		PROFILE_FUNCTION();
 		uint32_t deviceCount = 0;
 		VK_CHECK(vkEnumeratePhysicalDevices(_instance, &deviceCount, nullptr));
 		ASSERT_MSG(deviceCount != 0, "No supported physical devices found.");
 		std::vector<VkPhysicalDevice> devices(deviceCount);
 		VK_CHECK(vkEnumeratePhysicalDevices(_instance, &deviceCount, devices.data()));
 
+		VulkanDeviceCapabilities best = {};
+		bool found = false;
 		for(auto &device : devices)
 		{
-			if(VulkanRenderer::PhysicalDeviceMeetsRequirements(device, _surface))
-			{
-				return device;
+			VulkanDeviceCapabilities capabilities = VulkanRenderer::QueryDeviceCapabilities(device, _surface);
+			if (!capabilities.MeetsRequirements) {
+				Logger::Info("GPU %s does not meet engine requirements", capabilities.Properties.deviceName);
+				continue;
 			}
+			Logger::Info("GPU %s scored %llu", capabilities.Properties.deviceName, (unsigned long long)capabilities.Score);
+
+			if (deviceOverride && MatchesDeviceOverride(capabilities, deviceOverride)) {
+				Logger::Info("Using %s, forced by device override", capabilities.Properties.deviceName);
+				return capabilities;
+			}
+			if (!found || capabilities.Score > best.Score) {
+				best = capabilities;
+				found = true;
+			}
+		}
+
+		if (deviceOverride) {
+			Logger::Warn("No suitable GPU matches device override \"%s\"", deviceOverride);
+		}
+		if (!found) {
+			Logger::Fatal("No devices that meet engine requirements found");
+			return best;
 		}
-		Logger::Fatal("No devices that meet engine requirements found");
-		return nullptr;
+		Logger::Info("Using %s", best.Properties.deviceName);
+		return best;
 	}
 
-	bool VulkanRenderer::PhysicalDeviceMeetsRequirements(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
+	VulkanDeviceCapabilities VulkanRenderer::QueryDeviceCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
 	{
-		int32_t graphicsQueueIndex = -1;
-		int32_t presentationQueueIndex = -1;
-		DetectQueueFamilyIndices(physicalDevice, surface, &graphicsQueueIndex, &presentationQueueIndex);
-
-		VulkanSwapchainSupport swapchainSupport = VulkanRenderer::QuerySwapchainSupport(physicalDevice, surface);
+		VulkanDeviceCapabilities capabilities = {};
+		capabilities.PhysicalDevice = physicalDevice;
+
+		// Properties. The UUID needs Vulkan 1.1.
+		vkGetPhysicalDeviceProperties(physicalDevice, &capabilities.Properties);
+		if (capabilities.Properties.apiVersion >= VK_API_VERSION_1_1) {
+			VkPhysicalDeviceIDProperties idProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+			VkPhysicalDeviceProperties2 properties2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+			properties2.pNext = &idProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			memcpy(capabilities.DeviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+		}
 
-		VkPhysicalDeviceProperties properties;
-		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+			const VkMemoryHeap& heap = memoryProperties.memoryHeaps[i];
+			if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap.size > capabilities.DeviceLocalBytes) {
+				capabilities.DeviceLocalBytes = heap.size;
+			}
+		}
 
-		VkPhysicalDeviceFeatures features;
-		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+		// Queue topology
+		capabilities.GraphicsQueueIndex = -1;
+		capabilities.PresentationQueueIndex = -1;
+		capabilities.TransferQueueIndex = -1;
+		DetectQueueFamilyIndices(physicalDevice, surface, &capabilities.GraphicsQueueIndex, &capabilities.PresentationQueueIndex,
+			&capabilities.TransferQueueIndex);
+		capabilities.DedicatedTransferQueue = capabilities.TransferQueueIndex != capabilities.GraphicsQueueIndex;
 
-		bool supportsRequiredQueueFamilies = (graphicsQueueIndex != -1) && (presentationQueueIndex != -1);
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> familyProperties(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, familyProperties.data());
+		for (auto& family : familyProperties) {
+			capabilities.AsyncCompute |= (family.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(family.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+		}
 
 		// Extension support
 		uint32_t extensionCount = 0;
@@ -187,7 +344,7 @@ namespace VKE
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
 		};
 
-		bool success = true;
+		bool supportsRequiredExtensions = true;
 		for(auto & requiredExtension : requiredExtensions)
 		{
 			bool found = false;
@@ -198,68 +355,178 @@ namespace VKE
 					found = true;
 					break;
 				}
+			}
 
-				if(!found)
-				{
-					success = false;
-					break;
-				}
+			if(!found)
+			{
+				supportsRequiredExtensions = false;
+				break;
 			}
 		}
 
+		bool hasPipelineLibrary = false;
+		bool hasGraphicsPipelineLibrary = false;
+		for (auto& extension : availableExtensions) {
+			hasPipelineLibrary |= strcmp(extension.extensionName, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) == 0;
+			hasGraphicsPipelineLibrary |= strcmp(extension.extensionName, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0;
+			capabilities.MemoryBudget |= strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+		}
+
+		// Features. Everything optional past 1.0 is read from the Vulkan 1.2 feature block, so older devices
+		// simply report none of it.
+		VkPhysicalDeviceFeatures features;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+		capabilities.MultiDrawIndirect = features.multiDrawIndirect == VK_TRUE;
+		capabilities.DrawIndirectFirstInstance = features.drawIndirectFirstInstance == VK_TRUE;
+		capabilities.FragmentStoresAndAtomics = features.fragmentStoresAndAtomics == VK_TRUE;
+
+		if (capabilities.Properties.apiVersion >= VK_API_VERSION_1_2) {
+			VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gplFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+			VkPhysicalDeviceVulkan12Features vulkan12Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+			vulkan12Features.pNext = hasPipelineLibrary && hasGraphicsPipelineLibrary ? &gplFeatures : nullptr;
+			VkPhysicalDeviceFeatures2 features2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+			features2.pNext = &vulkan12Features;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+			capabilities.TimelineSemaphores = vulkan12Features.timelineSemaphore == VK_TRUE;
+			capabilities.DescriptorIndexing = features.shaderStorageBufferArrayDynamicIndexing && vulkan12Features.runtimeDescriptorArray &&
+				vulkan12Features.descriptorBindingPartiallyBound &&
+				vulkan12Features.descriptorBindingVariableDescriptorCount &&
+				vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+				vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind &&
+				vulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+				vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+				vulkan12Features.shaderStorageBufferArrayNonUniformIndexing;
+			capabilities.DrawIndirectCount = vulkan12Features.drawIndirectCount == VK_TRUE;
+			capabilities.BufferDeviceAddress = vulkan12Features.bufferDeviceAddress == VK_TRUE;
+			capabilities.GraphicsPipelineLibrary = gplFeatures.graphicsPipelineLibrary == VK_TRUE;
+		}
+
+		bool supportsRequiredQueueFamilies = (capabilities.GraphicsQueueIndex != -1) && (capabilities.PresentationQueueIndex != -1);
+
 		bool swapChainMeetsReq = false;
-		if(supportsRequiredQueueFamilies)
+		if(supportsRequiredQueueFamilies && supportsRequiredExtensions)
 		{
-			swapChainMeetsReq = !swapchainSupport.Formats.empty() &&
-				!swapchainSupport.PresentationModes.empty();
+			ScratchScope scratch;
+			VulkanSwapchainSupport swapchainSupport = VulkanRenderer::QuerySwapchainSupport(physicalDevice, surface, scratch.GetArena());
+			swapChainMeetsReq = swapchainSupport.FormatCount > 0 && swapchainSupport.PresentationModeCount > 0;
+		}
+
+		// Uploads are tracked with timeline semaphores, and every shader resource goes through the bindless heap
+		capabilities.MeetsRequirements = supportsRequiredQueueFamilies && supportsRequiredExtensions && swapChainMeetsReq &&
+			features.samplerAnisotropy && capabilities.TimelineSemaphores && capabilities.DescriptorIndexing;
+		capabilities.Score = ScoreDevice(capabilities);
+		return capabilities;
+	}
+
+	static int32_t HexDigit(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	bool VulkanRenderer::MatchesDeviceOverride(const VulkanDeviceCapabilities& capabilities, const char* deviceOverride)
+	{
+		// UUID, as 32 hex digits with optional dashes
+		uint8_t uuid[VK_UUID_SIZE] = {};
+		uint32_t digits = 0;
+		bool isUUID = true;
+		for (const char* c = deviceOverride; *c && isUUID; ++c) {
+			if (*c == '-') {
+				continue;
+			}
+			const int32_t value = HexDigit(*c);
+			if (value < 0 || digits >= VK_UUID_SIZE * 2) {
+				isUUID = false;
+				break;
+			}
+			uuid[digits / 2] |= (uint8_t)(digits % 2 == 0 ? value << 4 : value);
+			digits++;
+		}
+		if (isUUID && digits == VK_UUID_SIZE * 2) {
+			return memcmp(uuid, capabilities.DeviceUUID, VK_UUID_SIZE) == 0;
 		}
 
-        // NOTE: Could also look for discrete GPU. We could score and rank them based on features and capabilities.
-		return supportsRequiredQueueFamilies && swapChainMeetsReq && features.samplerAnisotropy;
+		// Otherwise a case insensitive substring of the device name, e.g. "4090"
+		const char* name = capabilities.Properties.deviceName;
+		const size_t length = strlen(deviceOverride);
+		for (const char* start = name; *start; ++start) {
+			size_t i = 0;
+			while (i < length && start[i] && tolower((unsigned char)start[i]) == tolower((unsigned char)deviceOverride[i])) {
+				++i;
+			}
+			if (i == length) {
+				return true;
+			}
+		}
+		return false;
 	}
 
-	void VulkanRenderer::DetectQueueFamilyIndices(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, int32_t* graphicsQueueIndex, int32_t* presentationQueueIndex)
+	void VulkanRenderer::DetectQueueFamilyIndices(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, int32_t* graphicsQueueIndex,
+		int32_t* presentationQueueIndex, int32_t* transferQueueIndex)
 	{
 		uint32_t queueFamilyCount = 0;
 		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
 		std::vector<VkQueueFamilyProperties> familyProperties(queueFamilyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, familyProperties.data());
 
+		int32_t transferOnly = -1;
+		int32_t computeTransfer = -1;
 		for(uint32_t i = 0; i < familyProperties.size(); i++)
 		{
-			if(familyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-			{
-				*graphicsQueueIndex = i;
-			}
+			const VkQueueFlags flags = familyProperties[i].queueFlags;
+			const bool graphics = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
 
 			VkBool32 supportsPresentation = VK_FALSE;
 			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresentation);
-			if(supportsPresentation)
-			{
+
+			// Keep the first match, but prefer a family that can both draw and present so the swapchain
+			// images never need to be shared.
+			if (graphics && supportsPresentation && (*graphicsQueueIndex == -1 || *graphicsQueueIndex != *presentationQueueIndex)) {
+				*graphicsQueueIndex = i;
+				*presentationQueueIndex = i;
+			}
+			if (graphics && *graphicsQueueIndex == -1) {
+				*graphicsQueueIndex = i;
+			}
+			if (supportsPresentation && *presentationQueueIndex == -1) {
 				*presentationQueueIndex = i;
 			}
+
+			// Transfer-only families map to the copy engines, which run alongside graphics work
+			if (!graphics && (flags & VK_QUEUE_TRANSFER_BIT)) {
+				if (!(flags & VK_QUEUE_COMPUTE_BIT) && transferOnly == -1) {
+					transferOnly = i;
+				}
+				else if ((flags & VK_QUEUE_COMPUTE_BIT) && computeTransfer == -1) {
+					computeTransfer = i;
+				}
+			}
 		}
+
+		// Graphics and compute families always support transfers, even when they don't say so
+		*transferQueueIndex = transferOnly != -1 ? transferOnly : (computeTransfer != -1 ? computeTransfer : *graphicsQueueIndex);
 	}
 
-	VulkanSwapchainSupport VulkanRenderer::QuerySwapchainSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
+	VulkanSwapchainSupport VulkanRenderer::QuerySwapchainSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, LinearArena& arena)
 	{
-		VulkanSwapchainSupport support;
+		VulkanSwapchainSupport support = {};
 
 		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &support.Capabilities);
-		uint32_t formatCount = 0;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
-		if(formatCount != 0)
+		vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &support.FormatCount, nullptr);
+		if(support.FormatCount != 0)
 		{
-			support.Formats.resize(formatCount);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, support.Formats.data());
+			support.Formats = arena.Allocate<VkSurfaceFormatKHR>(support.FormatCount);
+			vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &support.FormatCount, support.Formats);
 		}
 
-		uint32_t presentModeCount = 0;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
-		if(presentModeCount != 0)
+		vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &support.PresentationModeCount, nullptr);
+		if(support.PresentationModeCount != 0)
 		{
-			support.PresentationModes.resize(presentModeCount);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, support.PresentationModes.data());
+			support.PresentationModes = arena.Allocate<VkPresentModeKHR>(support.PresentationModeCount);
+			vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &support.PresentationModeCount, support.PresentationModes);
 		}
 
 		return support;
@@ -267,16 +534,22 @@ namespace VKE
 
 	void VulkanRenderer::CreateLogicalDevice(std::vector<const char*>& requiredValidationLayers)
 	{
-		int32_t graphicsQueueIndex = -1;
-		int32_t presentationQueueIndex = -1;
-		VulkanRenderer::DetectQueueFamilyIndices(_physicalDevice, _surface, &graphicsQueueIndex, &presentationQueueIndex);
+		PROFILE_FUNCTION();
+		const int32_t graphicsQueueIndex = _capabilities.GraphicsQueueIndex;
+		const int32_t presentationQueueIndex = _capabilities.PresentationQueueIndex;
+		const int32_t transferQueueIndex = _capabilities.TransferQueueIndex;
 
 		std::vector<uint32_t> queueIndices;
 		queueIndices.push_back(graphicsQueueIndex);
-		if (graphicsQueueIndex != presentationQueueIndex) {
+		if (presentationQueueIndex != graphicsQueueIndex) {
 			queueIndices.push_back(presentationQueueIndex);
 		}
+		if (transferQueueIndex != graphicsQueueIndex && transferQueueIndex != presentationQueueIndex) {
+			queueIndices.push_back(transferQueueIndex);
+		}
 
+		// Has to outlive vkCreateDevice
+		const float32_t queuePriority = 1.0f;
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos(queueIndices.size());
 		for(uint32_t i = 0; i < queueIndices.size(); i++)
 		{
@@ -285,110 +558,221 @@ namespace VKE
 			queueCreateInfos[i].queueCount = 1;
 			queueCreateInfos[i].flags = 0;
 			queueCreateInfos[i].pNext = nullptr;
-			float32_t queuePriority = 1.0f;
 			queueCreateInfos[i].pQueuePriorities = &queuePriority;
 		}
 
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+		std::vector<const char*> enabledExtensions = {
+			VK_KHR_SWAPCHAIN_EXTENSION_NAME
+		};
+
+		// Optional: graphics pipeline libraries, for fast-linked pipelines
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gplFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+		if (_capabilities.GraphicsPipelineLibrary) {
+			enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+			gplFeatures.graphicsPipelineLibrary = VK_TRUE;
+		}
+		Logger::Info("VK_EXT_graphics_pipeline_library %s", _capabilities.GraphicsPipelineLibrary ? "enabled" : "not supported, using monolithic pipelines");
+
+		// Optional: real heap budgets and usage for the memory tracker and streaming
+		if (_capabilities.MemoryBudget) {
+			enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+
+		// Vulkan 1.2 core features. Only what the capability profile reported is switched on.
+		VkPhysicalDeviceVulkan12Features vulkan12Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+		vulkan12Features.timelineSemaphore = VK_TRUE;
+		vulkan12Features.drawIndirectCount = _capabilities.DrawIndirectCount ? VK_TRUE : VK_FALSE;
+		vulkan12Features.bufferDeviceAddress = _capabilities.BufferDeviceAddress ? VK_TRUE : VK_FALSE;
+		if (_capabilities.DescriptorIndexing) {
+			vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+			vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+			vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+			vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+			vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+		}
+		vulkan12Features.pNext = _capabilities.GraphicsPipelineLibrary ? &gplFeatures : nullptr;
+		deviceFeatures.multiDrawIndirect = _capabilities.MultiDrawIndirect ? VK_TRUE : VK_FALSE;
+		deviceFeatures.drawIndirectFirstInstance = _capabilities.DrawIndirectFirstInstance ? VK_TRUE : VK_FALSE;
+		deviceFeatures.fragmentStoresAndAtomics = _capabilities.FragmentStoresAndAtomics ? VK_TRUE : VK_FALSE;
+		deviceFeatures.shaderStorageBufferArrayDynamicIndexing = _capabilities.DescriptorIndexing ? VK_TRUE : VK_FALSE;
+
+		Logger::Info("Descriptor indexing %s, draw indirect count %s, buffer device address %s, %s transfer queue",
+			_capabilities.DescriptorIndexing ? "enabled" : "not supported",
+			_capabilities.DrawIndirectCount ? "enabled" : "not supported",
+			_capabilities.BufferDeviceAddress ? "enabled" : "not supported",
+			_capabilities.DedicatedTransferQueue ? "dedicated" : "shared");
+
 		// TODO: Disable on release builds
 		VkDeviceCreateInfo deviceCreateInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
 		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 		deviceCreateInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-        deviceCreateInfo.enabledExtensionCount = 1;
-        deviceCreateInfo.pNext = nullptr;
-        const char* requiredExtensions[1] = {
-            VK_KHR_SWAPCHAIN_EXTENSION_NAME
-        };
-        deviceCreateInfo.ppEnabledExtensionNames = requiredExtensions;
+        deviceCreateInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
+        deviceCreateInfo.pNext = &vulkan12Features;
+        deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 		deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(requiredValidationLayers.size());
 		deviceCreateInfo.ppEnabledLayerNames = requiredValidationLayers.data();
 
 		// Create device
-		VK_CHECK(vkCreateDevice(_physicalDevice, &deviceCreateInfo, nullptr, &_device));
+		VK_CHECK(vkCreateDevice(_physicalDevice, &deviceCreateInfo, VK_ALLOCATOR, &_device));
 
 		_graphicsQueueIndex = graphicsQueueIndex;
 		_presentationQueueIndex = presentationQueueIndex;
+		_transferQueueIndex = transferQueueIndex;
 
 		// Create queues
 		vkGetDeviceQueue(_device, _graphicsQueueIndex, 0, &_graphicsQueue);
 		vkGetDeviceQueue(_device, _presentationQueueIndex, 0, &_presentationQueue);
+		vkGetDeviceQueue(_device, _transferQueueIndex, 0, &_transferQueue);
 	}
 
-	char* VulkanRenderer::ReadShaderFile(const char* filename, const char* shaderType, uint64_t* fileSize) const
+	static void OnShaderSourceRead(const IOResult& result)
 	{
-		ASSERT_MSG(shaderType == "frag" || shaderType == "vert", "Unexpected shader type string");
-		char buffer[256];
-		uint32_t length = snprintf(buffer, sizeof(buffer), "shaders/%s.%s.spv", filename, shaderType);
-
-		if (length < 0) {
-			Logger::Fatal("Shader filename is too long");
+		VulkanShaderSource* source = static_cast<VulkanShaderSource*>(result.UserData);
+		if (result.Status == IOStatus::Complete) {
+			source->Code = static_cast<const char*>(result.Data);
+			source->Size = result.Size;
+			source->Owned = true;
 		}
+	}
 
-		std::ifstream file(buffer, std::ios::ate | std::ios::binary);
-		if (!file.is_open()) {
-			Logger::Fatal("Unable to open shader file %s.", buffer);
+	void VulkanRenderer::ReadShaderSources(const char* name, VulkanShaderSource* sources, const char* const* shaderTypes, uint32_t stageCount) const
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(stageCount <= MAX_SHADER_STAGES, "Too many shader stages");
+
+		char paths[MAX_SHADER_STAGES][256];
+		IOReadDesc reads[MAX_SHADER_STAGES];
+		IORequestHandle handles[MAX_SHADER_STAGES];
+		uint32_t readCount = 0;
+
+		for (uint32_t i = 0; i < stageCount; ++i) {
+			ASSERT_MSG(strcmp(shaderTypes[i], "frag") == 0 || strcmp(shaderTypes[i], "vert") == 0 || strcmp(shaderTypes[i], "comp") == 0,
+				"Unexpected shader type string");
+			sources[i] = VulkanShaderSource();
+
+			int32_t length = snprintf(paths[i], sizeof(paths[i]), "shaders/%s.%s.spv", name, shaderTypes[i]);
+			if (length < 0 || length >= (int32_t)sizeof(paths[i])) {
+				Logger::Fatal("Shader filename is too long");
+			}
+
+			// Packed archive (production). Uncompressed entries are used straight from the mapping.
+			const ArchiveEntry* entry = _assets && _assets->IsOpen() ? _assets->Find(paths[i]) : nullptr;
+			if (entry) {
+				sources[i].Size = entry->Size;
+				sources[i].Code = static_cast<const char*>(_assets->GetMappedData(entry));
+				if (!sources[i].Code) {
+					char* code = (char*)malloc(entry->Size);
+					if (!_assets->Read(entry, code)) {
+						Logger::Fatal("Unable to read shader %s from the asset archive", paths[i]);
+					}
+					sources[i].Code = code;
+					sources[i].Owned = true;
+				}
+				continue;
+			}
+
+			// Loose files (development), read together rather than one after another
+			IOReadDesc& read = reads[readCount++];
+			read.Path = paths[i];
+			read.Priority = IOPriority::High;
+			read.Callback = OnShaderSourceRead;
+			read.UserData = &sources[i];
 		}
 
-		*fileSize = (uint64_t)file.tellg();
-		char* fb = (char*)malloc(*fileSize); // REMEMBER TO FREE THIS!
-		file.seekg(0);
-		file.read(fb, *fileSize);
-		file.close();
+		if (readCount > 0) {
+			_io->ReadBatch(reads, readCount, handles);
+			for (uint32_t i = 0; i < readCount; ++i) {
+				_io->Wait(handles[i]);
+			}
+			_io->Poll();
+		}
 
-		return fb;
+		for (uint32_t i = 0; i < stageCount; ++i) {
+			if (!sources[i].Code) {
+				Logger::Fatal("Unable to open shader file %s.", paths[i]);
+			}
+		}
 	}
 
-	void VulkanRenderer::CreateShader(const char* name)
+	void VulkanRenderer::CreateShaderModules(const char* name, const char* const* shaderTypes, uint32_t stageCount, VkShaderModule* modules)
 	{
-		// Vert shader
-		uint64_t vertShaderSize;
-		char* vertShaderSrc = ReadShaderFile(name, "vert", &vertShaderSize);
-		VkShaderModuleCreateInfo vertShaderCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		vertShaderCreateInfo.codeSize = vertShaderSize;
-		vertShaderCreateInfo.pCode = (uint32_t *)vertShaderSrc;
-		VkShaderModule vertShaderModule;
-		VK_CHECK(vkCreateShaderModule(_device, &vertShaderCreateInfo, nullptr, &vertShaderModule));
+		PROFILE_FUNCTION();
 
-		// Frag Shader
-		uint64_t fragShaderSize;
-		char* fragShaderSrc = ReadShaderFile(name, "frag", &fragShaderSize);
-		VkShaderModuleCreateInfo fragShaderCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		fragShaderCreateInfo.codeSize = fragShaderSize;
-		fragShaderCreateInfo.pCode = (uint32_t*)fragShaderSrc;
-		VkShaderModule fragShaderModule;
-		VK_CHECK(vkCreateShaderModule(_device, &fragShaderCreateInfo, nullptr, &fragShaderModule));
+		VulkanShaderSource sources[MAX_SHADER_STAGES];
+		ReadShaderSources(name, sources, shaderTypes, stageCount);
 
-		// Vert shader stage
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
-		vertShaderStageInfo.pName = "main";
+		for (uint32_t i = 0; i < stageCount; ++i) {
+			VkShaderModuleCreateInfo createInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+			createInfo.codeSize = sources[i].Size;
+			createInfo.pCode = (const uint32_t*)sources[i].Code;
+			VK_CHECK(vkCreateShaderModule(_device, &createInfo, VK_ALLOCATOR, &modules[i]));
+
+			if (sources[i].Owned) {
+				AsyncIO::FreeBuffer((void*)sources[i].Code);
+			}
+		}
+	}
 
-		// Frag shader stage
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
+	VulkanShader* VulkanRenderer::CreateShader(const char* name)
+	{
+		PROFILE_FUNCTION();
 
-		_shaderStageCount = 2;
-		_shaderStages.push_back(vertShaderStageInfo);
-		_shaderStages.push_back(fragShaderStageInfo);
+		const char* shaderTypes[] = { "vert", "frag" };
+		VkShaderModule modules[2];
+		CreateShaderModules(name, shaderTypes, 2, modules);
 
-		free(vertShaderSrc);
-		free(fragShaderSrc);
+		// Stages are built per variant, once specialization constants are known
+		return new VulkanShader(_device, name, modules[0], modules[1]);
 	}
 
-	void VulkanRenderer::CreateSwapchain()
+	VkPresentModeKHR VulkanRenderer::ChoosePresentMode(const VkPresentModeKHR* available, uint32_t availableCount) const
 	{
-		VulkanSwapchainSupport swapchainSupport = VulkanRenderer::QuerySwapchainSupport(_physicalDevice, _surface);
+		// Preferred mode first; FIFO is guaranteed, so every list ends there
+		VkPresentModeKHR preferences[3] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR };
+		switch (_presentPolicy) {
+		case VulkanPresentPolicy::LowLatency:
+			preferences[0] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			preferences[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+			break;
+		case VulkanPresentPolicy::Mailbox:
+			preferences[0] = VK_PRESENT_MODE_MAILBOX_KHR;
+			break;
+		case VulkanPresentPolicy::Fifo:
+			break;
+		case VulkanPresentPolicy::FifoRelaxed:
+			preferences[0] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+			break;
+		}
+
+		for (auto preference : preferences) {
+			for (uint32_t i = 0; i < availableCount; i++) {
+				if (available[i] == preference) {
+					return preference;
+				}
+			}
+		}
+		return VK_PRESENT_MODE_FIFO_KHR;
+	}
+
+	void VulkanRenderer::CreateSwapchain(VkSwapchainKHR oldSwapchain)
+	{
+		PROFILE_FUNCTION();
+		ScratchScope scratch;
+		VulkanSwapchainSupport swapchainSupport = VulkanRenderer::QuerySwapchainSupport(_physicalDevice, _surface, scratch.GetArena());
 		VkSurfaceCapabilitiesKHR capabilities = swapchainSupport.Capabilities;
 
 		// Surface format
 		bool found = false;
-		for (auto format : swapchainSupport.Formats) {
+		for (uint32_t i = 0; i < swapchainSupport.FormatCount; i++) {
+			const VkSurfaceFormatKHR format = swapchainSupport.Formats[i];
 			if (format.format == VK_FORMAT_B8G8R8A8_UNORM && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
 				_swapchainImageFormat = format;
 				found = true;
@@ -401,18 +785,7 @@ namespace VKE
 		}
 
 		// Presentation Mode
-		VkPresentModeKHR presentMode;
-		found = false;
-		for (auto mode : swapchainSupport.PresentationModes) {
-			if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-				presentMode = mode;
-				found = true;
-			}
-		}
-
-		if (!found) {
-			presentMode = VK_PRESENT_MODE_FIFO_KHR;
-		}
+		_presentMode = ChoosePresentMode(swapchainSupport.PresentationModes, swapchainSupport.PresentationModeCount);
 
 		// Swapchain extent
 		if (capabilities.currentExtent.width != UINT32_MAX) {
@@ -427,7 +800,10 @@ namespace VKE
 			_swapchainExtent.height = glm::clamp(_swapchainExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
 		}
 
-		uint32_t imageCount = capabilities.minImageCount + 1;
+		uint32_t imageCount = _requestedImageCount != 0 ? _requestedImageCount : capabilities.minImageCount + 1;
+		if (imageCount < capabilities.minImageCount) {
+			imageCount = capabilities.minImageCount;
+		}
 		if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount) {
 			imageCount = capabilities.maxImageCount;
 		}
@@ -457,15 +833,88 @@ namespace VKE
 
 		swapchainCreateInfo.preTransform = capabilities.currentTransform;
 		swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		swapchainCreateInfo.presentMode = presentMode;
+		swapchainCreateInfo.presentMode = _presentMode;
 		swapchainCreateInfo.clipped = VK_TRUE;
-		swapchainCreateInfo.oldSwapchain = nullptr; // Used after window resize, no need now
+		// Lets the driver hand resources over from the old swapchain, which is retired by this call
+		swapchainCreateInfo.oldSwapchain = oldSwapchain;
+
+		VK_CHECK(vkCreateSwapchainKHR(_device, &swapchainCreateInfo, VK_ALLOCATOR, &_swapchain));
+		Logger::Info("Swapchain %ux%u, %u images, present mode %d", _swapchainExtent.width, _swapchainExtent.height, imageCount, (int32_t)_presentMode);
+	}
+
+	void VulkanRenderer::SetPresentPolicy(VulkanPresentPolicy policy, uint32_t imageCount)
+	{
+		if (policy == _presentPolicy && imageCount == _requestedImageCount) {
+			return;
+		}
+		_presentPolicy = policy;
+		_requestedImageCount = imageCount;
+		_swapchainDirty = true;
+	}
+
+	void VulkanRenderer::SetCamera(const glm::mat4& view, float32_t verticalFov, float32_t nearPlane, float32_t farPlane)
+	{
+		_cameraView = view;
+		_cameraFov = verticalFov;
+		_cameraNear = nearPlane;
+		_cameraFar = farPlane;
+	}
 
-		VK_CHECK(vkCreateSwapchainKHR(_device, &swapchainCreateInfo, nullptr, &_swapchain));
+	bool VulkanRenderer::RecreateSwapchain()
+	{
+		PROFILE_FUNCTION();
+		// A minimized window has no surface area to present to
+		const Extent2D extent = _platform->GetFramebufferExtent();
+		if (extent.width == 0 || extent.height == 0) {
+			return false;
+		}
+		const auto start = std::chrono::steady_clock::now();
+
+		// Frames still in flight keep using the old images, so everything built on them is retired rather
+		// than destroyed. Frames recorded from now on only see the new swapchain.
+		VulkanRetiredSwapchain retired;
+		retired.Swapchain = _swapchain;
+		retired.ImageViews = std::move(_swapchainImageViews);
+		retired.FrameNumber = _frameStats.FrameNumber;
+		_retiredSwapchains.push_back(std::move(retired));
+		_swapchainImageViews.clear();
+
+		// The render pass and pipelines are kept, so the format must not change
+		const VkFormat previousFormat = _swapchainImageFormat.format;
+		CreateSwapchain(_retiredSwapchains.back().Swapchain);
+		ASSERT_MSG(_swapchainImageFormat.format == previousFormat, "Swapchain format changed on recreation");
+		CreateSwapchainImagesAndViews();
+		_graph->SetImportedImages(_backbuffer, _swapchainImages.data(), _swapchainImageViews.data(), (uint32_t)_swapchainImages.size());
+		_graph->Resize(_swapchainExtent, _frameStats.FrameNumber);
+		_imagesInFlight.assign(_swapchainImages.size(), VK_NULL_HANDLE);
+		_swapchainDirty = false;
+
+		const float64_t recreateMs = std::chrono::duration<float64_t, std::milli>(std::chrono::steady_clock::now() - start).count();
+		Logger::Info("Swapchain recreated in %.2f ms", recreateMs);
+		return true;
+	}
+
+	void VulkanRenderer::DestroyRetiredSwapchains(bool all)
+	{
+		// Frame N starts after the fence of frame N - framesInFlight, and frames finish in order, so a
+		// swapchain retired at frame R is unused once frame R + framesInFlight has begun.
+		auto it = _retiredSwapchains.begin();
+		while (it != _retiredSwapchains.end()) {
+			if (!all && _frameStats.FrameNumber < it->FrameNumber + _framesInFlight) {
+				++it;
+				continue;
+			}
+			for (auto view : it->ImageViews) {
+				vkDestroyImageView(_device, view, VK_ALLOCATOR);
+			}
+			vkDestroySwapchainKHR(_device, it->Swapchain, VK_ALLOCATOR);
+			it = _retiredSwapchains.erase(it);
+		}
 	}
 
 	void VulkanRenderer::CreateSwapchainImagesAndViews()
 	{
+		PROFILE_FUNCTION();
 		uint32_t swapchainImageCount = 0;
 		VK_CHECK(vkGetSwapchainImagesKHR(_device, _swapchain, &swapchainImageCount, nullptr));
 		_swapchainImages.resize(swapchainImageCount);
@@ -483,30 +932,12 @@ namespace VKE
 			viewInfo.subresourceRange.baseArrayLayer = 0;
 			viewInfo.subresourceRange.layerCount = 1;
 
-			VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &_swapchainImageViews[i]));
+			VK_CHECK(vkCreateImageView(_device, &viewInfo, VK_ALLOCATOR, &_swapchainImageViews[i]));
 		}
 	}
 
-	void VulkanRenderer::CreateRenderPass()
+	VkFormat VulkanRenderer::SelectDepthFormat() const
 	{
-		// Color attachment
-		VkAttachmentDescription colorAttachment = {};
-		colorAttachment.format = _swapchainImageFormat.format;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		// Color attachment reference
-		VkAttachmentReference colorReference = {};
-		colorReference.attachment = 0;
-		colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-		// Depth attachment
-		// Find depth format
 		constexpr uint64_t candidateCount = 3;
 		constexpr VkFormat candidates[candidateCount] = {
 			VK_FORMAT_D32_SFLOAT,
@@ -514,190 +945,508 @@ namespace VKE
 			VK_FORMAT_D24_UNORM_S8_UINT
 		};
 
+		// Render targets are always optimally tiled
 		constexpr uint32_t flags = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
 		for (auto candidate : candidates) {
 			VkFormatProperties props;
 			vkGetPhysicalDeviceFormatProperties(_physicalDevice, candidate, &props);
-			if ((props.linearTilingFeatures & flags) == flags) {
-				depthFormat = candidate;
-				break;
+			if ((props.optimalTilingFeatures & flags) == flags) {
+				return candidate;
 			}
-			else if ((props.optimalTilingFeatures & flags) == flags) {
-				depthFormat = candidate;
-				break;
+		}
+
+		Logger::Fatal("Unable to find a supported depth format");
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	void VulkanRenderer::CreateRenderGraph()
+	{
+		PROFILE_FUNCTION();
+		_depthFormat = SelectDepthFormat();
+		_graph = new VulkanRenderGraph(_device, _memory, _framesInFlight);
+
+		// Resources. The swapchain image is handed over by the acquire semaphore wait and goes back to present.
+		_backbuffer = _graph->ImportImage("Backbuffer", _swapchainImageFormat.format, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		const VulkanGraphResource depth = _graph->CreateImage("Depth", { _depthFormat, { 0, 0 }, VK_SAMPLE_COUNT_1_BIT });
+
+		// Passes. Culling touches no graph resources, only the scene's buffers, so it is kept alive explicitly.
+		_cullPass = _graph->AddPass("Cull", VulkanGraphPassType::Compute, RecordCullPass, this);
+		_graph->SetSideEffects(_cullPass);
+
+		VkClearValue clearColor = {};
+		clearColor.color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
+		VkClearValue clearDepth = {};
+		clearDepth.depthStencil = { 1.0f, 0 };
+		_mainPass = _graph->AddPass("Main", VulkanGraphPassType::Graphics, RecordMainPass, this);
+		// Its draws are recorded on the job system's workers
+		_graph->SetSecondaryCommandBuffers(_mainPass);
+		_graph->Use(_mainPass, _backbuffer, VulkanGraphAccess::ColorWrite, true, clearColor);
+		_graph->Use(_mainPass, depth, VulkanGraphAccess::DepthWrite, true, clearDepth);
+
+		_graph->Compile();
+		_graph->SetImportedImages(_backbuffer, _swapchainImages.data(), _swapchainImageViews.data(), (uint32_t)_swapchainImages.size());
+		_graph->Resize(_swapchainExtent, _frameStats.FrameNumber);
+		_graph->Dump();
+	}
+
+	void VulkanRenderer::CreateGraphicsPipeline()
+	{
+		PROFILE_FUNCTION();
+
+		// Every pipeline shares the bindless heap's layout, so the heap stays bound across pipeline changes
+		_pipelineLayout = _bindless->GetPipelineLayout();
+
+		// Main pipeline description. Viewport and scissor are dynamic, so swapchain resizes never touch it.
+		const VulkanShaderVariant* variant = _mainShader->GetVariant(_mainShader->GetDefaultValues());
+		_mainPipelineDesc = {};
+		_mainPipelineDesc.StageCount = variant->GetStageCount();
+		for (uint32_t i = 0; i < variant->GetStageCount(); i++) {
+			_mainPipelineDesc.Stages[i] = variant->GetStages()[i];
+		}
+		_mainPipelineDesc.CullMode = VK_CULL_MODE_BACK_BIT;
+		_mainPipelineDesc.FrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // Because we flipped the viewport
+		_mainPipelineDesc.Layout = _pipelineLayout;
+		_mainPipelineDesc.RenderPass = _graph->GetRenderPass(_mainPass);
+		_mainPipelineDesc.Subpass = _graph->GetSubpass(_mainPass);
+
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		const uint32_t workerCount = glm::clamp(hardwareThreads / 2, 1u, 4u);
+		_pipelineStates = new VulkanPipelineStateCache(_device, _pipelineCache->GetHandle(), workerCount,
+			_capabilities.GraphicsPipelineLibrary, _framesInFlight);
+
+		// The main pipeline doubles as the fallback used while other pipelines compile in the background.
+		const auto compileStart = std::chrono::steady_clock::now();
+		_pipelineStates->SetFallback(_mainPipelineDesc);
+		const float64_t compileMs = std::chrono::duration<float64_t, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+		Logger::Info("Graphics pipeline created in %.2f ms (%s pipeline cache)", compileMs, _pipelineCache->IsWarm() ? "warm" : "cold");
+	}
+
+	// Demo content: a square grid of cubes, this many on a side, two units apart
+	static constexpr uint32_t DEMO_GRID_SIZE = 64;
+	// Finest mip of the checkerboard on the cubes, large enough that only close cubes stream it in
+	static constexpr uint32_t DEMO_TEXTURE_SIZE = 1024;
+	static constexpr uint32_t DEMO_TEXTURE_CELL = 32;
+
+	// RGBA8 checkerboard and its box filtered mips, finest first and tightly packed. Returns the mip count.
+	static uint32_t BuildDemoTexture(std::vector<uint8_t>& texels, VkDeviceSize* mipOffsets, VkDeviceSize* mipSizes)
+	{
+		uint32_t mipCount = 0;
+		VkDeviceSize total = 0;
+		for (uint32_t size = DEMO_TEXTURE_SIZE; size > 0; size /= 2) {
+			mipOffsets[mipCount] = total;
+			mipSizes[mipCount] = (VkDeviceSize)size * size * 4;
+			total += mipSizes[mipCount++];
+		}
+		texels.resize(total);
+
+		uint8_t* finest = texels.data();
+		for (uint32_t y = 0; y < DEMO_TEXTURE_SIZE; y++) {
+			for (uint32_t x = 0; x < DEMO_TEXTURE_SIZE; x++) {
+				const uint8_t value = ((x / DEMO_TEXTURE_CELL + y / DEMO_TEXTURE_CELL) & 1) ? 230 : 110;
+				uint8_t* texel = finest + ((size_t)y * DEMO_TEXTURE_SIZE + x) * 4;
+				texel[0] = texel[1] = texel[2] = value;
+				texel[3] = 255;
 			}
 		}
 
-		if (depthFormat == VK_FORMAT_UNDEFINED) {
-			Logger::Fatal("Unable to find a supported depth format");
-		}
-		VkAttachmentDescription depthAttachment = {};
-		depthAttachment.format = depthFormat;
-		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		// Depth attachment reference
-		VkAttachmentReference depthReference = {};
-		depthReference.attachment = 1;
-		depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		// Subpass
-		VkSubpassDescription subpass = {};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorReference;
-		subpass.pDepthStencilAttachment = &depthReference;
-
-		// Render pass dependencies
-		VkSubpassDependency dependency = {};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-		constexpr uint32_t attachmentCount = 2;
-		VkAttachmentDescription attachments[attachmentCount] = {
-			colorAttachment,
-			depthAttachment
+		for (uint32_t mip = 1; mip < mipCount; mip++) {
+			const uint32_t size = DEMO_TEXTURE_SIZE >> mip;
+			const uint8_t* source = texels.data() + mipOffsets[mip - 1];
+			uint8_t* target = texels.data() + mipOffsets[mip];
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					for (uint32_t channel = 0; channel < 4; channel++) {
+						const size_t row0 = ((size_t)(2 * y) * (2 * size) + 2 * x) * 4 + channel;
+						const size_t row1 = row0 + (size_t)(2 * size) * 4;
+						target[((size_t)y * size + x) * 4 + channel] = (uint8_t)((source[row0] + source[row0 + 4] + source[row1] + source[row1 + 4] + 2) / 4);
+					}
+				}
+			}
+		}
+		return mipCount;
+	}
+
+	void VulkanRenderer::CreateScene()
+	{
+		PROFILE_FUNCTION();
+		const char* shaderTypes[] = { "comp" };
+		VkShaderModule cullModule;
+		CreateShaderModules("cull", shaderTypes, 1, &cullModule);
+		_scene = new VulkanGpuScene(_device, _memory, _uploads, _bindless, _pipelineCache->GetHandle(), cullModule, _capabilities,
+			_framesInFlight);
+
+		// Unit cube, counter-clockwise seen from outside
+		const glm::vec3 positions[8] = {
+			{ -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f },
+			{ -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f }
+		};
+		const uint32_t indices[36] = {
+			4, 5, 6, 4, 6, 7,
+			1, 0, 3, 1, 3, 2,
+			5, 1, 2, 5, 2, 6,
+			0, 4, 7, 0, 7, 3,
+			7, 6, 2, 7, 2, 3,
+			0, 1, 5, 0, 5, 4
 		};
+		_demoMesh = _scene->AddMesh(positions, 8, indices, 36);
+
+		VkDeviceSize mipOffsets[VKE_TEXTURE_STREAMING_MAX_MIPS];
+		VkDeviceSize mipSizes[VKE_TEXTURE_STREAMING_MAX_MIPS];
+		const void* mipData[VKE_TEXTURE_STREAMING_MAX_MIPS];
+		const uint32_t mipCount = BuildDemoTexture(_demoTexels, mipOffsets, mipSizes);
+		for (uint32_t mip = 0; mip < mipCount; mip++) {
+			mipData[mip] = _demoTexels.data() + mipOffsets[mip];
+		}
+		VulkanStreamedTextureDesc textureDesc = {};
+		textureDesc.Format = VK_FORMAT_R8G8B8A8_UNORM;
+		textureDesc.Width = DEMO_TEXTURE_SIZE;
+		textureDesc.Height = DEMO_TEXTURE_SIZE;
+		textureDesc.MipCount = mipCount;
+		textureDesc.MipData = mipData;
+		textureDesc.MipSizes = mipSizes;
+		_demoTexture = _textures->AddTexture(textureDesc);
+
+		// Trilinear, so mips that stream in blend in rather than pop
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		VK_CHECK(vkCreateSampler(_device, &samplerInfo, VK_ALLOCATOR, &_demoSampler));
+		_scene->SetTextureBindings(_textures->GetTableBuffer(), _textures->GetFeedbackBuffer(), _bindless->AddSampler(_demoSampler));
+
+		const float32_t half = (float32_t)(DEMO_GRID_SIZE - 1);
+		for (uint32_t z = 0; z < DEMO_GRID_SIZE; z++) {
+			for (uint32_t x = 0; x < DEMO_GRID_SIZE; x++) {
+				const glm::vec3 position(2.0f * x - half, 0.0f, 2.0f * z - half);
+				const glm::vec4 color(0.3f + 0.7f * x / DEMO_GRID_SIZE, 0.3f + 0.7f * z / DEMO_GRID_SIZE, 0.8f, 1.0f);
+				_scene->AddInstance(_demoMesh, glm::translate(glm::mat4(1.0f), position), color, _demoTexture);
+			}
+		}
 
-		// Render pass create
-		VkRenderPassCreateInfo renderPassCreateInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
-		renderPassCreateInfo.attachmentCount = attachmentCount;
-		renderPassCreateInfo.pAttachments = attachments;
-		renderPassCreateInfo.subpassCount = 1;
-		renderPassCreateInfo.pSubpasses = &subpass;
-		renderPassCreateInfo.dependencyCount = 1;
-		renderPassCreateInfo.pDependencies = &dependency;
-		VK_CHECK(vkCreateRenderPass(_device, &renderPassCreateInfo, nullptr, &_renderPass));
+		// Above one edge of the grid, looking across it; much of it falls outside the frustum
+		SetCamera(glm::lookAt(glm::vec3(0.0f, 12.0f, half + 8.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+			glm::radians(60.0f), 0.1f, 500.0f);
 	}
 
-	void VulkanRenderer::CreateGraphicsPipeline()
+	void VulkanRenderer::CreateFrames()
+	{
+		PROFILE_FUNCTION();
+		ASSERT_MSG(_framesInFlight > 0, "At least one frame in flight is required");
+		_frames.resize(_framesInFlight);
+		_imagesInFlight.assign(_swapchainImages.size(), VK_NULL_HANDLE);
+
+		for (auto& frame : _frames) {
+			// Each frame owns its pool so it can be reset wholesale once the frame's fence signals.
+			VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			poolInfo.queueFamilyIndex = (uint32_t)_graphicsQueueIndex;
+			VK_CHECK(vkCreateCommandPool(_device, &poolInfo, VK_ALLOCATOR, &frame.CommandPool));
+
+			VkCommandBufferAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+			allocInfo.commandPool = frame.CommandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			VK_CHECK(vkAllocateCommandBuffers(_device, &allocInfo, &frame.CommandBuffer));
+
+			VkSemaphoreCreateInfo semaphoreInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+			VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, VK_ALLOCATOR, &frame.ImageAvailableSemaphore));
+			VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, VK_ALLOCATOR, &frame.RenderFinishedSemaphore));
+
+			// Created signaled so the first wait on each frame returns immediately.
+			VkFenceCreateInfo fenceInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+			fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+			VK_CHECK(vkCreateFence(_device, &fenceInfo, VK_ALLOCATOR, &frame.InFlightFence));
+		}
+
+		Logger::Info("Created %u frames in flight", _framesInFlight);
+	}
+
+	void VulkanRenderer::DestroyFrames()
+	{
+		for (auto& frame : _frames) {
+			vkDestroyFence(_device, frame.InFlightFence, VK_ALLOCATOR);
+			vkDestroySemaphore(_device, frame.RenderFinishedSemaphore, VK_ALLOCATOR);
+			vkDestroySemaphore(_device, frame.ImageAvailableSemaphore, VK_ALLOCATOR);
+			vkDestroyCommandPool(_device, frame.CommandPool, VK_ALLOCATOR);
+		}
+		_frames.clear();
+		_imagesInFlight.clear();
+	}
+
+	void VulkanRenderer::RecordCommandBuffer(VulkanFrame& frame, uint32_t imageIndex)
+	{
+		PROFILE_FUNCTION();
+		VkCommandBuffer commandBuffer = frame.CommandBuffer;
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+		// Take over uploads that finished on the transfer queue
+		frame.UploadWaitValue = _uploads->RecordAcquire(commandBuffer, &frame.UploadWaitStages);
+
+		// Buffer moves have to be recorded before anything that reads the moved buffers
+		_memory->Defragment(commandBuffer);
+
+		// The viewport flips Y, so the projection is the usual right-handed one, with Vulkan's 0 to 1 depth
+		const float32_t aspect = (float32_t)_swapchainExtent.width / (float32_t)std::max(_swapchainExtent.height, 1u);
+		_scene->SetViewProjection(glm::perspectiveRH_ZO(_cameraFov, aspect, _cameraNear, _cameraFar) * _cameraView);
+		// Instance changes since the last frame, ahead of culling
+		_scene->RecordUpdates(commandBuffer);
+		_textures->RecordUpdates(commandBuffer);
+
+		// Bound once; passes only push the indices of what they use
+		_bindless->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+		_bindless->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+		_graph->Execute(commandBuffer, imageIndex);
+		_textures->RecordFeedback(commandBuffer);
+
+		VK_CHECK(vkEndCommandBuffer(commandBuffer));
+	}
+
+	// Resolved once on the recording thread and shared with the workers
+	struct VulkanMainPassContext
+	{
+		VulkanRenderer* Renderer;
+		VkPipeline Pipeline;
+		VkExtent2D Extent;
+	};
+
+	void VulkanRenderer::RecordCullPass(VkCommandBuffer commandBuffer, void* userData)
 	{
-		// Viewport
+		static_cast<VulkanRenderer*>(userData)->_scene->RecordCull(commandBuffer);
+	}
+
+	void VulkanRenderer::RecordMainPass(VkCommandBuffer commandBuffer, void* userData)
+	{
+		VulkanRenderer* renderer = static_cast<VulkanRenderer*>(userData);
+
+		VulkanMainPassContext context;
+		context.Renderer = renderer;
+		context.Pipeline = renderer->_pipelineStates->GetPipeline(renderer->_mainPipelineDesc);
+		context.Extent = renderer->_swapchainExtent;
+		// A single item when the GPU writes the draws, otherwise one per instance
+		renderer->_recorder->Record(commandBuffer, renderer->_graph->GetInheritance(renderer->_mainPass),
+			renderer->_scene->GetDrawItemCount(), RecordMainDraws, &context);
+	}
+
+	void VulkanRenderer::RecordMainDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end, void* userData)
+	{
+		const VulkanMainPassContext* context = static_cast<const VulkanMainPassContext*>(userData);
+		const VkExtent2D extent = context->Extent;
+
+		// Viewport, flipped so +Y is up
 		VkViewport viewport = {};
 		viewport.x = 0.0f;
-		viewport.y = static_cast<float>(_swapchainExtent.height);
-		viewport.width = static_cast<float>(_swapchainExtent.width);
-		viewport.height = -static_cast<float>(_swapchainExtent.height);
+		viewport.y = static_cast<float>(extent.height);
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = -static_cast<float>(extent.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 		// Scissor
 		VkRect2D scissor = {};
 		scissor.offset = { 0, 0 };
-		scissor.extent = { _swapchainExtent.width, _swapchainExtent.height };
-		
-		// Viewport state
-		VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
-
-		// Rasterizer
-		VkPipelineRasterizationStateCreateInfo rasterizer = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // Because we flipped the viewport
-		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f;
-		rasterizer.depthBiasClamp = 0.0f;
-		rasterizer.depthBiasSlopeFactor = 0.0f;
-
-		// Multisampling
-		VkPipelineMultisampleStateCreateInfo multisampleState = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
-		multisampleState.sampleShadingEnable = VK_FALSE;
-		multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisampleState.minSampleShading = 1.0f;
-		multisampleState.pSampleMask = nullptr;
-		multisampleState.alphaToCoverageEnable = VK_FALSE;
-		multisampleState.alphaToOneEnable = VK_FALSE;
-
-		// Depth and stencil
-		VkPipelineDepthStencilStateCreateInfo depthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
-		depthStencil.depthTestEnable = VK_TRUE;
-		depthStencil.depthWriteEnable = VK_TRUE;
-		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-		depthStencil.depthBoundsTestEnable = VK_FALSE;
-		depthStencil.stencilTestEnable = VK_FALSE;
-
-		// Color attachment
-		VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | 
-			VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-
-		VkPipelineColorBlendStateCreateInfo colorBlendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
-		colorBlendState.logicOpEnable = VK_FALSE;
-		colorBlendState.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendState.attachmentCount = 1;
-		colorBlendState.pAttachments = &colorBlendAttachment;
-		colorBlendState.blendConstants[0] = 0.0f;
-		colorBlendState.blendConstants[1] = 0.0f;
-		colorBlendState.blendConstants[2] = 0.0f;
-		colorBlendState.blendConstants[3] = 0.0f;
-
-		// Dynamic state
-		VkDynamicState dynamicStates[] = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_LINE_WIDTH
+		scissor.extent = extent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->Pipeline);
+		context->Renderer->_bindless->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+		context->Renderer->_scene->RecordDraws(commandBuffer, begin, end);
+	}
+
+	void VulkanRenderer::BenchmarkRecording(uint32_t drawCount)
+	{
+		static constexpr uint32_t Repeats = 5;
+
+		// More cubes in layers above the demo grid, until the scene holds drawCount instances
+		std::vector<VulkanInstanceHandle> added;
+		for (uint32_t i = _scene->GetStats().InstanceCount; i < drawCount; i++) {
+			const glm::vec3 position(2.0f * (i % DEMO_GRID_SIZE) - (DEMO_GRID_SIZE - 1), 2.0f * (i / (DEMO_GRID_SIZE * DEMO_GRID_SIZE)),
+				2.0f * ((i / DEMO_GRID_SIZE) % DEMO_GRID_SIZE) - (DEMO_GRID_SIZE - 1));
+			const VulkanInstanceHandle instance = _scene->AddInstance(_demoMesh, glm::translate(glm::mat4(1.0f), position), glm::vec4(1.0f));
+			if (instance == INVALID_INSTANCE) {
+				break;
+			}
+			added.push_back(instance);
+		}
+		drawCount = _scene->GetStats().InstanceCount;
+
+		// Real frames until the instances and the mesh are on the GPU, so every draw is recorded
+		for (uint32_t i = 0; i < 100 && _scene->HasPendingChanges(); i++) {
+			DrawFrame();
+		}
+		vkDeviceWaitIdle(_device);
+
+		VulkanFrame& frame = _frames[0];
+		auto recordBestOf = [&]() {
+			float64_t bestMs = 1e30;
+			for (uint32_t repeat = 0; repeat < Repeats; repeat++) {
+				VK_CHECK(vkResetCommandPool(_device, frame.CommandPool, 0));
+				_recorder->BeginFrame(0);
+
+				VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+				beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				VK_CHECK(vkBeginCommandBuffer(frame.CommandBuffer, &beginInfo));
+				_graph->Execute(frame.CommandBuffer, 0);
+				VK_CHECK(vkEndCommandBuffer(frame.CommandBuffer));
+				bestMs = std::min(bestMs, _recorder->GetStats().RecordMs);
+			}
+			return bestMs;
 		};
 
-		VkPipelineDynamicStateCreateInfo dynamicStateCreate = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
-		dynamicStateCreate.dynamicStateCount = 2;
-		dynamicStateCreate.pDynamicStates = dynamicStates;
-
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;
-		
-		// Input assembly
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-		// Pipeline layout
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
-		pipelineLayoutInfo.setLayoutCount = 0;
-		pipelineLayoutInfo.pSetLayouts = nullptr;
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-		VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout));
-
-		// Pipeline create
-		VkGraphicsPipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
-		pipelineCreateInfo.stageCount = _shaderStageCount;
-		pipelineCreateInfo.pStages = _shaderStages.data();
-		pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
-		pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-		pipelineCreateInfo.pViewportState = &viewportState;
-		pipelineCreateInfo.pRasterizationState = &rasterizer;
-		pipelineCreateInfo.pMultisampleState = &multisampleState;
-		pipelineCreateInfo.pDepthStencilState = &depthStencil;
-		pipelineCreateInfo.pColorBlendState = &colorBlendState;
-		pipelineCreateInfo.pDynamicState = nullptr; // For now?
-		pipelineCreateInfo.layout = _pipelineLayout;
-		pipelineCreateInfo.renderPass = _renderPass;
-		pipelineCreateInfo.subpass = 0;
-		pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-		pipelineCreateInfo.basePipelineIndex = -1;
-
-		VK_CHECK(vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-		Logger::Info("Graphics pipeline created");
-	}
-
-}
+		// One draw per instance, recorded on the CPU
+		const VulkanGpuDrawPath gpuPath = _scene->GetDrawPath();
+		_scene->SetDrawPath(VulkanGpuDrawPath::Direct);
+		Logger::Info("Command recording benchmark, %u draws, best of %u runs", drawCount, Repeats);
+		float64_t baselineMs = 0.0;
+		for (uint32_t chunks = 1; chunks <= _jobs->GetWorkerCount(); chunks++) {
+			_recorder->SetMaxChunks(chunks);
+			const float64_t bestMs = recordBestOf();
+			if (chunks == 1) {
+				baselineMs = bestMs;
+			}
+			Logger::Info("  %2u chunks  | %8.3f ms | %9.0f draws/ms | %5.2fx", chunks, bestMs, drawCount / bestMs, baselineMs / bestMs);
+		}
+		_recorder->SetMaxChunks(0);
+
+		// Culled and drawn on the GPU: the same single call whatever the instance count
+		_scene->SetDrawPath(gpuPath);
+		if (gpuPath != VulkanGpuDrawPath::Direct) {
+			const float64_t bestMs = recordBestOf();
+			Logger::Info("  GPU-driven | %8.3f ms | %9.0f draws/ms | %5.2fx | %s", bestMs, drawCount / bestMs, baselineMs / bestMs,
+				gpuPath == VulkanGpuDrawPath::IndirectCount ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect");
+		}
+		else {
+			Logger::Info("  GPU-driven | not supported by this device");
+		}
+
+		// Leave nothing recorded behind for the first real frame
+		VK_CHECK(vkResetCommandPool(_device, frame.CommandPool, 0));
+		_recorder->BeginFrame(0);
+		for (VulkanInstanceHandle instance : added) {
+			_scene->RemoveInstance(instance);
+		}
+	}
+
+	void VulkanRenderer::DrawFrame()
+	{
+		PROFILE_FUNCTION();
+		using Clock = std::chrono::steady_clock;
+
+		VulkanFrame& frame = _frames[_currentFrame];
+
+		// Only wait for the frame that used this slot N frames ago, not for the whole queue.
+		const auto waitStart = Clock::now();
+		{
+			PROFILE_SCOPE("WaitForFrameFence");
+			VK_CHECK(vkWaitForFences(_device, 1, &frame.InFlightFence, VK_TRUE, UINT64_MAX));
+		}
+
+		// Swapchain changes happen here, between frames, without waiting for the device
+		DestroyRetiredSwapchains(false);
+		if (_platform->ConsumeFramebufferResize()) {
+			_swapchainDirty = true;
+		}
+		if (_swapchainDirty && !RecreateSwapchain()) {
+			return;
+		}
+
+		uint32_t imageIndex = 0;
+		VkResult result = vkAcquireNextImageKHR(_device, _swapchain, UINT64_MAX, frame.ImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			// Nothing was acquired and the semaphore stays unsignaled, so the frame can simply be skipped
+			_swapchainDirty = true;
+			return;
+		}
+		ASSERT(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+		// A suboptimal image still has to be presented; the swapchain is replaced next frame
+		if (result == VK_SUBOPTIMAL_KHR) {
+			_swapchainDirty = true;
+		}
+
+		// The image may still be in use by an older frame if the swapchain returns images out of order.
+		if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE && _imagesInFlight[imageIndex] != frame.InFlightFence) {
+			VK_CHECK(vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX));
+		}
+		_imagesInFlight[imageIndex] = frame.InFlightFence;
+		const auto waitEnd = Clock::now();
+
+		_pipelineStates->BeginFrame(_frameStats.FrameNumber);
+		_memory->BeginFrame(_frameStats.FrameNumber);
+		_graph->BeginFrame(_frameStats.FrameNumber);
+		_bindless->BeginFrame(_frameStats.FrameNumber);
+		_recorder->BeginFrame(_currentFrame);
+		_scene->BeginFrame(_currentFrame);
+		_uploads->BeginFrame();
+		// Without feedback nothing reports which mips the demo texture needs; the budget still has the last word
+		if (_demoTexture != INVALID_TEXTURE && _textures->GetFeedbackBuffer() == UINT32_MAX) {
+			_textures->RequestMip(_demoTexture, 0);
+		}
+		_textures->BeginFrame(_frameStats.FrameNumber, _currentFrame);
+
+		VK_CHECK(vkResetFences(_device, 1, &frame.InFlightFence));
+
+		// Resetting the pool recycles the command buffer memory without freeing it.
+		VK_CHECK(vkResetCommandPool(_device, frame.CommandPool, 0));
+		RecordCommandBuffer(frame, imageIndex);
+
+		// Uploads recorded since the last frame go out ahead of the frame that may use them next time
+		_uploads->Flush();
+
+		// The binary semaphore ignores its value
+		VkSemaphore waitSemaphores[2] = { frame.ImageAvailableSemaphore, _uploads->GetSemaphore() };
+		VkPipelineStageFlags waitStages[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, frame.UploadWaitStages };
+		uint64_t waitValues[2] = { 0, frame.UploadWaitValue };
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+		timelineInfo.waitSemaphoreValueCount = 2;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.pNext = frame.UploadWaitValue != 0 ? &timelineInfo : nullptr;
+		submitInfo.waitSemaphoreCount = frame.UploadWaitValue != 0 ? 2 : 1;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frame.CommandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &frame.RenderFinishedSemaphore;
+		VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submitInfo, frame.InFlightFence));
+
+		VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &frame.RenderFinishedSemaphore;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &_swapchain;
+		presentInfo.pImageIndices = &imageIndex;
+		result = vkQueuePresentKHR(_presentationQueue, &presentInfo);
+		ASSERT(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR);
+		if (result != VK_SUCCESS) {
+			_swapchainDirty = true;
+		}
+
+		const auto presentEnd = Clock::now();
+
+		// Stats
+		_frameStats.FrameNumber++;
+		_frameStats.FenceWaitMs = std::chrono::duration<float64_t, std::milli>(waitEnd - waitStart).count();
+		_frameStats.RecordSubmitMs = std::chrono::duration<float64_t, std::milli>(presentEnd - waitEnd).count();
+		_frameStats.RecordedDraws = _recorder->GetStats().Items;
+		_frameStats.SecondaryCommandBuffers = _recorder->GetStats().SecondaryBuffers;
+		_frameStats.DrawRecordMs = _recorder->GetStats().RecordMs;
+		_frameStats.VisibleInstances = _scene->GetStats().VisibleInstances;
+		_frameStats.AverageFenceWaitMs = _frameStats.FrameNumber == 1
+			? _frameStats.FenceWaitMs
+			: _frameStats.AverageFenceWaitMs * 0.95 + _frameStats.FenceWaitMs * 0.05;
+
+		_currentFrame = (_currentFrame + 1) % _framesInFlight;
+	}
+
+}
\ No newline at end of file
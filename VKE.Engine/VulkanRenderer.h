@@ -3,59 +3,266 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 
+#include <glm/glm.hpp>
+
+#include "vke_types.h"
+#include "VulkanPipelineState.h"
+#include "VulkanRenderGraph.h"
+
+#ifndef VKE_DEFAULT_FRAMES_IN_FLIGHT
+#define VKE_DEFAULT_FRAMES_IN_FLIGHT 2
+#endif
+
 namespace VKE
 {
+	// The format and mode arrays live in the arena passed to QuerySwapchainSupport
 	struct VulkanSwapchainSupport
 	{
 		VkSurfaceCapabilitiesKHR Capabilities;
-		std::vector<VkSurfaceFormatKHR> Formats;
-		std::vector<VkPresentModeKHR> PresentationModes;
+		VkSurfaceFormatKHR* Formats;
+		uint32_t FormatCount;
+		VkPresentModeKHR* PresentationModes;
+		uint32_t PresentationModeCount;
+	};
+	
+	// How frames are handed to the presentation engine, from lowest latency to lowest power. Unsupported
+	// modes fall back towards Fifo, which every device has.
+	enum class VulkanPresentPolicy : uint32_t
+	{
+		// IMMEDIATE: no vsync, tears
+		LowLatency,
+		// MAILBOX: no tearing, newest image replaces the queued one
+		Mailbox,
+		// FIFO: vsync, the CPU waits for the display
+		Fifo,
+		// FIFO_RELAXED: vsync, but late frames are shown immediately and may tear
+		FifoRelaxed
+	};
+
+	// What a physical device offers, gathered once at startup. The renderer switches its faster paths on from here.
+	struct VulkanDeviceCapabilities
+	{
+		VkPhysicalDevice PhysicalDevice;
+		VkPhysicalDeviceProperties Properties;
+		uint8_t DeviceUUID[VK_UUID_SIZE];
+		// Largest device local heap, i.e. VRAM on discrete GPUs
+		VkDeviceSize DeviceLocalBytes;
+
+		// Queue topology
+		int32_t GraphicsQueueIndex;
+		int32_t PresentationQueueIndex;
+		int32_t TransferQueueIndex;
+		bool DedicatedTransferQueue;
+		bool AsyncCompute;
+
+		// Optional features
+		bool TimelineSemaphores;
+		bool DescriptorIndexing;
+		bool DrawIndirectCount;
+		bool DrawIndirectFirstInstance;
+		bool BufferDeviceAddress;
+		bool GraphicsPipelineLibrary;
+		bool MultiDrawIndirect;
+		bool MemoryBudget;
+		// Fragment shaders can write storage buffers, which texture streaming feedback needs
+		bool FragmentStoresAndAtomics;
+
+		bool MeetsRequirements;
+		uint64_t Score;
+	};
+
+	// A swapchain replaced by a recreation, with its image views. Destroyed once the last frame that could
+	// use it has retired.
+	struct VulkanRetiredSwapchain
+	{
+		VkSwapchainKHR Swapchain;
+		std::vector<VkImageView> ImageViews;
+		uint64_t FrameNumber;
+	};
+
+	// Everything the CPU needs to record and submit one frame while earlier frames are still on the GPU.
+	struct VulkanFrame
+	{
+		VkCommandPool CommandPool;
+		VkCommandBuffer CommandBuffer;
+		VkSemaphore ImageAvailableSemaphore;
+		VkSemaphore RenderFinishedSemaphore;
+		VkFence InFlightFence;
+		// Upload timeline value this frame's submit waits on, 0 for none
+		uint64_t UploadWaitValue;
+		VkPipelineStageFlags UploadWaitStages;
+	};
+
+	struct VulkanFrameStats
+	{
+		uint64_t FrameNumber;
+		// CPU time spent blocked on the frame fence (and the swapchain image fence) this frame.
+		// Consistently high values mean we are GPU-bound.
+		float64_t FenceWaitMs;
+		float64_t AverageFenceWaitMs;
+		// CPU time from the end of the fence wait to the present call.
+		float64_t RecordSubmitMs;
+		// Draws recorded on worker threads, and how long the main pass took to record
+		uint32_t RecordedDraws;
+		uint32_t SecondaryCommandBuffers;
+		float64_t DrawRecordMs;
+		// Instances that passed GPU culling, read back a few frames late. UINT32_MAX without GPU culling.
+		uint32_t VisibleInstances;
 	};
 	
 	class Platform;
+	class AssetArchive;
+	class AsyncIO;
+	class JobSystem;
+	class LinearArena;
+	class VulkanPipelineCache;
+	class VulkanMemoryAllocator;
+	class VulkanUploadQueue;
+	class VulkanBindlessHeap;
+	class VulkanCommandRecorder;
+	class VulkanShader;
+	class VulkanGpuScene;
+	class VulkanTextureStreamer;
 	
+	// SPIR-V for one shader stage. Owned code was allocated for us; otherwise it points into the asset archive.
+	struct VulkanShaderSource
+	{
+		const char* Code = nullptr;
+		uint64_t Size = 0;
+		bool Owned = false;
+	};
+
 	class VulkanRenderer
 	{
 	public:
-		VulkanRenderer(Platform* platform);
+		// deviceOverride forces a physical device by UUID or by (part of) its name; null picks the best scoring one.
+		VulkanRenderer(Platform* platform, AssetArchive* assets, AsyncIO* io, JobSystem* jobs,
+			uint32_t framesInFlight = VKE_DEFAULT_FRAMES_IN_FLIGHT, const char* deviceOverride = nullptr);
 		~VulkanRenderer();
 
+		void DrawFrame();
+
+		const VulkanFrameStats& GetFrameStats() const { return _frameStats; }
+		uint32_t GetFramesInFlight() const { return _framesInFlight; }
+		VulkanMemoryAllocator* GetMemoryAllocator() const { return _memory; }
+		VulkanUploadQueue* GetUploadQueue() const { return _uploads; }
+		VulkanBindlessHeap* GetBindless() const { return _bindless; }
+		VulkanGpuScene* GetScene() const { return _scene; }
+		VulkanTextureStreamer* GetTextures() const { return _textures; }
+		const VulkanDeviceCapabilities& GetCapabilities() const { return _capabilities; }
+
+		// Takes effect at the start of the next frame by recreating the swapchain. imageCount 0 uses one more
+		// than the surface minimum; other values are clamped to what the surface allows.
+		void SetPresentPolicy(VulkanPresentPolicy policy, uint32_t imageCount = 0);
+		VulkanPresentPolicy GetPresentPolicy() const { return _presentPolicy; }
+		VkPresentModeKHR GetPresentMode() const { return _presentMode; }
+
+		// The scene is drawn from this view, with a perspective projection that follows the swapchain's aspect ratio
+		void SetCamera(const glm::mat4& view, float32_t verticalFov, float32_t nearPlane, float32_t farPlane);
+
+		// Fills the scene up to drawCount instances, records the frame with one draw call per instance split into
+		// 1 to N secondary command buffers recorded in parallel, without submitting, and logs draws per
+		// millisecond for each chunk count. Then does the same
+		// with GPU culling and a single indirect draw, when the device supports it.
+		void BenchmarkRecording(uint32_t drawCount);
+
 	private:
-		VkPhysicalDevice SelectPhysicalDevice() const;
-		static bool PhysicalDeviceMeetsRequirements(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
-		static void DetectQueueFamilyIndices(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, int32_t* graphicsQueueIndex, int32_t* presentationQueueIndex);
-		static VulkanSwapchainSupport QuerySwapchainSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+		VulkanDeviceCapabilities SelectPhysicalDevice(const char* deviceOverride) const;
+		static VulkanDeviceCapabilities QueryDeviceCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+		static bool MatchesDeviceOverride(const VulkanDeviceCapabilities& capabilities, const char* deviceOverride);
+		// transferQueueIndex prefers a transfer-only family and falls back to the graphics family.
+		static void DetectQueueFamilyIndices(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, int32_t* graphicsQueueIndex,
+			int32_t* presentationQueueIndex, int32_t* transferQueueIndex);
+		static VulkanSwapchainSupport QuerySwapchainSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, LinearArena& arena);
 		void CreateLogicalDevice(std::vector<const char *> & requiredValidationLayers);
-		char* ReadShaderFile(const char* filename, const char* shaderType, uint64_t* fileSize) const;
-		void CreateShader(const char* name);
-		void CreateSwapchain();
+		static constexpr uint32_t MAX_SHADER_STAGES = 2;
+		// Owned sources are released with AsyncIO::FreeBuffer.
+		void ReadShaderSources(const char* name, VulkanShaderSource* sources, const char* const* shaderTypes, uint32_t stageCount) const;
+		void CreateShaderModules(const char* name, const char* const* shaderTypes, uint32_t stageCount, VkShaderModule* modules);
+		VulkanShader* CreateShader(const char* name);
+		VkPresentModeKHR ChoosePresentMode(const VkPresentModeKHR* available, uint32_t availableCount) const;
+		void CreateSwapchain(VkSwapchainKHR oldSwapchain);
+		// Builds a new swapchain from the old one without waiting for the device. Returns false while the
+		// window is minimized, in which case the old swapchain stays.
+		bool RecreateSwapchain();
+		void DestroyRetiredSwapchains(bool all);
 		void CreateSwapchainImagesAndViews();
-		void CreateRenderPass();
+		VkFormat SelectDepthFormat() const;
+		void CreateRenderGraph();
 		void CreateGraphicsPipeline();
+		// The GPU-driven scene, with a grid of cubes to look at until the game adds its own instances
+		void CreateScene();
+		void CreateFrames();
+		void DestroyFrames();
+		void RecordCommandBuffer(VulkanFrame& frame, uint32_t imageIndex);
+		static void RecordCullPass(VkCommandBuffer commandBuffer, void* userData);
+		static void RecordMainPass(VkCommandBuffer commandBuffer, void* userData);
+		static void RecordMainDraws(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end, void* userData);
 
 		Platform* _platform;
+		AssetArchive* _assets;
+		AsyncIO* _io;
+		JobSystem* _jobs;
 		
 		VkInstance _instance;
 		VkDebugUtilsMessengerEXT _debugMessenger;
 		VkPhysicalDevice _physicalDevice;
+		VulkanDeviceCapabilities _capabilities;
 		VkDevice _device;
 		VkSurfaceKHR _surface;
 		VkQueue _graphicsQueue;
 		int32_t _graphicsQueueIndex = -1;
 		VkQueue _presentationQueue;
 		int32_t _presentationQueueIndex = -1;
+		VkQueue _transferQueue;
+		int32_t _transferQueueIndex = -1;
 
-		uint64_t _shaderStageCount;
-		std::vector<VkPipelineShaderStageCreateInfo> _shaderStages;
+		VulkanShader* _mainShader;
 
 		VkSurfaceFormatKHR _swapchainImageFormat;
 		VkExtent2D _swapchainExtent;
 		VkSwapchainKHR _swapchain;
+		VulkanPresentPolicy _presentPolicy = VulkanPresentPolicy::Mailbox;
+		VkPresentModeKHR _presentMode;
+		uint32_t _requestedImageCount = 0;
+		bool _swapchainDirty = false;
+		std::vector<VulkanRetiredSwapchain> _retiredSwapchains;
 		std::vector<VkImage> _swapchainImages;
 		std::vector<VkImageView> _swapchainImageViews;
-		VkRenderPass _renderPass;
+		VkFormat _depthFormat;
+		VulkanRenderGraph* _graph;
+		VulkanGraphResource _backbuffer;
+		VulkanGraphPass _cullPass;
+		VulkanGraphPass _mainPass;
 		VkPipelineLayout _pipelineLayout;
-		VkPipeline _pipeline;
+		VulkanMemoryAllocator* _memory;
+		VulkanUploadQueue* _uploads;
+		VulkanBindlessHeap* _bindless;
+		VulkanPipelineCache* _pipelineCache;
+		VulkanPipelineStateCache* _pipelineStates;
+		VulkanPipelineDesc _mainPipelineDesc;
+		VulkanCommandRecorder* _recorder;
+		VulkanGpuScene* _scene;
+		VulkanTextureStreamer* _textures;
+		uint32_t _demoMesh;
+		// Streamed texture on the demo cubes. The streamer reads mips from _demoTexels until it is destroyed.
+		uint32_t _demoTexture;
+		std::vector<uint8_t> _demoTexels;
+		VkSampler _demoSampler;
+
+		// Camera
+		glm::mat4 _cameraView;
+		float32_t _cameraFov;
+		float32_t _cameraNear;
+		float32_t _cameraFar;
+
+		// Frames in flight
+		uint32_t _framesInFlight;
+		uint32_t _currentFrame = 0;
+		std::vector<VulkanFrame> _frames;
+		// Fence of the frame that last rendered to each swapchain image.
+		std::vector<VkFence> _imagesInFlight;
+		VulkanFrameStats _frameStats = {};
 	};
 }
 
@@ -0,0 +1,149 @@
+#include "VulkanShader.h"
+#include "VulkanRenderer.h"
+#include "Logger.h"
+#include "vke_hash.h"
+#include "vke_memory.h"
+
+#include <cstring>
+
+namespace VKE
+{
+	void ShaderConstantValues::SetBool(uint32_t index, bool value)
+	{
+		ASSERT_DEBUG(index < _count && _decls[index].Type == ShaderConstantType::Bool);
+		_values[index] = value ? VK_TRUE : VK_FALSE;
+	}
+
+	void ShaderConstantValues::SetInt(uint32_t index, int32_t value)
+	{
+		ASSERT_DEBUG(index < _count && _decls[index].Type == ShaderConstantType::Int);
+		memcpy(&_values[index], &value, sizeof(value));
+	}
+
+	void ShaderConstantValues::SetUInt(uint32_t index, uint32_t value)
+	{
+		ASSERT_DEBUG(index < _count && _decls[index].Type == ShaderConstantType::UInt);
+		_values[index] = value;
+	}
+
+	void ShaderConstantValues::SetFloat(uint32_t index, float32_t value)
+	{
+		ASSERT_DEBUG(index < _count && _decls[index].Type == ShaderConstantType::Float);
+		memcpy(&_values[index], &value, sizeof(value));
+	}
+
+	VulkanShader::VulkanShader(VkDevice device, const char* name, VkShaderModule vertexModule, VkShaderModule fragmentModule)
+		: _device(device), _name(name), _vertexModule(vertexModule), _fragmentModule(fragmentModule), _constantCount(0), _variantCount(0)
+	{
+	}
+
+	VulkanShader::~VulkanShader()
+	{
+		_variants.clear();
+		vkDestroyShaderModule(_device, _vertexModule, VK_ALLOCATOR);
+		vkDestroyShaderModule(_device, _fragmentModule, VK_ALLOCATOR);
+	}
+
+	uint32_t VulkanShader::DeclareConstant(const char* name, uint32_t constantId, ShaderConstantType type, uint32_t defaultValue)
+	{
+		ASSERT_MSG(_variantCount == 0, "Constants must be declared before variants are created");
+		if (_constantCount == ShaderConstantValues::MaxConstants) {
+			Logger::Fatal("Shader %s declares too many specialization constants", _name);
+		}
+
+		ShaderConstantDecl& decl = _constants[_constantCount];
+		decl.Name = name;
+		decl.ConstantId = constantId;
+		decl.Type = type;
+		decl.DefaultValue = defaultValue;
+		return _constantCount++;
+	}
+
+	uint32_t VulkanShader::DeclareBool(const char* name, uint32_t constantId, bool defaultValue)
+	{
+		return DeclareConstant(name, constantId, ShaderConstantType::Bool, defaultValue ? VK_TRUE : VK_FALSE);
+	}
+
+	uint32_t VulkanShader::DeclareInt(const char* name, uint32_t constantId, int32_t defaultValue)
+	{
+		uint32_t raw;
+		memcpy(&raw, &defaultValue, sizeof(raw));
+		return DeclareConstant(name, constantId, ShaderConstantType::Int, raw);
+	}
+
+	uint32_t VulkanShader::DeclareUInt(const char* name, uint32_t constantId, uint32_t defaultValue)
+	{
+		return DeclareConstant(name, constantId, ShaderConstantType::UInt, defaultValue);
+	}
+
+	uint32_t VulkanShader::DeclareFloat(const char* name, uint32_t constantId, float32_t defaultValue)
+	{
+		uint32_t raw;
+		memcpy(&raw, &defaultValue, sizeof(raw));
+		return DeclareConstant(name, constantId, ShaderConstantType::Float, raw);
+	}
+
+	uint32_t VulkanShader::FindConstant(const char* name) const
+	{
+		for (uint32_t i = 0; i < _constantCount; ++i) {
+			if (strcmp(_constants[i].Name, name) == 0) {
+				return i;
+			}
+		}
+		return UINT32_MAX;
+	}
+
+	ShaderConstantValues VulkanShader::GetDefaultValues() const
+	{
+		ShaderConstantValues values;
+		values._decls = _constants;
+		values._count = _constantCount;
+		for (uint32_t i = 0; i < _constantCount; ++i) {
+			values._values[i] = _constants[i].DefaultValue;
+		}
+		return values;
+	}
+
+	const VulkanShaderVariant* VulkanShader::GetVariant(const ShaderConstantValues& values)
+	{
+		ASSERT_MSG(values._decls == _constants, "Values were created by a different shader");
+
+		const uint64_t hash = HashBytes(values._values, sizeof(uint32_t) * _constantCount);
+
+		std::lock_guard<std::mutex> lock(_variantsMutex);
+		auto range = _variants.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (memcmp(it->second->_data, values._values, sizeof(uint32_t) * _constantCount) == 0) {
+				return it->second.get();
+			}
+		}
+
+		auto variant = std::make_unique<VulkanShaderVariant>();
+		variant->_hash = hash;
+		memcpy(variant->_data, values._values, sizeof(uint32_t) * _constantCount);
+
+		for (uint32_t i = 0; i < _constantCount; ++i) {
+			variant->_mapEntries[i].constantID = _constants[i].ConstantId;
+			variant->_mapEntries[i].offset = i * sizeof(uint32_t);
+			variant->_mapEntries[i].size = sizeof(uint32_t);
+		}
+
+		variant->_specializationInfo.mapEntryCount = _constantCount;
+		variant->_specializationInfo.pMapEntries = variant->_mapEntries;
+		variant->_specializationInfo.dataSize = sizeof(uint32_t) * _constantCount;
+		variant->_specializationInfo.pData = variant->_data;
+
+		// Both stages share one constant block; constant IDs a stage does not declare are ignored.
+		const VkSpecializationInfo* specialization = _constantCount > 0 ? &variant->_specializationInfo : nullptr;
+		variant->_stageCount = 2;
+		variant->_stages[0] = { VK_SHADER_STAGE_VERTEX_BIT, _vertexModule, specialization };
+		variant->_stages[1] = { VK_SHADER_STAGE_FRAGMENT_BIT, _fragmentModule, specialization };
+
+		const VulkanShaderVariant* result = variant.get();
+		_variants.emplace(hash, std::move(variant));
+		_variantCount++;
+
+		Logger::Trace("Created variant %llu of shader %s", (unsigned long long)_variantCount, _name);
+		return result;
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "vke_types.h"
+#include "VulkanPipelineState.h"
+
+namespace VKE
+{
+	enum class ShaderConstantType : uint8_t
+	{
+		Bool,
+		Int,
+		UInt,
+		Float
+	};
+
+	// A specialization constant a shader exposes (layout(constant_id = N) in GLSL).
+	struct ShaderConstantDecl
+	{
+		const char* Name;
+		uint32_t ConstantId;
+		ShaderConstantType Type;
+		uint32_t DefaultValue; // Raw 32-bit value
+	};
+
+	// One value per declared constant, stored raw in declaration order.
+	class ShaderConstantValues
+	{
+	public:
+		static constexpr uint32_t MaxConstants = 16;
+
+		void SetBool(uint32_t index, bool value);
+		void SetInt(uint32_t index, int32_t value);
+		void SetUInt(uint32_t index, uint32_t value);
+		void SetFloat(uint32_t index, float32_t value);
+
+		uint32_t GetCount() const { return _count; }
+		const uint32_t* GetData() const { return _values; }
+
+	private:
+		friend class VulkanShader;
+
+		const ShaderConstantDecl* _decls = nullptr;
+		uint32_t _count = 0;
+		uint32_t _values[MaxConstants] = {};
+	};
+
+	// A shader specialized with one set of constant values. Owned by its VulkanShader and stable
+	// for its lifetime, so pipelines can key on its address.
+	class VulkanShaderVariant
+	{
+	public:
+		uint32_t GetStageCount() const { return _stageCount; }
+		const VulkanShaderStageDesc* GetStages() const { return _stages; }
+		uint64_t GetHash() const { return _hash; }
+
+	private:
+		friend class VulkanShader;
+
+		uint64_t _hash;
+		uint32_t _data[ShaderConstantValues::MaxConstants];
+		VkSpecializationMapEntry _mapEntries[ShaderConstantValues::MaxConstants];
+		VkSpecializationInfo _specializationInfo;
+		uint32_t _stageCount;
+		VulkanShaderStageDesc _stages[VulkanPipelineDesc::MaxStages];
+	};
+
+	// A vertex/fragment program loaded once from SPIR-V. Variants are specialized at pipeline creation,
+	// giving compile-time fast paths without extra SPIR-V files or runtime branches.
+	class VulkanShader
+	{
+	public:
+		VulkanShader(VkDevice device, const char* name, VkShaderModule vertexModule, VkShaderModule fragmentModule);
+		~VulkanShader();
+
+		// Constants must be declared before the first variant is requested. Returns the constant's index.
+		uint32_t DeclareConstant(const char* name, uint32_t constantId, ShaderConstantType type, uint32_t defaultValue);
+		uint32_t DeclareBool(const char* name, uint32_t constantId, bool defaultValue);
+		uint32_t DeclareInt(const char* name, uint32_t constantId, int32_t defaultValue);
+		uint32_t DeclareUInt(const char* name, uint32_t constantId, uint32_t defaultValue);
+		uint32_t DeclareFloat(const char* name, uint32_t constantId, float32_t defaultValue);
+
+		// Returns UINT32_MAX if the shader has no constant with that name.
+		uint32_t FindConstant(const char* name) const;
+
+		// A value set initialised with every constant's default.
+		ShaderConstantValues GetDefaultValues() const;
+
+		// Returns the cached variant for the value set, creating it on first use.
+		const VulkanShaderVariant* GetVariant(const ShaderConstantValues& values);
+
+		const char* GetName() const { return _name; }
+		uint32_t GetVariantCount() const { return (uint32_t)_variantCount; }
+
+	private:
+		VkDevice _device;
+		const char* _name;
+		VkShaderModule _vertexModule;
+		VkShaderModule _fragmentModule;
+
+		uint32_t _constantCount;
+		ShaderConstantDecl _constants[ShaderConstantValues::MaxConstants];
+
+		std::mutex _variantsMutex;
+		std::unordered_multimap<uint64_t, std::unique_ptr<VulkanShaderVariant>> _variants;
+		uint64_t _variantCount;
+	};
+}
@@ -0,0 +1,627 @@
+#include "VulkanTextureStreamer.h"
+#include "VulkanRenderer.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanUploadQueue.h"
+#include "VulkanBindlessHeap.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace VKE
+{
+	static_assert(sizeof(VulkanStreamedTextureEntry) == 16, "VulkanStreamedTextureEntry must match its std430 layout in streaming.glsl");
+
+	// Feedback value of textures no pixel sampled
+	static constexpr uint32_t NO_FEEDBACK = UINT32_MAX;
+
+	VulkanTextureStreamer::VulkanTextureStreamer(VkDevice device, VulkanMemoryAllocator* memory, VulkanUploadQueue* uploads,
+		VulkanBindlessHeap* bindless, bool feedback, uint32_t framesInFlight)
+		: _device(device), _memory(memory), _uploads(uploads), _bindless(bindless), _framesInFlight(framesInFlight), _frameIndex(0),
+		_frameNumber(0), _heapIndex(0), _budgetLimit(0), _residentBytes(0), _pendingBytes(0), _stats()
+	{
+		PROFILE_FUNCTION();
+
+		// Images land in VRAM, the largest device local heap on discrete GPUs
+		VkDeviceSize heapSize = 0;
+		for (uint32_t i = 0; i < _memory->GetHeapCount(); i++) {
+			const VulkanHeapStats heap = _memory->GetHeapStats(i);
+			if (heap.DeviceLocal && heap.HeapSize > heapSize) {
+				heapSize = heap.HeapSize;
+				_heapIndex = i;
+			}
+		}
+
+		// The table, and the feedback shaders write with atomicMin
+		_table = CreateBuffer(VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(VulkanStreamedTextureEntry),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		_feedback = feedback
+			? CreateBuffer(VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+			: StreamingBuffer{ nullptr, UINT32_MAX };
+
+		// Per frame: staging for table entries, and where the feedback lands for the CPU. Coherent, so neither
+		// needs flushing or invalidating.
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(VulkanStreamedTextureEntry) * _framesInFlight;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		_staging = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::CpuToGpu);
+		bufferInfo.size = VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(uint32_t) * _framesInFlight;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		_readback = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::CpuToGpu);
+		if (!_staging || !_readback) {
+			Logger::Fatal("Unable to allocate the texture streamer's staging memory");
+		}
+		memset(_readback->MappedData, 0xFF, (size_t)bufferInfo.size);
+
+		// Mid grey, for textures whose first mips are still uploading
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = { 1, 1, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		_fallback.Allocation = _memory->CreateImage(imageInfo, VulkanMemoryUsage::GpuOnly);
+		if (!_fallback.Allocation) {
+			Logger::Fatal("Unable to allocate the fallback texture");
+		}
+
+		VkImageViewCreateInfo viewInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = _fallback.Allocation->Image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = imageInfo.format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VK_CHECK(vkCreateImageView(_device, &viewInfo, VK_ALLOCATOR, &_fallback.View));
+
+		const uint8_t grey[4] = { 128, 128, 128, 255 };
+		VkBufferImageCopy region = {};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { 1, 1, 1 };
+		const VulkanUploadTicket ticket = _uploads->UploadImage(_fallback.Allocation->Image, viewInfo.subresourceRange, &region, 1, grey,
+			sizeof(grey), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		// Table entries point at it from the moment a texture is added, so it has to be there before the first frame
+		_uploads->Wait(ticket);
+		_fallback.Index = _bindless->AddImage(_fallback.View);
+		_fallback.Mip = 0;
+
+		_textures.reserve(VKE_TEXTURE_STREAMING_MAX_TEXTURES);
+		_order.reserve(VKE_TEXTURE_STREAMING_MAX_TEXTURES);
+		_queue.reserve(VKE_TEXTURE_STREAMING_MAX_TEXTURES);
+		_dirtyFlags.assign(VKE_TEXTURE_STREAMING_MAX_TEXTURES, false);
+
+		Logger::Info("Texture streaming: %u textures in heap %u, GPU feedback %s", VKE_TEXTURE_STREAMING_MAX_TEXTURES, _heapIndex,
+			feedback ? "enabled" : "not supported, CPU requests only");
+	}
+
+	VulkanTextureStreamer::~VulkanTextureStreamer()
+	{
+		// The device is idle, so nothing has to wait for frames or uploads
+		for (auto& texture : _textures) {
+			if (texture.Active) {
+				Retire(texture.Current, 0);
+				Retire(texture.Pending, 0);
+			}
+		}
+		Retire(_fallback, 0);
+		for (auto& retired : _retired) {
+			vkDestroyImageView(_device, retired.Image.View, VK_ALLOCATOR);
+			_memory->Destroy(retired.Image.Allocation);
+		}
+
+		_memory->Destroy(_readback);
+		_memory->Destroy(_staging);
+		DestroyBuffer(_feedback);
+		DestroyBuffer(_table);
+	}
+
+	VulkanTextureStreamer::StreamingBuffer VulkanTextureStreamer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+	{
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		StreamingBuffer buffer;
+		buffer.Allocation = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::GpuOnly);
+		if (!buffer.Allocation) {
+			Logger::Fatal("Unable to allocate %llu bytes for texture streaming", (unsigned long long)size);
+		}
+		buffer.Index = _bindless->AddBuffer(buffer.Allocation->Buffer);
+		return buffer;
+	}
+
+	void VulkanTextureStreamer::DestroyBuffer(StreamingBuffer& buffer)
+	{
+		if (!buffer.Allocation) {
+			return;
+		}
+		_bindless->Remove(VulkanBindlessType::StorageBuffer, buffer.Index);
+		_memory->Destroy(buffer.Allocation);
+		buffer = { nullptr, UINT32_MAX };
+	}
+
+	VulkanTextureHandle VulkanTextureStreamer::AddTexture(const VulkanStreamedTextureDesc& desc)
+	{
+		PROFILE_FUNCTION();
+		if (desc.Width == 0 || desc.Height == 0 || desc.MipCount == 0 || desc.MipCount > VKE_TEXTURE_STREAMING_MAX_MIPS ||
+			!desc.MipData || !desc.MipSizes) {
+			Logger::Error("Invalid streamed texture (%ux%u, %u mips)", desc.Width, desc.Height, desc.MipCount);
+			return INVALID_TEXTURE;
+		}
+
+		// Each mip is uploaded on its own, so the finest one that fits the staging ring bounds the detail
+		uint32_t finestMip = 0;
+		while (finestMip < desc.MipCount && desc.MipSizes[finestMip] > _uploads->GetStagingSize()) {
+			finestMip++;
+		}
+		if (finestMip == desc.MipCount) {
+			Logger::Error("No mip of a %ux%u texture fits the upload staging ring", desc.Width, desc.Height);
+			return INVALID_TEXTURE;
+		}
+		if (finestMip > 0) {
+			Logger::Warn("Mips finer than %u of a %ux%u texture don't fit the upload staging ring and will never stream in",
+				finestMip, desc.Width, desc.Height);
+		}
+
+		VulkanTextureHandle handle;
+		if (!_freeTextures.empty()) {
+			handle = _freeTextures.back();
+			_freeTextures.pop_back();
+		}
+		else if (_textures.size() < VKE_TEXTURE_STREAMING_MAX_TEXTURES) {
+			handle = (VulkanTextureHandle)_textures.size();
+			_textures.emplace_back();
+		}
+		else {
+			Logger::Error("Texture streaming table is full, %ux%u texture not added", desc.Width, desc.Height);
+			return INVALID_TEXTURE;
+		}
+
+		TextureRecord& texture = _textures[handle];
+		texture = {};
+		texture.Format = desc.Format;
+		texture.Width = desc.Width;
+		texture.Height = desc.Height;
+		texture.MipCount = desc.MipCount;
+		texture.FinestMip = finestMip;
+
+		// The minimum mips: everything up to VKE_TEXTURE_STREAMING_MIN_RESIDENT_SIZE on the longer side
+		texture.MinResidentMip = finestMip;
+		while (texture.MinResidentMip + 1 < desc.MipCount &&
+			std::max(desc.Width >> texture.MinResidentMip, desc.Height >> texture.MinResidentMip) > VKE_TEXTURE_STREAMING_MIN_RESIDENT_SIZE) {
+			texture.MinResidentMip++;
+		}
+
+		VkDeviceSize chainBytes = 0;
+		for (uint32_t mip = desc.MipCount; mip-- > 0;) {
+			texture.MipData[mip] = desc.MipData[mip];
+			chainBytes += desc.MipSizes[mip];
+			texture.ChainBytes[mip] = chainBytes;
+		}
+
+		texture.Entry.Image = _fallback.Index;
+		texture.Entry.ResidentMip = desc.MipCount - 1;
+		texture.Entry.Width = (float32_t)desc.Width;
+		texture.Entry.Height = (float32_t)desc.Height;
+		texture.Current = { nullptr, VK_NULL_HANDLE, UINT32_MAX, desc.MipCount };
+		texture.Pending = { nullptr, VK_NULL_HANDLE, UINT32_MAX, desc.MipCount };
+		texture.WantedMip = texture.MinResidentMip;
+		texture.RequestedMip = UINT32_MAX;
+		texture.TargetMip = texture.MinResidentMip;
+		texture.LastUsedFrame = _frameNumber;
+		texture.EvictedMip = UINT32_MAX;
+		texture.Active = true;
+		MarkDirty(handle);
+		_stats.TextureCount++;
+
+		// Nothing to show until this arrives; a failed allocation is retried like any other stream-in
+		StartReplacement(handle, texture.MinResidentMip);
+		return handle;
+	}
+
+	void VulkanTextureStreamer::RemoveTexture(VulkanTextureHandle texture)
+	{
+		ASSERT_MSG(texture < _textures.size() && _textures[texture].Active, "Invalid texture handle");
+		TextureRecord& record = _textures[texture];
+		if (record.Current.Allocation) {
+			_residentBytes -= record.Current.Allocation->Size;
+			Retire(record.Current, 0);
+		}
+		if (record.Pending.Allocation) {
+			_pendingBytes -= record.Pending.Allocation->Size;
+			Retire(record.Pending, record.PendingTicket);
+		}
+		record.Active = false;
+		_freeTextures.push_back(texture);
+		_stats.TextureCount--;
+	}
+
+	void VulkanTextureStreamer::RequestMip(VulkanTextureHandle texture, uint32_t mip)
+	{
+		ASSERT_MSG(texture < _textures.size() && _textures[texture].Active, "Invalid texture handle");
+		_textures[texture].RequestedMip = std::min(_textures[texture].RequestedMip, mip);
+	}
+
+	void VulkanTextureStreamer::BeginFrame(uint64_t frameNumber, uint32_t frameIndex)
+	{
+		PROFILE_FUNCTION();
+		_frameNumber = frameNumber;
+		_frameIndex = frameIndex;
+		_stats.FrameUploadBytes = 0;
+
+		// Replaced images, once their uploads are done and the frames that could sample them have retired. An
+		// image whose upload is still running is acquired by the frame that first sees it complete, at the
+		// earliest the next one, so the wait starts over from there.
+		for (size_t i = 0; i < _retired.size();) {
+			RetiredImage& retired = _retired[i];
+			if (!_uploads->IsComplete(retired.Ticket)) {
+				retired.FrameNumber = frameNumber + 1;
+			}
+			if (frameNumber < retired.FrameNumber + _framesInFlight) {
+				i++;
+				continue;
+			}
+			vkDestroyImageView(_device, retired.Image.View, VK_ALLOCATOR);
+			_memory->Destroy(retired.Image.Allocation);
+			_retired[i] = _retired.back();
+			_retired.pop_back();
+		}
+
+		// Written by the last frame that used this index, whose fence has been waited on
+		const uint32_t* feedback = _feedback.Allocation
+			? (const uint32_t*)_readback->MappedData + (size_t)frameIndex * VKE_TEXTURE_STREAMING_MAX_TEXTURES : nullptr;
+		for (VulkanTextureHandle handle = 0; handle < _textures.size(); handle++) {
+			TextureRecord& texture = _textures[handle];
+			if (!texture.Active) {
+				continue;
+			}
+			const uint32_t requested = feedback ? std::min(texture.RequestedMip, feedback[handle]) : texture.RequestedMip;
+			if (requested != NO_FEEDBACK) {
+				texture.WantedMip = std::min(std::max(requested, texture.FinestMip), texture.MinResidentMip);
+				texture.LastUsedFrame = frameNumber;
+			}
+			else if (frameNumber > texture.LastUsedFrame + VKE_TEXTURE_STREAMING_IDLE_FRAMES) {
+				texture.WantedMip = texture.MinResidentMip;
+			}
+			texture.RequestedMip = UINT32_MAX;
+		}
+
+		const VkDeviceSize budget = ComputeBudget();
+		PlanTargets(budget);
+
+		// Planned from mip data sizes, so alignment padding doesn't make the plan wobble from frame to frame.
+		// Both images count while a replacement is in flight.
+		VkDeviceSize committed = 0;
+		for (const auto& texture : _textures) {
+			if (texture.Active) {
+				committed += (texture.Current.Allocation ? texture.ChainBytes[texture.Current.Mip] : 0) +
+					(texture.Pending.Allocation ? texture.ChainBytes[texture.Pending.Mip] : 0);
+			}
+		}
+
+		// Over budget: least recently used textures give up mips first, down to their target
+		if (committed > budget) {
+			_order.clear();
+			for (VulkanTextureHandle handle = 0; handle < _textures.size(); handle++) {
+				const TextureRecord& texture = _textures[handle];
+				if (texture.Active && texture.Current.Allocation && !texture.Pending.Allocation && texture.Current.Mip < texture.TargetMip) {
+					_order.push_back(handle);
+				}
+			}
+			std::sort(_order.begin(), _order.end(), [this](VulkanTextureHandle a, VulkanTextureHandle b) {
+				return _textures[a].LastUsedFrame < _textures[b].LastUsedFrame;
+			});
+			for (VulkanTextureHandle handle : _order) {
+				if (committed <= budget) {
+					break;
+				}
+				TextureRecord& texture = _textures[handle];
+				const uint32_t residentMip = texture.Current.Mip;
+				if (StartReplacement(handle, texture.TargetMip)) {
+					// Counted at the final size; the larger image goes as soon as the smaller one has arrived
+					committed -= texture.ChainBytes[residentMip] - texture.ChainBytes[texture.TargetMip];
+					_stats.EvictedMips += texture.TargetMip - residentMip;
+					texture.EvictedMip = residentMip;
+					texture.EvictedFrame = frameNumber;
+				}
+			}
+		}
+
+		// Stream in, most missing mips first, then most recently used
+		_order.clear();
+		for (VulkanTextureHandle handle = 0; handle < _textures.size(); handle++) {
+			const TextureRecord& texture = _textures[handle];
+			if (texture.Active && !texture.Pending.Allocation && texture.TargetMip < texture.Current.Mip) {
+				_order.push_back(handle);
+			}
+		}
+		std::sort(_order.begin(), _order.end(), [this](VulkanTextureHandle a, VulkanTextureHandle b) {
+			const TextureRecord& first = _textures[a];
+			const TextureRecord& second = _textures[b];
+			const uint32_t firstMissing = first.Current.Mip - first.TargetMip;
+			const uint32_t secondMissing = second.Current.Mip - second.TargetMip;
+			return firstMissing != secondMissing ? firstMissing > secondMissing : first.LastUsedFrame > second.LastUsedFrame;
+		});
+		for (VulkanTextureHandle handle : _order) {
+			TextureRecord& texture = _textures[handle];
+			const uint32_t residentMip = texture.Current.Mip;
+			const VkDeviceSize residentBytes = texture.Current.Allocation ? texture.ChainBytes[residentMip] : 0;
+			const VkDeviceSize growth = texture.ChainBytes[texture.TargetMip] - residentBytes;
+			if (committed + growth > budget) {
+				continue;
+			}
+			if (_stats.FrameUploadBytes > 0 && _stats.FrameUploadBytes + texture.ChainBytes[texture.TargetMip] > VKE_TEXTURE_STREAMING_UPLOAD_BYTES) {
+				break;
+			}
+			if (!StartReplacement(handle, texture.TargetMip)) {
+				continue;
+			}
+			committed += growth;
+			if (texture.Current.Allocation) {
+				_stats.StreamedMips += residentMip - texture.TargetMip;
+			}
+
+			// Mips evicted only a moment ago coming straight back
+			if (texture.EvictedMip != UINT32_MAX && frameNumber <= texture.EvictedFrame + VKE_TEXTURE_STREAMING_THRASH_FRAMES) {
+				const uint32_t reloaded = std::max(texture.TargetMip, texture.EvictedMip);
+				if (residentMip > reloaded) {
+					_stats.Thrash += residentMip - reloaded;
+				}
+				texture.EvictedMip = UINT32_MAX;
+			}
+		}
+
+		_stats.ResidentBytes = _residentBytes;
+		_stats.PendingBytes = _pendingBytes;
+		_stats.BudgetBytes = budget;
+	}
+
+	VkDeviceSize VulkanTextureStreamer::ComputeBudget() const
+	{
+		// Whatever the heap budget leaves after everyone else, which includes images we have retired but not
+		// yet destroyed
+		const VulkanHeapStats heap = _memory->GetHeapStats(_heapIndex);
+		const VkDeviceSize textureBytes = _residentBytes + _pendingBytes;
+		const VkDeviceSize otherBytes = heap.Usage > textureBytes ? heap.Usage - textureBytes : 0;
+		VkDeviceSize budget = heap.Budget > otherBytes ? (VkDeviceSize)((heap.Budget - otherBytes) * VKE_TEXTURE_STREAMING_BUDGET_SHARE) : 0;
+		if (_budgetLimit > 0 && _budgetLimit < budget) {
+			budget = _budgetLimit;
+		}
+		return budget;
+	}
+
+	void VulkanTextureStreamer::PlanTargets(VkDeviceSize budget)
+	{
+		// Everyone keeps their minimum mips. The rest of the budget goes one mip at a time to the texture
+		// missing the most levels of what it wants, so detail rises evenly instead of a few textures taking
+		// everything, and recently used textures win ties.
+		VkDeviceSize planned = 0;
+		_queue.clear();
+		for (VulkanTextureHandle handle = 0; handle < _textures.size(); handle++) {
+			TextureRecord& texture = _textures[handle];
+			if (!texture.Active) {
+				continue;
+			}
+			texture.TargetMip = texture.MinResidentMip;
+			planned += texture.ChainBytes[texture.MinResidentMip];
+			if (texture.WantedMip < texture.TargetMip) {
+				_queue.push_back(handle);
+			}
+		}
+
+		auto lessUrgent = [this](VulkanTextureHandle a, VulkanTextureHandle b) {
+			const TextureRecord& first = _textures[a];
+			const TextureRecord& second = _textures[b];
+			const uint32_t firstMissing = first.TargetMip - first.WantedMip;
+			const uint32_t secondMissing = second.TargetMip - second.WantedMip;
+			return firstMissing != secondMissing ? firstMissing < secondMissing : first.LastUsedFrame < second.LastUsedFrame;
+		};
+		std::make_heap(_queue.begin(), _queue.end(), lessUrgent);
+		while (!_queue.empty()) {
+			std::pop_heap(_queue.begin(), _queue.end(), lessUrgent);
+			TextureRecord& texture = _textures[_queue.back()];
+			const VkDeviceSize cost = texture.ChainBytes[texture.TargetMip - 1] - texture.ChainBytes[texture.TargetMip];
+			if (planned + cost > budget) {
+				// Smaller mips of other textures may still fit
+				_queue.pop_back();
+				continue;
+			}
+			planned += cost;
+			texture.TargetMip--;
+			if (texture.TargetMip > texture.WantedMip) {
+				std::push_heap(_queue.begin(), _queue.end(), lessUrgent);
+			}
+			else {
+				_queue.pop_back();
+			}
+		}
+	}
+
+	bool VulkanTextureStreamer::StartReplacement(VulkanTextureHandle handle, uint32_t mip)
+	{
+		PROFILE_FUNCTION();
+		TextureRecord& texture = _textures[handle];
+		const uint32_t width = std::max(texture.Width >> mip, 1u);
+		const uint32_t height = std::max(texture.Height >> mip, 1u);
+
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = texture.Format;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = texture.MipCount - mip;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		StreamedImage image = {};
+		image.Allocation = _memory->CreateImage(imageInfo, VulkanMemoryUsage::GpuOnly);
+		image.Mip = mip;
+		if (!image.Allocation) {
+			_stats.FailedAllocations++;
+			return false;
+		}
+
+		VkImageViewCreateInfo viewInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = image.Allocation->Image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = texture.Format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, imageInfo.mipLevels, 0, 1 };
+		VK_CHECK(vkCreateImageView(_device, &viewInfo, VK_ALLOCATOR, &image.View));
+		image.Index = UINT32_MAX;
+
+		// One upload per level, so no single copy has to hold the whole chain. Evictions upload the coarser
+		// mips again rather than copying them over on the graphics queue; they are a third of the size at most.
+		VulkanUploadTicket ticket = 0;
+		for (uint32_t level = 0; level < imageInfo.mipLevels; level++) {
+			const uint32_t source = mip + level;
+			const VkDeviceSize size = texture.ChainBytes[source] - (source + 1 < texture.MipCount ? texture.ChainBytes[source + 1] : 0);
+			const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			VkBufferImageCopy region = {};
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			region.imageExtent = { std::max(width >> level, 1u), std::max(height >> level, 1u), 1 };
+			const VulkanUploadTicket levelTicket = _uploads->UploadImage(image.Allocation->Image, range, &region, 1, texture.MipData[source], size,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			if (levelTicket == 0) {
+				Retire(image, ticket);
+				return false;
+			}
+			ticket = levelTicket;
+		}
+
+		// Written now, read only once the table points at it
+		image.Index = _bindless->AddImage(image.View);
+		if (image.Index == UINT32_MAX) {
+			Retire(image, ticket);
+			return false;
+		}
+
+		texture.Pending = image;
+		texture.PendingTicket = ticket;
+		_pendingBytes += image.Allocation->Size;
+		_stats.FrameUploadBytes += texture.ChainBytes[mip];
+		return true;
+	}
+
+	void VulkanTextureStreamer::Retire(const StreamedImage& image, uint64_t ticket)
+	{
+		if (!image.Allocation) {
+			return;
+		}
+		// Frames in flight may still sample through the slot, so it goes back to the heap on the same schedule
+		if (image.Index != UINT32_MAX) {
+			_bindless->Remove(VulkanBindlessType::SampledImage, image.Index);
+		}
+		_retired.push_back({ image, ticket, _frameNumber });
+		_retired.back().Image.Index = UINT32_MAX;
+	}
+
+	void VulkanTextureStreamer::MarkDirty(VulkanTextureHandle texture)
+	{
+		if (!_dirtyFlags[texture]) {
+			_dirtyFlags[texture] = true;
+			_dirty.push_back(texture);
+		}
+	}
+
+	void VulkanTextureStreamer::RecordUpdates(VkCommandBuffer commandBuffer)
+	{
+		PROFILE_FUNCTION();
+
+		// Replacements join the table once they have arrived. The upload queue's acquire for them was recorded
+		// earlier in this command buffer, since batches are handed over as soon as they complete.
+		for (VulkanTextureHandle handle = 0; handle < _textures.size(); handle++) {
+			TextureRecord& texture = _textures[handle];
+			if (!texture.Active || !texture.Pending.Allocation || !_uploads->IsComplete(texture.PendingTicket)) {
+				continue;
+			}
+			if (texture.Current.Allocation) {
+				_residentBytes -= texture.Current.Allocation->Size;
+				Retire(texture.Current, 0);
+			}
+			texture.Current = texture.Pending;
+			texture.Pending = { nullptr, VK_NULL_HANDLE, UINT32_MAX, texture.MipCount };
+			_pendingBytes -= texture.Current.Allocation->Size;
+			_residentBytes += texture.Current.Allocation->Size;
+
+			texture.Entry.Image = texture.Current.Index;
+			texture.Entry.ResidentMip = texture.Current.Mip;
+			MarkDirty(handle);
+		}
+		_stats.ResidentBytes = _residentBytes;
+		_stats.PendingBytes = _pendingBytes;
+
+		// Changed entries in slot order, so neighbours merge into one copy region
+		std::sort(_dirty.begin(), _dirty.end());
+		uint8_t* staging = (uint8_t*)_staging->MappedData + (size_t)_frameIndex * VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(VulkanStreamedTextureEntry);
+		const VkDeviceSize stagingBase = (VkDeviceSize)_frameIndex * VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(VulkanStreamedTextureEntry);
+		_tableCopies.clear();
+		for (size_t i = 0; i < _dirty.size(); i++) {
+			const VulkanTextureHandle texture = _dirty[i];
+			memcpy(staging + i * sizeof(VulkanStreamedTextureEntry), &_textures[texture].Entry, sizeof(VulkanStreamedTextureEntry));
+			_dirtyFlags[texture] = false;
+			if (i > 0 && _dirty[i - 1] + 1 == texture) {
+				_tableCopies.back().size += sizeof(VulkanStreamedTextureEntry);
+				continue;
+			}
+			_tableCopies.push_back({ stagingBase + i * sizeof(VulkanStreamedTextureEntry), texture * sizeof(VulkanStreamedTextureEntry),
+				sizeof(VulkanStreamedTextureEntry) });
+		}
+		_dirty.clear();
+
+		// Only the slots in use are cleared; without textures nothing reads or writes the feedback
+		const bool clearFeedback = _feedback.Allocation && _stats.TextureCount > 0;
+		if (_tableCopies.empty() && !clearFeedback) {
+			return;
+		}
+
+		// Earlier frames on this queue may still be sampling through the table, writing feedback with atomicMin
+		// and copying it out, and the last table copy has to land before this one
+		VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+		if (!_tableCopies.empty()) {
+			vkCmdCopyBuffer(commandBuffer, _staging->Buffer, _table.Allocation->Buffer, (uint32_t)_tableCopies.size(), _tableCopies.data());
+		}
+		if (clearFeedback) {
+			vkCmdFillBuffer(commandBuffer, _feedback.Allocation->Buffer, 0, _textures.size() * sizeof(uint32_t), NO_FEEDBACK);
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier,
+			0, nullptr, 0, nullptr);
+	}
+
+	void VulkanTextureStreamer::RecordFeedback(VkCommandBuffer commandBuffer)
+	{
+		if (!_feedback.Allocation || _stats.TextureCount == 0) {
+			return;
+		}
+
+		PROFILE_FUNCTION();
+		VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+			0, nullptr, 0, nullptr);
+
+		const VkBufferCopy copy = { 0, (VkDeviceSize)_frameIndex * VKE_TEXTURE_STREAMING_MAX_TEXTURES * sizeof(uint32_t),
+			_textures.size() * sizeof(uint32_t) };
+		vkCmdCopyBuffer(commandBuffer, _feedback.Allocation->Buffer, _readback->Buffer, 1, &copy);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "vke_types.h"
+
+// Table slots; the table, feedback and readback buffers are sized for this many up front
+#ifndef VKE_TEXTURE_STREAMING_MAX_TEXTURES
+#define VKE_TEXTURE_STREAMING_MAX_TEXTURES 4096
+#endif
+
+// 16 levels covers 32768 x 32768
+#define VKE_TEXTURE_STREAMING_MAX_MIPS 16
+
+// Textures start out with their mips up to this size resident, and are never evicted below them
+#ifndef VKE_TEXTURE_STREAMING_MIN_RESIDENT_SIZE
+#define VKE_TEXTURE_STREAMING_MIN_RESIDENT_SIZE 64
+#endif
+
+// Share of what the device local heap budget leaves after everything else that textures may fill. The rest
+// absorbs replacement images in flight and growth elsewhere between two frames.
+#ifndef VKE_TEXTURE_STREAMING_BUDGET_SHARE
+#define VKE_TEXTURE_STREAMING_BUDGET_SHARE 0.9
+#endif
+
+// Mip data started per frame. One replacement is always allowed, so mips larger than this still arrive.
+#ifndef VKE_TEXTURE_STREAMING_UPLOAD_BYTES
+#define VKE_TEXTURE_STREAMING_UPLOAD_BYTES (16ull * 1024 * 1024)
+#endif
+
+// Frames without feedback or requests after which a texture only wants its minimum mips
+#ifndef VKE_TEXTURE_STREAMING_IDLE_FRAMES
+#define VKE_TEXTURE_STREAMING_IDLE_FRAMES 120
+#endif
+
+// Mips streamed back in this many frames after their eviction count as thrash
+#ifndef VKE_TEXTURE_STREAMING_THRASH_FRAMES
+#define VKE_TEXTURE_STREAMING_THRASH_FRAMES 60
+#endif
+
+namespace VKE
+{
+	class VulkanMemoryAllocator;
+	class VulkanUploadQueue;
+	class VulkanBindlessHeap;
+	struct VulkanAllocation;
+
+	// Slot in the streaming table, which shaders index (see streaming.glsl)
+	typedef uint32_t VulkanTextureHandle;
+	constexpr VulkanTextureHandle INVALID_TEXTURE = UINT32_MAX;
+
+	struct VulkanStreamedTextureDesc
+	{
+		VkFormat Format;
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t MipCount;
+		// Tightly packed data of each mip, finest first. Has to stay valid until the texture is removed, so it
+		// normally points into a mapped asset archive.
+		const void* const* MipData;
+		const VkDeviceSize* MipSizes;
+	};
+
+	// Matches StreamedTexture in streaming.glsl
+	struct VulkanStreamedTextureEntry
+	{
+		// Bindless image holding mips ResidentMip and coarser
+		uint32_t Image;
+		uint32_t ResidentMip;
+		// Size of mip 0, for the LOD the feedback reports
+		float32_t Width;
+		float32_t Height;
+	};
+
+	struct VulkanTextureStreamingStats
+	{
+		uint32_t TextureCount;
+		// Device memory of the images shaders read, and of replacements still uploading
+		VkDeviceSize ResidentBytes;
+		VkDeviceSize PendingBytes;
+		// What textures may use this frame, from the heap budget and SetBudgetLimit
+		VkDeviceSize BudgetBytes;
+		// Mip data started this frame
+		VkDeviceSize FrameUploadBytes;
+		// Totals since startup
+		uint64_t StreamedMips;
+		uint64_t EvictedMips;
+		// Mips streamed back in within VKE_TEXTURE_STREAMING_THRASH_FRAMES of their eviction. Steady growth
+		// means the budget is too small for what the camera sees.
+		uint64_t Thrash;
+		uint64_t FailedAllocations;
+	};
+
+	// Keeps each texture's mips resident as far as the device local memory budget allows. Textures start with
+	// their small mips only; shaders report the finest mip they would sample through a feedback buffer, the
+	// CPU can add its own requests, and every frame the streamer decides which textures get finer mips and
+	// which give theirs up, finest wants first and least recently used evicted first.
+	//
+	// Without sparse residency, mips that aren't resident would still cost memory in a full image, so each
+	// texture's image holds just its resident mips and is replaced when they change: the new image is
+	// uploaded through the upload queue, gets its own bindless slot, and takes over in the streaming table
+	// once it has arrived. Shaders go through the table, so no descriptor is ever rewritten while in use.
+	//
+	// Use from the render thread.
+	class VulkanTextureStreamer
+	{
+	public:
+		// feedback: the device has fragmentStoresAndAtomics, so fragment shaders can write the feedback buffer
+		VulkanTextureStreamer(VkDevice device, VulkanMemoryAllocator* memory, VulkanUploadQueue* uploads, VulkanBindlessHeap* bindless,
+			bool feedback, uint32_t framesInFlight);
+		~VulkanTextureStreamer();
+
+		// Uploads the minimum mips; until they arrive, shaders sample a grey 1x1 image. Returns INVALID_TEXTURE
+		// when the table is full or the description is invalid.
+		VulkanTextureHandle AddTexture(const VulkanStreamedTextureDesc& desc);
+		// The source data can be released once the call returns
+		void RemoveTexture(VulkanTextureHandle texture);
+
+		// Finest mip the CPU expects to need this frame, e.g. from distance and screen size. Merged with the
+		// GPU feedback; call before BeginFrame.
+		void RequestMip(VulkanTextureHandle texture, uint32_t mip);
+		// Caps the texture budget below what the heap allows. 0 removes the cap.
+		void SetBudgetLimit(VkDeviceSize bytes) { _budgetLimit = bytes; }
+
+		// Call once per frame after the frame's fence wait and the upload queue's BeginFrame. Reads the
+		// feedback of the last frame that used this index, then evicts and starts uploads.
+		void BeginFrame(uint64_t frameNumber, uint32_t frameIndex);
+		// Switches textures whose replacement has arrived, copies the changed table entries and clears the
+		// feedback. Record outside a render pass, after the upload queue's acquires and before any pass
+		// samples streamed textures.
+		void RecordUpdates(VkCommandBuffer commandBuffer);
+		// Copies the feedback for the CPU. Record after the last pass that samples streamed textures.
+		void RecordFeedback(VkCommandBuffer commandBuffer);
+
+		// Bindless buffer slots shaders get through push constants. The feedback buffer is UINT32_MAX without
+		// feedback support.
+		uint32_t GetTableBuffer() const { return _table.Index; }
+		uint32_t GetFeedbackBuffer() const { return _feedback.Index; }
+		uint32_t GetResidentMip(VulkanTextureHandle texture) const { return _textures[texture].Entry.ResidentMip; }
+		const VulkanTextureStreamingStats& GetStats() const { return _stats; }
+
+		VulkanTextureStreamer(const VulkanTextureStreamer&) = delete;
+		VulkanTextureStreamer& operator=(const VulkanTextureStreamer&) = delete;
+
+	private:
+		// An image holding a texture's mips from some level down
+		struct StreamedImage
+		{
+			VulkanAllocation* Allocation;
+			VkImageView View;
+			uint32_t Index;
+			uint32_t Mip;
+		};
+
+		struct TextureRecord
+		{
+			VkFormat Format;
+			uint32_t Width;
+			uint32_t Height;
+			uint32_t MipCount;
+			// Never evicted below this
+			uint32_t MinResidentMip;
+			// Finest mip that fits the staging ring in one upload
+			uint32_t FinestMip;
+			const void* MipData[VKE_TEXTURE_STREAMING_MAX_MIPS];
+			// Bytes of mip i and everything coarser, the planning size of an image starting at mip i
+			VkDeviceSize ChainBytes[VKE_TEXTURE_STREAMING_MAX_MIPS];
+
+			VulkanStreamedTextureEntry Entry;
+			// Image the table points at. Allocation is null until the first one arrives.
+			StreamedImage Current;
+			// Replacement still uploading, Allocation null when there is none
+			StreamedImage Pending;
+			uint64_t PendingTicket;
+
+			// Finest mip the last frame that used the texture asked for, the minimum mips once it goes idle
+			uint32_t WantedMip;
+			// Merged CPU requests and feedback of the frame being planned, UINT32_MAX when unused
+			uint32_t RequestedMip;
+			// What the budget allows this frame
+			uint32_t TargetMip;
+			uint64_t LastUsedFrame;
+			// Finest mip of the last eviction, for the thrash counter
+			uint32_t EvictedMip;
+			uint64_t EvictedFrame;
+			bool Active;
+		};
+
+		// Images and slots replaced or removed, destroyed once no frame in flight can use them
+		struct RetiredImage
+		{
+			StreamedImage Image;
+			uint64_t Ticket;
+			uint64_t FrameNumber;
+		};
+
+		struct StreamingBuffer
+		{
+			VulkanAllocation* Allocation;
+			uint32_t Index;
+		};
+
+		StreamingBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+		void DestroyBuffer(StreamingBuffer& buffer);
+		VkDeviceSize ComputeBudget() const;
+		void PlanTargets(VkDeviceSize budget);
+		// Creates the image for mips [mip, MipCount) and starts its uploads. Returns false if it couldn't.
+		bool StartReplacement(VulkanTextureHandle texture, uint32_t mip);
+		void Retire(const StreamedImage& image, uint64_t ticket);
+		void MarkDirty(VulkanTextureHandle texture);
+
+		VkDevice _device;
+		VulkanMemoryAllocator* _memory;
+		VulkanUploadQueue* _uploads;
+		VulkanBindlessHeap* _bindless;
+		uint32_t _framesInFlight;
+		uint32_t _frameIndex;
+		uint64_t _frameNumber;
+		// Largest device local heap, where the images live
+		uint32_t _heapIndex;
+		VkDeviceSize _budgetLimit;
+
+		// Shown while a texture's first image uploads
+		StreamedImage _fallback;
+
+		std::vector<TextureRecord> _textures;
+		std::vector<VulkanTextureHandle> _freeTextures;
+		std::vector<RetiredImage> _retired;
+		// Planning scratch, kept to avoid allocating every frame
+		std::vector<VulkanTextureHandle> _order;
+		std::vector<VulkanTextureHandle> _queue;
+
+		// The table on the GPU and the entries RecordUpdates has to copy from the records
+		StreamingBuffer _table;
+		std::vector<VulkanTextureHandle> _dirty;
+		std::vector<bool> _dirtyFlags;
+		std::vector<VkBufferCopy> _tableCopies;
+		// Finest mip per texture, cleared every frame, and a host readable copy per frame in flight
+		StreamingBuffer _feedback;
+		VulkanAllocation* _staging;
+		VulkanAllocation* _readback;
+
+		VkDeviceSize _residentBytes;
+		VkDeviceSize _pendingBytes;
+		VulkanTextureStreamingStats _stats;
+	};
+}
@@ -0,0 +1,489 @@
+#include "VulkanUploadQueue.h"
+#include "VulkanRenderer.h"
+#include "VulkanMemoryAllocator.h"
+#include "Allocators.h"
+#include "Logger.h"
+#include "vke_memory.h"
+#include "vke_profile.h"
+
+#include <cstring>
+
+namespace VKE
+{
+	// Copy offsets only need to be a multiple of the texel block size (and 4), which this covers for every
+	// format we upload.
+	static constexpr VkDeviceSize BUFFER_STAGING_ALIGNMENT = 16;
+	static constexpr VkDeviceSize IMAGE_STAGING_ALIGNMENT = 256;
+
+	static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	VulkanUploadQueue::VulkanUploadQueue(VkDevice device, VulkanMemoryAllocator* memory, VkQueue transferQueue, uint32_t transferFamily,
+		uint32_t graphicsFamily, VkDeviceSize stagingSize)
+		: _device(device), _memory(memory), _queue(transferQueue), _transferFamily(transferFamily), _graphicsFamily(graphicsFamily),
+		_stagingSize(stagingSize), _ringHead(0), _ringTail(0), _ringUsed(0), _nextValue(0), _completedValue(0),
+		_oldestBatch(0), _batchCount(0), _readyValue(0), _stats(), _completedBytes(0)
+	{
+		PROFILE_FUNCTION();
+
+		// Staging ring, mapped for its whole lifetime
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = stagingSize;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		_staging = _memory->CreateBuffer(bufferInfo, VulkanMemoryUsage::CpuToGpu);
+		if (!_staging) {
+			Logger::Fatal("Unable to allocate %llu bytes of upload staging memory", (unsigned long long)stagingSize);
+		}
+
+		VkSemaphoreTypeCreateInfo typeInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+		VkSemaphoreCreateInfo semaphoreInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		semaphoreInfo.pNext = &typeInfo;
+		VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, VK_ALLOCATOR, &_timeline));
+
+		// Like frames, each batch owns its pool so it can be reset wholesale once the batch has finished
+		for (auto& batch : _batches) {
+			VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			poolInfo.queueFamilyIndex = _transferFamily;
+			VK_CHECK(vkCreateCommandPool(_device, &poolInfo, VK_ALLOCATOR, &batch.CommandPool));
+
+			VkCommandBufferAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+			allocInfo.commandPool = batch.CommandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			VK_CHECK(vkAllocateCommandBuffers(_device, &allocInfo, &batch.CommandBuffer));
+
+			batch.Value = 0;
+			batch.RingEnd = 0;
+			batch.RingBytes = 0;
+			batch.Recording = false;
+			batch.Bytes = 0;
+		}
+
+		_stats.DedicatedQueue = NeedsOwnershipTransfer();
+		_lastFrame = std::chrono::steady_clock::now();
+		Logger::Info("Uploads use %s with a %llu MB staging ring", _stats.DedicatedQueue ? "a dedicated transfer queue" : "the graphics queue",
+			(unsigned long long)(stagingSize / (1024 * 1024)));
+	}
+
+	VulkanUploadQueue::~VulkanUploadQueue()
+	{
+		Flush();
+		if (_nextValue > 0) {
+			VkSemaphoreWaitInfo waitInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &_timeline;
+			waitInfo.pValues = &_nextValue;
+			VK_CHECK(vkWaitSemaphores(_device, &waitInfo, UINT64_MAX));
+		}
+
+		for (auto& batch : _batches) {
+			vkDestroyCommandPool(_device, batch.CommandPool, VK_ALLOCATOR);
+		}
+		vkDestroySemaphore(_device, _timeline, VK_ALLOCATOR);
+		_memory->Destroy(_staging);
+	}
+
+	VulkanUploadTicket VulkanUploadQueue::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		PROFILE_FUNCTION();
+		const auto requestTime = std::chrono::steady_clock::now();
+		const uint8_t* source = static_cast<const uint8_t*>(data);
+		char* staging = static_cast<char*>(_staging->MappedData);
+
+		// Half the ring at most, so one piece can be in flight while the next is written
+		const VkDeviceSize maxChunk = _stagingSize / 2;
+		VulkanUploadTicket ticket = 0;
+		while (size > 0) {
+			const VkDeviceSize chunk = size < maxChunk ? size : maxChunk;
+			VkDeviceSize stagingOffset;
+			Batch* batch = ReserveStaging(chunk, BUFFER_STAGING_ALIGNMENT, &stagingOffset);
+			if (!batch) {
+				return 0;
+			}
+
+			memcpy(staging + stagingOffset, source, chunk);
+			VkBufferCopy copy = {};
+			copy.srcOffset = stagingOffset;
+			copy.dstOffset = offset;
+			copy.size = chunk;
+			vkCmdCopyBuffer(batch->CommandBuffer, _staging->Buffer, buffer, 1, &copy);
+
+			Acquire acquire = {};
+			acquire.Buffer = buffer;
+			acquire.Offset = offset;
+			acquire.Size = chunk;
+			acquire.DstStage = dstStage;
+			acquire.DstAccess = dstAccess;
+			acquire.RequestTime = requestTime;
+			batch->Acquires.push_back(acquire);
+			batch->Bytes += chunk;
+			ticket = batch->Value;
+
+			source += chunk;
+			offset += chunk;
+			size -= chunk;
+		}
+		return ticket;
+	}
+
+	VulkanUploadTicket VulkanUploadQueue::UploadImage(VkImage image, const VkImageSubresourceRange& range, const VkBufferImageCopy* regions,
+		uint32_t regionCount, const void* data, VkDeviceSize size, VkImageLayout finalLayout,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		PROFILE_FUNCTION();
+		const auto requestTime = std::chrono::steady_clock::now();
+
+		VkDeviceSize stagingOffset;
+		Batch* batch = ReserveStaging(size, IMAGE_STAGING_ALIGNMENT, &stagingOffset);
+		if (!batch) {
+			return 0;
+		}
+		memcpy(static_cast<char*>(_staging->MappedData) + stagingOffset, data, size);
+
+		// Whatever the range held before is discarded
+		VkImageMemoryBarrier toTransfer = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		toTransfer.srcAccessMask = 0;
+		toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.image = image;
+		toTransfer.subresourceRange = range;
+		vkCmdPipelineBarrier(batch->CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &toTransfer);
+
+		ScratchScope scratch;
+		VkBufferImageCopy* copies = scratch.Allocate<VkBufferImageCopy>(regionCount);
+		for (uint32_t i = 0; i < regionCount; i++) {
+			copies[i] = regions[i];
+			copies[i].bufferOffset += stagingOffset;
+		}
+		vkCmdCopyBufferToImage(batch->CommandBuffer, _staging->Buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			regionCount, copies);
+
+		// The move to finalLayout is recorded with the release, or on its own when there is no ownership to transfer
+		Acquire acquire = {};
+		acquire.Image = image;
+		acquire.Range = range;
+		acquire.Layout = finalLayout;
+		acquire.DstStage = dstStage;
+		acquire.DstAccess = dstAccess;
+		acquire.RequestTime = requestTime;
+		batch->Acquires.push_back(acquire);
+		batch->Bytes += size;
+		return batch->Value;
+	}
+
+	void VulkanUploadQueue::BeginFrame()
+	{
+		PROFILE_FUNCTION();
+		Retire();
+
+		// Bandwidth counts bytes whose copies finished since the previous frame
+		const auto now = std::chrono::steady_clock::now();
+		const float64_t seconds = std::chrono::duration<float64_t>(now - _lastFrame).count();
+		_lastFrame = now;
+
+		_stats.FrameBytes = _completedBytes;
+		_stats.TotalBytes += _completedBytes;
+		if (seconds > 0.0) {
+			const float64_t bandwidth = (float64_t)_completedBytes / (1024.0 * 1024.0) / seconds;
+			_stats.BandwidthMBps = _stats.BandwidthMBps * 0.95 + bandwidth * 0.05;
+		}
+		_completedBytes = 0;
+	}
+
+	void VulkanUploadQueue::Flush()
+	{
+		if (_batchCount == 0 || !GetNewestBatch().Recording) {
+			return;
+		}
+
+		PROFILE_FUNCTION();
+		Batch& batch = GetNewestBatch();
+		RecordReleases(batch);
+		VK_CHECK(vkEndCommandBuffer(batch.CommandBuffer));
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &batch.Value;
+
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.CommandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &_timeline;
+		VK_CHECK(vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+		batch.Recording = false;
+	}
+
+	uint64_t VulkanUploadQueue::RecordAcquire(VkCommandBuffer commandBuffer, VkPipelineStageFlags* waitStages)
+	{
+		*waitStages = 0;
+		if (_ready.empty()) {
+			_stats.FrameUploads = 0;
+			return 0;
+		}
+
+		PROFILE_FUNCTION();
+		const auto now = std::chrono::steady_clock::now();
+		VkPipelineStageFlags dstStages = 0;
+		ScratchScope scratch;
+		VkBufferMemoryBarrier* bufferBarriers = scratch.Allocate<VkBufferMemoryBarrier>(_ready.size());
+		VkImageMemoryBarrier* imageBarriers = scratch.Allocate<VkImageMemoryBarrier>(_ready.size());
+		uint32_t bufferBarrierCount = 0;
+		uint32_t imageBarrierCount = 0;
+
+		for (const auto& acquire : _ready) {
+			dstStages |= acquire.DstStage;
+
+			const float64_t latencyMs = std::chrono::duration<float64_t, std::milli>(now - acquire.RequestTime).count();
+			_stats.LatencyMs = _stats.LatencyMs == 0.0 ? latencyMs : _stats.LatencyMs * 0.95 + latencyMs * 0.05;
+			if (latencyMs > _stats.PeakLatencyMs) {
+				_stats.PeakLatencyMs = latencyMs;
+			}
+
+			if (!NeedsOwnershipTransfer()) {
+				continue;
+			}
+
+			// Mirrors the release recorded on the transfer queue
+			if (acquire.Image) {
+				VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = acquire.DstAccess;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = acquire.Layout;
+				barrier.srcQueueFamilyIndex = _transferFamily;
+				barrier.dstQueueFamilyIndex = _graphicsFamily;
+				barrier.image = acquire.Image;
+				barrier.subresourceRange = acquire.Range;
+				imageBarriers[imageBarrierCount++] = barrier;
+			}
+			else {
+				VkBufferMemoryBarrier barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = acquire.DstAccess;
+				barrier.srcQueueFamilyIndex = _transferFamily;
+				barrier.dstQueueFamilyIndex = _graphicsFamily;
+				barrier.buffer = acquire.Buffer;
+				barrier.offset = acquire.Offset;
+				barrier.size = acquire.Size;
+				bufferBarriers[bufferBarrierCount++] = barrier;
+			}
+		}
+
+		// The source stage matches the stages the semaphore wait blocks, which chains the acquire after it
+		if (bufferBarrierCount > 0 || imageBarrierCount > 0) {
+			vkCmdPipelineBarrier(commandBuffer, dstStages, dstStages, 0, 0, nullptr,
+				bufferBarrierCount, bufferBarriers, imageBarrierCount, imageBarriers);
+		}
+
+		*waitStages = dstStages;
+		_stats.FrameUploads = (uint32_t)_ready.size();
+		_ready.clear();
+		return _readyValue;
+	}
+
+	void VulkanUploadQueue::Wait(VulkanUploadTicket ticket)
+	{
+		if (ticket <= _completedValue) {
+			return;
+		}
+
+		PROFILE_FUNCTION();
+		if (_batchCount > 0 && GetNewestBatch().Recording && ticket >= GetNewestBatch().Value) {
+			Flush();
+		}
+
+		VkSemaphoreWaitInfo waitInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &_timeline;
+		waitInfo.pValues = &ticket;
+		VK_CHECK(vkWaitSemaphores(_device, &waitInfo, UINT64_MAX));
+		Retire();
+	}
+
+	VulkanUploadQueue::Batch& VulkanUploadQueue::GetRecordingBatch()
+	{
+		if (_batchCount > 0 && GetNewestBatch().Recording) {
+			return GetNewestBatch();
+		}
+
+		if (_batchCount == VKE_UPLOAD_BATCH_COUNT) {
+			_stats.Stalls++;
+			WaitForOldestBatch();
+		}
+
+		_batchCount++;
+		Batch& batch = GetNewestBatch();
+		VK_CHECK(vkResetCommandPool(_device, batch.CommandPool, 0));
+
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK(vkBeginCommandBuffer(batch.CommandBuffer, &beginInfo));
+
+		// Values are handed out in submission order, so a ticket is known before its batch is flushed
+		batch.Value = ++_nextValue;
+		batch.RingEnd = _ringHead;
+		batch.RingBytes = 0;
+		batch.Recording = true;
+		batch.Bytes = 0;
+		batch.Acquires.clear();
+		return batch;
+	}
+
+	VulkanUploadQueue::Batch* VulkanUploadQueue::ReserveStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset)
+	{
+		if (size > _stagingSize) {
+			Logger::Error("Upload of %llu bytes does not fit the %llu byte staging ring", (unsigned long long)size, (unsigned long long)_stagingSize);
+			return nullptr;
+		}
+
+		// Opening the batch first: waiting for a free batch slot can also release staging space
+		Batch* batch = &GetRecordingBatch();
+		VkDeviceSize consumed;
+		while (!AllocateStaging(size, alignment, offset, &consumed)) {
+			_stats.Stalls++;
+			if (_batchCount == 1) {
+				// Only the recording batch holds staging space; submit it and start over once it is done
+				Flush();
+				WaitForOldestBatch();
+				batch = &GetRecordingBatch();
+			}
+			else {
+				WaitForOldestBatch();
+			}
+		}
+
+		batch->RingBytes += consumed;
+		batch->RingEnd = _ringHead;
+		return batch;
+	}
+
+	bool VulkanUploadQueue::AllocateStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* consumed)
+	{
+		if (_ringUsed == 0) {
+			_ringHead = 0;
+			_ringTail = 0;
+		}
+		else if (_ringHead == _ringTail) {
+			// Full
+			return false;
+		}
+
+		const VkDeviceSize start = AlignUp(_ringHead, alignment);
+		if (_ringHead > _ringTail || _ringUsed == 0) {
+			// Free space is the end of the ring and everything before the tail
+			if (start + size <= _stagingSize) {
+				*offset = start;
+			}
+			else if (size <= _ringTail) {
+				*offset = 0;
+			}
+			else {
+				return false;
+			}
+		}
+		else {
+			// Wrapped: free space is between the head and the tail
+			if (start + size > _ringTail) {
+				return false;
+			}
+			*offset = start;
+		}
+
+		// Skipping the end of the ring counts as used until the batch retires
+		*consumed = *offset >= _ringHead ? *offset + size - _ringHead : _stagingSize - _ringHead + size;
+		_ringHead = *offset + size;
+		_ringUsed += *consumed;
+		return true;
+	}
+
+	void VulkanUploadQueue::RecordReleases(Batch& batch)
+	{
+		// Without a family change the copies are published by the semaphore alone; images still need their
+		// final layout.
+		ScratchScope scratch;
+		VkBufferMemoryBarrier* bufferBarriers = scratch.Allocate<VkBufferMemoryBarrier>(batch.Acquires.size());
+		VkImageMemoryBarrier* imageBarriers = scratch.Allocate<VkImageMemoryBarrier>(batch.Acquires.size());
+		uint32_t bufferBarrierCount = 0;
+		uint32_t imageBarrierCount = 0;
+		for (const auto& acquire : batch.Acquires) {
+			if (acquire.Image) {
+				VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = acquire.Layout;
+				barrier.srcQueueFamilyIndex = NeedsOwnershipTransfer() ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = NeedsOwnershipTransfer() ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = acquire.Image;
+				barrier.subresourceRange = acquire.Range;
+				imageBarriers[imageBarrierCount++] = barrier;
+			}
+			else if (NeedsOwnershipTransfer()) {
+				VkBufferMemoryBarrier barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				barrier.srcQueueFamilyIndex = _transferFamily;
+				barrier.dstQueueFamilyIndex = _graphicsFamily;
+				barrier.buffer = acquire.Buffer;
+				barrier.offset = acquire.Offset;
+				barrier.size = acquire.Size;
+				bufferBarriers[bufferBarrierCount++] = barrier;
+			}
+		}
+
+		if (bufferBarrierCount > 0 || imageBarrierCount > 0) {
+			vkCmdPipelineBarrier(batch.CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+				bufferBarrierCount, bufferBarriers, imageBarrierCount, imageBarriers);
+		}
+	}
+
+	void VulkanUploadQueue::WaitForOldestBatch()
+	{
+		ASSERT_MSG(_batchCount > 0 && !_batches[_oldestBatch].Recording, "The oldest upload batch has not been submitted");
+
+		PROFILE_FUNCTION();
+		const uint64_t value = _batches[_oldestBatch].Value;
+		VkSemaphoreWaitInfo waitInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &_timeline;
+		waitInfo.pValues = &value;
+		VK_CHECK(vkWaitSemaphores(_device, &waitInfo, UINT64_MAX));
+		Retire();
+	}
+
+	void VulkanUploadQueue::Retire()
+	{
+		VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &_completedValue));
+
+		while (_batchCount > 0) {
+			Batch& batch = _batches[_oldestBatch];
+			if (batch.Recording || batch.Value > _completedValue) {
+				break;
+			}
+
+			_ready.insert(_ready.end(), batch.Acquires.begin(), batch.Acquires.end());
+			_readyValue = batch.Value;
+			_completedBytes += batch.Bytes;
+
+			_ringTail = batch.RingEnd;
+			_ringUsed -= batch.RingBytes;
+
+			_oldestBatch = (_oldestBatch + 1) % VKE_UPLOAD_BATCH_COUNT;
+			_batchCount--;
+		}
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <vector>
+
+#include "vke_types.h"
+
+#ifndef VKE_DEFAULT_STAGING_SIZE
+#define VKE_DEFAULT_STAGING_SIZE (32ull * 1024 * 1024)
+#endif
+
+#ifndef VKE_UPLOAD_BATCH_COUNT
+#define VKE_UPLOAD_BATCH_COUNT 4
+#endif
+
+namespace VKE
+{
+	class VulkanMemoryAllocator;
+	struct VulkanAllocation;
+
+	// Timeline value of the batch an upload was recorded into. 0 is never issued.
+	typedef uint64_t VulkanUploadTicket;
+
+	struct VulkanUploadStats
+	{
+		// Set when uploads run on a transfer-only queue family rather than the graphics queue
+		bool DedicatedQueue;
+		uint64_t FrameBytes;
+		uint32_t FrameUploads;
+		// Exponential moving averages, updated once per frame
+		float64_t BandwidthMBps;
+		// From the upload call until the graphics queue can use the data
+		float64_t LatencyMs;
+		float64_t PeakLatencyMs;
+		// Times the staging ring or batch slots were exhausted and the CPU had to wait for the GPU
+		uint64_t Stalls;
+		uint64_t TotalBytes;
+	};
+
+	// Streams data into device local resources through a persistently mapped staging ring. Copies run on the
+	// transfer queue and completion is tracked with a timeline semaphore; when the transfer queue belongs to
+	// another family, ownership is released there and acquired on the graphics queue once the copy is done,
+	// so the graphics queue never waits on an unfinished upload. Not thread safe; use from the render thread.
+	class VulkanUploadQueue
+	{
+	public:
+		VulkanUploadQueue(VkDevice device, VulkanMemoryAllocator* memory, VkQueue transferQueue, uint32_t transferFamily,
+			uint32_t graphicsFamily, VkDeviceSize stagingSize = VKE_DEFAULT_STAGING_SIZE);
+		~VulkanUploadQueue();
+
+		// dstStage and dstAccess describe how the graphics queue will first use the data. Buffers larger
+		// than the staging ring are split across batches; the returned ticket covers the last piece.
+		// Returns 0 if the upload can never fit. Destination buffers must not be movable.
+		VulkanUploadTicket UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+			VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		// Copies data into the image regions and leaves the image in finalLayout. Every region's bufferOffset
+		// is relative to data. The whole image upload has to fit in the staging ring.
+		VulkanUploadTicket UploadImage(VkImage image, const VkImageSubresourceRange& range, const VkBufferImageCopy* regions,
+			uint32_t regionCount, const void* data, VkDeviceSize size, VkImageLayout finalLayout,
+			VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		// Call once per frame before recording. Retires finished batches and frees their staging space.
+		void BeginFrame();
+		// Submits everything recorded since the last flush to the transfer queue.
+		void Flush();
+
+		// Records ownership acquires for every finished batch not yet handed to the graphics queue. Returns
+		// the timeline value the graphics submit has to wait on at waitStages, or 0 when there is nothing to
+		// wait for. The value has already been reached, so the wait only makes the copies visible.
+		uint64_t RecordAcquire(VkCommandBuffer commandBuffer, VkPipelineStageFlags* waitStages);
+
+		bool IsComplete(VulkanUploadTicket ticket) const { return ticket <= _completedValue; }
+		// Blocks until the ticket's batch has finished on the transfer queue. Flushes if needed.
+		void Wait(VulkanUploadTicket ticket);
+
+		VkSemaphore GetSemaphore() const { return _timeline; }
+		// The largest single image upload
+		VkDeviceSize GetStagingSize() const { return _stagingSize; }
+		const VulkanUploadStats& GetStats() const { return _stats; }
+
+	private:
+		struct Acquire
+		{
+			VkBuffer Buffer;
+			VkDeviceSize Offset;
+			VkDeviceSize Size;
+			VkImage Image;
+			VkImageSubresourceRange Range;
+			VkImageLayout Layout;
+			VkPipelineStageFlags DstStage;
+			VkAccessFlags DstAccess;
+			std::chrono::steady_clock::time_point RequestTime;
+		};
+
+		struct Batch
+		{
+			VkCommandPool CommandPool;
+			VkCommandBuffer CommandBuffer;
+			uint64_t Value;
+			// Staging ring position after this batch's data; the ring tail moves here once it completes
+			VkDeviceSize RingEnd;
+			// Staging bytes held by the batch, including alignment padding and the wasted end of the ring
+			VkDeviceSize RingBytes;
+			bool Recording;
+			uint64_t Bytes;
+			std::vector<Acquire> Acquires;
+		};
+
+		bool NeedsOwnershipTransfer() const { return _transferFamily != _graphicsFamily; }
+		Batch& GetNewestBatch() { return _batches[(_oldestBatch + _batchCount - 1) % VKE_UPLOAD_BATCH_COUNT]; }
+		Batch& GetRecordingBatch();
+		// Reserves staging space in the recording batch, waiting for older batches when the ring is full
+		Batch* ReserveStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+		bool AllocateStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* consumed);
+		void RecordReleases(Batch& batch);
+		void WaitForOldestBatch();
+		void Retire();
+
+		VkDevice _device;
+		VulkanMemoryAllocator* _memory;
+		VkQueue _queue;
+		uint32_t _transferFamily;
+		uint32_t _graphicsFamily;
+
+		VulkanAllocation* _staging;
+		VkDeviceSize _stagingSize;
+		// Ring of staging bytes: [_ringTail, _ringHead) is in use, wrapping at _stagingSize
+		VkDeviceSize _ringHead;
+		VkDeviceSize _ringTail;
+		VkDeviceSize _ringUsed;
+
+		VkSemaphore _timeline;
+		uint64_t _nextValue;
+		uint64_t _completedValue;
+
+		Batch _batches[VKE_UPLOAD_BATCH_COUNT];
+		// Batches in submission order, oldest first. Only the newest can still be recording.
+		uint32_t _oldestBatch;
+		uint32_t _batchCount;
+		// Uploads of finished batches, waiting for RecordAcquire
+		std::vector<Acquire> _ready;
+		uint64_t _readyValue;
+
+		VulkanUploadStats _stats;
+		uint64_t _completedBytes;
+		std::chrono::steady_clock::time_point _lastFrame;
+	};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of packed asset archives (.vkpak), shared by the engine and VKE.Packer.
+//
+// [ArchiveHeader][entry data, each aligned to ARCHIVE_DATA_ALIGNMENT][ArchiveEntry table][name strings]
+//
+// The entry table is sorted by NameHash so lookups are a binary search over the mapped file.
+// Uncompressed entries can be used in place; compressed entries use the LZ4 block format.
+namespace VKE {
+	constexpr uint32_t ARCHIVE_MAGIC = 0x41454B56; // "VKEA"
+	constexpr uint32_t ARCHIVE_VERSION = 1;
+	// Keeps SPIR-V (4-byte words) and most GPU upload alignments valid straight from the mapping.
+	constexpr uint32_t ARCHIVE_DATA_ALIGNMENT = 64;
+
+	enum ArchiveEntryFlags : uint32_t
+	{
+		ARCHIVE_ENTRY_COMPRESSED = 1 << 0
+	};
+
+	struct ArchiveHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t EntryCount;
+		uint32_t Reserved;
+		uint64_t EntriesOffset;
+		uint64_t NamesOffset;
+		uint64_t NamesSize;
+		uint64_t FileSize;
+	};
+
+	struct ArchiveEntry
+	{
+		uint64_t NameHash;     // HashBytes of the '/'-separated path
+		uint64_t ContentHash;  // HashBytes of the uncompressed data
+		uint64_t Offset;       // From the start of the file
+		uint64_t StoredSize;   // Bytes on disk
+		uint64_t Size;         // Bytes once decompressed
+		uint32_t NameOffset;   // Into the name table
+		uint32_t Flags;        // ArchiveEntryFlags
+	};
+
+	static_assert(sizeof(ArchiveHeader) == 48, "ArchiveHeader layout changed");
+	static_assert(sizeof(ArchiveEntry) == 48, "ArchiveEntry layout changed");
+}
@@ -18,7 +18,7 @@
 	#else
 		#define VKE_API _declspec(dllimport)
 	#endif
-#elif PLATFORM_LINUX || PLATFORM_MAC
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
 #define FORCEINLINE	inline
 #define FORCENOINLINE
 	#ifdef VKE_BUILD_LIB
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+namespace VKE {
+	// 64-bit FNV-1a. Not cryptographic; used for cache keys and content checks.
+	constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+	constexpr uint64_t HASH_PRIME = 1099511628211ull;
+
+	inline uint64_t HashBytes(const void* data, uint64_t size, uint64_t seed = HASH_SEED)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = seed;
+		for (uint64_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= HASH_PRIME;
+		}
+		return hash;
+	}
+
+	// Only for types without padding (scalars, enums, handles, packed Vulkan descriptions).
+	template<typename T>
+	inline uint64_t HashValue(uint64_t seed, const T& value)
+	{
+		return HashBytes(&value, sizeof(T), seed);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "vke_defs.h"
+
+// Memory tracking. Define ENABLE_MEMORY_TRACKING to attribute heap allocations to the subsystem that made
+// them and to route Vulkan host allocations through the tracker; otherwise every macro expands to nothing,
+// VK_ALLOCATOR to nullptr, and allocations carry no header.
+#ifdef ENABLE_MEMORY_TRACKING
+#include "MemoryTracker.h"
+
+#define MEMORY_CONCAT_INNER(a, b) a##b
+#define MEMORY_CONCAT(a, b) MEMORY_CONCAT_INNER(a, b)
+
+// Tags allocations on this thread until the end of the enclosing scope
+#define MEMORY_SCOPE(tag) ::VKE::MemoryTagScope MEMORY_CONCAT(_memoryScope, __LINE__)(::VKE::MemoryTag::tag)
+// Default tag for a thread the subsystem owns
+#define MEMORY_THREAD(tag) ::VKE::MemoryTracker::SetThreadTag(::VKE::MemoryTag::tag)
+// pAllocator for every vkCreate*, vkDestroy*, vkAllocateMemory and vkFreeMemory
+#define VK_ALLOCATOR ::VKE::MemoryTracker::GetVulkanCallbacks()
+
+#else
+#define MEMORY_SCOPE(tag)
+#define MEMORY_THREAD(tag)
+#define VK_ALLOCATOR nullptr
+#endif // ENABLE_MEMORY_TRACKING
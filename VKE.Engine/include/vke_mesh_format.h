@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of cooked meshes (.vkmesh), shared by the engine and VKE.Cooker.
+//
+// [MeshHeader][MeshAttribute table][vertex data][index data], the data blocks aligned to MESH_DATA_ALIGNMENT
+//
+// Vertices are interleaved and already in their GPU formats, and indices are in vertex-cache order, so both
+// blocks are uploaded straight from the mapping. Positions are quantized to the mesh bounds; the shader gets
+// them back with PositionOffset + PositionScale * position, which folds into the world matrix.
+namespace VKE {
+	constexpr uint32_t MESH_MAGIC = 0x4D454B56; // "VKEM"
+	constexpr uint32_t MESH_VERSION = 1;
+	constexpr uint32_t MESH_DATA_ALIGNMENT = 64;
+	constexpr uint32_t MESH_MAX_ATTRIBUTES = 8;
+
+	// Also the shader input location of the attribute
+	enum MeshSemantic : uint32_t
+	{
+		MESH_SEMANTIC_POSITION = 0,
+		MESH_SEMANTIC_NORMAL = 1,
+		MESH_SEMANTIC_TEXCOORD = 2,
+		MESH_SEMANTIC_COUNT
+	};
+
+	// VkFormat values, so the cooker needs no Vulkan headers
+	enum MeshFormat : uint32_t
+	{
+		MESH_FORMAT_R16G16_SNORM = 78,       // Octahedral normals
+		MESH_FORMAT_R16G16_SFLOAT = 83,      // Texture coordinates
+		MESH_FORMAT_R16G16B16A16_UNORM = 91  // Positions within the bounds, w unused
+	};
+
+	struct MeshAttribute
+	{
+		uint32_t Semantic;  // MeshSemantic
+		uint32_t Format;    // MeshFormat
+		uint32_t Offset;    // Within a vertex
+		uint32_t Reserved;
+	};
+
+	struct MeshHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t VertexCount;
+		uint32_t IndexCount;
+		uint32_t VertexStride;
+		uint32_t IndexSize;       // 2 or 4 bytes
+		uint32_t AttributeCount;
+		uint32_t Reserved;
+		float PositionOffset[3];  // Bounds minimum
+		float PositionScale[3];   // Bounds size
+		float BoundingSphere[4];  // Object space center and radius
+		uint64_t AttributesOffset;
+		uint64_t VertexDataOffset;
+		uint64_t IndexDataOffset;
+		uint64_t FileSize;
+	};
+
+	static_assert(sizeof(MeshAttribute) == 16, "MeshAttribute layout changed");
+	static_assert(sizeof(MeshHeader) == 104, "MeshHeader layout changed");
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "vke_defs.h"
+
+// CPU profiling markers. Define ENABLE_PROFILING to record scopes; otherwise every macro
+// expands to nothing and the markers cost nothing.
+#ifdef ENABLE_PROFILING
+#include "Profiler.h"
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_SCOPE(name) ::VKE::ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD(name) ::VKE::Profiler::SetThreadName(name)
+
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(name)
+#endif // ENABLE_PROFILING
@@ -1,14 +1,92 @@
 #include "Logger.h"
 #include "Engine.h"
+#include "VulkanRenderer.h"
+#include "JobBenchmark.h"
+#include "TransformBenchmark.h"
+#include "EntityBenchmark.h"
+#include "OcclusionBenchmark.h"
+#include "MeshBenchmark.h"
+#include "IOBenchmark.h"
+#include <cstring>
+#include <cstdlib>
 
 int main(int argc, const char ** argv) {
+	// --bench-jobs [workers], --bench-transforms [nodes], --bench-entities [count], --bench-occlusion [boxes]
+	// --bench-meshes [triangles] and --bench-io [reads] measure a subsystem instead of starting the engine
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench-jobs") == 0) {
+			VKE::RunJobBenchmark(i + 1 < argc ? (uint32_t)strtoul(argv[i + 1], nullptr, 10) : 0);
+			VKE::Logger::Shutdown();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-transforms") == 0) {
+			VKE::RunTransformBenchmark(i + 1 < argc ? (uint32_t)strtoul(argv[i + 1], nullptr, 10) : 100000);
+			VKE::Logger::Shutdown();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-entities") == 0) {
+			VKE::RunEntityBenchmark(i + 1 < argc ? (uint32_t)strtoul(argv[i + 1], nullptr, 10) : 1000000);
+			VKE::Logger::Shutdown();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-occlusion") == 0) {
+			VKE::RunOcclusionBenchmark(i + 1 < argc ? (uint32_t)strtoul(argv[i + 1], nullptr, 10) : 100000);
+			VKE::Logger::Shutdown();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-meshes") == 0) {
+			VKE::RunMeshBenchmark(i + 1 < argc ? (uint32_t)strtoul(argv[i + 1], nullptr, 10) : 1000000);
+			VKE::Logger::Shutdown();
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-io") == 0) {
+			VKE::RunIOBenchmark(i + 1 < argc ? (uint32_t)strtoul(argv[i + 1], nullptr, 10) : 4096);
+			VKE::Logger::Shutdown();
+			return 0;
+		}
+	}
+
 	VKE::Logger::Info("Initializing engine %d", 4);
 
-	VKE::Engine* engine = new VKE::Engine("VKE");
+	// --device <uuid|name> forces a GPU
+	// --present <immediate|mailbox|fifo|relaxed> and --images <count> pick the latency policy
+	// --bench-recording <draws> measures command recording instead of running the game loop
+	const char* deviceOverride = nullptr;
+	VKE::VulkanPresentPolicy presentPolicy = VKE::VulkanPresentPolicy::Mailbox;
+	uint32_t swapchainImages = 0;
+	uint32_t benchmarkDraws = 0;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--device") == 0) {
+			deviceOverride = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--present") == 0) {
+			const char* mode = argv[i + 1];
+			if (strcmp(mode, "immediate") == 0) presentPolicy = VKE::VulkanPresentPolicy::LowLatency;
+			else if (strcmp(mode, "fifo") == 0) presentPolicy = VKE::VulkanPresentPolicy::Fifo;
+			else if (strcmp(mode, "relaxed") == 0) presentPolicy = VKE::VulkanPresentPolicy::FifoRelaxed;
+			else presentPolicy = VKE::VulkanPresentPolicy::Mailbox;
+		}
+		else if (strcmp(argv[i], "--images") == 0) {
+			swapchainImages = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--bench-recording") == 0) {
+			benchmarkDraws = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+		}
+	}
+
+	VKE::Engine* engine = new VKE::Engine("VKE", deviceOverride);
+	engine->GetRenderer()->SetPresentPolicy(presentPolicy, swapchainImages);
 
-	engine->Run();
+	if (benchmarkDraws > 0) {
+		engine->GetRenderer()->BenchmarkRecording(benchmarkDraws);
+	}
+	else {
+		engine->Run();
+	}
 
 	delete engine;
 
+	VKE::Logger::Shutdown();
+
 	return 0;
 }
\ No newline at end of file
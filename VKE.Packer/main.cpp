@@ -0,0 +1,219 @@
+// Packs loose asset files into a .vkpak archive (see vke_archive_format.h).
+//
+// Usage: VKE.Packer -o <archive> -r <root> [-z <extension>]... <path>...
+//   -o  output archive
+//   -r  root directory; entry names are stored relative to it with '/' separators
+//   -z  compress entries with this extension (e.g. -z .json). Everything else, SPIR-V included,
+//       is stored uncompressed so the engine can use it straight from the mapping.
+//   Paths are files or directories (walked recursively) under the root.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Compression.h"
+#include "vke_archive_format.h"
+#include "vke_hash.h"
+
+namespace fs = std::filesystem;
+using namespace VKE;
+
+struct PackEntry
+{
+	std::string Name;
+	fs::path Path;
+	std::vector<uint8_t> Stored;
+	ArchiveEntry Entry;
+};
+
+static bool ReadFile(const fs::path& path, std::vector<uint8_t>* data)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	data->resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(data->data()), data->size());
+	return !file.fail();
+}
+
+static void WritePadding(std::ofstream& file, uint64_t* offset, uint64_t alignment)
+{
+	static const char zeros[ARCHIVE_DATA_ALIGNMENT] = {};
+	const uint64_t padding = (alignment - (*offset % alignment)) % alignment;
+	file.write(zeros, padding);
+	*offset += padding;
+}
+
+static void PrintUsage()
+{
+	printf("Usage: VKE.Packer -o <archive> -r <root> [-z <extension>]... <path>...\n");
+}
+
+int main(int argc, const char** argv)
+{
+	const char* output = nullptr;
+	fs::path root = ".";
+	std::vector<std::string> compressExtensions;
+	std::vector<fs::path> inputs;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			root = argv[++i];
+		}
+		else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+			compressExtensions.push_back(argv[++i]);
+		}
+		else if (argv[i][0] == '-') {
+			PrintUsage();
+			return 1;
+		}
+		else {
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	if (!output || inputs.empty()) {
+		PrintUsage();
+		return 1;
+	}
+
+	// Gather files
+	std::vector<PackEntry> entries;
+	for (auto& input : inputs) {
+		const fs::path path = root / input;
+		std::vector<fs::path> files;
+		if (fs::is_directory(path)) {
+			for (auto& item : fs::recursive_directory_iterator(path)) {
+				if (item.is_regular_file()) {
+					files.push_back(item.path());
+				}
+			}
+		}
+		else if (fs::is_regular_file(path)) {
+			files.push_back(path);
+		}
+		else {
+			printf("Input not found: %s\n", path.string().c_str());
+			return 1;
+		}
+
+		for (auto& file : files) {
+			PackEntry entry = {};
+			entry.Path = file;
+			entry.Name = fs::relative(file, root).generic_string();
+			entries.push_back(std::move(entry));
+		}
+	}
+
+	// Read, hash and optionally compress
+	uint64_t totalSize = 0;
+	uint64_t totalStored = 0;
+	for (auto& entry : entries) {
+		std::vector<uint8_t> data;
+		if (!ReadFile(entry.Path, &data)) {
+			printf("Unable to read %s\n", entry.Path.string().c_str());
+			return 1;
+		}
+
+		entry.Entry.NameHash = HashBytes(entry.Name.data(), entry.Name.size());
+		entry.Entry.ContentHash = HashBytes(data.data(), data.size());
+		entry.Entry.Size = data.size();
+		entry.Entry.Flags = 0;
+
+		const std::string extension = entry.Path.extension().string();
+		const bool compress = std::find(compressExtensions.begin(), compressExtensions.end(), extension) != compressExtensions.end();
+		if (compress && !data.empty()) {
+			std::vector<uint8_t> compressed(Compression::Lz4CompressBound(data.size()));
+			const uint64_t compressedSize = Compression::Lz4Compress(data.data(), data.size(), compressed.data(), compressed.size());
+			// Only worth decompressing at load time if it saves at least an eighth.
+			if (compressedSize > 0 && compressedSize < data.size() - data.size() / 8) {
+				compressed.resize(compressedSize);
+				entry.Stored = std::move(compressed);
+				entry.Entry.Flags |= ARCHIVE_ENTRY_COMPRESSED;
+			}
+		}
+		if (!(entry.Entry.Flags & ARCHIVE_ENTRY_COMPRESSED)) {
+			entry.Stored = std::move(data);
+		}
+		entry.Entry.StoredSize = entry.Stored.size();
+
+		totalSize += entry.Entry.Size;
+		totalStored += entry.Entry.StoredSize;
+	}
+
+	// The engine binary-searches the table by name hash
+	std::sort(entries.begin(), entries.end(), [](const PackEntry& a, const PackEntry& b) {
+		return a.Entry.NameHash != b.Entry.NameHash ? a.Entry.NameHash < b.Entry.NameHash : a.Name < b.Name;
+	});
+
+	const fs::path tempOutput = std::string(output) + ".tmp";
+	std::ofstream file(tempOutput, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		printf("Unable to write %s\n", tempOutput.string().c_str());
+		return 1;
+	}
+
+	// Data
+	ArchiveHeader header = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	uint64_t offset = sizeof(header);
+	for (auto& entry : entries) {
+		WritePadding(file, &offset, ARCHIVE_DATA_ALIGNMENT);
+		entry.Entry.Offset = offset;
+		file.write(reinterpret_cast<const char*>(entry.Stored.data()), entry.Stored.size());
+		offset += entry.Stored.size();
+	}
+
+	// Names
+	std::string names;
+	for (auto& entry : entries) {
+		entry.Entry.NameOffset = (uint32_t)names.size();
+		names.append(entry.Name);
+		names.push_back('\0');
+	}
+
+	// Table of contents
+	WritePadding(file, &offset, ARCHIVE_DATA_ALIGNMENT);
+	header.EntriesOffset = offset;
+	for (auto& entry : entries) {
+		file.write(reinterpret_cast<const char*>(&entry.Entry), sizeof(ArchiveEntry));
+		offset += sizeof(ArchiveEntry);
+	}
+
+	header.NamesOffset = offset;
+	header.NamesSize = names.size();
+	file.write(names.data(), names.size());
+	offset += names.size();
+
+	header.Magic = ARCHIVE_MAGIC;
+	header.Version = ARCHIVE_VERSION;
+	header.EntryCount = (uint32_t)entries.size();
+	header.FileSize = offset;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.close();
+	if (file.fail()) {
+		printf("Failed writing %s\n", tempOutput.string().c_str());
+		return 1;
+	}
+
+	std::error_code error;
+	fs::rename(tempOutput, output, error);
+	if (error) {
+		printf("Unable to replace %s: %s\n", output, error.message().c_str());
+		return 1;
+	}
+
+	printf("Packed %u entries into %s (%llu bytes of assets, %llu stored, %llu total)\n", header.EntryCount, output,
+		(unsigned long long)totalSize, (unsigned long long)totalStored, (unsigned long long)header.FileSize);
+	return 0;
+}
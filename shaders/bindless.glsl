@@ -0,0 +1,15 @@
+// Bindless resources, matching VulkanBindlessHeap. Index with the values passed in push constants,
+// wrapped in nonuniformEXT when the index can differ within a draw.
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform texture2D Textures[];
+layout(set = 0, binding = 1) readonly buffer Buffers { uint Data[]; } BufferHeap[];
+layout(set = 0, binding = 2) uniform sampler Samplers[];
+
+// Implicit LOD needs derivatives, which compute shaders don't have; they define BINDLESS_NO_SAMPLING
+#ifndef BINDLESS_NO_SAMPLING
+vec4 SampleTexture(uint textureIndex, uint samplerIndex, vec2 uv)
+{
+	return texture(sampler2D(Textures[nonuniformEXT(textureIndex)], Samplers[nonuniformEXT(samplerIndex)]), uv);
+}
+#endif
@@ -0,0 +1,59 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#define BINDLESS_NO_SAMPLING
+#include "bindless.glsl"
+#include "scene.glsl"
+
+// VKE_GPU_SCENE_CULL_GROUP_SIZE
+layout(local_size_x = 64) in;
+
+// Appends visible instances to a packed list for vkCmdDrawIndexedIndirectCount. Without it every instance
+// keeps its own command and hidden ones get an instance count of 0.
+layout(constant_id = 0) const bool COMPACT = true;
+
+layout(set = 0, binding = 1) readonly buffer BoundsBuffers { Bounds Data[]; } BoundsHeap[];
+layout(set = 0, binding = 1) readonly buffer MeshBuffers { Mesh Data[]; } MeshHeap[];
+layout(set = 0, binding = 1) writeonly buffer DrawBuffers { DrawCommand Data[]; } DrawHeap[];
+layout(set = 0, binding = 1) buffer CountBuffers { uint Value; } CountHeap[];
+
+layout(push_constant) uniform CullConstants {
+	// Normalized, pointing inwards
+	vec4 Planes[6];
+	uint InstanceCount;
+	uint BoundsBuffer;
+	uint MeshBuffer;
+	uint DrawBuffer;
+	uint CountBuffer;
+} pc;
+
+void main() {
+	const uint instance = gl_GlobalInvocationID.x;
+	if (instance >= pc.InstanceCount) {
+		return;
+	}
+
+	Bounds bounds = BoundsHeap[pc.BoundsBuffer].Data[instance];
+	Mesh mesh = Mesh(0u, 0u, 0, 0u);
+	bool visible = bounds.Mesh != 0xFFFFFFFFu;
+	if (visible) {
+		mesh = MeshHeap[pc.MeshBuffer].Data[bounds.Mesh];
+		// Zero until the mesh's geometry has arrived
+		visible = mesh.IndexCount > 0;
+	}
+	for (int i = 0; i < 6 && visible; i++) {
+		visible = dot(pc.Planes[i].xyz, bounds.Sphere.xyz) + pc.Planes[i].w >= -bounds.Sphere.w;
+	}
+
+	// The count is kept on both paths for the visible instance stats
+	uint slot = instance;
+	if (visible) {
+		const uint index = atomicAdd(CountHeap[pc.CountBuffer].Value, 1u);
+		if (COMPACT) {
+			slot = index;
+		}
+	}
+	if (visible || !COMPACT) {
+		DrawHeap[pc.DrawBuffer].Data[slot] = DrawCommand(mesh.IndexCount, visible ? 1u : 0u, mesh.FirstIndex, mesh.VertexOffset, instance);
+	}
+}
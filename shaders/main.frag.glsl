@@ -1,8 +1,60 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "bindless.glsl"
+#include "streaming.glsl"
+
+// Specialization constants, set per variant by VulkanShader
+layout(constant_id = 0) const bool ENABLE_BANDING = false;
+layout(constant_id = 1) const int BAND_COUNT = 8;
+layout(constant_id = 2) const float INTENSITY = 1.0;
+
+// Shared with main.vert.glsl
+layout(push_constant) uniform DrawConstants {
+	mat4 ViewProjection;
+	uint VertexBuffer;
+	uint InstanceBuffer;
+	uint TextureTable;
+	uint TextureFeedback;
+	uint TextureSampler;
+	uint FrameNumber;
+} pc;
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec3 inObjectPosition;
+layout(location = 2) flat in uint inTexture;
 
 layout(location = 0) out vec4 outColor;
 
+// Meshes have positions only, so textures are projected along the object space axis the face points down
+vec2 ProjectTextureCoordinates(vec3 position)
+{
+	const vec3 normal = abs(cross(dFdx(position), dFdy(position)));
+	if (normal.x >= normal.y && normal.x >= normal.z) {
+		return position.zy + 0.5;
+	}
+	if (normal.y >= normal.z) {
+		return position.xz + 0.5;
+	}
+	return position.xy + 0.5;
+}
+
 void main() {
-	outColor = vec4(1.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
+	vec4 color = inColor;
+	// inTexture is flat, so the whole quad takes the same branch and derivatives stay valid inside it
+	if (inTexture != 0xFFFFFFFFu && pc.TextureTable != 0xFFFFFFFFu) {
+		const vec2 uv = ProjectTextureCoordinates(inObjectPosition);
+		color *= SampleStreamedTexture(pc.TextureTable, inTexture, pc.TextureSampler, uv);
+		if (pc.TextureFeedback != 0xFFFFFFFFu) {
+			WriteTextureFeedback(pc.TextureTable, pc.TextureFeedback, inTexture, uv, pc.FrameNumber);
+		}
+	}
+
+	float shade = INTENSITY;
+	if (ENABLE_BANDING) {
+		// Folded away entirely in variants that leave banding off
+		shade *= floor(fract(gl_FragCoord.y / 64.0) * float(BAND_COUNT)) / float(BAND_COUNT);
+	}
+	outColor = vec4(color.rgb * shade, color.a);
+}
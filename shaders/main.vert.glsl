@@ -1,11 +1,32 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-vec3 positions[3] = vec3[] (
-	vec3(-0.5, -0.5, -0.0),
-	vec3(0.5, -0.5, 0.0),
-	vec3(0.5, 0.5, 0.0)
-);
+#include "bindless.glsl"
+#include "scene.glsl"
 
+// Shared with main.frag.glsl
+layout(push_constant) uniform DrawConstants {
+	mat4 ViewProjection;
+	uint VertexBuffer;
+	uint InstanceBuffer;
+	uint TextureTable;
+	uint TextureFeedback;
+	uint TextureSampler;
+	uint FrameNumber;
+} pc;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec3 outObjectPosition;
+layout(location = 2) flat out uint outTexture;
+
+// No vertex input: indexed draws pull positions from the scene's vertex buffer, and firstInstance of each
+// command is the instance's slot
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 1.0);
-}
\ No newline at end of file
+	Instance instance = InstanceHeap[pc.InstanceBuffer].Data[gl_InstanceIndex];
+	Vertex vertex = VertexHeap[pc.VertexBuffer].Data[gl_VertexIndex];
+	const vec3 position = vec3(vertex.X, vertex.Y, vertex.Z);
+	gl_Position = pc.ViewProjection * vec4(TransformPoint(instance, position), 1.0);
+	outColor = instance.Color;
+	outObjectPosition = position;
+	outTexture = instance.Texture;
+}
@@ -0,0 +1,54 @@
+// Scene data, matching VulkanGpuScene. The buffers are slots of the bindless buffer array (binding 1),
+// redeclared here with their real layouts.
+
+struct Instance {
+	// World transform, rows of a 3x4 matrix
+	vec4 Rows[3];
+	vec4 Color;
+	// Slot in the streaming table, 0xFFFFFFFF for untextured instances
+	uint Texture;
+	uint Padding0;
+	uint Padding1;
+	uint Padding2;
+};
+
+struct Bounds {
+	// World space center and radius
+	vec4 Sphere;
+	// 0xFFFFFFFF for free slots
+	uint Mesh;
+	uint Padding0;
+	uint Padding1;
+	uint Padding2;
+};
+
+struct Mesh {
+	uint IndexCount;
+	uint FirstIndex;
+	int VertexOffset;
+	uint Padding;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+	uint IndexCount;
+	uint InstanceCount;
+	uint FirstIndex;
+	int VertexOffset;
+	uint FirstInstance;
+};
+
+struct Vertex {
+	float X;
+	float Y;
+	float Z;
+};
+
+layout(set = 0, binding = 1) readonly buffer InstanceBuffers { Instance Data[]; } InstanceHeap[];
+layout(set = 0, binding = 1) readonly buffer VertexBuffers { Vertex Data[]; } VertexHeap[];
+
+vec3 TransformPoint(Instance instance, vec3 position)
+{
+	const vec4 p = vec4(position, 1.0);
+	return vec3(dot(instance.Rows[0], p), dot(instance.Rows[1], p), dot(instance.Rows[2], p));
+}
@@ -0,0 +1,39 @@
+// Streamed textures, matching VulkanTextureStreamer. Include after bindless.glsl; the table and feedback
+// buffers are slots of the bindless buffer array (binding 1), passed in push constants.
+//
+// Writing feedback needs fragmentStoresAndAtomics. Without it the streamer has no feedback buffer and only
+// CPU requests decide what streams in, so shaders skip WriteTextureFeedback.
+
+struct StreamedTexture {
+	// Bindless image holding mips ResidentMip and coarser
+	uint Image;
+	uint ResidentMip;
+	// Size of mip 0
+	vec2 Size;
+};
+
+layout(set = 0, binding = 1) readonly buffer StreamedTextureBuffers { StreamedTexture Data[]; } StreamedTextureHeap[];
+layout(set = 0, binding = 1) buffer TextureFeedbackBuffers { uint Data[]; } TextureFeedbackHeap[];
+
+// The image only holds the resident mips, so implicit LOD already picks the right level of it
+vec4 SampleStreamedTexture(uint tableBuffer, uint textureIndex, uint samplerIndex, vec2 uv)
+{
+	const StreamedTexture entry = StreamedTextureHeap[tableBuffer].Data[textureIndex];
+	return texture(sampler2D(Textures[nonuniformEXT(entry.Image)], Samplers[nonuniformEXT(samplerIndex)]), uv);
+}
+
+// Reports the finest mip of the full texture this pixel would sample. One pixel in each 4x4 block writes,
+// rotating with the frame, which keeps the atomics cheap and still covers every surface within 16 frames.
+void WriteTextureFeedback(uint tableBuffer, uint feedbackBuffer, uint textureIndex, vec2 uv, uint frame)
+{
+	// Derivatives ahead of the branch, while the whole quad is still active
+	const vec2 size = StreamedTextureHeap[tableBuffer].Data[textureIndex].Size;
+	const vec2 dx = dFdx(uv) * size;
+	const vec2 dy = dFdy(uv) * size;
+	const uvec2 pixel = uvec2(gl_FragCoord.xy) & 3u;
+	if (pixel.x + pixel.y * 4u != (frame & 15u)) {
+		return;
+	}
+	const float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+	atomicMin(TextureFeedbackHeap[feedbackBuffer].Data[textureIndex], uint(lod));
+}
@@ -5,14 +5,29 @@ if not exist %SHADERS_BUILD_DIR% mkdir %SHADERS_BUILD_DIR%
 set GLSLC=%VK_SDK_PATH%\Bin\glslc.exe
 echo Compiling shaders...
 
+REM Only the stages are compiled; bindless.glsl, scene.glsl and streaming.glsl are built into the stages that
+REM include them, found through -I
+
 REM Vert shaders
 for /r %SHADERS_SRC_DIR% %%f in (*.vert.glsl) do (
 	echo "%SHADERS_SRC_DIR%\%%~nxf -> %SHADERS_BUILD_DIR%\%%~nf.spv"
-	call %GLSLC% -fshader-stage=vert %SHADERS_SRC_DIR%\%%~nxf -o %SHADERS_BUILD_DIR%\%%~nf.spv
+	call %GLSLC% -I %SHADERS_SRC_DIR% -fshader-stage=vert %SHADERS_SRC_DIR%\%%~nxf -o %SHADERS_BUILD_DIR%\%%~nf.spv
 )
 
 REM Frag shaders
 for /r %SHADERS_SRC_DIR% %%f in (*.frag.glsl) do (
 	echo "%SHADERS_SRC_DIR%\%%~nxf -> %SHADERS_BUILD_DIR%\%%~nf.spv"
-	call %GLSLC% -fshader-stage=frag %SHADERS_SRC_DIR%\%%~nxf -o %SHADERS_BUILD_DIR%\%%~nf.spv
-)
\ No newline at end of file
+	call %GLSLC% -I %SHADERS_SRC_DIR% -fshader-stage=frag %SHADERS_SRC_DIR%\%%~nxf -o %SHADERS_BUILD_DIR%\%%~nf.spv
+)
+
+REM Compute shaders
+for /r %SHADERS_SRC_DIR% %%f in (*.comp.glsl) do (
+	echo "%SHADERS_SRC_DIR%\%%~nxf -> %SHADERS_BUILD_DIR%\%%~nf.spv"
+	call %GLSLC% -I %SHADERS_SRC_DIR% -fshader-stage=comp %SHADERS_SRC_DIR%\%%~nxf -o %SHADERS_BUILD_DIR%\%%~nf.spv
+)
+
+REM Release builds read shaders from the packed archive instead of loose files
+if /i "%1"=="release" (
+	echo Packing assets...
+	call ..\build\VKE.Packer.exe -o ..\build\assets.vkpak -r ..\build shaders
+)